@@ -0,0 +1,176 @@
+#ifndef GOOFY_BENCHMARKS_H
+#define GOOFY_BENCHMARKS_H
+
+#include "../goofy.h"
+
+#include <algorithm>
+
+namespace benchmarks {
+
+	/// <summary>
+	/// Gets the time in seconds elapsed since the benchmarks started.
+	/// </summary>
+	double Now();
+
+	/// <summary>
+	/// Gets the presenter description benchmarks start from.
+	/// </summary>
+	goofy::PresenterDescription DefaultDescription();
+
+	/// <summary>
+	/// Creates a presenter and loads a technique in it, created with the arguments specified.
+	/// </summary>
+	template<typename T, typename ...A>
+	std::shared_ptr<goofy::Presenter> CreatePresenter(const goofy::PresenterDescription& description, std::shared_ptr<T>& technique, A ...args) {
+		std::shared_ptr<goofy::Presenter> presenter;
+		goofy::Presenter::CreateNew(description, presenter);
+		presenter->LoadTechnique(technique, args...);
+		return presenter;
+	}
+
+	/// <summary>
+	/// Renders frames dispatching the technique in each one. Returns the elapsed seconds, and the slowest frame if requested.
+	/// </summary>
+	template<typename T>
+	double RunFrames(const std::shared_ptr<goofy::Presenter>& presenter, const std::shared_ptr<T>& technique, int frames, double* worstFrame = nullptr) {
+		double start = Now();
+		double frameStart = start;
+		for (int i = 0; i < frames; i++) {
+			presenter->BeginFrame();
+			presenter->DispatchTechnique(technique);
+			presenter->EndFrame();
+			if (worstFrame != nullptr) {
+				double frameEnd = Now();
+				*worstFrame = std::max(*worstFrame, frameEnd - frameStart);
+				frameStart = frameEnd;
+			}
+		}
+		return Now() - start;
+	}
+
+	/// <summary>
+	/// Gets the peak resident memory of the process in megabytes.
+	/// </summary>
+	double PeakResidentMemory();
+
+	/// <summary>
+	/// Prints a single measure of a benchmark and keeps it for the results file.
+	/// </summary>
+	void Report(const char* benchmark, const char* metric, double value, const char* unit);
+
+	/// <summary>
+	/// Builds the SPIR-V of an empty compute shader. Every local size gives a different module, so the driver compiles each one.
+	/// </summary>
+	std::vector<unsigned int> EmptyComputeShader(unsigned int localSizeX);
+
+	/// <summary>
+	/// Measures the total time to stream a multi-gigabyte set of buffers and the worst frame time while loading.
+	/// </summary>
+	void StreamingUpload();
+
+	/// <summary>
+	/// Measures the load time and the peak resident memory while importing a large asset file into a buffer.
+	/// </summary>
+	void AssetImport();
+
+	/// <summary>
+	/// Compares the frame rate with and without reading back the render target every frame.
+	/// </summary>
+	void FrameReadback();
+
+	/// <summary>
+	/// Compares the frame rate without output against writing every frame in each output format.
+	/// </summary>
+	void FrameOutput();
+
+	/// <summary>
+	/// Compares the CPU cost of binding resources through the descriptor heap with few and many registered textures.
+	/// </summary>
+	void BindlessBinding();
+
+	/// <summary>
+	/// Compares the CPU cost of recording commands on resources passed as wrappers and as pool handles.
+	/// </summary>
+	void HandlePassing();
+
+	/// <summary>
+	/// Compares the startup time creating a set of pipelines without and with the pipeline cache file.
+	/// </summary>
+	void PipelineCacheStartup();
+
+	/// <summary>
+	/// Measures the time from dispatching an empty process until its population completes, for each dispatch mode.
+	/// </summary>
+	void DispatchLatency();
+
+	/// <summary>
+	/// Measures the frame time and the cost per dispatch with an increasing number of empty processes per frame.
+	/// </summary>
+	void DispatchThroughput();
+
+	/// <summary>
+	/// Measures the cost of flushing a populated process and the round trip until the gpu signals it.
+	/// </summary>
+	void FlushLatency();
+
+	/// <summary>
+	/// Measures the cost of building and waiting chains of GPU tasks combined one by one.
+	/// </summary>
+	void CombineChains();
+
+	/// <summary>
+	/// Measures the cost of empty BeginFrame and EndFrame calls for different numbers of frames in fly.
+	/// </summary>
+	void FrameOverhead();
+
+	/// <summary>
+	/// Measures the frame time populating processes asynchronously in frame with an increasing number of frame threads.
+	/// </summary>
+	void FrameThreadScaling();
+
+	/// <summary>
+	/// Measures how much capturing slows frames down and the frame time replaying the capture as fast as possible.
+	/// </summary>
+	void CaptureReplay();
+
+	/// <summary>
+	/// Checks every conversion kernel supported by the CPU against the scalar reference and measures their throughput.
+	/// </summary>
+	void FormatConversion();
+
+	/// <summary>
+	/// Measures the block compression encoder throughput and quality for each format and preset, and the upload time and device memory of a BC7 texture against RGBA8.
+	/// </summary>
+	void BlockCompression();
+
+	/// <summary>
+	/// Measures the GPU time of generating the mip chain of a 4096x4096 image on the compute path and the blit path, and of a 256^3 volume.
+	/// </summary>
+	void MipGeneration();
+
+	/// <summary>
+	/// Measures the CPU BVH builder throughput from small to large meshes, and the time and memory of building the structures of 2000 meshes on the device.
+	/// </summary>
+	void AccelerationStructureBuild();
+
+	/// <summary>
+	/// Measures the time of updating 200 twisting dynamic structures every frame against rebuilding them, and how often degraded structures are rebuilt.
+	/// </summary>
+	void AccelerationStructureRefit();
+
+	/// <summary>
+	/// Measures the CPU cost per dispatch of recording shuffled dispatches of 16 pipelines one by one and as a sorted batch, and of indirect dispatches.
+	/// </summary>
+	void ComputeDispatchRecording();
+	/// <summary>
+	/// Measures the CPU time per frame of recording frustum culling and indirect draws of 10k, 100k and 1M instances, flat in the number of instances, and their GPU time.
+	/// </summary>
+	void GPUDrivenDraws();
+
+	/// <summary>
+	/// Replays a capture file at a speed (0 as fast as possible) and reports its frame times.
+	/// </summary>
+	void ReplayCapture(const char* path, double speed);
+}
+
+#endif
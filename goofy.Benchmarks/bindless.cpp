@@ -0,0 +1,64 @@
+#include "benchmarks.h"
+
+using namespace goofy;
+
+namespace benchmarks {
+
+	struct BindingTechnique : public Technique {
+		int TextureCount;
+		int DrawsPerFrame;
+		std::vector<Image2D> Textures;
+		double BindingTime = 0;
+
+		BindingTechnique(int textureCount, int drawsPerFrame) : TextureCount(textureCount), DrawsPerFrame(drawsPerFrame) { }
+
+		virtual void OnLoad() override {
+			Image2DDescription description = {};
+			description.Format = Formats::R8G8B8A8::UNORM_Handle();
+			description.width = 64;
+			description.height = 64;
+			description.Usage.Sampled = true;
+			description.Usage.TransferDestination = true;
+			for (int i = 0; i < TextureCount; i++)
+				Textures.push_back(Create(description));
+		}
+
+		// Every draw references a different texture, as a material system would.
+		void Binding(GraphicsManager manager) {
+			double start = Now();
+			for (int i = 0; i < DrawsPerFrame; i++) {
+				GraphicsBinder binder;
+				binder.Set(0, Textures[i % TextureCount]);
+				binder.Set(1, (unsigned int)i);
+				manager.Set(binder);
+			}
+			BindingTime += Now() - start;
+		}
+
+		virtual void OnDispatch() override
+		{
+			Dispatch_Method(Binding);
+		}
+	};
+
+	// Returns the CPU time per bind in nanoseconds.
+	static double BindCost(int textureCount, int frames) {
+		const int drawsPerFrame = 4096;
+
+		std::shared_ptr<BindingTechnique> technique;
+		std::shared_ptr<Presenter> presenter = CreatePresenter(DefaultDescription(), technique, textureCount, drawsPerFrame);
+		RunFrames(presenter, technique, frames);
+		return technique->BindingTime * 1e9 / ((double)frames * drawsPerFrame);
+	}
+
+	void BindlessBinding() {
+		const int frames = 500;
+
+		double few = BindCost(16, frames);
+		double many = BindCost(4096, frames);
+
+		Report("bindless_binding", "bind_cost_16_textures", few, "ns");
+		Report("bindless_binding", "bind_cost_4096_textures", many, "ns");
+		Report("bindless_binding", "cost_ratio", many / few, "x");
+	}
+}
@@ -0,0 +1,216 @@
+#include "benchmarks.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+using namespace goofy;
+
+namespace benchmarks {
+
+	// Decodes the blocks written by the encoder to measure its quality. BC7 blocks are always mode 6.
+
+	static unsigned long long ReadBits(const unsigned char* data, int position, int bits) {
+		unsigned long long value = 0;
+		for (int i = 0; i < bits; i++, position++)
+			value |= (unsigned long long)((data[position >> 3] >> (position & 7)) & 1) << i;
+		return value;
+	}
+
+	static void DecodeBC1(const unsigned char* block, bool fourColors, unsigned char texels[16][4]) {
+		unsigned int c0 = (unsigned int)ReadBits(block, 0, 16), c1 = (unsigned int)ReadBits(block, 16, 16);
+		int palette[4][4];
+		unsigned int colors[2] = { c0, c1 };
+		for (int e = 0; e < 2; e++) {
+			int r = (colors[e] >> 11) & 31, g = (colors[e] >> 5) & 63, b = colors[e] & 31;
+			palette[e][0] = (r << 3) | (r >> 2);
+			palette[e][1] = (g << 2) | (g >> 4);
+			palette[e][2] = (b << 3) | (b >> 2);
+			palette[e][3] = 255;
+		}
+		fourColors |= c0 > c1;
+		for (int c = 0; c < 3; c++) {
+			palette[2][c] = fourColors ? (2 * palette[0][c] + palette[1][c]) / 3 : (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = fourColors ? (palette[0][c] + 2 * palette[1][c]) / 3 : 0;
+		}
+		palette[2][3] = 255;
+		palette[3][3] = fourColors ? 255 : 0;
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < 4; c++)
+				texels[i][c] = (unsigned char)palette[ReadBits(block, 32 + i * 2, 2)][c];
+	}
+
+	static void DecodeBC4(const unsigned char* block, unsigned char texels[16][4], int channel) {
+		int r0 = block[0], r1 = block[1];
+		int palette[8] = { r0, r1 };
+		for (int k = 1; k <= 6; k++)
+			palette[k + 1] = r0 > r1 ? ((7 - k) * r0 + k * r1 + 3) / 7 : k <= 4 ? ((5 - k) * r0 + k * r1 + 2) / 5 : (k == 5 ? 0 : 255);
+		for (int i = 0; i < 16; i++)
+			texels[i][channel] = (unsigned char)palette[ReadBits(block, 16 + i * 3, 3)];
+	}
+
+	static void DecodeBC7(const unsigned char* block, unsigned char texels[16][4]) {
+		static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+		if (ReadBits(block, 0, 7) != (1 << 6))
+			throw std::runtime_error("Unexpected BC7 mode");
+		int a[4], b[4];
+		int p0 = (int)ReadBits(block, 63, 1), p1 = (int)ReadBits(block, 64, 1);
+		for (int c = 0; c < 4; c++) {
+			a[c] = ((int)ReadBits(block, 7 + c * 14, 7) << 1) | p0;
+			b[c] = ((int)ReadBits(block, 14 + c * 14, 7) << 1) | p1;
+		}
+		int position = 65;
+		for (int i = 0; i < 16; i++) {
+			int bits = i == 0 ? 3 : 4;
+			int w = weights[ReadBits(block, position, bits)];
+			position += bits;
+			for (int c = 0; c < 4; c++)
+				texels[i][c] = (unsigned char)(((64 - w) * a[c] + w * b[c] + 32) >> 6);
+		}
+	}
+
+	struct CompressedFormat {
+		const char* Name;
+		FormatHandle Handle;
+		int Channels; // channels compared, from red
+	};
+
+	// Peak signal to noise ratio of the decoded blocks against the source pixels, in the compared channels.
+	// BC1 punches through texels with alpha below one half, their color is not compared.
+	static double PSNR(const CompressedFormat& format, const std::vector<Formats::R8G8B8A8>& pixels, unsigned int width, unsigned int height, const std::vector<unsigned char>& blocks) {
+		int blockBytes = format.Handle == Formats::BC1::UNORM_Handle() || format.Handle == Formats::BC4::UNORM_Handle() ? 8 : 16;
+		double error = 0;
+		size_t samples = 0;
+		const unsigned char* block = blocks.data();
+		for (unsigned int by = 0; by < height / 4; by++)
+			for (unsigned int bx = 0; bx < width / 4; bx++, block += blockBytes) {
+				unsigned char texels[16][4] = { };
+				if (format.Handle == Formats::BC1::UNORM_Handle())
+					DecodeBC1(block, false, texels);
+				else if (format.Handle == Formats::BC3::UNORM_Handle()) {
+					DecodeBC4(block, texels, 3);
+					unsigned char color[16][4];
+					DecodeBC1(block + 8, true, color);
+					for (int i = 0; i < 16; i++)
+						memcpy(texels[i], color[i], 3);
+				}
+				else if (format.Handle == Formats::BC4::UNORM_Handle())
+					DecodeBC4(block, texels, 0);
+				else if (format.Handle == Formats::BC5::UNORM_Handle()) {
+					DecodeBC4(block, texels, 0);
+					DecodeBC4(block + 8, texels, 1);
+				}
+				else
+					DecodeBC7(block, texels);
+				for (int i = 0; i < 16; i++) {
+					const unsigned char* source = (const unsigned char*)&pixels[(size_t)(by * 4 + i / 4) * width + bx * 4 + i % 4];
+					if (format.Handle == Formats::BC1::UNORM_Handle() && source[3] < 128)
+						continue;
+					samples += format.Channels;
+					for (int c = 0; c < format.Channels; c++)
+						error += (double)(texels[i][c] - source[c]) * (texels[i][c] - source[c]);
+				}
+			}
+		double mse = error / (double)samples;
+		return mse == 0 ? 99.0 : 10 * log10(255.0 * 255.0 / mse);
+	}
+
+	// Smooth gradients with noise and hard edges, alpha ramps so every format has content in its channels.
+	static std::vector<Formats::R8G8B8A8> TestImage(unsigned int width, unsigned int height) {
+		std::vector<Formats::R8G8B8A8> pixels((size_t)width * height);
+		std::mt19937 random(3);
+		for (unsigned int y = 0; y < height; y++)
+			for (unsigned int x = 0; x < width; x++) {
+				int noise = (int)(random() % 17) - 8;
+				bool edge = ((x / 61) + (y / 47)) % 2 == 0;
+				auto channel = [&](double value) { return (char)std::min(255, std::max(0, (int)value + noise)); };
+				pixels[(size_t)y * width + x] = Formats::R8G8B8A8(
+					channel(255.0 * x / width),
+					channel(edge ? 200 : 40 + 120.0 * y / height),
+					channel(127.5 + 127.5 * sin(x * 0.05) * cos(y * 0.03)),
+					channel(255.0 * (x + y) / (width + height)));
+			}
+		return pixels;
+	}
+
+	struct CompressedUploadTechnique : public Technique {
+		const std::vector<Formats::R8G8B8A8>* Pixels;
+		unsigned int Size;
+		Image2D Uncompressed;
+		Image2D Compressed;
+
+		CompressedUploadTechnique(const std::vector<Formats::R8G8B8A8>* pixels, unsigned int size) : Pixels(pixels), Size(size) { }
+
+		Image2D CreateTexture(FormatHandle format) {
+			Image2DDescription description = {};
+			description.Format = format;
+			description.width = Size;
+			description.height = Size;
+			description.Usage.TransferDestination = true;
+			description.Usage.Sampled = true;
+			return Create(description);
+		}
+
+		// Measures the time in seconds and the device memory in megabytes of uploading the pixels to a new texture.
+		void Measure(bool compressed, double& time, double& memory) {
+			unsigned long long before = GetStatistics().ResourceMemory;
+			double start = Now();
+			if (compressed) {
+				Compressed = CreateTexture(Formats::BC7::UNORM_Handle());
+				Upload(Compressed, Pixels->data(), Formats::CompressionPreset::FAST).Wait();
+			}
+			else {
+				Uncompressed = CreateTexture(Formats::R8G8B8A8::UNORM_Handle());
+				Upload(Uncompressed, Pixels->data()).Wait();
+			}
+			time = Now() - start;
+			memory = (GetStatistics().ResourceMemory - before) / (1024.0 * 1024.0);
+		}
+
+		virtual void OnLoad() override { }
+
+		virtual void OnDispatch() override { }
+	};
+
+	void BlockCompression() {
+		const unsigned int size = 2048;
+		std::vector<Formats::R8G8B8A8> pixels = TestImage(size, size);
+		const CompressedFormat formats[] = {
+			{ "bc1", Formats::BC1::UNORM_Handle(), 3 },
+			{ "bc3", Formats::BC3::UNORM_Handle(), 4 },
+			{ "bc4", Formats::BC4::UNORM_Handle(), 1 },
+			{ "bc5", Formats::BC5::UNORM_Handle(), 2 },
+			{ "bc7", Formats::BC7::UNORM_Handle(), 4 },
+		};
+		const Formats::CompressionPreset presets[] = { Formats::CompressionPreset::FAST, Formats::CompressionPreset::QUALITY };
+
+		for (const CompressedFormat& format : formats) {
+			std::vector<unsigned char> blocks(Formats::CompressedSize(format.Handle, size, size));
+			std::string name = format.Name;
+			for (Formats::CompressionPreset preset : presets) {
+				std::string metric = name + (preset == Formats::CompressionPreset::FAST ? "_fast" : "_quality");
+				double start = Now();
+				Formats::Compress(format.Handle, pixels.data(), size, size, blocks.data(), preset);
+				double elapsed = Now() - start;
+				Report("block_compression", (metric + "_throughput").c_str(), (double)size * size / elapsed * 1e-6, "MPix/s");
+				Report("block_compression", (metric + "_psnr").c_str(), PSNR(format, pixels, size, size, blocks), "dB");
+			}
+			Report("block_compression", (name + "_memory_saved").c_str(), (1 - (double)blocks.size() / (pixels.size() * 4)) * 100, "%");
+		}
+
+		// Streams the same texture uncompressed and encoding BC7 on the async workers
+		PresenterDescription description = DefaultDescription();
+		description.async_threads = 2;
+		std::shared_ptr<CompressedUploadTechnique> technique;
+		std::shared_ptr<Presenter> presenter = CreatePresenter(description, technique, &pixels, size);
+
+		double time, memory;
+		technique->Measure(false, time, memory);
+		Report("block_compression", "rgba8_upload_time", time * 1e3, "ms");
+		Report("block_compression", "rgba8_device_memory", memory, "MB");
+		technique->Measure(true, time, memory);
+		Report("block_compression", "bc7_upload_time", time * 1e3, "ms");
+		Report("block_compression", "bc7_device_memory", memory, "MB");
+	}
+}
@@ -0,0 +1,116 @@
+#include "benchmarks.h"
+
+#include <algorithm>
+#include <random>
+
+using namespace goofy;
+
+namespace benchmarks {
+
+	enum class DispatchMethod { DIRECT, BATCHED, INDIRECT };
+
+	// Records the same shuffled dispatches every frame with one of the methods and accumulates the recording time.
+	struct DispatchProcess : public Process {
+		DispatchMethod Method;
+		const std::vector<ComputeDispatch>* Dispatches;
+		Buffer Arguments;
+		double RecordingTime = 0;
+
+		virtual EngineType RequiredEngines() override { return ComputeManager::SupportedEngines; }
+
+		virtual void Populate(CommandListManager manager) override {
+			ComputeManager compute = manager.As<ComputeManager>();
+			const std::vector<ComputeDispatch>& dispatches = *Dispatches;
+			double start = Now();
+			switch (Method) {
+			case DispatchMethod::DIRECT:
+				for (const ComputeDispatch& dispatch : dispatches) {
+					compute.Set(*dispatch.Pipeline);
+					compute.Set(*dispatch.Binder);
+					compute.Dispatch(dispatch.GroupsX, dispatch.GroupsY, dispatch.GroupsZ);
+				}
+				break;
+			case DispatchMethod::BATCHED:
+				compute.Dispatch((int)dispatches.size(), dispatches.data());
+				break;
+			case DispatchMethod::INDIRECT:
+				for (const ComputeDispatch& dispatch : dispatches) {
+					compute.Set(*dispatch.Pipeline);
+					compute.Set(*dispatch.Binder);
+					compute.DispatchIndirect(Arguments);
+				}
+				break;
+			}
+			RecordingTime += Now() - start;
+		}
+
+		virtual const char* Name() override {
+			return Method == DispatchMethod::DIRECT ? "compute_direct" : Method == DispatchMethod::BATCHED ? "compute_batched" : "compute_indirect";
+		}
+	};
+
+	struct ComputeDispatchTechnique : public Technique {
+		const int Pipelines = 16;
+		const int Binders = 64;
+		const int Count = 10000;
+		std::vector<ComputePipeline> Loaded;
+		std::vector<ComputeBinder> Constants;
+		std::vector<ComputeDispatch> Dispatches;
+		std::shared_ptr<DispatchProcess> Processes[3];
+
+		virtual void OnLoad() override {
+			for (int i = 0; i < Pipelines; i++) {
+				std::vector<unsigned int> code = EmptyComputeShader(64 + i);
+				ComputePipelineDescription description = {};
+				description.Shader.Code = code.data();
+				description.Shader.Size = code.size() * sizeof(unsigned int);
+				Loaded.push_back(Create(description));
+			}
+			Constants.resize(Binders);
+			for (int i = 0; i < Binders; i++)
+				for (int slot = 0; slot < 4; slot++)
+					Constants[i].Set(slot, (unsigned int)(i * 4 + slot));
+
+			// Small dispatches in the order a scene would submit them, with pipelines and constants interleaved
+			std::mt19937 random(11);
+			for (int i = 0; i < Count; i++)
+				Dispatches.push_back({ &Loaded[random() % Pipelines], &Constants[random() % Binders], 1 + (unsigned int)(random() % 8), 1, 1 });
+
+			BufferDescription arguments = {};
+			arguments.size = 16;
+			arguments.Usage.Indirect = true;
+			arguments.Usage.TransferDestination = true;
+			Buffer buffer = Create(arguments);
+			unsigned int groups[4] = { 4, 1, 1, 0 };
+			Upload(buffer, groups, sizeof(groups), 0).Wait();
+
+			for (int i = 0; i < 3; i++) {
+				Processes[i] = std::shared_ptr<DispatchProcess>(new DispatchProcess());
+				Processes[i]->Method = (DispatchMethod)i;
+				Processes[i]->Dispatches = &Dispatches;
+				Processes[i]->Arguments = buffer;
+			}
+		}
+
+		virtual void OnDispatch() override {
+			for (auto& process : Processes)
+				Dispatch(process);
+		}
+	};
+
+	void ComputeDispatchRecording() {
+		const int frames = 100;
+
+		std::shared_ptr<ComputeDispatchTechnique> technique;
+		std::shared_ptr<Presenter> presenter = CreatePresenter(DefaultDescription(), technique);
+		RunFrames(presenter, technique, frames);
+
+		double dispatches = (double)technique->Count * frames;
+		double direct = technique->Processes[0]->RecordingTime / dispatches * 1e9;
+		double batched = technique->Processes[1]->RecordingTime / dispatches * 1e9;
+		Report("compute_dispatch", "direct_cost", direct, "ns/dispatch");
+		Report("compute_dispatch", "batched_cost", batched, "ns/dispatch");
+		Report("compute_dispatch", "indirect_cost", technique->Processes[2]->RecordingTime / dispatches * 1e9, "ns/dispatch");
+		Report("compute_dispatch", "batched_speedup", direct / batched, "x");
+	}
+}
@@ -0,0 +1,128 @@
+#include "benchmarks.h"
+
+#include <cstring>
+#include <random>
+
+using namespace goofy;
+using namespace goofy::Formats;
+
+namespace benchmarks {
+
+	static const char* KernelName(ConversionKernel kernel) {
+		switch (kernel) {
+		case ConversionKernel::SSE4: return "sse4";
+		case ConversionKernel::AVX2: return "avx2";
+		case ConversionKernel::AVX512: return "avx512";
+		default: return "scalar";
+		}
+	}
+
+	struct ConversionInputs {
+		std::vector<R32G32B32A32_SFLOAT> Floats;
+		std::vector<R8G8B8A8> Bytes;
+		std::vector<unsigned short> Halves;
+	};
+
+	// Outputs of every conversion with the active kernel, appended as bytes.
+	static std::vector<unsigned char> ConvertAll(const ConversionInputs& inputs) {
+		std::vector<unsigned char> all;
+		auto append = [&](const void* data, size_t size) {
+			all.insert(all.end(), (const unsigned char*)data, (const unsigned char*)data + size);
+		};
+		size_t pixels = inputs.Floats.size();
+		std::vector<R8G8B8A8> bytes(pixels);
+		std::vector<R32G32B32A32_SFLOAT> floats(pixels);
+		std::vector<unsigned short> halves(pixels * 4);
+		std::vector<float> unpacked(inputs.Halves.size());
+
+		FloatToUnorm(inputs.Floats.data(), bytes.data(), pixels);
+		append(bytes.data(), pixels * 4);
+		FloatToSRGB(inputs.Floats.data(), bytes.data(), pixels, SRGBMethod::LUT);
+		append(bytes.data(), pixels * 4);
+		FloatToSRGB(inputs.Floats.data(), bytes.data(), pixels, SRGBMethod::POLYNOMIAL);
+		append(bytes.data(), pixels * 4);
+		UnormToFloat(inputs.Bytes.data(), floats.data(), pixels);
+		append(floats.data(), pixels * 16);
+		SRGBToFloat(inputs.Bytes.data(), floats.data(), pixels, SRGBMethod::LUT);
+		append(floats.data(), pixels * 16);
+		SRGBToFloat(inputs.Bytes.data(), floats.data(), pixels, SRGBMethod::POLYNOMIAL);
+		append(floats.data(), pixels * 16);
+		FloatToHalf(&inputs.Floats[0].R, halves.data(), pixels * 4);
+		append(halves.data(), halves.size() * 2);
+		HalfToFloat(inputs.Halves.data(), unpacked.data(), unpacked.size());
+		append(unpacked.data(), unpacked.size() * 4);
+		return all;
+	}
+
+	// Returns the conversion rate in megapixels per second.
+	template<typename F>
+	static double Throughput(size_t pixels, int repetitions, F convert) {
+		convert(); // warm up
+		double start = Now();
+		for (int i = 0; i < repetitions; i++)
+			convert();
+		return pixels * (double)repetitions / (Now() - start) * 1e-6;
+	}
+
+	void FormatConversion() {
+		// Odd count so every kernel also runs its tail. Inputs mix random bit patterns (NaN, infinities, denormals),
+		// a dense sweep of [0, 1] and values slightly out of range.
+		const size_t pixels = (1 << 20) + 3;
+		const int repetitions = 20;
+		std::mt19937 random(7);
+		ConversionInputs inputs;
+		inputs.Floats.resize(pixels);
+		inputs.Bytes.resize(pixels);
+		float* values = &inputs.Floats[0].R;
+		for (size_t i = 0; i < pixels * 4; i++)
+			switch (i % 3) {
+			case 0: { unsigned int bits = random(); memcpy(&values[i], &bits, 4); break; }
+			case 1: values[i] = (float)(i % (1 << 22)) / (1 << 22); break;
+			default: values[i] = std::uniform_real_distribution<float>(-0.1f, 1.1f)(random); break;
+			}
+		for (size_t i = 0; i < pixels; i++)
+			inputs.Bytes[i] = R8G8B8A8((unsigned int)random());
+		for (unsigned int i = 0; i < 65536; i++) // every half
+			inputs.Halves.push_back((unsigned short)i);
+
+		ConversionKernel supported = SupportedConversionKernel();
+		SetConversionKernel(ConversionKernel::SCALAR);
+		std::vector<unsigned char> reference = ConvertAll(inputs);
+
+		std::vector<R8G8B8A8> bytes(pixels);
+		std::vector<R32G32B32A32_SFLOAT> floats(pixels);
+		std::vector<unsigned short> halves(pixels * 4);
+		bool exact = true;
+		for (int k = 0; k <= (int)supported; k++) {
+			ConversionKernel kernel = (ConversionKernel)k;
+			SetConversionKernel(kernel);
+			std::string name = KernelName(kernel);
+
+			std::vector<unsigned char> converted = ConvertAll(inputs);
+			size_t mismatches = 0;
+			for (size_t i = 0; i < reference.size(); i++)
+				mismatches += converted[i] != reference[i];
+			exact &= mismatches == 0;
+			Report("format_conversion", (name + "_mismatched_bytes").c_str(), (double)mismatches, "bytes");
+
+			Report("format_conversion", (name + "_unorm_to_float").c_str(),
+				Throughput(pixels, repetitions, [&] { UnormToFloat(inputs.Bytes.data(), floats.data(), pixels); }), "Mpixels/s");
+			Report("format_conversion", (name + "_float_to_unorm").c_str(),
+				Throughput(pixels, repetitions, [&] { FloatToUnorm(inputs.Floats.data(), bytes.data(), pixels); }), "Mpixels/s");
+			Report("format_conversion", (name + "_srgb_to_float_lut").c_str(),
+				Throughput(pixels, repetitions, [&] { SRGBToFloat(inputs.Bytes.data(), floats.data(), pixels, SRGBMethod::LUT); }), "Mpixels/s");
+			Report("format_conversion", (name + "_srgb_to_float_polynomial").c_str(),
+				Throughput(pixels, repetitions, [&] { SRGBToFloat(inputs.Bytes.data(), floats.data(), pixels, SRGBMethod::POLYNOMIAL); }), "Mpixels/s");
+			Report("format_conversion", (name + "_float_to_srgb_lut").c_str(),
+				Throughput(pixels, repetitions, [&] { FloatToSRGB(inputs.Floats.data(), bytes.data(), pixels, SRGBMethod::LUT); }), "Mpixels/s");
+			Report("format_conversion", (name + "_float_to_srgb_polynomial").c_str(),
+				Throughput(pixels, repetitions, [&] { FloatToSRGB(inputs.Floats.data(), bytes.data(), pixels, SRGBMethod::POLYNOMIAL); }), "Mpixels/s");
+			Report("format_conversion", (name + "_float_to_half").c_str(),
+				Throughput(pixels, repetitions, [&] { FloatToHalf(values, halves.data(), pixels * 4); }), "Mpixels/s");
+		}
+		SetConversionKernel(supported);
+
+		if (!exact)
+			throw std::runtime_error("Conversion kernels differ from the scalar reference");
+	}
+}
@@ -0,0 +1,195 @@
+#include "benchmarks.h"
+
+#include <cmath>
+#include <random>
+#include <string>
+
+using namespace goofy;
+
+namespace benchmarks {
+
+	// Stage writing a constant position (vertex) or color (fragment), the objects are degenerate and the draws cost what the gpu spends on the commands.
+	static std::vector<unsigned int> ConstantShader(bool fragment) {
+		std::vector<unsigned int> code = {
+			0x07230203, 0x00010000, 0, 12, 0,	// Header, bound = 12
+			(2 << 16) | 17, 1,					// OpCapability Shader
+			(3 << 16) | 14, 0, 1,				// OpMemoryModel Logical GLSL450
+			(6 << 16) | 15, fragment ? 4u : 0u, 1, 0x6E69616D, 0, 7,	// OpEntryPoint Fragment/Vertex %1 "main" %7
+		};
+		if (fragment)
+			code.insert(code.end(), {
+				(3 << 16) | 16, 1, 7,			// OpExecutionMode %1 OriginUpperLeft
+				(4 << 16) | 71, 7, 30, 0 });	// OpDecorate %7 Location 0
+		else
+			code.insert(code.end(), { (4 << 16) | 71, 7, 11, 0 });	// OpDecorate %7 BuiltIn Position
+		code.insert(code.end(), {
+			(2 << 16) | 19, 2,					// %2 = OpTypeVoid
+			(3 << 16) | 33, 3, 2,				// %3 = OpTypeFunction %2
+			(3 << 16) | 22, 4, 32,				// %4 = OpTypeFloat 32
+			(4 << 16) | 23, 5, 4, 4,			// %5 = OpTypeVector %4 4
+			(4 << 16) | 32, 6, 3, 5,			// %6 = OpTypePointer Output %5
+			(4 << 16) | 59, 6, 7, 3,			// %7 = OpVariable %6 Output
+			(4 << 16) | 43, 4, 8, 0,			// %8 = OpConstant %4 0
+			(4 << 16) | 43, 4, 9, 0x3F800000,	// %9 = OpConstant %4 1
+			(7 << 16) | 44, 5, 10, 8, 8, 8, 9,	// %10 = OpConstantComposite %5 %8 %8 %8 %9
+			(5 << 16) | 54, 2, 1, 0, 3,			// %1 = OpFunction %2 None %3
+			(2 << 16) | 248, 11,				// %11 = OpLabel
+			(3 << 16) | 62, 7, 10,				// OpStore %7 %10
+			(1 << 16) | 253,					// OpReturn
+			(1 << 16) | 56						// OpFunctionEnd
+		});
+		return code;
+	}
+
+	// Perspective of 60 degrees looking down -z from the origin, column-major with 0 to 1 depth.
+	static void ViewProjection(float matrix[16]) {
+		const float nearPlane = 0.1f, farPlane = 1000.0f;
+		const float f = 1.0f / tanf(3.14159265f / 6);
+		for (int i = 0; i < 16; i++)
+			matrix[i] = 0;
+		matrix[0] = f;
+		matrix[5] = -f;
+		matrix[10] = farPlane / (nearPlane - farPlane);
+		matrix[11] = -1;
+		matrix[14] = nearPlane * farPlane / (nearPlane - farPlane);
+	}
+
+	// Culls and draws every instance of a scene each frame and accumulates the CPU time recording it.
+	struct GPUDrivenProcess : public Process {
+		std::string ProcessName;
+		unsigned int Count;
+		const float (*Planes)[4];
+		GraphicsPipeline Pipeline;
+		Image2D Target;
+		Buffer Indices;
+		Buffer Instances;
+		Buffer Draws;
+		double RecordingTime = 0;
+
+		virtual EngineType RequiredEngines() override { return GraphicsManager::SupportedEngines; }
+
+		virtual void Populate(CommandListManager manager) override {
+			GraphicsManager graphics = manager.As<GraphicsManager>();
+			double start = Now();
+			graphics.Cull(Instances, Count, Planes, Draws);
+			graphics.BeginRendering(Target);
+			graphics.Set(Pipeline);
+			graphics.SetIndices(Indices);
+			graphics.DrawIndirect(Draws, Count);
+			graphics.EndRendering();
+			RecordingTime += Now() - start;
+		}
+
+		virtual const char* Name() override { return ProcessName.c_str(); }
+	};
+
+	struct GPUDrivenTechnique : public Technique {
+		static const int Scenes = 3;
+		const unsigned int Counts[Scenes] = { 10000, 100000, 1000000 };
+		float Planes[6][4];
+		double Visible[Scenes];
+		std::shared_ptr<GPUDrivenProcess> Processes[Scenes];
+
+		// Fraction of the instances inside the frustum, by the same test the culling shader does.
+		static double VisibleFraction(const std::vector<DrawInstance>& instances, const float planes[6][4]) {
+			size_t visible = 0;
+			for (const DrawInstance& instance : instances) {
+				bool inside = true;
+				for (int p = 0; p < 6 && inside; p++)
+					inside = planes[p][0] * instance.Center[0] + planes[p][1] * instance.Center[1] + planes[p][2] * instance.Center[2] + planes[p][3] >= -instance.Radius;
+				visible += inside ? 1 : 0;
+			}
+			return (double)visible / instances.size();
+		}
+
+		virtual void OnLoad() override {
+			float viewProjection[16];
+			ViewProjection(viewProjection);
+			FrustumPlanes(viewProjection, Planes);
+
+			std::vector<unsigned int> vertex = ConstantShader(false), fragment = ConstantShader(true);
+			GraphicsPipelineDescription pipeline = {};
+			pipeline.Vertex.Code = vertex.data();
+			pipeline.Vertex.Size = vertex.size() * sizeof(unsigned int);
+			pipeline.Fragment.Code = fragment.data();
+			pipeline.Fragment.Size = fragment.size() * sizeof(unsigned int);
+			pipeline.Topology = PrimitiveTopology::TRIANGLE_LIST;
+			pipeline.RenderTargetFormat = Formats::R8G8B8A8::UNORM_Handle();
+			GraphicsPipeline loaded = Create(pipeline);
+
+			Image2DDescription target = {};
+			target.Format = Formats::R8G8B8A8::UNORM_Handle();
+			target.width = 1024;
+			target.height = 1024;
+			target.Usage.RenderTarget = true;
+			Image2D renderTarget = Create(target);
+
+			// A cube of 12 triangles per instance, the vertices are not read
+			std::vector<unsigned int> cube(36, 0);
+			BufferDescription indices = {};
+			indices.size = cube.size() * sizeof(unsigned int);
+			indices.Usage.Indices = true;
+			indices.Usage.TransferDestination = true;
+			Buffer indexBuffer = Create(indices);
+			Upload(indexBuffer, cube.data(), indices.size).Wait();
+
+			// Objects scattered around the camera, a few percent of them in the frustum as in a large open scene
+			std::mt19937 random(13);
+			std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+			for (int s = 0; s < Scenes; s++) {
+				std::vector<DrawInstance> scene(Counts[s]);
+				for (unsigned int i = 0; i < Counts[s]; i++)
+					scene[i] = { { position(random), position(random), position(random) }, 1.0f, 36, 0, 0, i };
+				Visible[s] = VisibleFraction(scene, Planes);
+
+				BufferDescription instances = {};
+				instances.size = scene.size() * sizeof(DrawInstance);
+				instances.Usage.Storage = true;
+				instances.Usage.TransferDestination = true;
+				BufferDescription draws = {};
+				draws.size = GraphicsManager::DrawsSize(Counts[s]);
+				draws.Usage.Storage = true;
+				draws.Usage.Indirect = true;
+				draws.Usage.TransferDestination = true;
+
+				Processes[s] = std::shared_ptr<GPUDrivenProcess>(new GPUDrivenProcess());
+				Processes[s]->ProcessName = "gpu_driven_" + std::to_string(Counts[s] / 1000) + "k";
+				Processes[s]->Count = Counts[s];
+				Processes[s]->Planes = Planes;
+				Processes[s]->Pipeline = loaded;
+				Processes[s]->Target = renderTarget;
+				Processes[s]->Indices = indexBuffer;
+				Processes[s]->Instances = Create(instances);
+				Processes[s]->Draws = Create(draws);
+				Upload(Processes[s]->Instances, scene.data(), instances.size).Wait();
+			}
+		}
+
+		virtual void OnDispatch() override {
+			for (auto& process : Processes)
+				Dispatch(process);
+		}
+	};
+
+	void GPUDrivenDraws() {
+		const int frames = 100;
+
+		PresenterDescription description = DefaultDescription();
+		description.profiling = true;
+		std::shared_ptr<GPUDrivenTechnique> technique;
+		std::shared_ptr<Presenter> presenter = CreatePresenter(description, technique);
+		RunFrames(presenter, technique, frames);
+
+		ProfileReport report = presenter->Profile();
+		for (int s = 0; s < GPUDrivenTechnique::Scenes; s++) {
+			const GPUDrivenProcess& process = *technique->Processes[s];
+			std::string metric = process.ProcessName.substr(sizeof("gpu_driven_") - 1);
+			Report("gpu_driven_draws", (metric + "_record_time").c_str(), process.RecordingTime / frames * 1e6, "us");
+			Report("gpu_driven_draws", (metric + "_visible").c_str(), technique->Visible[s] * 100, "%");
+			for (const ProcessProfile& profile : report.Processes)
+				if (profile.Process == process.ProcessName)
+					Report("gpu_driven_draws", (metric + "_gpu_time").c_str(), profile.GPU.Average, "ms");
+		}
+		Report("gpu_driven_draws", "record_time_growth", technique->Processes[GPUDrivenTechnique::Scenes - 1]->RecordingTime / technique->Processes[0]->RecordingTime, "x");
+	}
+}
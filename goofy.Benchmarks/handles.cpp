@@ -0,0 +1,65 @@
+#include "benchmarks.h"
+
+using namespace goofy;
+
+namespace benchmarks {
+
+	struct HandlePassingTechnique : public Technique {
+		bool UseHandles;
+		int ClearsPerFrame;
+		std::vector<Image2D> Images;
+		std::vector<ResourceHandle> Handles;
+		double RecordingTime = 0;
+
+		HandlePassingTechnique(bool useHandles, int clearsPerFrame) : UseHandles(useHandles), ClearsPerFrame(clearsPerFrame) { }
+
+		virtual void OnLoad() override {
+			Image2DDescription description = {};
+			description.Format = Formats::R8G8B8A8::UNORM_Handle();
+			description.width = 4;
+			description.height = 4;
+			description.Usage.TransferDestination = true;
+			for (int i = 0; i < 1024; i++) {
+				Images.push_back(Create(description));
+				Handles.push_back(Register(Images.back()));
+			}
+		}
+
+		void Recording(GraphicsManager manager) {
+			double start = Now();
+			if (UseHandles)
+				for (int i = 0; i < ClearsPerFrame; i++)
+					manager.Clear(Handles[i % Handles.size()], Formats::R32G32B32A32_SFLOAT(0, 0, 0, 1));
+			else
+				for (int i = 0; i < ClearsPerFrame; i++)
+					manager.Clear(Images[i % Images.size()], Formats::R32G32B32A32_SFLOAT(0, 0, 0, 1));
+			RecordingTime += Now() - start;
+		}
+
+		virtual void OnDispatch() override
+		{
+			Dispatch_Method(Recording);
+		}
+	};
+
+	// Returns the CPU time per recorded command in nanoseconds.
+	static double CommandCost(bool useHandles, int frames) {
+		const int clearsPerFrame = 4096;
+
+		std::shared_ptr<HandlePassingTechnique> technique;
+		std::shared_ptr<Presenter> presenter = CreatePresenter(DefaultDescription(), technique, useHandles, clearsPerFrame);
+		RunFrames(presenter, technique, frames);
+		return technique->RecordingTime * 1e9 / ((double)frames * clearsPerFrame);
+	}
+
+	void HandlePassing() {
+		const int frames = 500;
+
+		double wrappers = CommandCost(false, frames);
+		double handles = CommandCost(true, frames);
+
+		Report("handle_passing", "command_cost_wrappers", wrappers, "ns");
+		Report("handle_passing", "command_cost_handles", handles, "ns");
+		Report("handle_passing", "speedup", wrappers / handles, "x");
+	}
+}
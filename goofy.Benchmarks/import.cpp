@@ -0,0 +1,79 @@
+#include "benchmarks.h"
+
+#include <cstdio>
+#include <vector>
+
+using namespace goofy;
+
+namespace benchmarks {
+
+	struct AssetImportTechnique : public Technique {
+		const char* Path;
+		unsigned long long Size;
+		Buffer Target;
+		GPUTask Loading;
+
+		AssetImportTechnique(const char* path, unsigned long long size) : Path(path), Size(size) { }
+
+		virtual void OnLoad() override {
+			BufferDescription description = {};
+			description.size = Size;
+			description.Usage.TransferDestination = true;
+			description.Usage.Vertices = true;
+			Target = Create(description);
+		}
+
+		void StartLoading() {
+			Loading = UploadFile(Target, Path);
+		}
+
+		void FinishLoading() {
+			Loading.Wait();
+		}
+
+		void Clearing(GraphicsManager manager) {
+			manager.Clear(GetCurrentRenderTarget(), Formats::R32G32B32A32_SFLOAT(0, 0, 0, 1));
+		}
+
+		virtual void OnDispatch() override
+		{
+			Dispatch_Method(Clearing);
+		}
+	};
+
+	void AssetImport() {
+		const char* path = "goofy_asset_import.bin";
+		const unsigned long long budget = 16 * 1024 * 1024;
+		const unsigned long long size = 1024ull * 1024 * 1024; // 1GB vertex pack
+
+		// Write the asset pack in small blocks to keep the resident memory low before loading
+		{
+			std::vector<char> block(4 * 1024 * 1024, 7);
+			FILE* file = fopen(path, "wb");
+			if (file == nullptr)
+				throw std::runtime_error("failed to create the asset file!");
+			for (unsigned long long written = 0; written < size; written += block.size())
+				fwrite(block.data(), 1, block.size(), file);
+			fclose(file);
+		}
+
+		PresenterDescription description = DefaultDescription();
+		description.upload_budget = budget;
+		std::shared_ptr<AssetImportTechnique> technique;
+		std::shared_ptr<Presenter> presenter = CreatePresenter(description, technique, path, size);
+
+		double residentBefore = PeakResidentMemory();
+		double start = Now();
+		technique->StartLoading();
+		RunFrames(presenter, technique, (int)(size / budget) + presenter->NumberOfFrames() + 1);
+		technique->FinishLoading();
+		double loadTime = Now() - start;
+
+		Report("asset_import", "load_time", loadTime, "s");
+		Report("asset_import", "bandwidth", size / loadTime / (1024 * 1024 * 1024), "GB/s");
+		Report("asset_import", "peak_rss_before", residentBefore, "MB");
+		Report("asset_import", "peak_rss", PeakResidentMemory(), "MB");
+
+		remove(path);
+	}
+}
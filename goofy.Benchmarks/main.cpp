@@ -0,0 +1,155 @@
+#include "benchmarks.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace goofy;
+
+namespace benchmarks {
+
+	static std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+	// Benchmarks run headless unless --window is specified.
+	static PresenterCreationMode mode = PresenterCreationMode::OFFLINE;
+
+	double Now() {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	}
+
+	PresenterDescription DefaultDescription() {
+		PresenterDescription description = {};
+		description.mode = mode;
+		description.PresentationFormat = Formats::R8G8B8A8::SRGB_Handle();
+		description.Usage.RenderTarget = true;
+		description.Usage.TransferSource = true;
+		description.Usage.TransferDestination = true;
+		description.frames = 3;
+		description.frame_threads = 0;
+		description.async_threads = 1;
+		description.resolution.width = 1264;
+		description.resolution.height = 761;
+		return description;
+	}
+
+	double PeakResidentMemory() {
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+		return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		return usage.ru_maxrss / 1024.0;
+#endif
+	}
+
+	struct Result {
+		std::string Benchmark;
+		std::string Metric;
+		double Value;
+		std::string Unit;
+	};
+
+	static std::vector<Result> results;
+
+	void Report(const char* benchmark, const char* metric, double value, const char* unit) {
+		std::cout << benchmark << " " << metric << ": " << value << " " << unit << std::endl;
+		results.push_back({ benchmark, metric, value, unit });
+	}
+
+	// Writes the results as a JSON array so runs of different releases can be compared by tools.
+	static bool WriteResults(const char* path) {
+		FILE* file = fopen(path, "w");
+		if (file == nullptr)
+			return false;
+		fprintf(file, "[\n");
+		for (size_t i = 0; i < results.size(); i++)
+			fprintf(file, "  { \"benchmark\": \"%s\", \"metric\": \"%s\", \"value\": %.9g, \"unit\": \"%s\" }%s\n",
+				results[i].Benchmark.c_str(), results[i].Metric.c_str(), results[i].Value, results[i].Unit.c_str(), i + 1 < results.size() ? "," : "");
+		fprintf(file, "]\n");
+		return fclose(file) == 0;
+	}
+
+	struct Benchmark {
+		const char* Name;
+		void (*Run)();
+	};
+
+	// Runs in order. AssetImport runs first, peak resident memory is measured from the process start.
+	static const Benchmark all[] = {
+		{ "asset_import", AssetImport },
+		{ "streaming_upload", StreamingUpload },
+		{ "frame_readback", FrameReadback },
+		{ "frame_output", FrameOutput },
+		{ "bindless_binding", BindlessBinding },
+		{ "handle_passing", HandlePassing },
+		{ "pipeline_cache_startup", PipelineCacheStartup },
+		{ "dispatch_latency", DispatchLatency },
+		{ "dispatch_throughput", DispatchThroughput },
+		{ "flush_latency", FlushLatency },
+		{ "combine_chains", CombineChains },
+		{ "frame_overhead", FrameOverhead },
+		{ "frame_thread_scaling", FrameThreadScaling },
+		{ "capture_replay", CaptureReplay },
+		{ "format_conversion", FormatConversion },
+		{ "block_compression", BlockCompression },
+		{ "mip_generation", MipGeneration },
+		{ "acceleration_structure_build", AccelerationStructureBuild },
+		{ "acceleration_structure_refit", AccelerationStructureRefit },
+		{ "compute_dispatch", ComputeDispatchRecording },
+		{ "gpu_driven_draws", GPUDrivenDraws },
+	};
+}
+
+// Usage: goofy.Benchmarks [--window] [--filter <name>] [--json <results file>] [--replay <capture file> [--speed <factor>]]
+int main(int argc, char** argv) {
+
+	const char* filter = nullptr;
+	const char* json = nullptr;
+	const char* replay = nullptr;
+	double speed = 0;
+	for (int i = 1; i < argc; i++)
+		if (strcmp(argv[i], "--window") == 0)
+			benchmarks::mode = PresenterCreationMode::NEW_GLFW_WINDOW;
+		else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+			filter = argv[++i];
+		else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+			json = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			replay = argv[++i];
+		else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc)
+			speed = atof(argv[++i]);
+
+	try {
+		if (replay != nullptr) // A capture replaces the suite
+			benchmarks::ReplayCapture(replay, speed);
+		else
+			for (const benchmarks::Benchmark& benchmark : benchmarks::all)
+				if (filter == nullptr || strstr(benchmark.Name, filter) != nullptr)
+					benchmark.Run();
+	}
+	catch (std::runtime_error& e) {
+		std::cout << e.what() << std::endl;
+		return 1;
+	}
+
+	if (json != nullptr && !benchmarks::WriteResults(json)) {
+		std::cout << "Failed to write " << json << std::endl;
+		return 1;
+	}
+	return 0;
+}
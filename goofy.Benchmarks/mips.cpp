@@ -0,0 +1,93 @@
+#include "benchmarks.h"
+
+#include <cmath>
+
+using namespace goofy;
+
+namespace benchmarks {
+
+	// Generates the whole chain of an image each time it is dispatched. Runs on graphics engines so both paths can be measured.
+	struct MipsProcess : public Process {
+		const char* ProcessName;
+		Image2D Image;
+		Image3D Volume;
+		bool IsVolume = false;
+
+		virtual EngineType RequiredEngines() override { return EngineType::GRAPHICS; }
+
+		virtual void Populate(CommandListManager manager) override {
+			if (IsVolume)
+				manager.As<GraphicsManager>().GenerateMips(Volume);
+			else
+				manager.As<GraphicsManager>().GenerateMips(Image);
+		}
+
+		virtual const char* Name() override { return ProcessName; }
+	};
+
+	struct MipsTechnique : public Technique {
+		std::shared_ptr<MipsProcess> Processes[3];
+
+		static int Levels(unsigned int size) {
+			return (int)log2((double)size) + 1;
+		}
+
+		virtual void OnLoad() override {
+			const unsigned int size = 4096;
+			const unsigned int volumeSize = 256;
+			const char* names[] = { "mip_generation_compute", "mip_generation_blit", "mip_generation_volume" };
+			for (int i = 0; i < 3; i++) {
+				Processes[i] = std::shared_ptr<MipsProcess>(new MipsProcess());
+				Processes[i]->ProcessName = names[i];
+			}
+
+			// Storage usage of a storage format takes the compute path, sRGB formats can not be storage images and are blitted
+			Image2DDescription description = {};
+			description.Format = Formats::R8G8B8A8::UNORM_Handle();
+			description.width = size;
+			description.height = size;
+			description.mips = Levels(size);
+			description.Usage.Storage = true;
+			description.Usage.Sampled = true;
+			Processes[0]->Image = Create(description);
+			description.Format = Formats::R8G8B8A8::SRGB_Handle();
+			description.Usage.Storage = false;
+			description.Usage.TransferSource = true;
+			description.Usage.TransferDestination = true;
+			Processes[1]->Image = Create(description);
+
+			Image3DDescription volume = {};
+			volume.Format = Formats::R8G8B8A8::UNORM_Handle();
+			volume.width = volumeSize;
+			volume.height = volumeSize;
+			volume.depth = volumeSize;
+			volume.mips = Levels(volumeSize);
+			volume.Usage.Storage = true;
+			volume.Usage.Sampled = true;
+			Processes[2]->Volume = Create(volume);
+			Processes[2]->IsVolume = true;
+		}
+
+		virtual void OnDispatch() override {
+			for (auto& process : Processes)
+				Dispatch(process);
+		}
+	};
+
+	void MipGeneration() {
+		const int frames = 100;
+
+		PresenterDescription description = DefaultDescription();
+		description.profiling = true;
+		std::shared_ptr<MipsTechnique> technique;
+		std::shared_ptr<Presenter> presenter = CreatePresenter(description, technique);
+		RunFrames(presenter, technique, frames);
+
+		ProfileReport report = presenter->Profile();
+		for (const ProcessProfile& process : report.Processes) {
+			std::string metric = process.Process.substr(sizeof("mip_generation_") - 1);
+			Report("mip_generation", (metric + "_chain_time").c_str(), process.GPU.Average, "ms");
+			Report("mip_generation", (metric + "_chain_time_p99").c_str(), process.GPU.P99, "ms");
+		}
+	}
+}
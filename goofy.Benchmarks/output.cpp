@@ -0,0 +1,67 @@
+#include "benchmarks.h"
+
+#include <cstdio>
+#include <string>
+
+using namespace goofy;
+
+namespace benchmarks {
+
+	struct ClearingTechnique : public Technique {
+		int Frame = 0;
+
+		virtual void OnLoad() override {
+		}
+
+		void Clearing(GraphicsManager manager) {
+			float t = (Frame % 256) / 255.0f;
+			manager.Clear(GetCurrentRenderTarget(), Formats::R32G32B32A32_SFLOAT(t, 1 - t, 0.5f, 1));
+		}
+
+		virtual void OnDispatch() override
+		{
+			Frame++;
+			Dispatch_Method(Clearing);
+		}
+	};
+
+	static double FramesPerSecond(const FrameOutputDescription* output, int frames) {
+		PresenterDescription description = DefaultDescription();
+		description.mode = PresenterCreationMode::OFFLINE; // Swapchain images are not read back
+		std::shared_ptr<ClearingTechnique> technique;
+		std::shared_ptr<Presenter> presenter = CreatePresenter(description, technique);
+
+		if (output != nullptr)
+			presenter->AttachOutput(*output);
+
+		double start = Now();
+		RunFrames(presenter, technique, frames);
+		presenter->DetachOutput(); // all frames written
+		return frames / (Now() - start);
+	}
+
+	void FrameOutput() {
+		const int frames = 500;
+		const char* names[] = { "raw", "ppm", "png", "exr" };
+
+		double baseline = FramesPerSecond(nullptr, frames);
+		Report("frame_output", "fps_no_output", baseline, "fps");
+
+		for (int format = 0; format < 4; format++) {
+			FrameOutputDescription output = {};
+			output.path = "goofy_frame_";
+			output.format = (FrameOutputFormat)format;
+
+			double fps = FramesPerSecond(&output, frames);
+			std::string metric = std::string("fps_") + names[format];
+			Report("frame_output", metric.data(), fps, "fps");
+			Report("frame_output", (metric + "_ratio").data(), fps / baseline, "x");
+
+			char number[32];
+			for (int i = 0; i < frames; i++) {
+				snprintf(number, sizeof(number), "%06d", i);
+				remove((output.path + number + "." + names[format]).data());
+			}
+		}
+	}
+}
@@ -0,0 +1,271 @@
+#include "benchmarks.h"
+
+#include <cstdio>
+
+using namespace goofy;
+
+namespace benchmarks {
+
+	// Records nothing, isolates the cost of the library around a process.
+	struct EmptyProcess : public Process {
+		virtual EngineType RequiredEngines() override { return EngineType::GRAPHICS; }
+
+		virtual void Populate(CommandListManager) override { }
+	};
+
+	struct OverheadTechnique : public Technique {
+		std::shared_ptr<Process> Empty = std::shared_ptr<Process>(new EmptyProcess());
+		Image2D Target;
+		int ClearsPerProcess = 64;
+
+		virtual void OnLoad() override {
+			Image2DDescription description = {};
+			description.Format = Formats::R8G8B8A8::UNORM_Handle();
+			description.width = 4;
+			description.height = 4;
+			description.Usage.TransferDestination = true;
+			Target = Create(description);
+		}
+
+		// Some CPU work to populate, so worker threads have something to share.
+		void Recording(GraphicsManager manager) {
+			for (int i = 0; i < ClearsPerProcess; i++)
+				manager.Clear(Target, Formats::R32G32B32A32_SFLOAT(0, 0, 0, 1));
+		}
+
+		virtual void OnDispatch() override { }
+
+		CPUTask DispatchEmpty(DispatchMode mode) {
+			return Dispatch(Empty, mode);
+		}
+
+		CPUTask DispatchRecording(DispatchMode mode) {
+			return Dispatch<OverheadTechnique, GraphicsManager>(this, &OverheadTechnique::Recording, mode);
+		}
+
+		GPUTask FlushTasks(int count, CPUTask* tasks) {
+			return Flush(count, tasks);
+		}
+	};
+
+	static PresenterDescription ThreadedDescription(int frames, int frameThreads, int asyncThreads) {
+		PresenterDescription description = DefaultDescription();
+		description.frames = frames;
+		description.frame_threads = frameThreads;
+		description.async_threads = asyncThreads;
+		return description;
+	}
+
+	// Returns the time in microseconds from dispatching an empty process until its population has completed.
+	static double DispatchLatency(DispatchMode mode, int frames) {
+		std::shared_ptr<OverheadTechnique> technique;
+		std::shared_ptr<Presenter> presenter = CreatePresenter(ThreadedDescription(3, 1, 1), technique);
+
+		double total = 0;
+		for (int i = 0; i < frames; i++) {
+			presenter->BeginFrame();
+			double start = Now();
+			CPUTask task = technique->DispatchEmpty(mode);
+			task.Wait();
+			total += Now() - start;
+			if (mode == DispatchMode::ASYNC) // Async processes are not flushed with the frame
+				technique->FlushTasks(1, &task).Wait();
+			presenter->EndFrame();
+		}
+		return total * 1e6 / frames;
+	}
+
+	void DispatchLatency() {
+		const int frames = 2000;
+
+		Report("dispatch_latency", "main_thread", DispatchLatency(DispatchMode::MAIN_THREAD, frames), "us");
+		Report("dispatch_latency", "async_frame", DispatchLatency(DispatchMode::ASYNC_FRAME, frames), "us");
+		Report("dispatch_latency", "async", DispatchLatency(DispatchMode::ASYNC, frames), "us");
+	}
+
+	void DispatchThroughput() {
+		const int frames = 500;
+		const int counts[] = { 1, 16, 256, 1024 };
+
+		for (int processes : counts) {
+			std::shared_ptr<OverheadTechnique> technique;
+			std::shared_ptr<Presenter> presenter = CreatePresenter(ThreadedDescription(3, 0, 0), technique);
+
+			double start = Now();
+			for (int i = 0; i < frames; i++) {
+				presenter->BeginFrame();
+				for (int p = 0; p < processes; p++)
+					technique->DispatchEmpty(DispatchMode::MAIN_THREAD);
+				presenter->EndFrame();
+			}
+			double elapsed = Now() - start;
+
+			std::string metric = "processes_" + std::to_string(processes);
+			Report("dispatch_throughput", (metric + "_frame_time").c_str(), elapsed * 1e6 / frames, "us");
+			Report("dispatch_throughput", (metric + "_per_dispatch").c_str(), elapsed * 1e9 / ((double)frames * processes), "ns");
+		}
+	}
+
+	void FlushLatency() {
+		const int frames = 2000;
+
+		std::shared_ptr<OverheadTechnique> technique;
+		std::shared_ptr<Presenter> presenter = CreatePresenter(ThreadedDescription(3, 0, 0), technique);
+
+		double flushing = 0;
+		double roundtrip = 0;
+		for (int i = 0; i < frames; i++) {
+			presenter->BeginFrame();
+			CPUTask task = technique->DispatchEmpty(DispatchMode::MAIN_THREAD);
+			double start = Now();
+			GPUTask gpu = technique->FlushTasks(1, &task);
+			double flushed = Now();
+			gpu.Wait();
+			flushing += flushed - start;
+			roundtrip += Now() - start;
+			presenter->EndFrame();
+		}
+
+		Report("flush_latency", "flush", flushing * 1e6 / frames, "us");
+		Report("flush_latency", "flush_and_wait", roundtrip * 1e6 / frames, "us");
+	}
+
+	void CombineChains() {
+		const int frames = 200;
+		const int lengths[] = { 1, 8, 64 };
+
+		for (int length : lengths) {
+			std::shared_ptr<OverheadTechnique> technique;
+			std::shared_ptr<Presenter> presenter = CreatePresenter(ThreadedDescription(3, 0, 0), technique);
+
+			double combining = 0;
+			double waiting = 0;
+			for (int i = 0; i < frames; i++) {
+				presenter->BeginFrame();
+				std::vector<GPUTask> tasks;
+				for (int t = 0; t < length; t++) {
+					CPUTask task = technique->DispatchEmpty(DispatchMode::MAIN_THREAD);
+					tasks.push_back(technique->FlushTasks(1, &task));
+				}
+				double start = Now();
+				// Each link combines the previous chain with a new task
+				GPUTask chain = tasks[0];
+				for (int t = 1; t < length; t++) {
+					GPUTask link[] = { chain, tasks[t] };
+					chain = GPUTask::Combine(2, link);
+				}
+				double combined = Now();
+				chain.Wait();
+				combining += combined - start;
+				waiting += Now() - combined;
+				presenter->EndFrame();
+			}
+
+			std::string metric = "length_" + std::to_string(length);
+			Report("combine_chains", (metric + "_combine").c_str(), combining * 1e6 / frames, "us");
+			Report("combine_chains", (metric + "_wait").c_str(), waiting * 1e6 / frames, "us");
+		}
+	}
+
+	void FrameOverhead() {
+		const int frames = 2000;
+
+		for (int inFly = 1; inFly <= 4; inFly++) {
+			std::shared_ptr<OverheadTechnique> technique;
+			std::shared_ptr<Presenter> presenter = CreatePresenter(ThreadedDescription(inFly, 0, 0), technique);
+
+			double begin = 0;
+			double end = 0;
+			for (int i = 0; i < frames; i++) {
+				double start = Now();
+				presenter->BeginFrame();
+				double begun = Now();
+				presenter->EndFrame();
+				begin += begun - start;
+				end += Now() - begun;
+			}
+
+			std::string metric = "frames_" + std::to_string(inFly);
+			Report("frame_overhead", (metric + "_begin").c_str(), begin * 1e6 / frames, "us");
+			Report("frame_overhead", (metric + "_end").c_str(), end * 1e6 / frames, "us");
+		}
+	}
+
+	void FrameThreadScaling() {
+		const int frames = 300;
+		const int processes = 256;
+		const int threads[] = { 0, 1, 2, 4, 8 };
+
+		double baseline = 0;
+		for (int frameThreads : threads) {
+			std::shared_ptr<OverheadTechnique> technique;
+			std::shared_ptr<Presenter> presenter = CreatePresenter(ThreadedDescription(3, frameThreads, 0), technique);
+
+			double start = Now();
+			for (int i = 0; i < frames; i++) {
+				presenter->BeginFrame();
+				for (int p = 0; p < processes; p++)
+					technique->DispatchRecording(DispatchMode::ASYNC_FRAME);
+				presenter->EndFrame();
+			}
+			double frameTime = (Now() - start) * 1e3 / frames;
+			if (frameThreads == 0)
+				baseline = frameTime;
+
+			std::string metric = "frame_threads_" + std::to_string(frameThreads);
+			Report("frame_thread_scaling", (metric + "_frame_time").c_str(), frameTime, "ms");
+			Report("frame_thread_scaling", (metric + "_speedup").c_str(), baseline / frameTime, "x");
+		}
+	}
+
+	static double RecordingFrames(std::shared_ptr<Presenter> presenter, std::shared_ptr<OverheadTechnique> technique, int frames, int processes) {
+		double start = Now();
+		for (int i = 0; i < frames; i++) {
+			presenter->BeginFrame();
+			for (int p = 0; p < processes; p++)
+				technique->DispatchRecording(DispatchMode::ASYNC_FRAME);
+			presenter->EndFrame();
+		}
+		return (Now() - start) * 1e3 / frames;
+	}
+
+	void CaptureReplay() {
+		const int frames = 300;
+		const int processes = 256;
+		const char* path = "capture_replay.goofycap";
+
+		std::shared_ptr<OverheadTechnique> technique;
+		std::shared_ptr<Presenter> presenter = CreatePresenter(ThreadedDescription(3, 2, 0), technique);
+		RecordingFrames(presenter, technique, 30, processes); // warm up
+		double plain = RecordingFrames(presenter, technique, frames, processes);
+		if (!presenter->StartCapture(path))
+			throw std::runtime_error("Failed to create the capture file");
+		double captured = RecordingFrames(presenter, technique, frames, processes);
+		presenter->StopCapture();
+
+		Report("capture_replay", "frame_time", plain, "ms");
+		Report("capture_replay", "captured_frame_time", captured, "ms");
+		Report("capture_replay", "capture_overhead", (captured / plain - 1) * 100, "%");
+
+		std::shared_ptr<OverheadTechnique> replaying;
+		std::shared_ptr<Presenter> replayer = CreatePresenter(ThreadedDescription(3, 2, 0), replaying);
+		ReplayReport report = replayer->Replay(path, 0);
+		Report("capture_replay", "replay_frame_time", report.Frame.Average, "ms");
+		Report("capture_replay", "replay_speedup", report.CapturedTime / report.ReplayTime, "x");
+		remove(path);
+	}
+
+	void ReplayCapture(const char* path, double speed) {
+		std::shared_ptr<OverheadTechnique> technique;
+		std::shared_ptr<Presenter> presenter = CreatePresenter(ThreadedDescription(3, 2, 1), technique);
+		ReplayReport report = presenter->Replay(path, speed);
+		Report("replay", "frames", report.Frames, "frames");
+		Report("replay", "dispatches", report.Dispatches, "processes");
+		Report("replay", "captured_time", report.CapturedTime, "ms");
+		Report("replay", "replay_time", report.ReplayTime, "ms");
+		Report("replay", "frame_time_min", report.Frame.Min, "ms");
+		Report("replay", "frame_time_average", report.Frame.Average, "ms");
+		Report("replay", "frame_time_p99", report.Frame.P99, "ms");
+		Report("replay", "unsupported_commands", report.Unsupported, "commands");
+	}
+}
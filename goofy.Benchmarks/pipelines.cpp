@@ -0,0 +1,74 @@
+#include "benchmarks.h"
+
+#include <cstdio>
+#include <vector>
+
+using namespace goofy;
+
+namespace benchmarks {
+
+	std::vector<unsigned int> EmptyComputeShader(unsigned int localSizeX) {
+		return {
+			0x07230203, 0x00010000, 0, 5, 0,	// Header, bound = 5
+			(2 << 16) | 17, 1,					// OpCapability Shader
+			(3 << 16) | 14, 0, 1,				// OpMemoryModel Logical GLSL450
+			(5 << 16) | 15, 5, 1, 0x6E69616D, 0,	// OpEntryPoint GLCompute %1 "main"
+			(6 << 16) | 16, 1, 17, localSizeX, 1, 1,	// OpExecutionMode %1 LocalSize x 1 1
+			(2 << 16) | 19, 2,					// %2 = OpTypeVoid
+			(3 << 16) | 33, 3, 2,				// %3 = OpTypeFunction %2
+			(5 << 16) | 54, 2, 1, 0, 3,			// %1 = OpFunction %2 None %3
+			(2 << 16) | 248, 4,					// %4 = OpLabel
+			(1 << 16) | 253,					// OpReturn
+			(1 << 16) | 56						// OpFunctionEnd
+		};
+	}
+
+	struct PipelineLoadingTechnique : public Technique {
+		int Pipelines;
+		std::vector<ComputePipeline> Loaded;
+
+		PipelineLoadingTechnique(int pipelines) : Pipelines(pipelines) { }
+
+		virtual void OnLoad() override {
+			for (int i = 0; i < Pipelines; i++) {
+				std::vector<unsigned int> code = EmptyComputeShader(i + 1);
+				ComputePipelineDescription description = {};
+				description.Shader.Code = code.data();
+				description.Shader.Size = code.size() * sizeof(unsigned int);
+				Loaded.push_back(Create(description));
+			}
+		}
+
+		virtual void OnDispatch() override {
+		}
+	};
+
+	// Returns the seconds to create the presenter and all pipelines.
+	static double Startup(const char* cachePath, int pipelines) {
+		double start = Now();
+
+		PresenterDescription description = DefaultDescription();
+		description.pipeline_cache = cachePath;
+		std::shared_ptr<PipelineLoadingTechnique> technique;
+		std::shared_ptr<Presenter> presenter = CreatePresenter(description, technique, pipelines);
+
+		double elapsed = Now() - start;
+		technique = nullptr;
+		presenter = nullptr; // cache is saved here
+		return elapsed;
+	}
+
+	void PipelineCacheStartup() {
+		const char* path = "benchmark.pipelines.cache";
+		const int pipelines = 256;
+
+		remove(path);
+		double cold = Startup(path, pipelines);
+		double warm = Startup(path, pipelines);
+		remove(path);
+
+		Report("pipeline_cache", "cold_startup", cold * 1000, "ms");
+		Report("pipeline_cache", "warm_startup", warm * 1000, "ms");
+		Report("pipeline_cache", "speedup", cold / warm, "x");
+	}
+}
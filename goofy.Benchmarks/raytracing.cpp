@@ -0,0 +1,210 @@
+#include "benchmarks.h"
+
+#include <cmath>
+#include <random>
+
+using namespace goofy;
+
+namespace benchmarks {
+
+	struct ProceduralMesh {
+		std::vector<float> Positions;
+		std::vector<unsigned int> Indices;
+
+		MeshDescription Description() const {
+			MeshDescription description = {};
+			description.Positions = Positions.data();
+			description.VertexCount = (unsigned int)(Positions.size() / 3);
+			description.Indices = Indices.data();
+			description.TriangleCount = (unsigned int)(Indices.size() / 3);
+			description.Opaque = true;
+			return description;
+		}
+	};
+
+	// Displaced sphere of segments x segments quads, like a scanned rock or a prop of a scene.
+	static ProceduralMesh Rock(int segments, std::mt19937& random) {
+		ProceduralMesh mesh;
+		std::uniform_real_distribution<float> noise(0.9f, 1.1f);
+		const float pi = 3.14159265f;
+		for (int y = 0; y <= segments; y++)
+			for (int x = 0; x <= segments; x++) {
+				float theta = pi * y / segments, phi = 2 * pi * x / segments, r = noise(random);
+				mesh.Positions.insert(mesh.Positions.end(), { r * sin(theta) * cos(phi), r * cos(theta), r * sin(theta) * sin(phi) });
+			}
+		for (int y = 0; y < segments; y++)
+			for (int x = 0; x < segments; x++) {
+				unsigned int v = y * (segments + 1) + x;
+				mesh.Indices.insert(mesh.Indices.end(), { v, v + 1, v + segments + 1, v + 1, v + segments + 2, v + segments + 1 });
+			}
+		return mesh;
+	}
+
+	// Heightfield of size x size quads, a terrain tile.
+	static ProceduralMesh Terrain(int size) {
+		ProceduralMesh mesh;
+		for (int y = 0; y <= size; y++)
+			for (int x = 0; x <= size; x++)
+				mesh.Positions.insert(mesh.Positions.end(), { (float)x, 8 * sin(x * 0.05f) * cos(y * 0.07f), (float)y });
+		for (int y = 0; y < size; y++)
+			for (int x = 0; x < size; x++) {
+				unsigned int v = y * (size + 1) + x;
+				mesh.Indices.insert(mesh.Indices.end(), { v, v + 1, v + size + 1, v + 1, v + size + 2, v + size + 1 });
+			}
+		return mesh;
+	}
+
+	struct AccelerationStructureTechnique : public Technique {
+		const std::vector<MeshDescription>* Meshes;
+		std::vector<AccelerationStructure> Structures;
+
+		AccelerationStructureTechnique(const std::vector<MeshDescription>* meshes) : Meshes(meshes) { }
+
+		// Measures the time in seconds of building every mesh and the device memory in megabytes of the structures.
+		void Measure(double& time, double& memory) {
+			Structures = std::vector<AccelerationStructure>(Meshes->size());
+			double start = Now();
+			Build((int)Meshes->size(), Meshes->data(), Structures.data());
+			time = Now() - start;
+			unsigned long long bytes = 0;
+			for (const AccelerationStructure& structure : Structures)
+				bytes += structure.Size();
+			memory = bytes / (1024.0 * 1024.0);
+		}
+
+		virtual void OnLoad() override { }
+
+		virtual void OnDispatch() override { }
+	};
+
+	void AccelerationStructureBuild() {
+		const int meshCount = 2000;
+		std::mt19937 random(5);
+		std::vector<ProceduralMesh> meshes;
+		std::vector<MeshDescription> descriptions;
+		double triangles = 0;
+		for (int i = 0; i < meshCount; i++)
+			meshes.push_back(Rock(8 + (int)(random() % 41), random));
+		for (const ProceduralMesh& mesh : meshes) {
+			descriptions.push_back(mesh.Description());
+			triangles += descriptions.back().TriangleCount;
+		}
+
+		// Single meshes from one subtree (built by one thread) to hundreds of subtrees binned and built in parallel
+		for (int size : { 32, 128, 512, 1024 }) {
+			ProceduralMesh terrain = Terrain(size);
+			MeshDescription mesh = terrain.Description();
+			double start = Now();
+			BVH bvh = BuildBVH(mesh);
+			double elapsed = Now() - start;
+			std::string metric = "bvh_" + std::to_string(mesh.TriangleCount / 1024) + "k";
+			Report("acceleration_structure_build", (metric + "_throughput").c_str(), mesh.TriangleCount / elapsed * 1e-6, "MTris/s");
+			Report("acceleration_structure_build", (metric + "_nodes_per_triangle").c_str(), (double)bvh.Nodes.size() / mesh.TriangleCount, "nodes");
+		}
+
+		std::shared_ptr<AccelerationStructureTechnique> technique;
+		std::shared_ptr<Presenter> presenter = CreatePresenter(DefaultDescription(), technique, &descriptions);
+
+		double time, memory;
+		technique->Measure(time, memory);
+		Report("acceleration_structure_build", "software", technique->Structures[0].IsSoftware() ? 1 : 0, "bool");
+		Report("acceleration_structure_build", "scene_build_time", time * 1e3, "ms");
+		Report("acceleration_structure_build", "scene_throughput", triangles / time * 1e-6, "MTris/s");
+		Report("acceleration_structure_build", "scene_memory", memory, "MB");
+		Report("acceleration_structure_build", "scene_bytes_per_triangle", memory * 1024 * 1024 / triangles, "bytes");
+	}
+
+	// Twists the rocks around the vertical axis, more every frame, so refitting degrades the hierarchies until they are rebuilt.
+	struct RefitProcess : public Process {
+		const std::vector<ProceduralMesh>* Meshes;
+		std::vector<AccelerationStructure>* Structures;
+		std::vector<std::vector<float>> Animated;
+		int Frame = 0;
+		double UpdateTime = 0;
+
+		virtual EngineType RequiredEngines() override { return RaytracingManager::SupportedEngines; }
+
+		virtual void Populate(CommandListManager manager) override {
+			float twist = 0.05f * Frame++;
+			for (size_t i = 0; i < Meshes->size(); i++) {
+				const std::vector<float>& source = (*Meshes)[i].Positions;
+				Animated[i].resize(source.size());
+				for (size_t v = 0; v < source.size(); v += 3) {
+					float angle = twist * source[v + 1];
+					Animated[i][v] = source[v] * cos(angle) - source[v + 2] * sin(angle);
+					Animated[i][v + 1] = source[v + 1];
+					Animated[i][v + 2] = source[v] * sin(angle) + source[v + 2] * cos(angle);
+				}
+			}
+			double start = Now();
+			for (size_t i = 0; i < Meshes->size(); i++)
+				manager.As<RaytracingManager>().Update((*Structures)[i], Animated[i].data());
+			UpdateTime += Now() - start;
+		}
+	};
+
+	struct RefitTechnique : public Technique {
+		const std::vector<ProceduralMesh>* Meshes;
+		std::vector<MeshDescription> Descriptions;
+		std::vector<AccelerationStructure> Structures;
+		std::shared_ptr<RefitProcess> Updates;
+
+		RefitTechnique(const std::vector<ProceduralMesh>* meshes) : Meshes(meshes) { }
+
+		// Measures the time in seconds of building every mesh from scratch, what a frame would cost without updates.
+		double MeasureRebuild() {
+			std::vector<AccelerationStructure> structures(Descriptions.size());
+			std::vector<MeshDescription> rebuilt = Descriptions;
+			for (MeshDescription& description : rebuilt)
+				description.Dynamic = false;
+			double start = Now();
+			Build((int)rebuilt.size(), rebuilt.data(), structures.data());
+			return Now() - start;
+		}
+
+		virtual void OnLoad() override {
+			for (const ProceduralMesh& mesh : *Meshes) {
+				Descriptions.push_back(mesh.Description());
+				Descriptions.back().Dynamic = true;
+			}
+			Structures = std::vector<AccelerationStructure>(Descriptions.size());
+			Build((int)Descriptions.size(), Descriptions.data(), Structures.data());
+			Updates = std::shared_ptr<RefitProcess>(new RefitProcess());
+			Updates->Meshes = Meshes;
+			Updates->Structures = &Structures;
+			Updates->Animated.resize(Meshes->size());
+		}
+
+		virtual void OnDispatch() override {
+			Dispatch(Updates);
+		}
+	};
+
+	void AccelerationStructureRefit() {
+		const int meshCount = 200;
+		const int frames = 100;
+		std::mt19937 random(9);
+		std::vector<ProceduralMesh> meshes;
+		double triangles = 0;
+		for (int i = 0; i < meshCount; i++) {
+			meshes.push_back(Rock(48, random));
+			triangles += meshes.back().Indices.size() / 3;
+		}
+
+		std::shared_ptr<RefitTechnique> technique;
+		std::shared_ptr<Presenter> presenter = CreatePresenter(DefaultDescription(), technique, &meshes);
+		double elapsed = RunFrames(presenter, technique, frames);
+		unsigned int rebuilds = 0;
+		for (const AccelerationStructure& structure : technique->Structures)
+			rebuilds += structure.Rebuilds();
+
+		double update = technique->Updates->UpdateTime / frames;
+		double rebuild = technique->MeasureRebuild();
+		Report("acceleration_structure_refit", "update_time", update * 1e3, "ms");
+		Report("acceleration_structure_refit", "update_throughput", triangles / update * 1e-6, "MTris/s");
+		Report("acceleration_structure_refit", "frame_time", elapsed / frames * 1e3, "ms");
+		Report("acceleration_structure_refit", "full_rebuild_time", rebuild * 1e3, "ms");
+		Report("acceleration_structure_refit", "update_speedup", rebuild / update, "x");
+		Report("acceleration_structure_refit", "rebuilds_per_structure", (double)rebuilds / meshCount, "rebuilds");
+	}
+}
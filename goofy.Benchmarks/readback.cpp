@@ -0,0 +1,59 @@
+#include "benchmarks.h"
+
+#include <deque>
+
+using namespace goofy;
+
+namespace benchmarks {
+
+	struct FrameReadbackTechnique : public Technique {
+		bool ReadEveryFrame;
+		std::deque<Readback> InFlight;
+		unsigned long long Checksum = 0;
+
+		FrameReadbackTechnique(bool readEveryFrame) : ReadEveryFrame(readEveryFrame) { }
+
+		virtual void OnLoad() override {
+		}
+
+		void Clearing(GraphicsManager manager) {
+			manager.Clear(GetCurrentRenderTarget(), Formats::R32G32B32A32_SFLOAT(0, 0, 1, 1));
+		}
+
+		virtual void OnDispatch() override
+		{
+			Dispatch_Method(Clearing);
+
+			if (!ReadEveryFrame)
+				return;
+
+			InFlight.push_back(Download(GetCurrentRenderTarget()));
+
+			// Frame N is consumed at frame N + frames-in-fly, when its slot has already been retired.
+			if ((int)InFlight.size() > NumberOfFrames()) {
+				Readback oldest = InFlight.front();
+				InFlight.pop_front();
+				Checksum += ((const unsigned char*)oldest.Data())[oldest.Size() / 2];
+			}
+		}
+	};
+
+	static double FramesPerSecond(bool readEveryFrame, int frames) {
+		PresenterDescription description = DefaultDescription();
+		description.mode = PresenterCreationMode::OFFLINE; // Swapchain images are not read back
+		std::shared_ptr<FrameReadbackTechnique> technique;
+		std::shared_ptr<Presenter> presenter = CreatePresenter(description, technique, readEveryFrame);
+		return frames / RunFrames(presenter, technique, frames);
+	}
+
+	void FrameReadback() {
+		const int frames = 2000;
+
+		double baseline = FramesPerSecond(false, frames);
+		double reading = FramesPerSecond(true, frames);
+
+		Report("frame_readback", "fps_no_readback", baseline, "fps");
+		Report("frame_readback", "fps_readback", reading, "fps");
+		Report("frame_readback", "throughput_ratio", reading / baseline, "x");
+	}
+}
@@ -0,0 +1,75 @@
+#include "benchmarks.h"
+
+#include <algorithm>
+
+using namespace goofy;
+
+namespace benchmarks {
+
+	struct StreamingUploadTechnique : public Technique {
+		unsigned long long BufferSize;
+		int Buffers;
+		std::vector<char> Source;
+		std::vector<Buffer> Targets;
+		std::vector<GPUTask> Uploads;
+
+		StreamingUploadTechnique(unsigned long long bufferSize, int buffers) : BufferSize(bufferSize), Buffers(buffers) { }
+
+		virtual void OnLoad() override {
+			Source.resize(BufferSize, 1);
+
+			BufferDescription description = {};
+			description.size = BufferSize;
+			description.Usage.TransferDestination = true;
+			description.Usage.Storage = true;
+			for (int i = 0; i < Buffers; i++)
+				Targets.push_back(Create(description));
+		}
+
+		void StartLoading() {
+			for (int i = 0; i < Buffers; i++)
+				Uploads.push_back(Upload(Targets[i], Source.data(), BufferSize));
+		}
+
+		void FinishLoading() {
+			for (GPUTask& t : Uploads)
+				t.Wait();
+			Uploads.clear();
+		}
+
+		void Clearing(GraphicsManager manager) {
+			manager.Clear(GetCurrentRenderTarget(), Formats::R32G32B32A32_SFLOAT(0, 0, 0, 1));
+		}
+
+		virtual void OnDispatch() override
+		{
+			Dispatch_Method(Clearing);
+		}
+	};
+
+	void StreamingUpload() {
+		const unsigned long long budget = 16 * 1024 * 1024;
+		const unsigned long long bufferSize = 64 * 1024 * 1024;
+		const int buffers = 32; // 2GB scene
+
+		PresenterDescription description = DefaultDescription();
+		description.upload_budget = budget;
+		std::shared_ptr<StreamingUploadTechnique> technique;
+		std::shared_ptr<Presenter> presenter = CreatePresenter(description, technique, bufferSize, buffers);
+
+		// Render while the scene is streamed, all chunks should be scheduled after total / budget frames.
+		int frames = (int)(bufferSize * buffers / budget) + presenter->NumberOfFrames() + 1;
+		double worstFrame = 0;
+
+		double start = Now();
+		technique->StartLoading();
+		double totalFrames = RunFrames(presenter, technique, frames, &worstFrame);
+		technique->FinishLoading();
+		double loadTime = Now() - start;
+
+		Report("streaming_upload", "load_time", loadTime, "s");
+		Report("streaming_upload", "bandwidth", bufferSize * buffers / loadTime / (1024 * 1024 * 1024), "GB/s");
+		Report("streaming_upload", "avg_frame", totalFrames / frames * 1000, "ms");
+		Report("streaming_upload", "worst_frame", worstFrame * 1000, "ms");
+	}
+}
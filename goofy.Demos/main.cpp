@@ -1,4 +1,4 @@
-#include "..\goofy.h"
+#include "../goofy.h"
 
 #include <exception>
 
@@ -18,7 +18,7 @@ struct TestTechnique : public Technique {
 	}
 };
 
-void main() {
+int main() {
 
 	try {
 
@@ -62,6 +62,9 @@ void main() {
 
 			if (current_frame % 1000 == 0) {
 				std::cout << "Time per frame (ms): " << (mspf * 1000) << std::endl;
+				DeviceStatistics statistics = presenter->GetStatistics();
+				std::cout << "Dispatches per frame: " << statistics.DispatchesPerFrame << " Submits per frame: " << statistics.SubmitsPerFrame << std::endl;
+				std::cout << "GPU task waits: " << statistics.GPUTaskWaits.Waits << " (" << statistics.GPUTaskWaits.TotalMilliseconds << " ms)" << std::endl;
 			}
 		}
 	}
@@ -1,28 +1,63 @@
 
-
 #include "goofy.states.h"
 
+#include <cmath>
+#include <unordered_map>
+#ifdef __GNUC__
+#include <cxxabi.h>
+#endif
+
 namespace goofy {
 
+	const char* Process::Name() {
+		// Names are demangled once per type and kept for the process lifetime, the lookup happens on every dispatch
+		thread_local std::unordered_map<const std::type_info*, const char*> local;
+		const std::type_info* type = &typeid(*this);
+		auto found = local.find(type);
+		if (found != local.end())
+			return found->second;
+
+		static std::mutex mutex;
+		static std::unordered_map<std::string, std::string> names;
+		std::lock_guard<std::mutex> lock(mutex);
+		auto inserted = names.emplace(type->name(), std::string());
+		if (inserted.second) {
+			inserted.first->second = type->name();
+#ifdef __GNUC__
+			int status = 0;
+			char* demangled = abi::__cxa_demangle(type->name(), nullptr, nullptr, &status);
+			if (status == 0 && demangled != nullptr)
+				inserted.first->second = demangled;
+			free(demangled);
+#endif
+		}
+		return local[type] = inserted.first->second.c_str();
+	}
+
 	Device::Device(states::__Device* initialState) {
 		this->__state = std::shared_ptr<states::__Device>(initialState);
 	}
 
-	inline int Device::GetCurrentFrameIndex()
+	int Device::GetCurrentFrameIndex()
 	{
 		return __state->_FrameIndex;
 	}
 
-	inline int Device::NumberOfFrames() {
+	DeviceStatistics Device::GetStatistics()
+	{
+		return __state->GetStatistics();
+	}
+
+	int Device::NumberOfFrames() {
 		return __state->NumberOfFrames();
 	}
 
-	inline int Device::RenderTargetWidth()
+	int Device::RenderTargetWidth()
 	{
 		return __state->_RT_Resolution.width;
 	}
 
-	inline int Device::RenderTargetHeight()
+	int Device::RenderTargetHeight()
 	{
 		return __state->_RT_Resolution.height;
 	}
@@ -55,16 +90,212 @@ namespace goofy {
 			) };
 	}
 
+	Buffer Device::Create(const BufferDescription& description)
+	{
+		Buffer buffer;
+		buffer.__state = __state->CreateBuffer(description.size, states::__Convert(description.Usage), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		return buffer;
+	}
+
+	Image1D Device::Create(const Image1DDescription& description)
+	{
+		Image1D image;
+		image.__state = __state->CreateImage(VK_IMAGE_TYPE_1D, (VkFormat)description.Format, VkExtent3D{ description.width, 1, 1 }, description.mips, description.arrays, states::__Convert(description.Usage));
+		return image;
+	}
+
+	Image2D Device::Create(const Image2DDescription& description)
+	{
+		Image2D image;
+		image.__state = __state->CreateImage(VK_IMAGE_TYPE_2D, (VkFormat)description.Format, VkExtent3D{ description.width, description.height, 1 }, description.mips, description.arrays, states::__Convert(description.Usage));
+		return image;
+	}
+
+	ComputePipeline Device::Create(const ComputePipelineDescription& description)
+	{
+		ComputePipeline pipeline;
+		pipeline.__state = __state->CreateComputePipeline(description);
+		return pipeline;
+	}
+
+	GraphicsPipeline Device::Create(const GraphicsPipelineDescription& description)
+	{
+		GraphicsPipeline pipeline;
+		pipeline.__state = __state->CreateGraphicsPipeline(description);
+		return pipeline;
+	}
+
+	ComputePipeline Device::CreateAsync(const ComputePipelineDescription& description)
+	{
+		ComputePipeline pipeline;
+		pipeline.__state = __state->CreateComputePipeline(description, true);
+		return pipeline;
+	}
+
+	GraphicsPipeline Device::CreateAsync(const GraphicsPipelineDescription& description)
+	{
+		GraphicsPipeline pipeline;
+		pipeline.__state = __state->CreateGraphicsPipeline(description, true);
+		return pipeline;
+	}
+
+	ComputePipeline Device::CreateVariant(const ComputePipelineDescription& description)
+	{
+		ComputePipeline pipeline;
+		pipeline.__state = __state->CreateComputeVariant(description);
+		return pipeline;
+	}
+
+	GraphicsPipeline Device::CreateVariant(const GraphicsPipelineDescription& description)
+	{
+		GraphicsPipeline pipeline;
+		pipeline.__state = __state->CreateGraphicsVariant(description);
+		return pipeline;
+	}
+
+	bool Pipeline::IsReady() const
+	{
+		return __state->Ready.load() && __state->Error.empty();
+	}
+
+	void Pipeline::Wait()
+	{
+		__state->Wait();
+	}
+
+	ResourceHandle Device::Register(const Resource& resource)
+	{
+		return ResourceHandle{ __state->_Pool->Register(resource.__state) };
+	}
+
+	void Device::Release(ResourceHandle handle)
+	{
+		__state->_Pool->Release(handle.Value);
+	}
+
+	bool Device::IsAlive(ResourceHandle handle)
+	{
+		return __state->_Pool->IsAlive(handle.Value);
+	}
+
+	Image3D Device::Create(const Image3DDescription& description)
+	{
+		Image3D image;
+		image.__state = __state->CreateImage(VK_IMAGE_TYPE_3D, (VkFormat)description.Format, VkExtent3D{ description.width, description.height, description.depth }, description.mips, 1, states::__Convert(description.Usage));
+		return image;
+	}
+
+	GPUTask Device::Upload(Buffer buffer, const void* data, unsigned long long size, unsigned long long offset)
+	{
+		return GPUTask{ __state->Upload(buffer.__state, data, size, offset) };
+	}
+
+	GPUTask Device::Upload(Image1D image, const void* data)
+	{
+		return GPUTask{ __state->Upload(image.__state, data, 0, 0) };
+	}
+
+	GPUTask Device::Upload(Image2D image, const void* data)
+	{
+		return GPUTask{ __state->Upload(image.__state, data, 0, 0) };
+	}
+
+	GPUTask Device::Upload(Image2D image, const Formats::R8G8B8A8* pixels, Formats::CompressionPreset preset)
+	{
+		return GPUTask{ __state->UploadCompressed(image.__state, (const unsigned char*)pixels, preset) };
+	}
+
+	GPUTask Device::Upload(Image3D image, const void* data)
+	{
+		return GPUTask{ __state->Upload(image.__state, data, 0, 0) };
+	}
+
+	GPUTask Device::UploadFile(Buffer buffer, const char* path, unsigned long long offset)
+	{
+		return GPUTask{ __state->UploadFile(buffer.__state, path, 0, offset) };
+	}
+
+	GPUTask Device::UploadFile(Image1D image, const char* path, unsigned long long fileOffset)
+	{
+		return GPUTask{ __state->UploadFile(image.__state, path, fileOffset, 0) };
+	}
+
+	GPUTask Device::UploadFile(Image2D image, const char* path, unsigned long long fileOffset)
+	{
+		return GPUTask{ __state->UploadFile(image.__state, path, fileOffset, 0) };
+	}
+
+	GPUTask Device::UploadFile(Image3D image, const char* path, unsigned long long fileOffset)
+	{
+		return GPUTask{ __state->UploadFile(image.__state, path, fileOffset, 0) };
+	}
+
+	void Device::Build(int count, const MeshDescription* meshes, AccelerationStructure* structures)
+	{
+		std::vector<std::shared_ptr<states::__AccelerationStructure>> built(std::max(count, 0));
+		__state->BuildAccelerationStructures(count, meshes, built.data());
+		for (int i = 0; i < count; i++)
+			structures[i].__state = built[i];
+	}
+
+	Readback Device::Download(Buffer buffer, unsigned long long size, unsigned long long offset)
+	{
+		Readback readback;
+		readback.__state = __state->Download(buffer.__state, size, offset);
+		return readback;
+	}
+
+	Readback Device::Download(Image1D image)
+	{
+		Readback readback;
+		readback.__state = __state->Download(image.__state, 0, 0);
+		return readback;
+	}
+
+	Readback Device::Download(Image2D image)
+	{
+		Readback readback;
+		readback.__state = __state->Download(image.__state, 0, 0);
+		return readback;
+	}
+
+	Readback Device::Download(Image3D image)
+	{
+		Readback readback;
+		readback.__state = __state->Download(image.__state, 0, 0);
+		return readback;
+	}
+
 	Presenter::Presenter(const PresenterDescription& description):Device(new states::__Device(description)) {
 	}
 
 	void goofy::Presenter::BeginFrame()
 	{
+		Tracer::Frame.store(__state->_FrameNumber, std::memory_order_relaxed);
+		TraceScope trace("BeginFrame");
+		if (__state->_Capture != nullptr)
+			__state->_Capture->Frame(states::__CaptureOp::BEGIN_FRAME);
+
 		for (goofy::states::__EngineManager* e : __state->_Engines)
 			e->WaitForCompletition(__state->_FrameIndex); // auto submit all pending work
 
+		// Objects whose submissions finished are not used by the GPU anymore
+		__state->_Destruction->Retire();
+
+		// Schedule streaming uploads within this frame budget
+		__state->_Uploader->Pump();
+
+		// Offline presenter rotates its render targets, the slot was already retired
+		if (__state->_Swapchain == nullptr) {
+			__state->_ImageIndex = __state->_FrameIndex;
+			return;
+		}
+
 		// Get Index of the current target in swapchain
-		vkAcquireNextImageKHR(__state->_Device, __state->_Swapchain, UINT64_MAX, __state->ImageReadyToRender[__state->_FrameIndex], VK_NULL_HANDLE, &__state->_ImageIndex);
+		{
+			TraceScope acquire("AcquireNextImage");
+			vkAcquireNextImageKHR(__state->_Device, __state->_Swapchain, UINT64_MAX, __state->ImageReadyToRender[__state->_FrameIndex], VK_NULL_HANDLE, &__state->_ImageIndex);
+		}
 
 		// Enqueue signaling for waiting for image to be ready.
 		VkSubmitInfo submitInfo{};
@@ -86,8 +317,30 @@ namespace goofy {
 
 	void Presenter::EndFrame()
 	{
+		TraceScope trace("EndFrame");
+		if (__state->_Capture != nullptr)
+			__state->_Capture->Frame(states::__CaptureOp::END_FRAME);
+
+		// Pieces still queued would be populated in the next frame's command lists
+		__state->__WaitFramePopulation();
+
+		std::vector<std::shared_ptr<goofy::states::__GPUTask>> submitted;
 		for (goofy::states::__EngineManager* e : __state->_Engines)
-			e->Flush(__state->_FrameIndex); // auto submit all pending work
+			e->Flush(__state->_FrameIndex, submitted); // auto submit all pending work
+
+		// Readbacks requested in this frame complete with its command lists
+		__state->__FrameSubmitted(submitted);
+		__state->_Destruction->Submitted(submitted.size(), submitted.data());
+
+		if (__state->_FrameWriter != nullptr)
+			__state->__OutputFrame(submitted);
+
+		__state->_FrameNumber++;
+
+		if (__state->_Swapchain == nullptr) { // Nothing to present offline
+			__state->_FrameIndex = (__state->_FrameIndex + 1) % __state->_NumberOfFrames;
+			return;
+		}
 
 		// Enqueue signaling for waiting for image to be ready to present.
 		VkSubmitInfo submitInfo{};
@@ -114,11 +367,138 @@ namespace goofy {
 		__state->_FrameIndex = (__state->_FrameIndex + 1) % __state->_NumberOfFrames;
 	}
 
+	void Presenter::AttachOutput(const FrameOutputDescription& description)
+	{
+		__state->AttachOutput(description);
+	}
+
+	void Presenter::DetachOutput()
+	{
+		__state->DetachOutput();
+	}
+
 	void Presenter::CreateNew(const PresenterDescription& description, std::shared_ptr<Presenter>& presenter)
 	{
 		presenter = std::shared_ptr<Presenter>(new Presenter(description));
 	}
 
+	void Presenter::StartTrace(int events_per_thread)
+	{
+		Tracer::Start(events_per_thread > 0 ? events_per_thread : 65536);
+	}
+
+	bool Presenter::StopTrace(const char* path)
+	{
+		Tracer::Stop();
+		return Tracer::Write(path);
+	}
+
+	bool Presenter::StartCapture(const char* path)
+	{
+		StopCapture();
+		FILE* file = fopen(path, "wb");
+		if (file == nullptr)
+			return false;
+		__state->_Capture = std::shared_ptr<states::__Capture>(new states::__Capture(file));
+		return true;
+	}
+
+	void Presenter::StopCapture()
+	{
+		if (__state->_Capture == nullptr)
+			return;
+		__state->_Capture->Close();
+		__state->_Capture = nullptr;
+	}
+
+	ReplayReport Presenter::Replay(const char* path, double speed)
+	{
+		states::__Replay replay(__state.get(), path);
+
+		ReplayReport report{};
+		std::map<uint32_t, std::shared_ptr<states::__CPUTask>> dispatched;
+		std::map<uint32_t, std::shared_ptr<states::__GPUTask>> flushed;
+		std::vector<double> frames;
+		std::vector<std::shared_ptr<states::__CPUTask>> tasks;
+		std::vector<std::shared_ptr<states::__GPUTask>> waits;
+
+		unsigned long long capturedStart = 0;
+		unsigned long long start = Tracer::Now();
+		unsigned long long frameStart = start;
+		bool first = true;
+		for (const states::__ReplayEvent& e : replay.Events) {
+			if (first) {
+				capturedStart = e.Time;
+				first = false;
+			}
+			if (speed > 0) { // Keep the captured pace scaled by the speed
+				unsigned long long due = start + (unsigned long long)((e.Time - capturedStart) / speed);
+				unsigned long long now = Tracer::Now();
+				if (due > now)
+					std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+			}
+
+			switch (e.Op) {
+			case states::__CaptureOp::BEGIN_FRAME:
+				frameStart = Tracer::Now();
+				BeginFrame();
+				break;
+			case states::__CaptureOp::END_FRAME:
+				EndFrame();
+				frames.push_back((Tracer::Now() - frameStart) / 1000000.0);
+				report.CapturedTime = (e.Time - capturedStart) / 1000000.0;
+				break;
+			case states::__CaptureOp::DISPATCH:
+				dispatched[e.Id] = __state->Dispatch(replay.Processes[e.Id], e.Mode);
+				report.Dispatches++;
+				break;
+			case states::__CaptureOp::FLUSH:
+			{
+				tasks.clear();
+				waits.clear();
+				for (uint32_t t : e.Tasks) {
+					auto task = dispatched.find(t);
+					if (task != dispatched.end())
+						tasks.push_back(task->second);
+				}
+				for (uint32_t w : e.Waits) {
+					auto wait = flushed.find(w);
+					if (wait != flushed.end())
+						waits.push_back(wait->second);
+				}
+				flushed[e.Id] = __state->Flush((int)tasks.size(), tasks.data(), (int)waits.size(), waits.data());
+				break;
+			}
+			default:
+				break;
+			}
+		}
+		// Replayed processes read the capture, it must outlive their population
+		for (auto& task : dispatched)
+			task.second->Wait();
+		report.ReplayTime = (Tracer::Now() - start) / 1000000.0;
+		report.Unsupported = replay.Unsupported.load();
+
+		report.Frames = (int)frames.size();
+		report.Frame.Samples = report.Frames;
+		if (!frames.empty()) {
+			std::sort(frames.begin(), frames.end());
+			report.Frame.Min = frames[0];
+			report.Frame.Average = std::accumulate(frames.begin(), frames.end(), 0.0) / frames.size();
+			report.Frame.P99 = frames[std::min(frames.size() - 1, frames.size() * 99 / 100)];
+		}
+		return report;
+	}
+
+	ProfileReport Presenter::Profile()
+	{
+#ifndef GOOFY_NO_PROFILING
+		if (__state->_Profiler != nullptr)
+			return __state->_Profiler->Report();
+#endif
+		return ProfileReport();
+	}
+
 	Window Presenter::Window()
 	{
 		auto w = goofy::Window();
@@ -135,8 +515,225 @@ namespace goofy {
 		return this->_supported_engines;
 	}
 
+	void CommandListManager::Set(const Binder& binder)
+	{
+		if (((int)this->_supported_engines & (int)binder._engine) == 0)
+			throw std::runtime_error("Binder is not supported by this command list");
+
+		const unsigned int* constants = binder._constants;
+		unsigned int resolved[32];
+		if (binder._handles != 0) {
+			states::__ResourcePool* pool = this->__state->Pool;
+			memcpy(resolved, binder._constants, binder._count * 4);
+			for (int i = 0; i < binder._count; i++)
+				if (binder._handles & (1u << i)) {
+					uint32_t slot = pool->Slot(resolved[i]);
+					bool sampled = (binder._sampled & (1u << i)) && pool->Images[slot] != nullptr && pool->SampledIndices[slot] != Resource::NoIndex;
+					resolved[i] = sampled ? pool->SampledIndices[slot] : pool->StorageIndices[slot];
+					if (resolved[i] == Resource::NoIndex)
+						throw std::runtime_error("Resource is not in the descriptor heap");
+				}
+			constants = resolved;
+		}
+		this->__state->__Push(binder._engine, binder._count, constants);
+	}
+
+	void Binder::Set(int slot, unsigned int value)
+	{
+		if (slot < 0 || slot >= 32)
+			throw std::runtime_error("Binder slot out of range");
+		_constants[slot] = value;
+		_count = std::max(_count, slot + 1);
+		_handles &= ~(1u << slot);
+	}
+
+	void Binder::Set(int slot, float value)
+	{
+		unsigned int bits;
+		memcpy(&bits, &value, sizeof(float));
+		Set(slot, bits);
+	}
+
+	void Binder::Set(int slot, const Resource& resource, ResourceAccess access)
+	{
+		std::shared_ptr<states::__Resource> state = resource.__state;
+		unsigned int index = !state->IsBuffer && access == ResourceAccess::READ && state->SampledIndex != Resource::NoIndex
+			? state->SampledIndex
+			: state->StorageIndex;
+		if (index == Resource::NoIndex)
+			throw std::runtime_error("Resource is not in the descriptor heap");
+		Set(slot, index);
+	}
+
+	Image2D Image2D::Slice(int mip_start, int mip_count, int array_start, int array_count)
+	{
+		states::ImageSliceDescription slice = __state->ImageSlice;
+		if (mip_start + mip_count > slice.mip_count || array_start + array_count > slice.array_count)
+			throw std::runtime_error("Image slice out of range");
+		slice.mip_start += mip_start;
+		slice.mip_count = mip_count;
+		slice.array_start += array_start;
+		slice.array_count = array_count;
+		slice.ImageType = array_count > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+
+		Image2D result;
+		result.__state = __state->device->__CreateSlice(__state.get(), slice);
+		return result;
+	}
+
+	static VkFilter __Convert(Filter filter) {
+		return filter == Filter::NEAREST ? VK_FILTER_NEAREST : VK_FILTER_LINEAR;
+	}
+
+	static VkSamplerAddressMode __Convert(AddressMode mode) {
+		switch (mode) {
+		case AddressMode::MIRRORED_REPEAT: return VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;
+		case AddressMode::CLAMP_TO_EDGE: return VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		case AddressMode::CLAMP_TO_BORDER: return VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+		default: return VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		}
+	}
+
+	Texture2D Image2D::AsTexture(const Sampler& sampler)
+	{
+		states::__SamplerKey key{
+			__Convert(sampler.MinFilter),
+			__Convert(sampler.MagFilter),
+			sampler.MipFilter == Filter::NEAREST ? VK_SAMPLER_MIPMAP_MODE_NEAREST : VK_SAMPLER_MIPMAP_MODE_LINEAR,
+			__Convert(sampler.AddressU),
+			__Convert(sampler.AddressV),
+			__Convert(sampler.AddressW),
+			sampler.MipLodBias,
+			sampler.MaxAnisotropy,
+			sampler.MinLod,
+			sampler.MaxLod
+		};
+		states::__CachedSampler cached = __state->device->_Views->FetchSampler(key);
+
+		Texture2D result;
+		result.__state = __state->device->__CreateSlice(__state.get(), __state->ImageSlice, cached.Sampler, cached.Index);
+		return result;
+	}
+
+	unsigned int Texture2D::SamplerIndex() const
+	{
+		return __state->SamplerIndex;
+	}
+
+	void Binder::Set(int slot, ResourceHandle resource, ResourceAccess access)
+	{
+		Set(slot, resource.Value);
+		_handles |= 1u << slot;
+		if (access == ResourceAccess::READ)
+			_sampled |= 1u << slot;
+		else
+			_sampled &= ~(1u << slot);
+	}
+
+	unsigned int Resource::SampledIndex() const
+	{
+		return __state->SampledIndex;
+	}
+
+	unsigned int Resource::StorageIndex() const
+	{
+		return __state->StorageIndex;
+	}
+
+	bool AccelerationStructure::IsSoftware() const
+	{
+		return __state->Software;
+	}
+
+	unsigned long long AccelerationStructure::DeviceAddress() const
+	{
+		return __state->Address;
+	}
+
+	unsigned long long AccelerationStructure::Size() const
+	{
+		return __state->Size;
+	}
+
+	unsigned int AccelerationStructure::StorageIndex() const
+	{
+		return __state->Software ? __state->Storage->StorageIndex : Resource::NoIndex;
+	}
+
+	unsigned int AccelerationStructure::RootNode() const
+	{
+		return __state->Software ? (unsigned int)__state->Offset : 0;
+	}
+
+	unsigned int AccelerationStructure::Rebuilds() const
+	{
+		return __state->Dynamic != nullptr ? __state->Dynamic->Rebuilds : 0;
+	}
+
+	void FrustumPlanes(const float viewProjection[16], float planes[6][4])
+	{
+		// Rows of the matrix, combined as Gribb and Hartmann. With 0 to 1 depth the near plane is the third row alone
+		float rows[4][4];
+		for (int r = 0; r < 4; r++)
+			for (int c = 0; c < 4; c++)
+				rows[r][c] = viewProjection[c * 4 + r];
+		for (int c = 0; c < 4; c++) {
+			planes[0][c] = rows[3][c] + rows[0][c];
+			planes[1][c] = rows[3][c] - rows[0][c];
+			planes[2][c] = rows[3][c] + rows[1][c];
+			planes[3][c] = rows[3][c] - rows[1][c];
+			planes[4][c] = rows[2][c];
+			planes[5][c] = rows[3][c] - rows[2][c];
+		}
+		for (int p = 0; p < 6; p++) {
+			float length = sqrtf(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+			if (length > 0)
+				for (int c = 0; c < 4; c++)
+					planes[p][c] /= length;
+		}
+	}
+
+	void goofy::GraphicsManager::BeginRendering(Image2D renderTarget)
+	{
+		this->__state->__BeginRendering(renderTarget.__state.get(), nullptr);
+	}
+
+	void goofy::GraphicsManager::BeginRendering(Image2D renderTarget, Image2D depth)
+	{
+		this->__state->__BeginRendering(renderTarget.__state.get(), depth.__state.get());
+	}
+
+	void goofy::GraphicsManager::EndRendering()
+	{
+		this->__state->__EndRendering();
+	}
+
+	void goofy::GraphicsManager::Set(GraphicsPipeline pipeline)
+	{
+		this->__state->__Bind(pipeline.__state.get());
+	}
+
+	void goofy::GraphicsManager::SetIndices(Buffer indices)
+	{
+		this->__state->__SetIndices(indices.__state.get());
+	}
+
+	void goofy::GraphicsManager::Cull(Buffer instances, unsigned int count, const float planes[6][4], Buffer draws)
+	{
+		states::__CommandListManager* list = this->__state.get();
+		if (list->Capture != nullptr)
+			list->Capture->Cull(list->Captured, instances.__state.get(), count, planes[0], draws.__state.get());
+		instances.__state->device->Cull(list, instances.__state.get(), count, planes[0], draws.__state.get());
+	}
+
+	void goofy::GraphicsManager::DrawIndirect(Buffer draws, unsigned int maxDraws)
+	{
+		this->__state->__DrawIndirect(draws.__state.get(), maxDraws);
+	}
+
 	void goofy::GraphicsManager::Clear(Image2D image, const Formats::R32G32B32A32_SFLOAT &color)
 	{
+		this->__state->__OutsideRendering("Clearing");
 		VkCommandBuffer cmdList = this->__state->vkCmdList;
 		VkClearColorValue v = { color.R, color.G, color.B, color.A };
 		std::shared_ptr<goofy::states::__Resource> state = image.__state;
@@ -148,6 +745,147 @@ namespace goofy {
 		range.layerCount = state->ImageSlice.array_count;
 		range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		vkCmdClearColorImage(cmdList, data->Image, VkImageLayout::VK_IMAGE_LAYOUT_GENERAL, &v, 1, &range);
+		if (this->__state->Capture != nullptr)
+			this->__state->Capture->Clear(this->__state->Captured, state.get(), range, v.float32);
+	}
+
+	void goofy::GraphicsManager::Clear(ResourceHandle image, const Formats::R32G32B32A32_SFLOAT &color)
+	{
+		this->__state->__OutsideRendering("Clearing");
+		states::__ResourcePool* pool = this->__state->Pool;
+		uint32_t slot = pool->Slot(image.Value);
+		if (pool->Images[slot] == nullptr)
+			throw std::runtime_error("Resource handle is not an image");
+		VkClearColorValue v = { color.R, color.G, color.B, color.A };
+		vkCmdClearColorImage(this->__state->vkCmdList, pool->Images[slot], VkImageLayout::VK_IMAGE_LAYOUT_GENERAL, &v, 1, &pool->Ranges[slot]);
+		if (this->__state->Capture != nullptr)
+			this->__state->Capture->Clear(this->__state->Captured, pool->Owners[slot].get(), pool->Ranges[slot], v.float32);
+	}
+
+	static void GenerateMips(states::__CommandListManager* list, const states::__Resource* image)
+	{
+		const states::ImageSliceDescription& slice = image->ImageSlice;
+		if (list->Capture != nullptr) {
+			VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, (uint32_t)slice.mip_start, (uint32_t)slice.mip_count, (uint32_t)slice.array_start, (uint32_t)slice.array_count };
+			list->Capture->GenerateMips(list->Captured, image, range);
+		}
+		image->device->GenerateMips(list, image, slice.mip_start, slice.mip_count, slice.array_start, slice.array_count);
+	}
+
+	void goofy::ComputeManager::GenerateMips(Image2D image)
+	{
+		goofy::GenerateMips(this->__state.get(), image.__state.get());
+	}
+
+	void goofy::ComputeManager::GenerateMips(Image3D image)
+	{
+		goofy::GenerateMips(this->__state.get(), image.__state.get());
+	}
+
+	void goofy::GraphicsManager::GenerateMips(Image2D image)
+	{
+		goofy::GenerateMips(this->__state.get(), image.__state.get());
+	}
+
+	void goofy::GraphicsManager::GenerateMips(Image3D image)
+	{
+		goofy::GenerateMips(this->__state.get(), image.__state.get());
+	}
+
+	/// <summary>
+	/// Dispatch of a batch with its sort key.
+	/// </summary>
+	struct __SortedDispatch {
+		const states::__Pipeline* Pipeline;
+		const ComputeBinder* Binder;
+		const ComputeDispatch* Dispatch;
+	};
+
+	/// <summary>
+	/// Gets the sort keys of a batch of the calling thread. Reused by every batch it records, so batches allocate nothing
+	/// once the thread has recorded a larger one.
+	/// </summary>
+	static std::vector<__SortedDispatch>& SortedDispatches(int count)
+	{
+		static thread_local std::vector<__SortedDispatch> sorted;
+		sorted.resize(std::max(count, 0));
+		return sorted;
+	}
+
+	static void DispatchBatch(CommandListManager& manager, states::__CommandListManager* list, std::vector<__SortedDispatch>& sorted)
+	{
+		// Dispatches without a binder keep the constants pushed before the batch, so they run, grouped by pipeline,
+		// before any binder of the batch pushes its constants. The others are grouped by pipeline and binder.
+		std::sort(sorted.begin(), sorted.end(), [](const __SortedDispatch& a, const __SortedDispatch& b) {
+			if ((a.Binder == nullptr) != (b.Binder == nullptr))
+				return a.Binder == nullptr;
+			if (a.Pipeline != b.Pipeline)
+				return a.Pipeline < b.Pipeline;
+			if (a.Binder != b.Binder)
+				return a.Binder < b.Binder;
+			return a.Dispatch < b.Dispatch;
+		});
+
+		const ComputeBinder* pushed = nullptr;
+		for (const __SortedDispatch& dispatch : sorted) {
+			list->__Bind(dispatch.Pipeline);
+			if (dispatch.Binder != nullptr && dispatch.Binder != pushed) {
+				manager.Set(*dispatch.Binder);
+				pushed = dispatch.Binder;
+			}
+			list->__Dispatch(dispatch.Dispatch->GroupsX, dispatch.Dispatch->GroupsY, dispatch.Dispatch->GroupsZ);
+		}
+	}
+
+	void goofy::ComputeManager::Set(ComputePipeline pipeline)
+	{
+		this->__state->__Bind(pipeline.__state.get());
+	}
+
+	void goofy::ComputeManager::Dispatch(unsigned int groupsX, unsigned int groupsY, unsigned int groupsZ)
+	{
+		this->__state->__Dispatch(groupsX, groupsY, groupsZ);
+	}
+
+	void goofy::ComputeManager::DispatchIndirect(Buffer arguments, unsigned long long offset)
+	{
+		this->__state->__DispatchIndirect(arguments.__state.get(), offset);
+	}
+
+	void goofy::ComputeManager::Dispatch(int count, const ComputeDispatch* dispatches)
+	{
+		std::vector<__SortedDispatch>& sorted = SortedDispatches(count);
+		for (int i = 0; i < count; i++)
+			sorted[i] = { dispatches[i].Pipeline->__state.get(), dispatches[i].Binder, &dispatches[i] };
+		DispatchBatch(*this, this->__state.get(), sorted);
+	}
+
+	void goofy::ComputeExclusiveManager::Set(ComputePipeline pipeline)
+	{
+		this->__state->__Bind(pipeline.__state.get());
+	}
+
+	void goofy::ComputeExclusiveManager::Dispatch(unsigned int groupsX, unsigned int groupsY, unsigned int groupsZ)
+	{
+		this->__state->__Dispatch(groupsX, groupsY, groupsZ);
+	}
+
+	void goofy::ComputeExclusiveManager::DispatchIndirect(Buffer arguments, unsigned long long offset)
+	{
+		this->__state->__DispatchIndirect(arguments.__state.get(), offset);
+	}
+
+	void goofy::ComputeExclusiveManager::Dispatch(int count, const ComputeDispatch* dispatches)
+	{
+		std::vector<__SortedDispatch>& sorted = SortedDispatches(count);
+		for (int i = 0; i < count; i++)
+			sorted[i] = { dispatches[i].Pipeline->__state.get(), dispatches[i].Binder, &dispatches[i] };
+		DispatchBatch(*this, this->__state.get(), sorted);
+	}
+
+	void goofy::RaytracingManager::Update(AccelerationStructure structure, const float* positions)
+	{
+		structure.__state->device->UpdateAccelerationStructure(this->__state.get(), structure.__state.get(), positions);
 	}
 
 	void CPUTask::Wait() {
@@ -158,6 +896,23 @@ namespace goofy {
 		__state->Wait();
 	}
 
+	bool Readback::IsReady() {
+		return __state->IsReady();
+	}
+
+	void Readback::Wait() {
+		__state->Wait();
+	}
+
+	const void* Readback::Data() {
+		__state->Wait();
+		return __state->Staging->Mapped;
+	}
+
+	unsigned long long Readback::Size() {
+		return __state->Size;
+	}
+
 	GPUTask GPUTask::Combine(int count, GPUTask* tasks)
 	{
 		return GPUTask{ goofy::states::__GPUTask::Union(count, (std::shared_ptr<goofy::states::__GPUTask>*) tasks) };
@@ -165,6 +920,8 @@ namespace goofy {
 
 	bool Window::IsClosed()
 	{
+		if (__state->IsHeadless)
+			return false;
 		if (__state->IsGLFW) {
 			GLFWwindow* window = (GLFWwindow*)__state->pWindow;
 			return glfwWindowShouldClose(window);
@@ -176,6 +933,8 @@ namespace goofy {
 	
 	void Window::PollEvents()
 	{
+		if (__state->IsHeadless)
+			return;
 		if (__state->IsGLFW) {
 			glfwPollEvents();
 		}
@@ -190,6 +949,8 @@ namespace goofy {
 	}
 
 	double Window::Time() {
+		if (__state->IsHeadless)
+			return (Tracer::Now() - __state->Created) * 1e-9;
 		if (__state->IsGLFW) {
 			return glfwGetTime();
 		}
@@ -205,10 +966,75 @@ namespace goofy {
 			return (FormatHandle)VkFormat::VK_FORMAT_R8G8B8A8_SRGB;
 		}
 
+		FormatHandle R8G8B8A8::SNORM_Handle()
+		{
+			return (FormatHandle)VkFormat::VK_FORMAT_R8G8B8A8_SNORM;
+		}
+
+		FormatHandle R8G8B8A8::UNORM_Handle()
+		{
+			return (FormatHandle)VkFormat::VK_FORMAT_R8G8B8A8_UNORM;
+		}
+
+		FormatHandle R8G8B8A8::USCALED_Handle()
+		{
+			return (FormatHandle)VkFormat::VK_FORMAT_R8G8B8A8_USCALED;
+		}
+
+		FormatHandle R8G8B8A8::SSCALED_Handle()
+		{
+			return (FormatHandle)VkFormat::VK_FORMAT_R8G8B8A8_SSCALED;
+		}
+
+		FormatHandle BC1::UNORM_Handle()
+		{
+			return (FormatHandle)VkFormat::VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+		}
+
+		FormatHandle BC1::SRGB_Handle()
+		{
+			return (FormatHandle)VkFormat::VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+		}
+
+		FormatHandle BC3::UNORM_Handle()
+		{
+			return (FormatHandle)VkFormat::VK_FORMAT_BC3_UNORM_BLOCK;
+		}
+
+		FormatHandle BC3::SRGB_Handle()
+		{
+			return (FormatHandle)VkFormat::VK_FORMAT_BC3_SRGB_BLOCK;
+		}
+
+		FormatHandle BC4::UNORM_Handle()
+		{
+			return (FormatHandle)VkFormat::VK_FORMAT_BC4_UNORM_BLOCK;
+		}
+
+		FormatHandle BC5::UNORM_Handle()
+		{
+			return (FormatHandle)VkFormat::VK_FORMAT_BC5_UNORM_BLOCK;
+		}
+
+		FormatHandle BC7::UNORM_Handle()
+		{
+			return (FormatHandle)VkFormat::VK_FORMAT_BC7_UNORM_BLOCK;
+		}
+
+		FormatHandle BC7::SRGB_Handle()
+		{
+			return (FormatHandle)VkFormat::VK_FORMAT_BC7_SRGB_BLOCK;
+		}
+
 		FormatHandle R32G32B32A32_SFLOAT::Handle()
 		{
 			return (FormatHandle)VkFormat::VK_FORMAT_R32G32B32A32_SFLOAT;
 		}
+
+		FormatHandle D32_SFLOAT::Handle()
+		{
+			return (FormatHandle)VkFormat::VK_FORMAT_D32_SFLOAT;
+		}
 	
 	}
 }
\ No newline at end of file
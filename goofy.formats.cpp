@@ -0,0 +1,1170 @@
+#include "goofy.internal.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GOOFY_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define GOOFY_TARGET(isa)
+#else
+#include <cpuid.h>
+#define GOOFY_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace goofy {
+	namespace Formats {
+
+#pragma region Scalar Reference
+
+		// Every kernel follows the operation order of these functions, so results match bit by bit. Floating point
+		// operations are single IEEE operations and clamps send NaN to the lower bound like MAXPS. The file is compiled
+		// without floating point contraction, a fused multiply add in one path would round differently.
+
+		static const float __SRGBLinearEnd = 0.0031308f;
+		static const float __SRGB1 = 0.585122381f, __SRGB2 = 0.783140355f, __SRGB3 = 0.368262736f;
+		static const float __Linear1 = 0.305306011f, __Linear2 = 0.682171111f, __Linear3 = 0.012522878f;
+
+		// Encoding table indexed by the exponent and the 8 highest mantissa bits of values in [2^-13, 1]
+		static const unsigned int __EncodeMinimum = 0x39000000; // 2^-13, smaller values encode to 0
+		static const int __EncodeEntries = 13 * 256 + 1;
+
+		static inline float __AsFloat(unsigned int bits) {
+			float value;
+			memcpy(&value, &bits, 4);
+			return value;
+		}
+
+		static inline unsigned int __AsBits(float value) {
+			unsigned int bits;
+			memcpy(&bits, &value, 4);
+			return bits;
+		}
+
+		static double __ExactLinearToSRGB(double c) {
+			return c <= 0.0031308 ? c * 12.92 : 1.055 * pow(c, 1 / 2.4) - 0.055;
+		}
+
+		static double __ExactSRGBToLinear(double c) {
+			return c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+		}
+
+		struct __SRGBTables {
+			float Decode[256];
+			unsigned char Encode[__EncodeEntries + 3]; // padding for 32 bits gathers of the last entries
+
+			__SRGBTables() {
+				for (int i = 0; i < 256; i++)
+					Decode[i] = (float)__ExactSRGBToLinear(i / 255.0);
+				memset(Encode, 0, sizeof(Encode));
+				for (int i = 0; i < __EncodeEntries; i++) {
+					// Center of the range of values sharing the entry
+					double low = __AsFloat(__EncodeMinimum + (i << 15));
+					double high = __AsFloat(__EncodeMinimum + ((i + 1) << 15));
+					double value = __ExactLinearToSRGB(std::min(1.0, (low + high) / 2)) * 255 + 0.5;
+					Encode[i] = (unsigned char)std::min(255.0, value);
+				}
+			}
+		};
+
+		static const __SRGBTables __tables;
+
+		static inline float __Clamp01(float v) {
+			v = v > 0.0f ? v : 0.0f;
+			return v < 1.0f ? v : 1.0f;
+		}
+
+		// Value in [0, 1] to the nearest 8 bits step
+		static inline unsigned char __Quantize(float c) {
+			float scaled = c * 255.0f;
+			scaled = scaled + 0.5f;
+			return (unsigned char)(int)scaled;
+		}
+
+		static inline unsigned char __EncodeLUT(float c) {
+			c = c > __AsFloat(__EncodeMinimum) ? c : __AsFloat(__EncodeMinimum);
+			return __tables.Encode[(__AsBits(c) - __EncodeMinimum) >> 15];
+		}
+
+		static inline float __EncodePolynomial(float c) {
+			float s1 = sqrtf(c);
+			float s2 = sqrtf(s1);
+			float s3 = sqrtf(s2);
+			float p = __SRGB1 * s1;
+			float q = __SRGB2 * s2;
+			p = p + q;
+			q = __SRGB3 * s3;
+			p = p - q;
+			float linear = c * 12.92f;
+			return __Clamp01(c <= __SRGBLinearEnd ? linear : p);
+		}
+
+		static inline float __DecodePolynomial(float c) {
+			float p = c * __Linear1;
+			p = p + __Linear2;
+			p = c * p;
+			p = p + __Linear3;
+			return c * p;
+		}
+
+		static void __UnormToFloatScalar(const unsigned char* source, float* destination, size_t count) {
+			for (size_t i = 0; i < count * 4; i++)
+				destination[i] = source[i] / 255.0f;
+		}
+
+		static void __FloatToUnormScalar(const float* source, unsigned char* destination, size_t count) {
+			for (size_t i = 0; i < count * 4; i++)
+				destination[i] = __Quantize(__Clamp01(source[i]));
+		}
+
+		static void __SRGBToFloatLUTScalar(const unsigned char* source, float* destination, size_t count) {
+			for (size_t i = 0; i < count * 4; i++)
+				destination[i] = (i & 3) == 3 ? source[i] / 255.0f : __tables.Decode[source[i]];
+		}
+
+		static void __SRGBToFloatPolynomialScalar(const unsigned char* source, float* destination, size_t count) {
+			for (size_t i = 0; i < count * 4; i++) {
+				float c = source[i] / 255.0f;
+				destination[i] = (i & 3) == 3 ? c : __DecodePolynomial(c);
+			}
+		}
+
+		static void __FloatToSRGBLUTScalar(const float* source, unsigned char* destination, size_t count) {
+			for (size_t i = 0; i < count * 4; i++) {
+				float c = __Clamp01(source[i]);
+				destination[i] = (i & 3) == 3 ? __Quantize(c) : __EncodeLUT(c);
+			}
+		}
+
+		static void __FloatToSRGBPolynomialScalar(const float* source, unsigned char* destination, size_t count) {
+			for (size_t i = 0; i < count * 4; i++) {
+				float c = __Clamp01(source[i]);
+				destination[i] = __Quantize((i & 3) == 3 ? c : __EncodePolynomial(c));
+			}
+		}
+
+		static inline unsigned short __FloatToHalf(float value) {
+			unsigned int bits = __AsBits(value);
+			unsigned int sign = (bits >> 16) & 0x8000;
+			unsigned int magnitude = bits & 0x7FFFFFFF;
+			if (magnitude >= 0x7F800000) // infinity, or NaN quieted keeping the high payload bits
+				return (unsigned short)(sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 | ((magnitude >> 13) & 0x3FF) : 0));
+			if (magnitude >= 0x477FF000) // rounds above the largest half
+				return (unsigned short)(sign | 0x7C00);
+			if (magnitude >= 0x38800000) { // normal half, rebias the exponent and round to nearest even
+				unsigned int rebiased = magnitude - 0x38000000;
+				rebiased += 0x0FFF + ((rebiased >> 13) & 1);
+				return (unsigned short)(sign | (rebiased >> 13));
+			}
+			if (magnitude <= 0x33000000) // half of the smallest denormal or less rounds to zero
+				return (unsigned short)sign;
+			unsigned int exponent = magnitude >> 23;
+			unsigned int mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+			unsigned int shift = 126 - exponent;
+			unsigned int half = mantissa >> shift;
+			unsigned int remainder = mantissa & ((1u << shift) - 1);
+			unsigned int middle = 1u << (shift - 1);
+			if (remainder > middle || (remainder == middle && (half & 1)))
+				half++;
+			return (unsigned short)(sign | half);
+		}
+
+		static inline float __HalfToFloat(unsigned short value) {
+			unsigned int sign = (unsigned int)(value & 0x8000) << 16;
+			unsigned int exponent = (value >> 10) & 0x1F;
+			unsigned int mantissa = value & 0x3FF;
+			if (exponent == 0x1F) // infinity, or NaN quieted
+				return __AsFloat(sign | 0x7F800000 | (mantissa << 13) | (mantissa != 0 ? 0x400000 : 0));
+			if (exponent != 0)
+				return __AsFloat(sign | ((exponent + 112) << 23) | (mantissa << 13));
+			if (mantissa == 0)
+				return __AsFloat(sign);
+			unsigned int shift = 0;
+			while (!(mantissa & 0x400)) {
+				mantissa <<= 1;
+				shift++;
+			}
+			return __AsFloat(sign | ((113 - shift) << 23) | ((mantissa & 0x3FF) << 13));
+		}
+
+		static void __FloatToHalfScalar(const float* source, unsigned short* destination, size_t count) {
+			for (size_t i = 0; i < count; i++)
+				destination[i] = __FloatToHalf(source[i]);
+		}
+
+		static void __HalfToFloatScalar(const unsigned short* source, float* destination, size_t count) {
+			for (size_t i = 0; i < count; i++)
+				destination[i] = __HalfToFloat(source[i]);
+		}
+
+#pragma endregion
+
+		/// <summary>
+		/// Conversion functions of an instruction set. Pixel counts for RGBA conversions and value counts for half floats.
+		/// </summary>
+		struct __ConversionKernels {
+			void(*UnormToFloat)(const unsigned char*, float*, size_t);
+			void(*FloatToUnorm)(const float*, unsigned char*, size_t);
+			void(*SRGBToFloatLUT)(const unsigned char*, float*, size_t);
+			void(*SRGBToFloatPolynomial)(const unsigned char*, float*, size_t);
+			void(*FloatToSRGBLUT)(const float*, unsigned char*, size_t);
+			void(*FloatToSRGBPolynomial)(const float*, unsigned char*, size_t);
+			void(*FloatToHalf)(const float*, unsigned short*, size_t);
+			void(*HalfToFloat)(const unsigned short*, float*, size_t);
+		};
+
+		static const __ConversionKernels __scalarKernels = {
+			__UnormToFloatScalar, __FloatToUnormScalar,
+			__SRGBToFloatLUTScalar, __SRGBToFloatPolynomialScalar,
+			__FloatToSRGBLUTScalar, __FloatToSRGBPolynomialScalar,
+			__FloatToHalfScalar, __HalfToFloatScalar
+		};
+
+#ifdef GOOFY_X86
+
+#pragma region SSE4
+
+		// One pixel per register
+
+		GOOFY_TARGET("sse4.1") static inline __m128i __LoadPixelSSE4(const unsigned char* pixel) {
+			int value;
+			memcpy(&value, pixel, 4);
+			return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(value));
+		}
+
+		GOOFY_TARGET("sse4.1") static inline void __StorePixelSSE4(unsigned char* pixel, __m128i values) {
+			__m128i words = _mm_packs_epi32(values, values);
+			int value = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+			memcpy(pixel, &value, 4);
+		}
+
+		GOOFY_TARGET("sse4.1") static inline __m128 __Clamp01SSE4(__m128 v) {
+			return _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		}
+
+		GOOFY_TARGET("sse4.1") static inline __m128i __QuantizeSSE4(__m128 c) {
+			return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(c, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+		}
+
+		GOOFY_TARGET("sse4.1") static inline __m128 __UnormSSE4(const unsigned char* pixel) {
+			return _mm_div_ps(_mm_cvtepi32_ps(__LoadPixelSSE4(pixel)), _mm_set1_ps(255.0f));
+		}
+
+		GOOFY_TARGET("sse4.1") static void __UnormToFloatSSE4(const unsigned char* source, float* destination, size_t count) {
+			for (size_t i = 0; i < count; i++)
+				_mm_storeu_ps(destination + i * 4, __UnormSSE4(source + i * 4));
+		}
+
+		GOOFY_TARGET("sse4.1") static void __FloatToUnormSSE4(const float* source, unsigned char* destination, size_t count) {
+			for (size_t i = 0; i < count; i++)
+				__StorePixelSSE4(destination + i * 4, __QuantizeSSE4(__Clamp01SSE4(_mm_loadu_ps(source + i * 4))));
+		}
+
+		GOOFY_TARGET("sse4.1") static void __SRGBToFloatLUTSSE4(const unsigned char* source, float* destination, size_t count) {
+			for (size_t i = 0; i < count; i++) {
+				const unsigned char* pixel = source + i * 4;
+				__m128 decoded = _mm_setr_ps(__tables.Decode[pixel[0]], __tables.Decode[pixel[1]], __tables.Decode[pixel[2]], 0);
+				_mm_storeu_ps(destination + i * 4, _mm_blend_ps(decoded, __UnormSSE4(pixel), 0x8));
+			}
+		}
+
+		GOOFY_TARGET("sse4.1") static void __SRGBToFloatPolynomialSSE4(const unsigned char* source, float* destination, size_t count) {
+			for (size_t i = 0; i < count; i++) {
+				__m128 c = __UnormSSE4(source + i * 4);
+				__m128 p = _mm_add_ps(_mm_mul_ps(c, _mm_set1_ps(__Linear1)), _mm_set1_ps(__Linear2));
+				p = _mm_mul_ps(c, _mm_add_ps(_mm_mul_ps(c, p), _mm_set1_ps(__Linear3)));
+				_mm_storeu_ps(destination + i * 4, _mm_blend_ps(p, c, 0x8));
+			}
+		}
+
+		GOOFY_TARGET("sse4.1") static void __FloatToSRGBLUTSSE4(const float* source, unsigned char* destination, size_t count) {
+			for (size_t i = 0; i < count; i++) {
+				__m128 c = __Clamp01SSE4(_mm_loadu_ps(source + i * 4));
+				__m128i bits = _mm_castps_si128(_mm_max_ps(c, _mm_castsi128_ps(_mm_set1_epi32(__EncodeMinimum))));
+				__m128i index = _mm_srli_epi32(_mm_sub_epi32(bits, _mm_set1_epi32(__EncodeMinimum)), 15);
+				unsigned char* pixel = destination + i * 4;
+				pixel[0] = __tables.Encode[_mm_extract_epi32(index, 0)];
+				pixel[1] = __tables.Encode[_mm_extract_epi32(index, 1)];
+				pixel[2] = __tables.Encode[_mm_extract_epi32(index, 2)];
+				pixel[3] = (unsigned char)_mm_extract_epi32(__QuantizeSSE4(c), 3);
+			}
+		}
+
+		GOOFY_TARGET("sse4.1") static void __FloatToSRGBPolynomialSSE4(const float* source, unsigned char* destination, size_t count) {
+			for (size_t i = 0; i < count; i++) {
+				__m128 c = __Clamp01SSE4(_mm_loadu_ps(source + i * 4));
+				__m128 s1 = _mm_sqrt_ps(c);
+				__m128 s2 = _mm_sqrt_ps(s1);
+				__m128 s3 = _mm_sqrt_ps(s2);
+				__m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(__SRGB1), s1), _mm_mul_ps(_mm_set1_ps(__SRGB2), s2));
+				p = _mm_sub_ps(p, _mm_mul_ps(_mm_set1_ps(__SRGB3), s3));
+				__m128 linear = _mm_mul_ps(c, _mm_set1_ps(12.92f));
+				__m128 encoded = __Clamp01SSE4(_mm_blendv_ps(p, linear, _mm_cmple_ps(c, _mm_set1_ps(__SRGBLinearEnd))));
+				__StorePixelSSE4(destination + i * 4, __QuantizeSSE4(_mm_blend_ps(encoded, c, 0x8)));
+			}
+		}
+
+		static const __ConversionKernels __sse4Kernels = {
+			__UnormToFloatSSE4, __FloatToUnormSSE4,
+			__SRGBToFloatLUTSSE4, __SRGBToFloatPolynomialSSE4,
+			__FloatToSRGBLUTSSE4, __FloatToSRGBPolynomialSSE4,
+			__FloatToHalfScalar, __HalfToFloatScalar // half conversions need F16C
+		};
+
+#pragma endregion
+
+#pragma region AVX2
+
+		// Two pixels per register, tails go to the scalar reference
+
+#define GOOFY_AVX2 "avx2,f16c"
+
+		GOOFY_TARGET(GOOFY_AVX2) static inline __m256i __LoadPixelsAVX2(const unsigned char* pixels) {
+			return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)pixels));
+		}
+
+		GOOFY_TARGET(GOOFY_AVX2) static inline void __StorePixelsAVX2(unsigned char* pixels, __m256i values) {
+			__m128i words = _mm_packs_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+			_mm_storel_epi64((__m128i*)pixels, _mm_packus_epi16(words, words));
+		}
+
+		GOOFY_TARGET(GOOFY_AVX2) static inline __m256 __Clamp01AVX2(__m256 v) {
+			return _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+		}
+
+		GOOFY_TARGET(GOOFY_AVX2) static inline __m256i __QuantizeAVX2(__m256 c) {
+			return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(c, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f)));
+		}
+
+		GOOFY_TARGET(GOOFY_AVX2) static void __UnormToFloatAVX2(const unsigned char* source, float* destination, size_t count) {
+			size_t i = 0;
+			for (; i + 2 <= count; i += 2)
+				_mm256_storeu_ps(destination + i * 4, _mm256_div_ps(_mm256_cvtepi32_ps(__LoadPixelsAVX2(source + i * 4)), _mm256_set1_ps(255.0f)));
+			__UnormToFloatScalar(source + i * 4, destination + i * 4, count - i);
+		}
+
+		GOOFY_TARGET(GOOFY_AVX2) static void __FloatToUnormAVX2(const float* source, unsigned char* destination, size_t count) {
+			size_t i = 0;
+			for (; i + 2 <= count; i += 2)
+				__StorePixelsAVX2(destination + i * 4, __QuantizeAVX2(__Clamp01AVX2(_mm256_loadu_ps(source + i * 4))));
+			__FloatToUnormScalar(source + i * 4, destination + i * 4, count - i);
+		}
+
+		GOOFY_TARGET(GOOFY_AVX2) static void __SRGBToFloatLUTAVX2(const unsigned char* source, float* destination, size_t count) {
+			size_t i = 0;
+			for (; i + 2 <= count; i += 2) {
+				__m256i values = __LoadPixelsAVX2(source + i * 4);
+				__m256 decoded = _mm256_i32gather_ps(__tables.Decode, values, 4);
+				__m256 alpha = _mm256_div_ps(_mm256_cvtepi32_ps(values), _mm256_set1_ps(255.0f));
+				_mm256_storeu_ps(destination + i * 4, _mm256_blend_ps(decoded, alpha, 0x88));
+			}
+			__SRGBToFloatLUTScalar(source + i * 4, destination + i * 4, count - i);
+		}
+
+		GOOFY_TARGET(GOOFY_AVX2) static void __SRGBToFloatPolynomialAVX2(const unsigned char* source, float* destination, size_t count) {
+			size_t i = 0;
+			for (; i + 2 <= count; i += 2) {
+				__m256 c = _mm256_div_ps(_mm256_cvtepi32_ps(__LoadPixelsAVX2(source + i * 4)), _mm256_set1_ps(255.0f));
+				__m256 p = _mm256_add_ps(_mm256_mul_ps(c, _mm256_set1_ps(__Linear1)), _mm256_set1_ps(__Linear2));
+				p = _mm256_mul_ps(c, _mm256_add_ps(_mm256_mul_ps(c, p), _mm256_set1_ps(__Linear3)));
+				_mm256_storeu_ps(destination + i * 4, _mm256_blend_ps(p, c, 0x88));
+			}
+			__SRGBToFloatPolynomialScalar(source + i * 4, destination + i * 4, count - i);
+		}
+
+		GOOFY_TARGET(GOOFY_AVX2) static void __FloatToSRGBLUTAVX2(const float* source, unsigned char* destination, size_t count) {
+			size_t i = 0;
+			for (; i + 2 <= count; i += 2) {
+				__m256 c = __Clamp01AVX2(_mm256_loadu_ps(source + i * 4));
+				__m256i bits = _mm256_castps_si256(_mm256_max_ps(c, _mm256_castsi256_ps(_mm256_set1_epi32(__EncodeMinimum))));
+				__m256i index = _mm256_srli_epi32(_mm256_sub_epi32(bits, _mm256_set1_epi32(__EncodeMinimum)), 15);
+				__m256i encoded = _mm256_and_si256(_mm256_i32gather_epi32((const int*)__tables.Encode, index, 1), _mm256_set1_epi32(0xFF));
+				__StorePixelsAVX2(destination + i * 4, _mm256_blend_epi32(encoded, __QuantizeAVX2(c), 0x88));
+			}
+			__FloatToSRGBLUTScalar(source + i * 4, destination + i * 4, count - i);
+		}
+
+		GOOFY_TARGET(GOOFY_AVX2) static void __FloatToSRGBPolynomialAVX2(const float* source, unsigned char* destination, size_t count) {
+			size_t i = 0;
+			for (; i + 2 <= count; i += 2) {
+				__m256 c = __Clamp01AVX2(_mm256_loadu_ps(source + i * 4));
+				__m256 s1 = _mm256_sqrt_ps(c);
+				__m256 s2 = _mm256_sqrt_ps(s1);
+				__m256 s3 = _mm256_sqrt_ps(s2);
+				__m256 p = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(__SRGB1), s1), _mm256_mul_ps(_mm256_set1_ps(__SRGB2), s2));
+				p = _mm256_sub_ps(p, _mm256_mul_ps(_mm256_set1_ps(__SRGB3), s3));
+				__m256 linear = _mm256_mul_ps(c, _mm256_set1_ps(12.92f));
+				__m256 encoded = __Clamp01AVX2(_mm256_blendv_ps(p, linear, _mm256_cmp_ps(c, _mm256_set1_ps(__SRGBLinearEnd), _CMP_LE_OQ)));
+				__StorePixelsAVX2(destination + i * 4, __QuantizeAVX2(_mm256_blend_ps(encoded, c, 0x88)));
+			}
+			__FloatToSRGBPolynomialScalar(source + i * 4, destination + i * 4, count - i);
+		}
+
+		GOOFY_TARGET(GOOFY_AVX2) static void __FloatToHalfAVX2(const float* source, unsigned short* destination, size_t count) {
+			size_t i = 0;
+			for (; i + 8 <= count; i += 8)
+				_mm_storeu_si128((__m128i*)(destination + i), _mm256_cvtps_ph(_mm256_loadu_ps(source + i), _MM_FROUND_TO_NEAREST_INT));
+			__FloatToHalfScalar(source + i, destination + i, count - i);
+		}
+
+		GOOFY_TARGET(GOOFY_AVX2) static void __HalfToFloatAVX2(const unsigned short* source, float* destination, size_t count) {
+			size_t i = 0;
+			for (; i + 8 <= count; i += 8)
+				_mm256_storeu_ps(destination + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(source + i))));
+			__HalfToFloatScalar(source + i, destination + i, count - i);
+		}
+
+		static const __ConversionKernels __avx2Kernels = {
+			__UnormToFloatAVX2, __FloatToUnormAVX2,
+			__SRGBToFloatLUTAVX2, __SRGBToFloatPolynomialAVX2,
+			__FloatToSRGBLUTAVX2, __FloatToSRGBPolynomialAVX2,
+			__FloatToHalfAVX2, __HalfToFloatAVX2
+		};
+
+#pragma endregion
+
+#pragma region AVX512
+
+		// Four pixels per register, tails go to the scalar reference
+
+#define GOOFY_AVX512 "avx512f,avx2,f16c"
+
+		static const __mmask16 __alphaLanes = 0x8888;
+
+		GOOFY_TARGET(GOOFY_AVX512) static inline __m512i __LoadPixelsAVX512(const unsigned char* pixels) {
+			return _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)pixels));
+		}
+
+		GOOFY_TARGET(GOOFY_AVX512) static inline void __StorePixelsAVX512(unsigned char* pixels, __m512i values) {
+			_mm_storeu_si128((__m128i*)pixels, _mm512_cvtusepi32_epi8(values));
+		}
+
+		GOOFY_TARGET(GOOFY_AVX512) static inline __m512 __Clamp01AVX512(__m512 v) {
+			return _mm512_min_ps(_mm512_max_ps(v, _mm512_setzero_ps()), _mm512_set1_ps(1.0f));
+		}
+
+		GOOFY_TARGET(GOOFY_AVX512) static inline __m512i __QuantizeAVX512(__m512 c) {
+			return _mm512_cvttps_epi32(_mm512_add_ps(_mm512_mul_ps(c, _mm512_set1_ps(255.0f)), _mm512_set1_ps(0.5f)));
+		}
+
+		GOOFY_TARGET(GOOFY_AVX512) static void __UnormToFloatAVX512(const unsigned char* source, float* destination, size_t count) {
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+				_mm512_storeu_ps(destination + i * 4, _mm512_div_ps(_mm512_cvtepi32_ps(__LoadPixelsAVX512(source + i * 4)), _mm512_set1_ps(255.0f)));
+			__UnormToFloatScalar(source + i * 4, destination + i * 4, count - i);
+		}
+
+		GOOFY_TARGET(GOOFY_AVX512) static void __FloatToUnormAVX512(const float* source, unsigned char* destination, size_t count) {
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+				__StorePixelsAVX512(destination + i * 4, __QuantizeAVX512(__Clamp01AVX512(_mm512_loadu_ps(source + i * 4))));
+			__FloatToUnormScalar(source + i * 4, destination + i * 4, count - i);
+		}
+
+		GOOFY_TARGET(GOOFY_AVX512) static void __SRGBToFloatLUTAVX512(const unsigned char* source, float* destination, size_t count) {
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4) {
+				__m512i values = __LoadPixelsAVX512(source + i * 4);
+				__m512 decoded = _mm512_i32gather_ps(values, __tables.Decode, 4);
+				__m512 alpha = _mm512_div_ps(_mm512_cvtepi32_ps(values), _mm512_set1_ps(255.0f));
+				_mm512_storeu_ps(destination + i * 4, _mm512_mask_blend_ps(__alphaLanes, decoded, alpha));
+			}
+			__SRGBToFloatLUTScalar(source + i * 4, destination + i * 4, count - i);
+		}
+
+		GOOFY_TARGET(GOOFY_AVX512) static void __SRGBToFloatPolynomialAVX512(const unsigned char* source, float* destination, size_t count) {
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4) {
+				__m512 c = _mm512_div_ps(_mm512_cvtepi32_ps(__LoadPixelsAVX512(source + i * 4)), _mm512_set1_ps(255.0f));
+				__m512 p = _mm512_add_ps(_mm512_mul_ps(c, _mm512_set1_ps(__Linear1)), _mm512_set1_ps(__Linear2));
+				p = _mm512_mul_ps(c, _mm512_add_ps(_mm512_mul_ps(c, p), _mm512_set1_ps(__Linear3)));
+				_mm512_storeu_ps(destination + i * 4, _mm512_mask_blend_ps(__alphaLanes, p, c));
+			}
+			__SRGBToFloatPolynomialScalar(source + i * 4, destination + i * 4, count - i);
+		}
+
+		GOOFY_TARGET(GOOFY_AVX512) static void __FloatToSRGBLUTAVX512(const float* source, unsigned char* destination, size_t count) {
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4) {
+				__m512 c = __Clamp01AVX512(_mm512_loadu_ps(source + i * 4));
+				__m512i bits = _mm512_castps_si512(_mm512_max_ps(c, _mm512_castsi512_ps(_mm512_set1_epi32(__EncodeMinimum))));
+				__m512i index = _mm512_srli_epi32(_mm512_sub_epi32(bits, _mm512_set1_epi32(__EncodeMinimum)), 15);
+				__m512i encoded = _mm512_and_si512(_mm512_i32gather_epi32(index, __tables.Encode, 1), _mm512_set1_epi32(0xFF));
+				__StorePixelsAVX512(destination + i * 4, _mm512_mask_blend_epi32(__alphaLanes, encoded, __QuantizeAVX512(c)));
+			}
+			__FloatToSRGBLUTScalar(source + i * 4, destination + i * 4, count - i);
+		}
+
+		GOOFY_TARGET(GOOFY_AVX512) static void __FloatToSRGBPolynomialAVX512(const float* source, unsigned char* destination, size_t count) {
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4) {
+				__m512 c = __Clamp01AVX512(_mm512_loadu_ps(source + i * 4));
+				__m512 s1 = _mm512_sqrt_ps(c);
+				__m512 s2 = _mm512_sqrt_ps(s1);
+				__m512 s3 = _mm512_sqrt_ps(s2);
+				__m512 p = _mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(__SRGB1), s1), _mm512_mul_ps(_mm512_set1_ps(__SRGB2), s2));
+				p = _mm512_sub_ps(p, _mm512_mul_ps(_mm512_set1_ps(__SRGB3), s3));
+				__m512 linear = _mm512_mul_ps(c, _mm512_set1_ps(12.92f));
+				__mmask16 linearLanes = _mm512_cmp_ps_mask(c, _mm512_set1_ps(__SRGBLinearEnd), _CMP_LE_OQ);
+				__m512 encoded = __Clamp01AVX512(_mm512_mask_blend_ps(linearLanes, p, linear));
+				__StorePixelsAVX512(destination + i * 4, __QuantizeAVX512(_mm512_mask_blend_ps(__alphaLanes, encoded, c)));
+			}
+			__FloatToSRGBPolynomialScalar(source + i * 4, destination + i * 4, count - i);
+		}
+
+		GOOFY_TARGET(GOOFY_AVX512) static void __FloatToHalfAVX512(const float* source, unsigned short* destination, size_t count) {
+			size_t i = 0;
+			for (; i + 16 <= count; i += 16)
+				_mm256_storeu_si256((__m256i*)(destination + i), _mm512_cvtps_ph(_mm512_loadu_ps(source + i), _MM_FROUND_TO_NEAREST_INT));
+			__FloatToHalfScalar(source + i, destination + i, count - i);
+		}
+
+		GOOFY_TARGET(GOOFY_AVX512) static void __HalfToFloatAVX512(const unsigned short* source, float* destination, size_t count) {
+			size_t i = 0;
+			for (; i + 16 <= count; i += 16)
+				_mm512_storeu_ps(destination + i, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(source + i))));
+			__HalfToFloatScalar(source + i, destination + i, count - i);
+		}
+
+		static const __ConversionKernels __avx512Kernels = {
+			__UnormToFloatAVX512, __FloatToUnormAVX512,
+			__SRGBToFloatLUTAVX512, __SRGBToFloatPolynomialAVX512,
+			__FloatToSRGBLUTAVX512, __FloatToSRGBPolynomialAVX512,
+			__FloatToHalfAVX512, __HalfToFloatAVX512
+		};
+
+#pragma endregion
+
+		static void __CPUID(int leaf, int subleaf, unsigned int registers[4]) {
+#ifdef _MSC_VER
+			__cpuidex((int*)registers, leaf, subleaf);
+#else
+			__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+		}
+
+		static unsigned long long __EnabledStates() {
+#ifdef _MSC_VER
+			return _xgetbv(0);
+#else
+			unsigned int low, high;
+			__asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+			return ((unsigned long long)high << 32) | low;
+#endif
+		}
+
+		static ConversionKernel __DetectKernel() {
+			unsigned int registers[4];
+			__CPUID(0, 0, registers);
+			unsigned int leaves = registers[0];
+			if (leaves < 1)
+				return ConversionKernel::SCALAR;
+			__CPUID(1, 0, registers);
+			bool sse4 = (registers[2] >> 19) & 1;
+			bool osxsave = (registers[2] >> 27) & 1;
+			bool f16c = (registers[2] >> 29) & 1;
+			if (!sse4)
+				return ConversionKernel::SCALAR;
+			// Wide registers also need the operating system to save them
+			unsigned long long states = osxsave ? __EnabledStates() : 0;
+			if (leaves < 7 || (states & 0x6) != 0x6 || !f16c)
+				return ConversionKernel::SSE4;
+			__CPUID(7, 0, registers);
+			bool avx2 = (registers[1] >> 5) & 1;
+			bool avx512 = (registers[1] >> 16) & 1;
+			if (!avx2)
+				return ConversionKernel::SSE4;
+			if (!avx512 || (states & 0xE6) != 0xE6)
+				return ConversionKernel::AVX2;
+			return ConversionKernel::AVX512;
+		}
+
+#else
+
+		static ConversionKernel __DetectKernel() {
+			return ConversionKernel::SCALAR;
+		}
+
+#endif
+
+		static const __ConversionKernels& __KernelsOf(ConversionKernel kernel) {
+			switch (kernel) {
+#ifdef GOOFY_X86
+			case ConversionKernel::SSE4: return __sse4Kernels;
+			case ConversionKernel::AVX2: return __avx2Kernels;
+			case ConversionKernel::AVX512: return __avx512Kernels;
+#endif
+			default: return __scalarKernels;
+			}
+		}
+
+		static const ConversionKernel __supportedKernel = __DetectKernel();
+		static std::atomic<ConversionKernel> __activeKernel = { __supportedKernel };
+
+		ConversionKernel SupportedConversionKernel() {
+			return __supportedKernel;
+		}
+
+		ConversionKernel ActiveConversionKernel() {
+			return __activeKernel.load();
+		}
+
+		void SetConversionKernel(ConversionKernel kernel) {
+			if ((int)kernel > (int)__supportedKernel)
+				throw std::runtime_error("Conversion kernel not supported by the CPU");
+			__activeKernel.store(kernel);
+		}
+
+		// Conversions smaller than a range run on the calling thread
+		static const size_t __ParallelRange = 1 << 16;
+
+		template<typename S, typename D>
+		static void __Convert(void(*kernel)(const S*, D*, size_t), const void* source, void* destination, size_t count, size_t elements) {
+			const S* from = (const S*)source;
+			D* to = (D*)destination;
+			ParallelFor(count, __ParallelRange, [=](size_t begin, size_t end) {
+				kernel(from + begin * elements, to + begin * elements, end - begin);
+			});
+		}
+
+		void UnormToFloat(const R8G8B8A8* source, R32G32B32A32_SFLOAT* destination, size_t count) {
+			__Convert(__KernelsOf(__activeKernel).UnormToFloat, source, destination, count, 4);
+		}
+
+		void FloatToUnorm(const R32G32B32A32_SFLOAT* source, R8G8B8A8* destination, size_t count) {
+			__Convert(__KernelsOf(__activeKernel).FloatToUnorm, source, destination, count, 4);
+		}
+
+		void SRGBToFloat(const R8G8B8A8* source, R32G32B32A32_SFLOAT* destination, size_t count, SRGBMethod method) {
+			const __ConversionKernels& kernels = __KernelsOf(__activeKernel);
+			__Convert(method == SRGBMethod::LUT ? kernels.SRGBToFloatLUT : kernels.SRGBToFloatPolynomial, source, destination, count, 4);
+		}
+
+		void FloatToSRGB(const R32G32B32A32_SFLOAT* source, R8G8B8A8* destination, size_t count, SRGBMethod method) {
+			const __ConversionKernels& kernels = __KernelsOf(__activeKernel);
+			__Convert(method == SRGBMethod::LUT ? kernels.FloatToSRGBLUT : kernels.FloatToSRGBPolynomial, source, destination, count, 4);
+		}
+
+		void FloatToHalf(const float* source, unsigned short* destination, size_t count) {
+			__Convert(__KernelsOf(__activeKernel).FloatToHalf, source, destination, count, 1);
+		}
+
+		void HalfToFloat(const unsigned short* source, float* destination, size_t count) {
+			__Convert(__KernelsOf(__activeKernel).HalfToFloat, source, destination, count, 1);
+		}
+
+#pragma region Block Compression
+
+		// Texels of a 4x4 block, RGBA
+		struct __Block {
+			unsigned char Texels[16][4];
+		};
+
+		static void __LoadBlock(const unsigned char* pixels, unsigned int width, unsigned int height, unsigned int bx, unsigned int by, __Block& block) {
+			for (unsigned int y = 0; y < 4; y++) {
+				unsigned int sy = std::min(by * 4 + y, height - 1);
+				for (unsigned int x = 0; x < 4; x++) {
+					unsigned int sx = std::min(bx * 4 + x, width - 1);
+					memcpy(block.Texels[y * 4 + x], pixels + ((size_t)sy * width + sx) * 4, 4);
+				}
+			}
+		}
+
+		/// <summary>
+		/// Fits a segment to the texels of a block in the first channels, along their principal axis (power iteration of the
+		/// covariance). Only texels with used set count.
+		/// </summary>
+		static void __FitEndpoints(const __Block& block, const bool used[16], int channels, float e0[4], float e1[4]) {
+			float mean[4] = { };
+			int count = 0;
+			for (int i = 0; i < 16; i++)
+				if (used[i]) {
+					for (int c = 0; c < channels; c++)
+						mean[c] += block.Texels[i][c];
+					count++;
+				}
+			for (int c = 0; c < channels; c++)
+				mean[c] /= std::max(count, 1);
+
+			float covariance[4][4] = { };
+			for (int i = 0; i < 16; i++)
+				if (used[i])
+					for (int a = 0; a < channels; a++)
+						for (int b = 0; b < channels; b++)
+							covariance[a][b] += (block.Texels[i][a] - mean[a]) * (block.Texels[i][b] - mean[b]);
+
+			// Starts from the channel of largest variance
+			int largest = 0;
+			for (int c = 1; c < channels; c++)
+				if (covariance[c][c] > covariance[largest][largest])
+					largest = c;
+			float axis[4] = { };
+			for (int c = 0; c < channels; c++)
+				axis[c] = covariance[largest][c];
+			for (int iteration = 0; iteration < 8; iteration++) {
+				float next[4] = { };
+				float scale = 0;
+				for (int a = 0; a < channels; a++) {
+					for (int b = 0; b < channels; b++)
+						next[a] += covariance[a][b] * axis[b];
+					scale = std::max(scale, fabsf(next[a]));
+				}
+				if (scale == 0)
+					break;
+				for (int c = 0; c < channels; c++)
+					axis[c] = next[c] / scale;
+			}
+			float length = 0;
+			for (int c = 0; c < channels; c++)
+				length += axis[c] * axis[c];
+			length = sqrtf(length);
+
+			float low = 0, high = 0;
+			if (length > 0) {
+				for (int c = 0; c < channels; c++)
+					axis[c] /= length;
+				low = 1e9f;
+				high = -1e9f;
+				for (int i = 0; i < 16; i++)
+					if (used[i]) {
+						float t = 0;
+						for (int c = 0; c < channels; c++)
+							t += (block.Texels[i][c] - mean[c]) * axis[c];
+						low = std::min(low, t);
+						high = std::max(high, t);
+					}
+			}
+			for (int c = 0; c < channels; c++) {
+				e0[c] = std::min(255.0f, std::max(0.0f, mean[c] + low * axis[c]));
+				e1[c] = std::min(255.0f, std::max(0.0f, mean[c] + high * axis[c]));
+			}
+		}
+
+		/// <summary>
+		/// Solves the endpoints minimizing the squared error of the texels given their interpolation weights toward e1.
+		/// Returns false if all used texels share the same weight.
+		/// </summary>
+		static bool __RefineEndpoints(const __Block& block, const bool used[16], const float weights[16], int channels, float e0[4], float e1[4]) {
+			float aa = 0, ab = 0, bb = 0;
+			float ax[4] = { }, bx[4] = { };
+			for (int i = 0; i < 16; i++) {
+				if (!used[i])
+					continue;
+				float b = weights[i];
+				float a = 1 - b;
+				aa += a * a;
+				ab += a * b;
+				bb += b * b;
+				for (int c = 0; c < channels; c++) {
+					ax[c] += a * block.Texels[i][c];
+					bx[c] += b * block.Texels[i][c];
+				}
+			}
+			float determinant = aa * bb - ab * ab;
+			if (fabsf(determinant) < 1e-6f)
+				return false;
+			for (int c = 0; c < channels; c++) {
+				e0[c] = std::min(255.0f, std::max(0.0f, (bb * ax[c] - ab * bx[c]) / determinant));
+				e1[c] = std::min(255.0f, std::max(0.0f, (aa * bx[c] - ab * ax[c]) / determinant));
+			}
+			return true;
+		}
+
+		// Writes values LSB first
+		struct __BitWriter {
+			unsigned char* Out;
+			int Position = 0;
+
+			__BitWriter(unsigned char* out, int bytes) : Out(out) { memset(out, 0, bytes); }
+
+			void Put(unsigned int value, int bits) {
+				for (int i = 0; i < bits; i++, Position++)
+					Out[Position >> 3] |= ((value >> i) & 1) << (Position & 7);
+			}
+		};
+
+		static inline int __Square(int v) {
+			return v * v;
+		}
+
+		static inline unsigned short __To565(const float c[3]) {
+			int r = std::min(31, std::max(0, (int)(c[0] * 31 / 255 + 0.5f)));
+			int g = std::min(63, std::max(0, (int)(c[1] * 63 / 255 + 0.5f)));
+			int b = std::min(31, std::max(0, (int)(c[2] * 31 / 255 + 0.5f)));
+			return (unsigned short)((r << 11) | (g << 5) | b);
+		}
+
+		static inline void __From565(unsigned short v, int c[3]) {
+			int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+			c[0] = (r << 3) | (r >> 2);
+			c[1] = (g << 2) | (g >> 4);
+			c[2] = (b << 3) | (b >> 2);
+		}
+
+		/// <summary>
+		/// Chooses the nearest palette entry of every texel and returns the squared error. Three color blocks (c0 <= c1 out
+		/// of BC3) give index 3 to transparent texels.
+		/// </summary>
+		static int __BC1Indices(const __Block& block, unsigned short c0, unsigned short c1, bool fourColors, unsigned int& indices, float weights[16]) {
+			int palette[4][3];
+			__From565(c0, palette[0]);
+			__From565(c1, palette[1]);
+			int entries = fourColors ? 4 : 3;
+			for (int c = 0; c < 3; c++)
+				if (fourColors) {
+					palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+					palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+				}
+				else
+					palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			static const float fourWeights[4] = { 0, 1, 1 / 3.0f, 2 / 3.0f };
+
+			int error = 0;
+			indices = 0;
+			for (int i = 0; i < 16; i++) {
+				const unsigned char* texel = block.Texels[i];
+				int best = 0, bestError = 1 << 30;
+				if (!fourColors && texel[3] < 128) {
+					best = 3;
+					bestError = 0;
+				}
+				else
+					for (int e = 0; e < entries; e++) {
+						int d = __Square(texel[0] - palette[e][0]) + __Square(texel[1] - palette[e][1]) + __Square(texel[2] - palette[e][2]);
+						if (d < bestError) {
+							bestError = d;
+							best = e;
+						}
+					}
+				indices |= (unsigned int)best << (i * 2);
+				weights[i] = fourColors ? fourWeights[best] : (best == 2 ? 0.5f : (float)best);
+				error += bestError;
+			}
+			return error;
+		}
+
+		static void __EncodeBC1(const __Block& block, CompressionPreset preset, bool colorOnly, unsigned char* out) {
+			bool used[16];
+			bool transparent = false;
+			for (int i = 0; i < 16; i++) {
+				used[i] = colorOnly || block.Texels[i][3] >= 128;
+				transparent |= !used[i];
+			}
+			// Four colors need c0 > c1, transparent blocks use three colors with c0 <= c1. BC3 always decodes four colors.
+			bool fourColors = !transparent;
+			auto order = [&](unsigned short& c0, unsigned short& c1) {
+				if (fourColors != (c0 > c1) && c0 != c1)
+					std::swap(c0, c1);
+			};
+
+			float e0[4], e1[4];
+			__FitEndpoints(block, used, 3, e0, e1);
+			unsigned short c0 = __To565(e1), c1 = __To565(e0);
+			order(c0, c1);
+			unsigned int indices;
+			float weights[16];
+			int error = __BC1Indices(block, c0, c1, fourColors, indices, weights);
+
+			if (preset == CompressionPreset::QUALITY)
+				for (int iteration = 0; iteration < 2 && error > 0; iteration++) {
+					float r0[4], r1[4];
+					if (!__RefineEndpoints(block, used, weights, 3, r0, r1))
+						break;
+					unsigned short n0 = __To565(r0), n1 = __To565(r1);
+					order(n0, n1);
+					unsigned int refinedIndices;
+					float refinedWeights[16];
+					int refined = __BC1Indices(block, n0, n1, fourColors, refinedIndices, refinedWeights);
+					if (refined >= error)
+						break;
+					error = refined;
+					c0 = n0;
+					c1 = n1;
+					indices = refinedIndices;
+					memcpy(weights, refinedWeights, sizeof(weights));
+				}
+
+			__BitWriter writer(out, 8);
+			writer.Put(c0, 16);
+			writer.Put(c1, 16);
+			writer.Put(indices, 32);
+		}
+
+		/// <summary>
+		/// Chooses the nearest of the 8 values of a BC4 palette for every texel and returns the squared error.
+		/// </summary>
+		static int __BC4Indices(const unsigned char values[16], int r0, int r1, unsigned int indices[16]) {
+			int palette[8] = { r0, r1 };
+			if (r0 > r1)
+				for (int k = 1; k <= 6; k++)
+					palette[k + 1] = ((7 - k) * r0 + k * r1 + 3) / 7;
+			else {
+				for (int k = 1; k <= 4; k++)
+					palette[k + 1] = ((5 - k) * r0 + k * r1 + 2) / 5;
+				palette[6] = 0;
+				palette[7] = 255;
+			}
+			int error = 0;
+			for (int i = 0; i < 16; i++) {
+				int best = 0, bestError = 1 << 30;
+				for (int e = 0; e < 8; e++) {
+					int d = __Square(values[i] - palette[e]);
+					if (d < bestError) {
+						bestError = d;
+						best = e;
+					}
+				}
+				indices[i] = best;
+				error += bestError;
+			}
+			return error;
+		}
+
+		static void __EncodeBC4(const unsigned char values[16], CompressionPreset preset, unsigned char* out) {
+			int low = 255, high = 0;
+			for (int i = 0; i < 16; i++) {
+				low = std::min(low, (int)values[i]);
+				high = std::max(high, (int)values[i]);
+			}
+			int r0 = high, r1 = low;
+			unsigned int indices[16];
+			int error = __BC4Indices(values, r0, r1, indices);
+
+			if (preset == CompressionPreset::QUALITY && error > 0) {
+				auto attempt = [&](int a, int b) {
+					unsigned int candidate[16];
+					int e = __BC4Indices(values, a, b, candidate);
+					if (e < error) {
+						error = e;
+						r0 = a;
+						r1 = b;
+						memcpy(indices, candidate, sizeof(indices));
+					}
+				};
+				// Eight values with the range inset, then six values with 0 and 255 left to the extremes
+				for (int inset0 = 0; inset0 <= 2; inset0++)
+					for (int inset1 = 0; inset1 <= 2; inset1++)
+						if (high - inset0 > low + inset1)
+							attempt(high - inset0, low + inset1);
+				int innerLow = 255, innerHigh = 0;
+				for (int i = 0; i < 16; i++)
+					if (values[i] != 0 && values[i] != 255) {
+						innerLow = std::min(innerLow, (int)values[i]);
+						innerHigh = std::max(innerHigh, (int)values[i]);
+					}
+				if (innerLow <= innerHigh)
+					attempt(innerLow, innerHigh);
+			}
+
+			__BitWriter writer(out, 8);
+			writer.Put(r0, 8);
+			writer.Put(r1, 8);
+			for (int i = 0; i < 16; i++)
+				writer.Put(indices[i], 3);
+		}
+
+		static void __EncodeBC4Channel(const __Block& block, int channel, CompressionPreset preset, unsigned char* out) {
+			unsigned char values[16];
+			for (int i = 0; i < 16; i++)
+				values[i] = block.Texels[i][channel];
+			__EncodeBC4(values, preset, out);
+		}
+
+		static const int __BC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+		// Mode 6 endpoint, 7 bits per channel and a shared p-bit giving the 8th (lowest) bit
+		static void __QuantizeMode6(const float e[4], int p, int q[4]) {
+			for (int c = 0; c < 4; c++)
+				q[c] = std::min(127, std::max(0, (int)((e[c] - p) / 2 + 0.5f)));
+		}
+
+		/// <summary>
+		/// Chooses the index of every texel for mode 6 endpoints and returns the squared error. Fast matching projects the
+		/// texels on the segment, otherwise the 16 palette entries are compared.
+		/// </summary>
+		static int __BC7Indices(const __Block& block, const int q0[4], int p0, const int q1[4], int p1, bool project, unsigned int indices[16], float weights[16]) {
+			int a[4], b[4], palette[16][4];
+			for (int c = 0; c < 4; c++) {
+				a[c] = (q0[c] << 1) | p0;
+				b[c] = (q1[c] << 1) | p1;
+			}
+			for (int e = 0; e < 16; e++)
+				for (int c = 0; c < 4; c++)
+					palette[e][c] = ((64 - __BC7Weights[e]) * a[c] + __BC7Weights[e] * b[c] + 32) >> 6;
+
+			int direction[4], length = 0;
+			for (int c = 0; c < 4; c++) {
+				direction[c] = b[c] - a[c];
+				length += direction[c] * direction[c];
+			}
+
+			int error = 0;
+			for (int i = 0; i < 16; i++) {
+				const unsigned char* texel = block.Texels[i];
+				int best = 0;
+				if (project) {
+					if (length > 0) {
+						int dot = 0;
+						for (int c = 0; c < 4; c++)
+							dot += (texel[c] - a[c]) * direction[c];
+						best = std::min(15, std::max(0, (dot * 15 + length / 2) / length));
+					}
+				}
+				else {
+					int bestError = 1 << 30;
+					for (int e = 0; e < 16; e++) {
+						int d = __Square(texel[0] - palette[e][0]) + __Square(texel[1] - palette[e][1]) +
+							__Square(texel[2] - palette[e][2]) + __Square(texel[3] - palette[e][3]);
+						if (d < bestError) {
+							bestError = d;
+							best = e;
+						}
+					}
+				}
+				indices[i] = best;
+				weights[i] = __BC7Weights[best] / 64.0f;
+				for (int c = 0; c < 4; c++)
+					error += __Square(texel[c] - palette[best][c]);
+			}
+			return error;
+		}
+
+		struct __Mode6 {
+			int Q0[4], Q1[4], P0, P1;
+			unsigned int Indices[16];
+			float Weights[16];
+			int Error = 1 << 30;
+		};
+
+		static void __TryMode6(const __Block& block, const float e0[4], const float e1[4], CompressionPreset preset, __Mode6& best) {
+			bool fast = preset == CompressionPreset::FAST;
+			for (int p0 = 0; p0 < 2; p0++)
+				for (int p1 = 0; p1 < 2; p1++) {
+					if (fast && p0 != p1) // fast blocks share the p-bits
+						continue;
+					__Mode6 candidate;
+					candidate.P0 = p0;
+					candidate.P1 = p1;
+					__QuantizeMode6(e0, p0, candidate.Q0);
+					__QuantizeMode6(e1, p1, candidate.Q1);
+					candidate.Error = __BC7Indices(block, candidate.Q0, p0, candidate.Q1, p1, fast, candidate.Indices, candidate.Weights);
+					if (candidate.Error < best.Error)
+						best = candidate;
+				}
+		}
+
+		// Single subset mode 6, RGBA 7.7.7.7 endpoints with p-bits and 4 bits indices
+		static void __EncodeBC7(const __Block& block, CompressionPreset preset, unsigned char* out) {
+			bool used[16];
+			for (int i = 0; i < 16; i++)
+				used[i] = true;
+			float e0[4], e1[4];
+			__FitEndpoints(block, used, 4, e0, e1);
+			__Mode6 best;
+			__TryMode6(block, e0, e1, preset, best);
+
+			if (preset == CompressionPreset::QUALITY)
+				for (int iteration = 0; iteration < 2 && best.Error > 0; iteration++) {
+					int previous = best.Error;
+					if (!__RefineEndpoints(block, used, best.Weights, 4, e0, e1))
+						break;
+					__TryMode6(block, e0, e1, preset, best);
+					if (best.Error >= previous)
+						break;
+				}
+
+			// The anchor (first) index has an implicit 0 most significant bit
+			if (best.Indices[0] >= 8) {
+				std::swap(best.Q0, best.Q1);
+				std::swap(best.P0, best.P1);
+				for (int i = 0; i < 16; i++)
+					best.Indices[i] = 15 - best.Indices[i];
+			}
+
+			__BitWriter writer(out, 16);
+			writer.Put(1 << 6, 7);
+			for (int c = 0; c < 4; c++) {
+				writer.Put(best.Q0[c], 7);
+				writer.Put(best.Q1[c], 7);
+			}
+			writer.Put(best.P0, 1);
+			writer.Put(best.P1, 1);
+			writer.Put(best.Indices[0], 3);
+			for (int i = 1; i < 16; i++)
+				writer.Put(best.Indices[i], 4);
+		}
+
+		static int __BlockBytes(FormatHandle format) {
+			switch ((VkFormat)format) {
+			case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+			case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+			case VK_FORMAT_BC4_UNORM_BLOCK:
+				return 8;
+			case VK_FORMAT_BC3_UNORM_BLOCK:
+			case VK_FORMAT_BC3_SRGB_BLOCK:
+			case VK_FORMAT_BC5_UNORM_BLOCK:
+			case VK_FORMAT_BC7_UNORM_BLOCK:
+			case VK_FORMAT_BC7_SRGB_BLOCK:
+				return 16;
+			default:
+				throw std::runtime_error("Not a block compressed format");
+			}
+		}
+
+		static void __EncodeBlock(VkFormat format, const __Block& block, CompressionPreset preset, unsigned char* out) {
+			switch (format) {
+			case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+			case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+				__EncodeBC1(block, preset, false, out);
+				break;
+			case VK_FORMAT_BC3_UNORM_BLOCK:
+			case VK_FORMAT_BC3_SRGB_BLOCK:
+				__EncodeBC4Channel(block, 3, preset, out);
+				__EncodeBC1(block, preset, true, out + 8);
+				break;
+			case VK_FORMAT_BC4_UNORM_BLOCK:
+				__EncodeBC4Channel(block, 0, preset, out);
+				break;
+			case VK_FORMAT_BC5_UNORM_BLOCK:
+				__EncodeBC4Channel(block, 0, preset, out);
+				__EncodeBC4Channel(block, 1, preset, out + 8);
+				break;
+			default:
+				__EncodeBC7(block, preset, out);
+				break;
+			}
+		}
+
+		size_t CompressedSize(FormatHandle format, unsigned int width, unsigned int height) {
+			return (size_t)__BlockBytes(format) * ((width + 3) / 4) * ((height + 3) / 4);
+		}
+
+		void Compress(FormatHandle format, const R8G8B8A8* pixels, unsigned int width, unsigned int height, void* blocks, CompressionPreset preset) {
+			CompressBlockRows(format, (const unsigned char*)pixels, width, height, 0, (height + 3) / 4, preset, (unsigned char*)blocks);
+		}
+
+#pragma endregion
+	}
+
+	void CompressBlockRows(FormatHandle format, const unsigned char* pixels, unsigned int width, unsigned int height,
+		unsigned int firstRow, unsigned int rows, Formats::CompressionPreset preset, unsigned char* blocks) {
+		int blockBytes = Formats::__BlockBytes(format);
+		unsigned int columns = (width + 3) / 4;
+		// Ranges of about 4K blocks
+		ParallelFor(rows, std::max<size_t>(1, 4096 / columns), [=](size_t begin, size_t end) {
+			Formats::__Block block;
+			for (size_t row = begin; row < end; row++) {
+				unsigned char* out = blocks + row * columns * blockBytes;
+				for (unsigned int column = 0; column < columns; column++, out += blockBytes) {
+					Formats::__LoadBlock(pixels, width, height, column, firstRow + (unsigned int)row, block);
+					Formats::__EncodeBlock((VkFormat)format, block, preset, out);
+				}
+			}
+		});
+	}
+}
@@ -4,6 +4,8 @@
 #include <memory>
 #include <vector>
 #include <iostream>
+#include <type_traits>
+#include <typeinfo>
 
 using namespace std;
 
@@ -36,6 +38,7 @@ namespace goofy {
 	struct RaytracingManager;
 
 	class Resource;
+	struct ResourceHandle;
 	class Buffer;
 	class Image1D;
 	class Image2D;
@@ -46,10 +49,12 @@ namespace goofy {
 	class Texture2D;
 	class Texture3D;
 	struct Sampler;
+	class AccelerationStructure;
 
 	// Sync objects
 	struct CPUTask;
 	struct GPUTask;
+	struct Readback;
 	struct Rallypoint;
 	struct Barrier;
 
@@ -64,10 +69,14 @@ namespace goofy {
 		struct __Pipeline;
 		struct __CommandListManager;
 		struct __Resource;
+		struct __AccelerationStructure;
 		struct __CPUTask;
 		struct __GPUTask;
 		struct __Rallypoint;
 		struct __Barrier;
+		struct __StreamingUploader;
+		struct __Readback;
+		class __ReplayProcess;
 	}
 }
 
@@ -81,12 +90,19 @@ namespace goofy {
 	class Obj {
 		friend states::__Device;
 		friend states::__EngineManager;
+		friend states::__StreamingUploader;
+		friend states::__Readback;
+		friend states::__ReplayProcess;
 		friend GPUTask;
 		friend CPUTask;
 		friend Presenter;
 		friend Device;
 		friend CommandListManager;
+		friend ComputeManager;
+		friend ComputeExclusiveManager;
 		friend GraphicsManager;
+		friend RaytracingManager;
+		friend Binder;
 	protected:
 		std::shared_ptr<S> __state = nullptr;
 		Obj() {}
@@ -158,6 +174,53 @@ namespace goofy {
 		READ,
 		WRITE
 	};
+
+	/// <summary>
+	/// File formats frames can be written to.
+	/// </summary>
+	enum class FrameOutputFormat {
+		/// <summary>
+		/// Texels as stored in the render target.
+		/// </summary>
+		RAW,
+		/// <summary>
+		/// Binary 8 bits RGB portable pixmap.
+		/// </summary>
+		PPM,
+		/// <summary>
+		/// 8 bits RGBA PNG without compression.
+		/// </summary>
+		PNG,
+		/// <summary>
+		/// 32 bits float RGBA OpenEXR without compression. Values are linear.
+		/// </summary>
+		EXR
+	};
+
+	/// <summary>
+	/// Filters used when sampling textures.
+	/// </summary>
+	enum class Filter {
+		LINEAR,
+		NEAREST
+	};
+
+	/// <summary>
+	/// Behaviour of texture coordinates outside the image.
+	/// </summary>
+	enum class AddressMode {
+		REPEAT,
+		MIRRORED_REPEAT,
+		CLAMP_TO_EDGE,
+		CLAMP_TO_BORDER
+	};
+
+	enum class PrimitiveTopology {
+		TRIANGLE_LIST,
+		TRIANGLE_STRIP,
+		LINE_LIST,
+		POINT_LIST
+	};
 }
 
 #pragma endregion
@@ -170,14 +233,16 @@ namespace goofy {
 
 	namespace Formats {
 		struct R8G8B8A8 {
+			struct RGBA {
+				char R;
+				char G;
+				char B;
+				char A;
+			};
+
 			union {
 				unsigned int Value;
-				struct Components {
-					char R;
-					char G;
-					char B;
-					char A;
-				} Components;
+				RGBA Components;
 			};
 
 			R8G8B8A8() :R8G8B8A8(0) {}
@@ -208,6 +273,145 @@ namespace goofy {
 
 			static FormatHandle Handle();
 		};
+
+		/// <summary>
+		/// 32-bit float depth, for depth buffers.
+		/// </summary>
+		struct D32_SFLOAT {
+			static FormatHandle Handle();
+		};
+
+		/// <summary>
+		/// RGB with 1 bit alpha in 8 bytes per 4x4 texels block.
+		/// </summary>
+		struct BC1 {
+			static FormatHandle UNORM_Handle();
+			static FormatHandle SRGB_Handle();
+		};
+
+		/// <summary>
+		/// RGB with interpolated alpha in 16 bytes per 4x4 texels block.
+		/// </summary>
+		struct BC3 {
+			static FormatHandle UNORM_Handle();
+			static FormatHandle SRGB_Handle();
+		};
+
+		/// <summary>
+		/// Single channel in 8 bytes per 4x4 texels block. Encoded from the red channel.
+		/// </summary>
+		struct BC4 {
+			static FormatHandle UNORM_Handle();
+		};
+
+		/// <summary>
+		/// Two channels in 16 bytes per 4x4 texels block (e.g. normal maps). Encoded from the red and green channels.
+		/// </summary>
+		struct BC5 {
+			static FormatHandle UNORM_Handle();
+		};
+
+		/// <summary>
+		/// RGBA in 16 bytes per 4x4 texels block, with the best quality of the block compressed formats.
+		/// </summary>
+		struct BC7 {
+			static FormatHandle UNORM_Handle();
+			static FormatHandle SRGB_Handle();
+		};
+
+		/// <summary>
+		/// Trade-off of the block compression encoder.
+		/// </summary>
+		enum class CompressionPreset {
+			/// <summary>
+			/// Endpoints fitted once and texels projected on them. Suited to streaming at load time.
+			/// </summary>
+			FAST,
+			/// <summary>
+			/// Endpoints refined by least squares and texels matched exhaustively against the palette. Several times slower.
+			/// </summary>
+			QUALITY
+		};
+
+		/// <summary>
+		/// Gets the size in bytes of the blocks of an image of a block compressed format.
+		/// </summary>
+		size_t CompressedSize(FormatHandle format, unsigned int width, unsigned int height);
+
+		/// <summary>
+		/// Encodes RGBA8 pixels into the blocks of a block compressed format (BC1, BC3, BC4, BC5 or BC7). Blocks past the image
+		/// edges repeat the last row and column. Large images are split among the worker threads of the library.
+		/// </summary>
+		void Compress(FormatHandle format, const R8G8B8A8* pixels, unsigned int width, unsigned int height, void* blocks, CompressionPreset preset = CompressionPreset::QUALITY);
+
+		/// <summary>
+		/// Variants of the sRGB transfer function used by the CPU conversions.
+		/// </summary>
+		enum class SRGBMethod {
+			/// <summary>
+			/// Tables indexed by the value. Decoding is exact and encoding is at most one 8 bits step away from the exact curve.
+			/// </summary>
+			LUT,
+			/// <summary>
+			/// Polynomial fit evaluated in registers, avoids the tables. Also within one 8 bits step of the exact curve.
+			/// </summary>
+			POLYNOMIAL
+		};
+
+		/// <summary>
+		/// Instruction sets of the CPU conversion kernels. All kernels produce the same bits as SCALAR for every input.
+		/// </summary>
+		enum class ConversionKernel {
+			SCALAR,
+			SSE4,
+			AVX2,
+			AVX512
+		};
+
+		/// <summary>
+		/// Gets the widest kernel supported by the CPU. It is the kernel used unless another one is set.
+		/// </summary>
+		ConversionKernel SupportedConversionKernel();
+
+		/// <summary>
+		/// Gets the kernel used by the conversions.
+		/// </summary>
+		ConversionKernel ActiveConversionKernel();
+
+		/// <summary>
+		/// Sets the kernel used by the conversions. Throws if the CPU does not support it.
+		/// </summary>
+		void SetConversionKernel(ConversionKernel kernel);
+
+		/// <summary>
+		/// Converts UNORM pixels to float. Large conversions are split among the worker threads of the library.
+		/// </summary>
+		void UnormToFloat(const R8G8B8A8* source, R32G32B32A32_SFLOAT* destination, size_t count);
+
+		/// <summary>
+		/// Converts float pixels to UNORM, clamping to [0, 1] and rounding to the nearest value. NaN becomes 0.
+		/// </summary>
+		void FloatToUnorm(const R32G32B32A32_SFLOAT* source, R8G8B8A8* destination, size_t count);
+
+		/// <summary>
+		/// Decodes sRGB pixels to linear float. Alpha is linear.
+		/// </summary>
+		void SRGBToFloat(const R8G8B8A8* source, R32G32B32A32_SFLOAT* destination, size_t count, SRGBMethod method = SRGBMethod::LUT);
+
+		/// <summary>
+		/// Encodes linear float pixels to sRGB, clamping to [0, 1]. Alpha is linear.
+		/// </summary>
+		void FloatToSRGB(const R32G32B32A32_SFLOAT* source, R8G8B8A8* destination, size_t count, SRGBMethod method = SRGBMethod::LUT);
+
+		/// <summary>
+		/// Packs floats into half floats rounding to the nearest even, the same as the hardware conversion.
+		/// </summary>
+		void FloatToHalf(const float* source, unsigned short* destination, size_t count);
+
+		/// <summary>
+		/// Unpacks half floats into floats. Conversion is exact.
+		/// </summary>
+		void HalfToFloat(const unsigned short* source, float* destination, size_t count);
 	}
 
 }
@@ -281,6 +485,40 @@ namespace goofy {
 		/// </summary>
 		int async_threads;
 
+		/// <summary>
+		/// Determines the number of bytes the streaming uploader can move through the transfer engine every frame.
+		/// If 0 is specified then default value of 16MB is assumed.
+		/// </summary>
+		unsigned long long upload_budget;
+
+		/// <summary>
+		/// Determines if retired GPU objects are destroyed in a background thread instead of in BeginFrame.
+		/// </summary>
+		bool background_destruction;
+
+		/// <summary>
+		/// Determines the file the pipeline cache is loaded from when the device is created and saved to when it is destroyed.
+		/// If null is specified then the cache is kept in memory only.
+		/// </summary>
+		const char* pipeline_cache;
+
+		/// <summary>
+		/// Determines the number of threads compiling pipelines created asynchronously, that is, the maximum concurrent compilations.
+		/// If 0 is specified then half of the hardware threads is assumed.
+		/// </summary>
+		int pipeline_compile_threads;
+
+		/// <summary>
+		/// Determines if the GPU time of every dispatched process is measured with timestamp queries.
+		/// Profiling code is compiled out if GOOFY_NO_PROFILING is defined.
+		/// </summary>
+		bool profiling;
+
+		/// <summary>
+		/// Determines if pipeline statistics (vertices and shader invocations) are queried for processes on graphics engines when profiling.
+		/// </summary>
+		bool profile_pipeline_statistics;
+
 		/// <summary>
 		/// Determines the presentation format for the framebuffer.
 		/// Common value used is Format::R8G8B8A8_SRGB
@@ -297,6 +535,11 @@ namespace goofy {
 		/// </summary>
 		std::string window_name;
 
+		struct Resolution {
+			unsigned int width;
+			unsigned int height;
+		};
+
 		union {
 			/// <summary>
 			/// Instance of GLFW window to draw to if EXISTING_GLFW_WINDOW
@@ -304,13 +547,35 @@ namespace goofy {
 			/// </summary>
 			void* ExistingWindow;
 
-			struct Resolution {
-				unsigned int width;
-				unsigned int height;
-			} resolution;
+			Resolution resolution;
 		};
 	};
 
+	struct FrameOutputDescription {
+		/// <summary>
+		/// Path prefix of the files written. The frame number and the extension of the format are appended.
+		/// e.g. "output/frame_" produces output/frame_000000.png, output/frame_000001.png, ...
+		/// </summary>
+		std::string path;
+
+		/// <summary>
+		/// Determines the file format of the frames.
+		/// </summary>
+		FrameOutputFormat format;
+
+		/// <summary>
+		/// Determines the number of threads encoding frames in parallel.
+		/// If 0 is specified then the number of hardware threads is assumed.
+		/// </summary>
+		int encoder_threads;
+
+		/// <summary>
+		/// Determines the maximum number of frames read back, encoding or waiting to be written. Bounds the memory used by the output.
+		/// EndFrame blocks only when this number is reached. If 0 is specified then frames-in-fly + twice the encoder threads is assumed.
+		/// </summary>
+		int max_queued_frames;
+	};
+
 	/// <summary>
 	/// Allows to define events for in-queue commands synchronization
 	/// </summary>
@@ -344,6 +609,10 @@ namespace goofy {
 		EngineType Engines();
 		void Set(Rallypoint point);
 		void Set(Barrier barrier);
+		/// <summary>
+		/// Binds the descriptor heap for the binder pipeline type and pushes its constants.
+		/// </summary>
+		void Set(const Binder& binder);
 		void Wait(Rallypoint point);
 	};
 
@@ -353,40 +622,250 @@ namespace goofy {
 		TransferManager();
 	};
 
+	/// <summary>
+	/// Dispatch of a batch. The pipeline and the binder are referenced and must live until the batch is recorded.
+	/// </summary>
+	struct ComputeDispatch {
+		const ComputePipeline* Pipeline;
+		/// <summary>
+		/// Push constants of the dispatch. If null the constants pushed before are kept.
+		/// </summary>
+		const ComputeBinder* Binder;
+		unsigned int GroupsX;
+		unsigned int GroupsY;
+		unsigned int GroupsZ;
+	};
+
 	struct ComputeManager : public CommandListManager {
 		static EngineType const SupportedEngines = (EngineType)((int)EngineType::COMPUTE | (int)EngineType::TRANSFER);
+
+		using CommandListManager::Set;
+
+		/// <summary>
+		/// Binds a compute pipeline. Binding the pipeline already bound records nothing. Pipelines compiled asynchronously
+		/// are waited for, processes can check IsReady to skip them instead.
+		/// </summary>
+		void Set(ComputePipeline pipeline);
+
+		/// <summary>
+		/// Dispatches groups of the pipeline bound.
+		/// </summary>
+		void Dispatch(unsigned int groupsX, unsigned int groupsY = 1, unsigned int groupsZ = 1);
+
+		/// <summary>
+		/// Dispatches the pipeline bound with the group counts read by the gpu from three unsigned integers of a buffer with
+		/// Indirect usage, at a 4-byte aligned offset.
+		/// </summary>
+		void DispatchIndirect(Buffer arguments, unsigned long long offset = 0);
+
+		/// <summary>
+		/// Records many dispatches sorted by pipeline and binder, so each binder is pushed once. Dispatches without a binder
+		/// run first with the constants pushed before the batch, each pipeline is bound once for them and once for the others.
+		/// Dispatches of a batch run in any order and must not depend on each other. Leaves the last pipeline bound.
+		/// </summary>
+		void Dispatch(int count, const ComputeDispatch* dispatches);
+
+		/// <summary>
+		/// Generates the mips after the first one of the image slice, for all its layers, averaging 2x2 (2x2x2 for volumes) texels.
+		/// Images with Storage usage of a format that can be a storage image are downsampled by compute shaders several levels per dispatch,
+		/// the others are blitted level by level and require a graphics engine and TransferSource and TransferDestination usages.
+		/// Overwrites the push constants and unbinds the compute pipeline when downsampling by compute shaders, a pipeline must be
+		/// set again before dispatching. Not allowed while rendering.
+		/// </summary>
+		void GenerateMips(Image2D image);
+
+		void GenerateMips(Image3D image);
+
 	private:
 		ComputeManager();
 	};
 
 	struct ComputeExclusiveManager : public CommandListManager {
 		static EngineType const SupportedEngines = EngineType::COMPUTE;
+
+		using CommandListManager::Set;
+
+		void Set(ComputePipeline pipeline);
+
+		void Dispatch(unsigned int groupsX, unsigned int groupsY = 1, unsigned int groupsZ = 1);
+
+		void DispatchIndirect(Buffer arguments, unsigned long long offset = 0);
+
+		void Dispatch(int count, const ComputeDispatch* dispatches);
 	private:
 		ComputeExclusiveManager();
 	};
 
+	/// <summary>
+	/// Object drawn by GPU-driven draws, 32 bytes in the instances buffer. The bounding sphere is tested against the frustum and
+	/// the visible objects draw IndexCount indices from FirstIndex, with firstInstance Instance so shaders can fetch their data.
+	/// </summary>
+	struct DrawInstance {
+		float Center[3];
+		float Radius;
+		unsigned int IndexCount;
+		unsigned int FirstIndex;
+		int VertexOffset;
+		unsigned int Instance;
+	};
+
+	/// <summary>
+	/// Extracts the left, right, bottom, top, near and far planes of a column-major view projection matrix with a 0 to 1 depth range.
+	/// Planes are (normal, distance) with normals of unit length pointing inside the frustum.
+	/// </summary>
+	void FrustumPlanes(const float viewProjection[16], float planes[6][4]);
+
 	struct GraphicsManager : public CommandListManager {
 		static EngineType const SupportedEngines = (EngineType)((int)EngineType::GRAPHICS | (int)EngineType::COMPUTE | (int)EngineType::TRANSFER);
 
+		using CommandListManager::Set;
+
+		/// <summary>
+		/// Gets the size in bytes of a draws buffer for a number of instances, a 16-byte header with the count of draws followed
+		/// by an indexed indirect command per instance.
+		/// </summary>
+		static unsigned long long DrawsSize(unsigned int instances) { return 16 + 20ull * instances; }
+
+		/// <summary>
+		/// Begins drawing to a render target of a single mip and layer, loading its contents. Rendering ends with EndRendering
+		/// or at the end of the process. Dispatches, clears and culling are not allowed while rendering.
+		/// </summary>
+		void BeginRendering(Image2D renderTarget);
+
+		/// <summary>
+		/// Begins drawing to a render target with a depth buffer of the same size, with DepthStencil usage.
+		/// </summary>
+		void BeginRendering(Image2D renderTarget, Image2D depth);
+
+		void EndRendering();
+
+		/// <summary>
+		/// Binds a graphics pipeline, its formats must match the render target and the depth buffer being rendered.
+		/// Binding the pipeline already bound records nothing.
+		/// </summary>
+		void Set(GraphicsPipeline pipeline);
+
+		/// <summary>
+		/// Binds a buffer with Indices usage as the 32-bit index buffer of the draws.
+		/// </summary>
+		void SetIndices(Buffer indices);
+
+		/// <summary>
+		/// Tests the bounding spheres of count DrawInstance of a storage buffer against six frustum planes on the gpu and writes
+		/// an indexed indirect command per visible instance to a draws buffer of DrawsSize(count) bytes, with Storage, Indirect
+		/// and TransferDestination usages. The CPU cost does not depend on the number of instances.
+		/// Overwrites the push constants and unbinds the compute pipeline, a pipeline must be set again before dispatching.
+		/// Not allowed while rendering.
+		/// </summary>
+		void Cull(Buffer instances, unsigned int count, const float planes[6][4], Buffer draws);
+
+		/// <summary>
+		/// Draws the commands written by Cull with the pipeline and the indices bound. With VK_KHR_draw_indirect_count the gpu
+		/// reads the count of visible draws, otherwise maxDraws commands are drawn and the culled ones have no instances.
+		/// </summary>
+		void DrawIndirect(Buffer draws, unsigned int maxDraws);
+
+		/// <summary>
+		/// Clears the slice of an image to a color. Not allowed while rendering.
+		/// </summary>
 		void Clear(Image2D image, const Formats::R32G32B32A32_SFLOAT &color);
 
+		void Clear(ResourceHandle image, const Formats::R32G32B32A32_SFLOAT &color);
+
+		void GenerateMips(Image2D image);
+
+		void GenerateMips(Image3D image);
+
 	private:
 		GraphicsManager();
 	};
 
 	struct RaytracingManager : public CommandListManager {
 		static EngineType const SupportedEngines = (EngineType)((int)EngineType::RAYTRACING | (int)EngineType::GRAPHICS | (int)EngineType::COMPUTE | (int)EngineType::TRANSFER);
+
+		/// <summary>
+		/// Moves the vertices of a dynamic structure to new positions, with the vertex stride of its mesh, refitting it in place.
+		/// The CPU copy of its BVH is refitted to measure the quality, once the SAH cost exceeds the rebuild threshold the
+		/// structure is rebuilt instead. Structures can be updated once per frame, the work is proportional to their triangles.
+		/// Not allowed while rendering.
+		/// </summary>
+		void Update(AccelerationStructure structure, const float* positions);
+
 	private:
 		RaytracingManager();
 	};
 
 
+	/// <summary>
+	/// Collects the push constants of a process, typically the heap indices of the resources it accesses.
+	/// Setting a binder on a command list binds the descriptor heap of the device (once per list) and pushes the constants.
+	/// In shaders the heap is the set 0 with unbounded arrays at bindings: 0 sampled images, 1 storage images, 2 storage buffers, 3 samplers.
+	/// </summary>
+	class Binder {
+		friend CommandListManager;
+	protected:
+		EngineType _engine;
+		unsigned int _constants[32];
+		/// <summary>
+		/// Number of 32 bits constants used.
+		/// </summary>
+		int _count = 0;
+		/// <summary>
+		/// Slots (as bits) holding resource handles, resolved to heap indices when the binder is set.
+		/// </summary>
+		unsigned int _handles = 0;
+		/// <summary>
+		/// Slots (as bits) of handles resolved to sampled indices.
+		/// </summary>
+		unsigned int _sampled = 0;
+
+		Binder(EngineType engine) : _engine(engine) { }
+	public:
+		/// <summary>
+		/// Sets a 32 bits constant at a slot. Slots are 4 bytes offsets in the push constants block.
+		/// </summary>
+		void Set(int slot, unsigned int value);
+
+		void Set(int slot, float value);
+
+		/// <summary>
+		/// Sets the heap index of a resource at a slot. Images read use the sampled index, otherwise the storage index is used.
+		/// </summary>
+		void Set(int slot, const Resource& resource, ResourceAccess access = ResourceAccess::READ);
+
+		/// <summary>
+		/// Sets the heap index of a registered resource at a slot. The index is resolved when the binder is set on a command list.
+		/// </summary>
+		void Set(int slot, ResourceHandle resource, ResourceAccess access = ResourceAccess::READ);
+	};
+
+	class ComputeBinder : public Binder {
+	public:
+		ComputeBinder() : Binder(EngineType::COMPUTE) { }
+	};
+
+	class GraphicsBinder : public Binder {
+	public:
+		GraphicsBinder() : Binder(EngineType::GRAPHICS) { }
+	};
+
+	class RaytracingBinder : public Binder {
+	public:
+		RaytracingBinder() : Binder(EngineType::RAYTRACING) { }
+	};
+
 	/// <summary>
 	/// Represents the abstraction of a graphic process by means of command list population process.
 	/// </summary>
 	struct Process {
 		virtual EngineType RequiredEngines() = 0;
 		virtual void Populate(CommandListManager manager) = 0;
+
+		/// <summary>
+		/// Name the GPU time of the process is reported with when profiling. The string must remain valid while the device lives.
+		/// Defaults to the demangled name of the process type.
+		/// </summary>
+		virtual const char* Name();
 	};
 
 	template<typename I, typename M>
@@ -403,16 +882,230 @@ namespace goofy {
 		virtual void Populate(CommandListManager manager) override;
 	};
 
-	struct BufferDescription {
-	};
-
-	struct Image1DDescription {
-	};
-
+	/// <summary>
+	/// Defines different usages of a buffer.
+	/// </summary>
+	struct BufferUsage {
+		/// <summary>
+		/// Allows transfers from the buffer.
+		/// </summary>
+		bool TransferSource;
+		/// <summary>
+		/// Allows transfers to the buffer.
+		/// </summary>
+		bool TransferDestination;
+		/// <summary>
+		/// Allows the buffer to be used as a uniform buffer.
+		/// </summary>
+		bool Uniform;
+		/// <summary>
+		/// Allows the buffer to be a storage buffer.
+		/// </summary>
+		bool Storage;
+		/// <summary>
+		/// Allows the buffer to be bound as vertex buffer.
+		/// </summary>
+		bool Vertices;
+		/// <summary>
+		/// Allows the buffer to be bound as index buffer.
+		/// </summary>
+		bool Indices;
+		/// <summary>
+		/// Allows the buffer to be used as argument for indirect commands.
+		/// </summary>
+		bool Indirect;
+	};
+
+	struct BufferDescription {
+		/// <summary>
+		/// Size in bytes of the buffer.
+		/// </summary>
+		unsigned long long size;
+
+		/// <summary>
+		/// Determines the valid usages of the buffer.
+		/// </summary>
+		BufferUsage Usage;
+	};
+
+	struct Image1DDescription {
+		FormatHandle Format;
+		unsigned int width;
+		/// <summary>
+		/// Number of mip levels. If 0 is specified then 1 is assumed.
+		/// </summary>
+		int mips;
+		/// <summary>
+		/// Number of array slices. If 0 is specified then 1 is assumed.
+		/// </summary>
+		int arrays;
+		ImageUsage Usage;
+	};
+
 	struct Image2DDescription {
+		FormatHandle Format;
+		unsigned int width;
+		unsigned int height;
+		/// <summary>
+		/// Number of mip levels. If 0 is specified then 1 is assumed.
+		/// </summary>
+		int mips;
+		/// <summary>
+		/// Number of array slices. If 0 is specified then 1 is assumed.
+		/// </summary>
+		int arrays;
+		ImageUsage Usage;
 	};
 
 	struct Image3DDescription {
+		FormatHandle Format;
+		unsigned int width;
+		unsigned int height;
+		unsigned int depth;
+		/// <summary>
+		/// Number of mip levels. If 0 is specified then 1 is assumed.
+		/// </summary>
+		int mips;
+		ImageUsage Usage;
+	};
+
+	/// <summary>
+	/// Triangles of a mesh an acceleration structure is built for. Positions are three floats at the start of each vertex.
+	/// </summary>
+	struct MeshDescription {
+		const float* Positions;
+		/// <summary>
+		/// Bytes between consecutive vertices. If 0 is specified then 12 (packed positions) is assumed.
+		/// </summary>
+		unsigned int VertexStride;
+		unsigned int VertexCount;
+		/// <summary>
+		/// Three vertex indices per triangle. If null then every three consecutive vertices are a triangle.
+		/// </summary>
+		const unsigned int* Indices;
+		unsigned int TriangleCount;
+		/// <summary>
+		/// Determines if any-hit shaders are skipped for the triangles of the mesh.
+		/// </summary>
+		bool Opaque;
+		/// <summary>
+		/// Determines if the vertices of the mesh move after the structure is built (skinned or animated geometry) and the
+		/// structure is updated with RaytracingManager::Update. The topology can not change.
+		/// </summary>
+		bool Dynamic;
+		/// <summary>
+		/// Ratio of the SAH cost of a refitted dynamic structure to its cost when it was built above which updates rebuild it.
+		/// If 0 is specified then 1.5 is assumed.
+		/// </summary>
+		float RebuildThreshold;
+	};
+
+	/// <summary>
+	/// Node of a BVH, 32 bytes. Leaves have a triangle count and the position of their first triangle in the triangle list,
+	/// inner nodes have a zero count and the index of their first child, the second child follows it.
+	/// </summary>
+	struct BVHNode {
+		float Min[3];
+		unsigned int Count;
+		float Max[3];
+		unsigned int Index;
+	};
+
+	/// <summary>
+	/// Bounding volume hierarchy of the triangles of a mesh. The root is the first node. Empty meshes have no nodes.
+	/// </summary>
+	struct BVH {
+		std::vector<BVHNode> Nodes;
+		/// <summary>
+		/// Triangles of the mesh ordered so the triangles of each leaf are consecutive.
+		/// </summary>
+		std::vector<unsigned int> Triangles;
+	};
+
+	/// <summary>
+	/// Builds a BVH of a mesh on the CPU splitting nodes by the surface area heuristic evaluated in 16 bins per axis.
+	/// Nodes of many triangles are binned in parallel and the subtrees below them are built concurrently on the threads
+	/// shared by the CPU kernels of the library. Leaves have at most 4 triangles unless they can not be split.
+	/// </summary>
+	BVH BuildBVH(const MeshDescription& mesh);
+
+	/// <summary>
+	/// Gets the SAH cost of a BVH relative to the area of its root, the expected number of nodes visited and triangles tested
+	/// by a ray hitting the root.
+	/// </summary>
+	float SAHCost(const BVH& bvh);
+
+	/// <summary>
+	/// Recomputes the bounds of a BVH for the moved vertices of the mesh it was built for, keeping its topology.
+	/// Leaves are refitted in parallel. Returns the SAH cost of the refitted BVH.
+	/// </summary>
+	float RefitBVH(BVH& bvh, const MeshDescription& mesh);
+
+	/// <summary>
+	/// Sampling state of a texture. Textures with equal states share a single sampler of the device.
+	/// </summary>
+	struct Sampler {
+		Filter MinFilter;
+		Filter MagFilter;
+		Filter MipFilter;
+		AddressMode AddressU;
+		AddressMode AddressV;
+		AddressMode AddressW;
+		float MipLodBias;
+		/// <summary>
+		/// Maximum anisotropy. Values of 1 or less disable anisotropic filtering.
+		/// </summary>
+		float MaxAnisotropy;
+		float MinLod;
+		/// <summary>
+		/// Maximum level of detail. If 0 is specified then all mips are accessible.
+		/// </summary>
+		float MaxLod;
+	};
+
+	/// <summary>
+	/// SPIR-V code of a shader stage.
+	/// </summary>
+	struct ShaderStageDescription {
+		const unsigned int* Code;
+		/// <summary>
+		/// Size of the code in bytes.
+		/// </summary>
+		unsigned long long Size;
+		/// <summary>
+		/// Entry point of the stage. If null is specified then "main" is assumed.
+		/// </summary>
+		const char* EntryPoint;
+		/// <summary>
+		/// Specialization constants block. Each 4-byte word sets the specialization constant with id equal to its index.
+		/// </summary>
+		const void* Constants;
+		/// <summary>
+		/// Size of the constants block in bytes.
+		/// </summary>
+		unsigned int ConstantsSize;
+	};
+
+	/// <summary>
+	/// Pipelines access resources through the descriptor heap and the binder push constants.
+	/// </summary>
+	struct ComputePipelineDescription {
+		ShaderStageDescription Shader;
+	};
+
+	/// <summary>
+	/// Vertices are read from the descriptor heap (vertex pulling), so there is no vertex input state.
+	/// </summary>
+	struct GraphicsPipelineDescription {
+		ShaderStageDescription Vertex;
+		ShaderStageDescription Fragment;
+		PrimitiveTopology Topology;
+		FormatHandle RenderTargetFormat;
+		/// <summary>
+		/// Format of the depth buffer. If 0 is specified then there is no depth test.
+		/// </summary>
+		FormatHandle DepthStencilFormat;
+		bool CullBackFaces;
 	};
 
 	struct CPUTask : public Obj<states::__CPUTask> {
@@ -425,17 +1118,110 @@ namespace goofy {
 		static GPUTask Combine(int count, GPUTask* tasks);
 	};
 
+	/// <summary>
+	/// Handle to the content of a resource being copied back to the cpu.
+	/// The copy is recorded in the frame and completes when the frame finishes on the gpu, so it can be consumed some frames later without stalls.
+	/// </summary>
+	struct Readback : public Obj<states::__Readback> {
+		/// <summary>
+		/// Checks without blocking if the data is already available.
+		/// </summary>
+		bool IsReady();
+
+		/// <summary>
+		/// Waits for the data to be available. The frame the readback was requested in must have ended.
+		/// </summary>
+		void Wait();
+
+		/// <summary>
+		/// Gets the read-only mapped data, waiting if necessary. Pointer is valid while the readback is referenced.
+		/// </summary>
+		const void* Data();
+
+		/// <summary>
+		/// Gets the size in bytes of the data.
+		/// </summary>
+		unsigned long long Size();
+	};
+
 	
 #define Dispatch_Method(m) Dispatch(this, &decltype(___dr(this))::m)
 #define Dispatch_Method_In_Frame_Async(m) Dispatch(this, &decltype(___dr(this))::m, goofy::DispatchMode::ASYNC_FRAME)
 #define Dispatch_Method_Async(m) Dispatch(this, &decltype(___dr(this))::m, goofy::DispatchMode::ASYNC)
 
+	/// <summary>
+	/// Histogram of wait times. Bucket i counts waits shorter than 2^i microseconds, the last bucket the longer waits.
+	/// </summary>
+	struct WaitHistogram {
+		static const int Buckets = 16;
+		unsigned long long Counts[Buckets];
+		unsigned long long Waits;
+		double TotalMilliseconds;
+	};
+
+	struct WorkerStatistics {
+		int Worker;
+		/// <summary>
+		/// Determines if the worker populates processes of the current frame (ASYNC_FRAME) or across frames (ASYNC).
+		/// </summary>
+		bool InFrame;
+		double BusyMilliseconds;
+		double IdleMilliseconds;
+	};
+
+	struct CommandQueueStatistics {
+		/// <summary>
+		/// Engines supported by the queue family of the command buffers.
+		/// </summary>
+		EngineType Engines;
+		int AllocatedBuffers;
+		/// <summary>
+		/// Command buffers submitted whose work has not been retired yet.
+		/// </summary>
+		int InFlightBuffers;
+	};
+
+	/// <summary>
+	/// Snapshot of the scheduler and submission counters. Counters are kept per thread and aggregated when the snapshot is taken.
+	/// </summary>
+	struct DeviceStatistics {
+		long long Frames;
+		/// <summary>
+		/// Processes waiting for a frame worker.
+		/// </summary>
+		int FrameQueueDepth;
+		/// <summary>
+		/// Processes waiting for an async worker.
+		/// </summary>
+		int AsyncQueueDepth;
+		unsigned long long Dispatches;
+		unsigned long long Submits;
+		/// <summary>
+		/// Dispatches per frame since the previous snapshot.
+		/// </summary>
+		double DispatchesPerFrame;
+		/// <summary>
+		/// Submits per frame since the previous snapshot.
+		/// </summary>
+		double SubmitsPerFrame;
+		std::vector<WorkerStatistics> Workers;
+		WaitHistogram CPUTaskWaits;
+		WaitHistogram GPUTaskWaits;
+		std::vector<CommandQueueStatistics> CommandQueues;
+		/// <summary>
+		/// Bytes of memory owned by live resources.
+		/// </summary>
+		unsigned long long ResourceMemory;
+	};
+
 	/// <summary>
 	/// Represents a base class for Presenter and Technique.
 	/// </summary>
 	class Device : public Obj<states::__Device> {
 		friend Presenter;
 		friend Technique;
+		template<typename C, int N> friend class ComputeVariants;
+		template<typename C, int N> friend class GraphicsVariants;
 		Device(states::__Device* initialState);
 
 		void BindTechnique(std::shared_ptr<Technique> technique);
@@ -474,14 +1260,154 @@ namespace goofy {
 
 		Image3D Create(const Image3DDescription& description);
 
+		/// <summary>
+		/// Creates a compute pipeline through the device pipeline cache.
+		/// </summary>
+		ComputePipeline Create(const ComputePipelineDescription& description);
+
+		/// <summary>
+		/// Creates a graphics pipeline through the device pipeline cache.
+		/// </summary>
+		GraphicsPipeline Create(const GraphicsPipelineDescription& description);
+
+		/// <summary>
+		/// Creates a compute pipeline compiled in background. The pipeline can not be used until it is ready.
+		/// Shader code is copied, the description does not need to outlive the call.
+		/// </summary>
+		ComputePipeline CreateAsync(const ComputePipelineDescription& description);
+
+		/// <summary>
+		/// Creates a graphics pipeline compiled in background. The pipeline can not be used until it is ready.
+		/// Shader code is copied, the description does not need to outlive the call.
+		/// </summary>
+		GraphicsPipeline CreateAsync(const GraphicsPipelineDescription& description);
+
+		/// <summary>
+		/// Creates a compute pipeline specialized by the shader constants. Variants with the same code and constants are shared.
+		/// </summary>
+		ComputePipeline CreateVariant(const ComputePipelineDescription& description);
+
+		/// <summary>
+		/// Creates a graphics pipeline specialized by the shader constants. Variants with the same code, constants and state are shared.
+		/// </summary>
+		GraphicsPipeline CreateVariant(const GraphicsPipelineDescription& description);
+
+		/// <summary>
+		/// Registers a resource in the device pool and gets a handle to it. The pool keeps the resource alive until the handle is released.
+		/// </summary>
+		ResourceHandle Register(const Resource& resource);
+
+		/// <summary>
+		/// Releases a handle. The handle is stale immediately but the resource is kept until the frames in fly have finished.
+		/// </summary>
+		void Release(ResourceHandle handle);
+
+		/// <summary>
+		/// Determines if a handle refers to a registered resource.
+		/// </summary>
+		bool IsAlive(ResourceHandle handle);
+
 		Rallypoint CreateRallypoint();
 
+		/// <summary>
+		/// Streams data to a buffer using the transfer engine. The upload is split in chunks scheduled asynchronously every frame
+		/// within the upload budget, so frame work is never starved. Data must remain valid until the returned task has completed.
+		/// </summary>
+		GPUTask Upload(Buffer buffer, const void* data, unsigned long long size, unsigned long long offset = 0);
+
+		/// <summary>
+		/// Streams the texels of the first mip level (all array slices) to an image using the transfer engine.
+		/// Data must remain valid until the returned task has completed.
+		/// </summary>
+		GPUTask Upload(Image1D image, const void* data);
+
+		/// <summary>
+		/// Streams the texels of the first mip level (all array slices) to an image using the transfer engine.
+		/// Data must remain valid until the returned task has completed.
+		/// </summary>
+		GPUTask Upload(Image2D image, const void* data);
+
+		/// <summary>
+		/// Streams RGBA8 texels of the first mip level (all array slices) to an image of a block compressed format.
+		/// Blocks are encoded into the staging memory by the async workers recording the upload chunks.
+		/// Pixels must remain valid until the returned task has completed.
+		/// </summary>
+		GPUTask Upload(Image2D image, const Formats::R8G8B8A8* pixels, Formats::CompressionPreset preset);
+
+		/// <summary>
+		/// Streams the texels of the first mip level to an image using the transfer engine.
+		/// Data must remain valid until the returned task has completed.
+		/// </summary>
+		GPUTask Upload(Image3D image, const void* data);
+
+		/// <summary>
+		/// Uploads the content of a file to a buffer. The file is memory mapped and, when the device supports it,
+		/// its pages are imported as host memory and copied by the gpu directly. Otherwise the mapped pages are streamed to the staging ring.
+		/// </summary>
+		GPUTask UploadFile(Buffer buffer, const char* path, unsigned long long offset = 0);
+
+		/// <summary>
+		/// Uploads the texels of the first mip level (all array slices) to an image from a file starting at fileOffset.
+		/// The file is memory mapped and imported as host memory when supported.
+		/// </summary>
+		GPUTask UploadFile(Image1D image, const char* path, unsigned long long fileOffset = 0);
+
+		/// <summary>
+		/// Uploads the texels of the first mip level (all array slices) to an image from a file starting at fileOffset.
+		/// The file is memory mapped and imported as host memory when supported.
+		/// </summary>
+		GPUTask UploadFile(Image2D image, const char* path, unsigned long long fileOffset = 0);
+
+		/// <summary>
+		/// Uploads the texels of the first mip level to an image from a file starting at fileOffset.
+		/// The file is memory mapped and imported as host memory when supported.
+		/// </summary>
+		GPUTask UploadFile(Image3D image, const char* path, unsigned long long fileOffset = 0);
+
+		/// <summary>
+		/// Builds the bottom level acceleration structures of a set of meshes and waits for them. Structures are built on the gpu
+		/// in batched build commands sharing a scratch pool, then compacted to the size queried after the build.
+		/// Devices without acceleration structures (e.g. software drivers) build BVHs on the CPU in parallel instead and store
+		/// them in a storage buffer. Mesh data is copied, it does not need to outlive the call.
+		/// Dynamic structures are not compacted, so they can be rebuilt in place, and keep a CPU copy of their BVH and indices.
+		/// </summary>
+		void Build(int count, const MeshDescription* meshes, AccelerationStructure* structures);
+
+		/// <summary>
+		/// Enqueues in the current frame a copy of a buffer region to a recycled readback buffer.
+		/// The copy is recorded when the frame ends, after its command lists. Safe to call from any thread.
+		/// If 0 is specified as size then the rest of the buffer is copied.
+		/// </summary>
+		Readback Download(Buffer buffer, unsigned long long size = 0, unsigned long long offset = 0);
+
+		/// <summary>
+		/// Enqueues in the current frame a copy of the first mip level (all array slices) of an image to a recycled readback buffer.
+		/// </summary>
+		Readback Download(Image1D image);
+
+		/// <summary>
+		/// Enqueues in the current frame a copy of the first mip level (all array slices) of an image to a recycled readback buffer.
+		/// Swapchain render targets can not be downloaded.
+		/// </summary>
+		Readback Download(Image2D image);
+
+		/// <summary>
+		/// Enqueues in the current frame a copy of the first mip level of an image to a recycled readback buffer.
+		/// </summary>
+		Readback Download(Image3D image);
+
 	public:
 		/// <summary>
 		/// Gets the current frame-in-fly index.
 		/// </summary>
 		int GetCurrentFrameIndex();
 
+		/// <summary>
+		/// Gets a snapshot of the scheduler and submission counters.
+		/// Rates per frame are measured since the previous snapshot.
+		/// </summary>
+		DeviceStatistics GetStatistics();
+
 		/// <summary>
 		/// Gets the number of frames-in-fly.
 		/// </summary>
@@ -517,17 +1443,87 @@ namespace goofy {
 		void DispatchTechnique(const std::shared_ptr<T>& technique);
 	};
 
+	/// <summary>
+	/// Window of the presenter. OFFLINE presenters get a headless window that is never closed, has no events and no internal window,
+	/// the application decides how many frames to render.
+	/// </summary>
 	class Window : public Obj<states::__Window> {
 	public:
 		bool IsClosed();
 
 		void PollEvents();
 
+		/// <summary>
+		/// Gets the time in seconds since the window was created.
+		/// </summary>
 		double Time();
 
 		void* InternalWindow();
 	};
 
+	/// <summary>
+	/// GPU time in milliseconds over the last samples measured.
+	/// </summary>
+	struct Timing {
+		int Samples;
+		double Min;
+		double Average;
+		double P99;
+	};
+
+	struct ProcessProfile {
+		std::string Process;
+		Timing GPU;
+		/// <summary>
+		/// Pipeline statistics of the last sample. Zero if pipeline statistics are not queried.
+		/// </summary>
+		unsigned long long Vertices;
+		unsigned long long VertexInvocations;
+		unsigned long long FragmentInvocations;
+		unsigned long long ComputeInvocations;
+	};
+
+	struct EngineProfile {
+		/// <summary>
+		/// Engines supported by the queue family the command lists were submitted to.
+		/// </summary>
+		EngineType Engines;
+		/// <summary>
+		/// Time of whole command lists, from the first to the last command recorded.
+		/// </summary>
+		Timing GPU;
+	};
+
+	struct ProfileReport {
+		std::vector<ProcessProfile> Processes;
+		std::vector<EngineProfile> Engines;
+	};
+
+	/// <summary>
+	/// Result of replaying a capture. Times in milliseconds.
+	/// </summary>
+	struct ReplayReport {
+		int Frames;
+		int Dispatches;
+		/// <summary>
+		/// Time from the first to the last frame when captured.
+		/// </summary>
+		double CapturedTime;
+		/// <summary>
+		/// Time from the first to the last frame when replayed.
+		/// </summary>
+		double ReplayTime;
+		/// <summary>
+		/// CPU time from the beginning to the end of the replayed frames.
+		/// </summary>
+		Timing Frame;
+		/// <summary>
+		/// Commands captured without capture support (uploads, downloads and acceleration structure builds and updates)
+		/// and skipped. The replay is not faithful if any.
+		/// </summary>
+		int Unsupported;
+	};
+
 	class Presenter : public Device {
 
 		Presenter(const PresenterDescription& description);
@@ -539,7 +1535,54 @@ namespace goofy {
 
 		void EndFrame();
 
-		Window Window();
+		/// <summary>
+		/// Writes every frame presented from now on to disk. The render target is read back asynchronously
+		/// and encoded in a pool of threads, files are written in frame order. Requires an OFFLINE presenter and TransferSource usage of the render targets.
+		/// </summary>
+		void AttachOutput(const FrameOutputDescription& description);
+
+		/// <summary>
+		/// Waits for all frames queued to be written and stops writing frames.
+		/// </summary>
+		void DetachOutput();
+
+		/// <summary>
+		/// Gets the GPU times of processes and engines resolved from the frames retired so far. Empty if profiling is disabled.
+		/// </summary>
+		ProfileReport Profile();
+
+		/// <summary>
+		/// Starts recording CPU events (population of processes, submissions, waits and frame boundaries) of all threads.
+		/// Each thread records up to events_per_thread events, if 0 is specified then 65536 is assumed. The capacity of the first
+		/// trace is kept by later ones.
+		/// </summary>
+		void StartTrace(int events_per_thread = 0);
+
+		/// <summary>
+		/// Stops recording and writes the trace in Chrome trace-event JSON format, viewable in chrome://tracing or Perfetto.
+		/// Returns false if the file can not be written.
+		/// </summary>
+		bool StopTrace(const char* path);
+
+		/// <summary>
+		/// Starts writing every frame, dispatch, flush and recorded command to a compact binary capture file.
+		/// Resources are written with their descriptions when first referenced by a captured command. Commands without capture support
+		/// are only marked, replays skip and report them. Returns false if the file can not be created.
+		/// </summary>
+		bool StartCapture(const char* path);
+
+		/// <summary>
+		/// Stops capturing and closes the file. Processes still populating are not captured.
+		/// </summary>
+		void StopCapture();
+
+		/// <summary>
+		/// Re-executes a capture on this presenter: captured resources are created again and every frame dispatches and flushes
+		/// processes recording the captured commands. A speed of 1 paces frames as captured, 2 twice as fast, and 0 runs as fast as possible.
+		/// </summary>
+		ReplayReport Replay(const char* path, double speed = 0);
+
+		goofy::Window Window();
 	};
 
 	class Technique : protected Device {
@@ -553,18 +1596,198 @@ namespace goofy {
 
 	};
 
+	/// <summary>
+	/// 32 bits reference to a resource registered in the device pool: 16 bits slot and 16 bits generation.
+	/// Handles are plain values, passing them does no reference counting and resolving them reads contiguous arrays.
+	/// </summary>
+	struct ResourceHandle {
+		unsigned int Value;
+
+		bool IsNull() const { return Value == 0; }
+	};
+
 	class Resource : public Obj<states::__Resource> {
+	public:
+		/// <summary>
+		/// Value of the indices when the resource is not in a range of the descriptor heap.
+		/// </summary>
+		static const unsigned int NoIndex = 0xFFFFFFFF;
+
+		/// <summary>
+		/// Gets the stable index of the resource in the sampled images of the descriptor heap.
+		/// </summary>
+		unsigned int SampledIndex() const;
+
+		/// <summary>
+		/// Gets the stable index of the resource in the storage images or storage buffers of the descriptor heap.
+		/// </summary>
+		unsigned int StorageIndex() const;
+	};
+
+	class Buffer : public Resource {
+
+	};
+
+	class Image1D : public Resource {
 
 	};
 
 	class Image2D : public Resource {
 
 	public:
+		/// <summary>
+		/// Gets a range of mips and array slices, relative to this image. Views are cached by the device,
+		/// slicing the same range again creates no object.
+		/// </summary>
+		Image2D Slice(int mip_start, int mip_count, int array_start = 0, int array_count = 1);
+
+		/// <summary>
+		/// Gets this image sampled with a sampler state. Samplers are cached by the device.
+		/// </summary>
 		Texture2D AsTexture(const Sampler& sampler);
 	};
 
 	class Texture2D : public Image2D {
 
+	public:
+		/// <summary>
+		/// Gets the index of the texture sampler in the samplers of the descriptor heap.
+		/// </summary>
+		unsigned int SamplerIndex() const;
+	};
+
+	class Image3D : public Resource {
+
+	};
+
+	/// <summary>
+	/// Bottom level acceleration structure of a mesh. Structures built together share their device memory.
+	/// Software structures are BVHs whose nodes and triangles are stored in a storage buffer of the heap: inner nodes
+	/// index their first child in the buffer (32-byte nodes) and leaves index the word of their first triangle.
+	/// </summary>
+	class AccelerationStructure : public Obj<states::__AccelerationStructure> {
+	public:
+		/// <summary>
+		/// Determines if the structure is a BVH built on the CPU because the device has no acceleration structures.
+		/// </summary>
+		bool IsSoftware() const;
+
+		/// <summary>
+		/// Gets the device address instances refer to the structure with. 0 for software structures.
+		/// </summary>
+		unsigned long long DeviceAddress() const;
+
+		/// <summary>
+		/// Gets the bytes of device memory used by the structure.
+		/// </summary>
+		unsigned long long Size() const;
+
+		/// <summary>
+		/// Gets the index in the storage buffers of the heap of the buffer with the nodes of software structures, NoIndex otherwise.
+		/// </summary>
+		unsigned int StorageIndex() const;
+
+		/// <summary>
+		/// Gets the index of the root node in the storage buffer of software structures.
+		/// </summary>
+		unsigned int RootNode() const;
+
+		/// <summary>
+		/// Gets the number of times updates rebuilt a dynamic structure because refitting degraded it.
+		/// </summary>
+		unsigned int Rebuilds() const;
+	};
+
+	class Pipeline : public Obj<states::__Pipeline> {
+	public:
+		/// <summary>
+		/// Determines if the pipeline has been compiled. Processes can skip or substitute the work of pipelines not ready yet.
+		/// </summary>
+		bool IsReady() const;
+
+		/// <summary>
+		/// Waits for the pipeline to be compiled. Throws if the compilation failed.
+		/// </summary>
+		void Wait();
+	};
+
+	class ComputePipeline : public Pipeline {
+
+	};
+
+	class GraphicsPipeline : public Pipeline {
+
+	};
+
+	class RaytracingPipeline : public Pipeline {
+
+	};
+
+	/// <summary>
+	/// Compute pipeline variants of the same shader specialized by a compile-time table of constants.
+	/// Constants is a struct of 4-byte fields (use unsigned int for feature toggles), the i-th field is the specialization constant with id i.
+	/// Variants are selected with a constant index, created on first use and shared with other variants with the same constants.
+	/// </summary>
+	template<typename Constants, int Count>
+	class ComputeVariants {
+		static_assert(sizeof(Constants) % 4 == 0, "Specialization constants must be 4-byte fields");
+		static_assert(std::is_trivially_copyable<Constants>::value, "Specialization constants must be trivially copyable");
+
+		ComputePipelineDescription description;
+		const Constants* table = nullptr;
+		ComputePipeline variants[Count];
+	public:
+		ComputeVariants() { }
+
+		/// <summary>
+		/// Table must outlive the variants, usually it is a static constexpr array.
+		/// </summary>
+		ComputeVariants(const ComputePipelineDescription& description, const Constants(&table)[Count]) : description(description), table(table) { }
+
+		template<int Index>
+		ComputePipeline Get(Device& device) {
+			static_assert(Index >= 0 && Index < Count, "Variant index out of range");
+			if (variants[Index].IsNull()) {
+				ComputePipelineDescription specialized = description;
+				specialized.Shader.Constants = &table[Index];
+				specialized.Shader.ConstantsSize = sizeof(Constants);
+				variants[Index] = device.CreateVariant(specialized);
+			}
+			return variants[Index];
+		}
+	};
+
+	/// <summary>
+	/// Graphics pipeline variants of the same shaders specialized by a compile-time table of constants.
+	/// The same constants are set for the vertex and fragment stages.
+	/// </summary>
+	template<typename Constants, int Count>
+	class GraphicsVariants {
+		static_assert(sizeof(Constants) % 4 == 0, "Specialization constants must be 4-byte fields");
+		static_assert(std::is_trivially_copyable<Constants>::value, "Specialization constants must be trivially copyable");
+
+		GraphicsPipelineDescription description;
+		const Constants* table = nullptr;
+		GraphicsPipeline variants[Count];
+	public:
+		GraphicsVariants() { }
+
+		/// <summary>
+		/// Table must outlive the variants, usually it is a static constexpr array.
+		/// </summary>
+		GraphicsVariants(const GraphicsPipelineDescription& description, const Constants(&table)[Count]) : description(description), table(table) { }
+
+		template<int Index>
+		GraphicsPipeline Get(Device& device) {
+			static_assert(Index >= 0 && Index < Count, "Variant index out of range");
+			if (variants[Index].IsNull()) {
+				GraphicsPipelineDescription specialized = description;
+				specialized.Vertex.Constants = specialized.Fragment.Constants = &table[Index];
+				specialized.Vertex.ConstantsSize = specialized.Fragment.ConstantsSize = sizeof(Constants);
+				variants[Index] = device.CreateVariant(specialized);
+			}
+			return variants[Index];
+		}
 	};
 
 	// GENERIC IMPLEMENTATIONS
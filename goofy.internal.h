@@ -1,9 +1,20 @@
 #ifndef GOOFY_INTERNAL_H
 #define GOOFY_INTERNAL_H
 
+#include <cassert>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
+#include <deque>
+#include <map>
+#include <set>
+#include <tuple>
+#include <atomic>
+#include <functional>
+#include <numeric>
+#include <cstring>
+#include <cstdio>
+#include <string>
 
 #include "goofy.h"
 
@@ -35,6 +46,251 @@ namespace goofy {
 		void Done();
 	};
 
+	/// <summary>
+	/// Read-only view of a whole file mapped in memory. Pages are loaded lazily by the OS.
+	/// </summary>
+	class MappedFile {
+		void* data = nullptr;
+		unsigned long long size = 0;
+		unsigned long long mappedSize = 0;
+#ifdef _WIN32
+		void* file = nullptr;
+		void* mapping = nullptr;
+#else
+		int file = -1;
+#endif
+	public:
+		MappedFile(const char* path);
+
+		MappedFile(const MappedFile&) = delete;
+
+		~MappedFile();
+
+		inline const unsigned char* Data() { return (const unsigned char*)data; }
+
+		/// <summary>
+		/// Gets the size in bytes of the file.
+		/// </summary>
+		inline unsigned long long Size() { return size; }
+
+		/// <summary>
+		/// Gets the size in bytes of the mapping, rounded up to whole pages.
+		/// </summary>
+		inline unsigned long long MappedSize() { return mappedSize; }
+	};
+
+	/// <summary>
+	/// 64 bits FNV-1a hash of a block of memory. A previous hash can be given as seed to hash several blocks.
+	/// </summary>
+	unsigned long long Hash(const void* data, size_t size, unsigned long long seed = 14695981039346656037ull);
+
+	/// <summary>
+	/// Reads a whole file. Returns false if the file can not be read.
+	/// </summary>
+	bool ReadFile(const char* path, std::vector<unsigned char>& content);
+
+	/// <summary>
+	/// Writes a whole file atomically. Content is written to a temporary file that replaces the destination once complete,
+	/// so readers never see a partially written file. Returns false if the file can not be written.
+	/// Durable writes also flush the content to the disk before replacing the destination.
+	/// </summary>
+	bool WriteFileAtomically(const char* path, const void* data, size_t size, bool durable = true);
+
+	/// <summary>
+	/// Calls body with consecutive ranges [begin, end) of at most grain elements covering [0, count). Ranges run on a pool
+	/// of threads shared by the CPU kernels of the library and the calling thread, which returns once all ranges are done.
+	/// </summary>
+	void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body);
+
+	/// <summary>
+	/// Encodes the rows of blocks [firstRow, firstRow + rows) of a RGBA8 image in a block compressed format. Blocks are
+	/// written consecutively from blocks, rows are split among the threads of ParallelFor.
+	/// </summary>
+	void CompressBlockRows(FormatHandle format, const unsigned char* pixels, unsigned int width, unsigned int height,
+		unsigned int firstRow, unsigned int rows, Formats::CompressionPreset preset, unsigned char* blocks);
+
+	/// <summary>
+	/// Builds the SPIR-V of a compute shader averaging one mip level of an image into the next levels (2x2 boxes, 2x2x2 for volumes).
+	/// Images are storage images of the descriptor heap with a SPIR-V image format. Push constants are the heap index of the source,
+	/// the indices of the levels destinations and, by level, the coordinates of the last texel (3 words). 2D images are arrays,
+	/// the z of the 8x8x1 groups is the layer. Each invocation writes one texel of the last level and all it covers in the others.
+	/// </summary>
+	std::vector<unsigned int> DownsampleShader(unsigned int format, bool volume, int levels);
+
+	/// <summary>
+	/// Builds the SPIR-V of a compute shader culling draw instances (8 words: bounding sphere center and radius, index count,
+	/// first index, vertex offset and instance) against 6 frustum planes. Buffers are storage buffers of the descriptor heap.
+	/// Push constants are the heap indices of the instances and the draws, the number of instances and the planes (4 floats each).
+	/// Visible instances write an indexed indirect command (5 words from word 4 of the draws): compacted at a slot taken from the
+	/// count at word 0 if compact, otherwise at their own index. One invocation per instance in groups of 64.
+	/// </summary>
+	std::vector<unsigned int> CullShader(bool compact);
+
+	/// <summary>
+	/// Memory layout of the pixels given to the image encoders.
+	/// </summary>
+	enum class PixelLayout {
+		RGBA8,
+		BGRA8,
+		RGBA32F
+	};
+
+	/// <summary>
+	/// Gets the extension (including the dot) of files in a format.
+	/// </summary>
+	const char* FileExtension(FrameOutputFormat format);
+
+	/// <summary>
+	/// Encodes an image in a file format. 8 bits layouts are sRGB encoded if srgb is true.
+	/// Float layouts are linear and are sRGB encoded when written to 8 bits formats.
+	/// </summary>
+	void EncodeImage(FrameOutputFormat format, const unsigned char* pixels, int width, int height, PixelLayout layout, bool srgb, std::vector<unsigned char>& output);
+
+	/// <summary>
+	/// Begin/end event recorded by a thread while tracing. Names must remain valid until the trace is written.
+	/// </summary>
+	struct TraceEvent {
+		const char* Name;
+		unsigned long long Begin;
+		unsigned long long End;
+		long long Frame;
+	};
+
+	/// <summary>
+	/// Events recorded by a single thread. Only the owner thread writes events, the count is published with release semantics.
+	/// </summary>
+	struct TraceBuffer {
+		int Thread;
+		std::string Name;
+		// Allocated once and never reallocated, threads may still be recording when a trace restarts
+		std::unique_ptr<TraceEvent[]> Events;
+		std::atomic<unsigned int> Capacity = { 0 };
+		std::atomic<unsigned int> Count = { 0 };
+		// Trace the events belong to
+		std::atomic<unsigned int> Session = { 0 };
+	};
+
+	/// <summary>
+	/// Records CPU events in preallocated per-thread buffers without locking, and writes them in Chrome trace-event format.
+	/// </summary>
+	class Tracer {
+		static TraceBuffer* __Buffer();
+	public:
+		static std::atomic<bool> Enabled;
+		/// <summary>
+		/// Frame events are recorded in.
+		/// </summary>
+		static std::atomic<long long> Frame;
+		/// <summary>
+		/// Trace scopes record in, events of scopes started in an older trace are dropped.
+		/// </summary>
+		static std::atomic<unsigned int> Session;
+
+		/// <summary>
+		/// Starts a new trace, allocating the buffers of threads without one. Buffers keep the capacity of the first trace,
+		/// events recorded by a thread beyond it are dropped. Should be called while no trace is running.
+		/// </summary>
+		static void Start(unsigned int eventsPerThread);
+
+		static void Stop();
+
+		/// <summary>
+		/// Writes the events of the last trace as Chrome/Perfetto JSON. Should be called once the trace has stopped.
+		/// </summary>
+		static bool Write(const char* path);
+
+		/// <summary>
+		/// Sets the name the calling thread is shown with.
+		/// </summary>
+		static void NameThread(const std::string& name);
+
+		/// <summary>
+		/// Gets a monotonic time in nanoseconds.
+		/// </summary>
+		static unsigned long long Now();
+
+		static void Record(const char* name, unsigned long long begin, long long frame, unsigned int session);
+	};
+
+	/// <summary>
+	/// Records its lifetime as an event. When tracing is off it costs a single branch.
+	/// </summary>
+	struct TraceScope {
+		const char* name;
+		unsigned long long begin;
+		long long frame;
+		unsigned int session;
+		bool active;
+
+		TraceScope(const char* name) : name(name), active(Tracer::Enabled.load(std::memory_order_relaxed)) {
+			if (active) {
+				begin = Tracer::Now();
+				frame = Tracer::Frame.load(std::memory_order_relaxed);
+				session = Tracer::Session.load(std::memory_order_relaxed);
+			}
+		}
+
+		~TraceScope() {
+			if (active)
+				Tracer::Record(name, begin, frame, session);
+		}
+	};
+
+	/// <summary>
+	/// Scheduler counters of a single thread for a device. Only the owner thread writes them (relaxed load and store, no read-modify-write),
+	/// readers aggregate all threads of the device.
+	/// </summary>
+	struct ThreadCounters {
+		static const int Buckets = 16;
+
+		// Device the counters count for, and whether they are still listed for it
+		const void* Owner = nullptr;
+		std::atomic<bool> Registered = { false };
+		// Index of the async worker owning the counters, -1 for other threads
+		std::atomic<int> Worker = { -1 };
+		std::atomic<unsigned long long> Dispatches = { 0 };
+		std::atomic<unsigned long long> Submits = { 0 };
+		std::atomic<unsigned long long> BusyNanoseconds = { 0 };
+		std::atomic<unsigned long long> IdleNanoseconds = { 0 };
+		std::atomic<unsigned long long> CPUWaits[Buckets] = { };
+		std::atomic<unsigned long long> GPUWaits[Buckets] = { };
+		std::atomic<unsigned long long> CPUWaitNanoseconds = { 0 };
+		std::atomic<unsigned long long> GPUWaitNanoseconds = { 0 };
+
+		static inline void Add(std::atomic<unsigned long long>& counter, unsigned long long value) {
+			counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		}
+
+		/// <summary>
+		/// Gets the histogram bucket of a wait. Bucket i counts waits shorter than 2^i microseconds, the last one the longer waits.
+		/// </summary>
+		static int Bucket(unsigned long long nanoseconds);
+
+		/// <summary>
+		/// Adds the counters of another thread, except the worker index. Used to keep the totals of exited threads.
+		/// </summary>
+		void Accumulate(const ThreadCounters& other);
+	};
+
+	class Metrics {
+	public:
+		/// <summary>
+		/// Gets the counters of the calling thread for a device. They are registered on first use and unregistered,
+		/// keeping their totals, when the thread exits.
+		/// </summary>
+		static ThreadCounters& Local(const void* owner);
+
+		/// <summary>
+		/// Visits the counters of all threads for a device, the exited threads as a single block.
+		/// </summary>
+		static void ForEach(const void* owner, const std::function<void(const ThreadCounters&)>& visit);
+
+		/// <summary>
+		/// Forgets the counters of a device. Should be called when the device is destroyed, threads still holding counters get new ones.
+		/// </summary>
+		static void Release(const void* owner);
+	};
+
 	template<typename T>
 	class ProducerConsumerQueue {
 		std::vector<T> elements;
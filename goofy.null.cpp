@@ -0,0 +1,649 @@
+// Null Vulkan backend.
+// Defines every Vulkan entry point used by the library against a device that does nothing: command recording is
+// a no-op, submissions signal their semaphores immediately or after a simulated latency, and resources only track
+// their sizes. Linking this file instead of the Vulkan loader measures the pure library overhead (scheduling,
+// dispatching, submission bookkeeping) independently of any driver. Only OFFLINE presenters are supported.
+#ifdef GOOFY_NULL_BACKEND
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace goofy {
+	namespace null {
+
+		static long long Now() {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		/// <summary>
+		/// Simulated time in nanoseconds between a submission and the signal of its semaphores.
+		/// Read once from GOOFY_NULL_LATENCY (microseconds), zero by default.
+		/// </summary>
+		static long long Latency() {
+			static long long latency = [] {
+				const char* value = std::getenv("GOOFY_NULL_LATENCY");
+				return value == nullptr ? 0ll : std::max(0ll, std::atoll(value)) * 1000;
+			}();
+			return latency;
+		}
+
+		/// <summary>
+		/// Objects without state are plain unique numbers, so they never need to be freed.
+		/// </summary>
+		template<typename H>
+		static H Fresh() {
+			static std::atomic<uint64_t> next{ 1 };
+			return (H)(uintptr_t)(next.fetch_add(1) * 16);
+		}
+
+		template<typename T, typename H>
+		static T* As(H handle) {
+			return (T*)(uintptr_t)handle;
+		}
+
+		template<typename H, typename T>
+		static H Handle(T* object) {
+			return (H)(uintptr_t)object;
+		}
+
+		struct Buffer {
+			VkDeviceSize Size;
+		};
+
+		struct Image {
+			VkDeviceSize Size;
+		};
+
+		struct Memory {
+			VkDeviceSize Size;
+			void* Data = nullptr;
+		};
+
+		struct Semaphore {
+			std::atomic<uint64_t> Value{ 0 };
+			// Time when the last signaled value becomes visible
+			std::atomic<long long> ReadyAt{ 0 };
+		};
+
+		// Completion time of the latest submission, for idle waits.
+		static std::atomic<long long> Latest{ 0 };
+
+		static void Later(std::atomic<long long>& time, long long value) {
+			long long current = time.load();
+			while (current < value && !time.compare_exchange_weak(current, value));
+		}
+
+		static bool Signaled(Semaphore* semaphore, uint64_t value, long long now) {
+			return semaphore->Value.load(std::memory_order_acquire) >= value && semaphore->ReadyAt.load() <= now;
+		}
+
+		template<typename S>
+		static const S* Find(const void* chain, VkStructureType type) {
+			for (const VkBaseInStructure* s = (const VkBaseInStructure*)chain; s != nullptr; s = s->pNext)
+				if (s->sType == type)
+					return (const S*)s;
+			return nullptr;
+		}
+
+		template<typename S>
+		static S* FindOut(void* chain, VkStructureType type) {
+			for (VkBaseOutStructure* s = (VkBaseOutStructure*)chain; s != nullptr; s = s->pNext)
+				if (s->sType == type)
+					return (S*)s;
+			return nullptr;
+		}
+	}
+}
+
+using namespace goofy::null;
+
+extern "C" {
+
+#pragma region Instance and Device
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreateInstance(const VkInstanceCreateInfo*, const VkAllocationCallbacks*, VkInstance* pInstance) {
+		*pInstance = Fresh<VkInstance>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroyInstance(VkInstance, const VkAllocationCallbacks*) { }
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkEnumeratePhysicalDevices(VkInstance, uint32_t* pPhysicalDeviceCount, VkPhysicalDevice* pPhysicalDevices) {
+		static VkPhysicalDevice device = Fresh<VkPhysicalDevice>();
+		if (pPhysicalDevices != nullptr && *pPhysicalDeviceCount > 0)
+			pPhysicalDevices[0] = device;
+		*pPhysicalDeviceCount = 1;
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceProperties(VkPhysicalDevice, VkPhysicalDeviceProperties* pProperties) {
+		memset(pProperties, 0, sizeof(VkPhysicalDeviceProperties));
+		pProperties->apiVersion = VK_API_VERSION_1_2;
+		pProperties->vendorID = 0x10000;
+		pProperties->deviceType = VK_PHYSICAL_DEVICE_TYPE_OTHER;
+		strcpy(pProperties->deviceName, "goofy null device");
+		memcpy(pProperties->pipelineCacheUUID, "goofy.null.cache", VK_UUID_SIZE);
+
+		VkPhysicalDeviceLimits& limits = pProperties->limits;
+		limits.maxImageDimension1D = 16384;
+		limits.maxImageDimension2D = 16384;
+		limits.maxImageDimension3D = 2048;
+		limits.maxImageDimensionCube = 16384;
+		limits.maxImageArrayLayers = 2048;
+		limits.maxPushConstantsSize = 256;
+		limits.maxMemoryAllocationCount = 1u << 20;
+		limits.maxSamplerAllocationCount = 1u << 20;
+		limits.maxBoundDescriptorSets = 32;
+		limits.maxPerStageDescriptorSamplers = 1u << 20;
+		limits.maxPerStageDescriptorUniformBuffers = 1u << 20;
+		limits.maxPerStageDescriptorStorageBuffers = 1u << 20;
+		limits.maxPerStageDescriptorSampledImages = 1u << 20;
+		limits.maxPerStageDescriptorStorageImages = 1u << 20;
+		limits.maxPerStageResources = 1u << 20;
+		limits.maxDescriptorSetSamplers = 1u << 20;
+		limits.maxDescriptorSetUniformBuffers = 1u << 20;
+		limits.maxDescriptorSetStorageBuffers = 1u << 20;
+		limits.maxDescriptorSetSampledImages = 1u << 20;
+		limits.maxDescriptorSetStorageImages = 1u << 20;
+		limits.maxComputeSharedMemorySize = 65536;
+		for (int i = 0; i < 3; i++) {
+			limits.maxComputeWorkGroupCount[i] = 65535;
+			limits.maxComputeWorkGroupSize[i] = 1024;
+		}
+		limits.maxComputeWorkGroupInvocations = 1024;
+		limits.maxSamplerAnisotropy = 16;
+		limits.maxViewports = 16;
+		limits.maxViewportDimensions[0] = limits.maxViewportDimensions[1] = 16384;
+		limits.maxFramebufferWidth = limits.maxFramebufferHeight = 16384;
+		limits.maxFramebufferLayers = 2048;
+		limits.maxColorAttachments = 8;
+		limits.maxDrawIndirectCount = 0xFFFFFFFF;
+		limits.minMemoryMapAlignment = 64;
+		limits.minUniformBufferOffsetAlignment = 256;
+		limits.minStorageBufferOffsetAlignment = 16;
+		limits.optimalBufferCopyOffsetAlignment = 16;
+		limits.optimalBufferCopyRowPitchAlignment = 1;
+		limits.nonCoherentAtomSize = 64;
+		limits.timestampComputeAndGraphics = VK_TRUE;
+		limits.timestampPeriod = 1;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceProperties2(VkPhysicalDevice physicalDevice, VkPhysicalDeviceProperties2* pProperties) {
+		void* chain = pProperties->pNext;
+		vkGetPhysicalDeviceProperties(physicalDevice, &pProperties->properties);
+		VkPhysicalDeviceIDProperties* id = FindOut<VkPhysicalDeviceIDProperties>(chain, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES);
+		if (id != nullptr) {
+			memcpy(id->deviceUUID, "goofy.null.devic", VK_UUID_SIZE);
+			memcpy(id->driverUUID, "goofy.null.drivr", VK_UUID_SIZE);
+		}
+		VkPhysicalDeviceDescriptorIndexingProperties* indexing = FindOut<VkPhysicalDeviceDescriptorIndexingProperties>(chain, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES);
+		if (indexing != nullptr) {
+			// Every limit member follows the booleans, update-after-bind limits match the plain ones
+			uint32_t* first = &indexing->maxPerStageDescriptorUpdateAfterBindSamplers;
+			uint32_t* last = &indexing->maxDescriptorSetUpdateAfterBindInputAttachments;
+			std::fill(first, last + 1, 1u << 20);
+			indexing->maxUpdateAfterBindDescriptorsInAllPools = 1u << 20;
+		}
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceFeatures2(VkPhysicalDevice, VkPhysicalDeviceFeatures2* pFeatures) {
+		void* chain = pFeatures->pNext;
+		memset(&pFeatures->features, 0, sizeof(VkPhysicalDeviceFeatures));
+		pFeatures->features.samplerAnisotropy = VK_TRUE;
+		pFeatures->features.pipelineStatisticsQuery = VK_TRUE;
+		pFeatures->features.multiDrawIndirect = VK_TRUE;
+		pFeatures->features.drawIndirectFirstInstance = VK_TRUE;
+		pFeatures->features.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
+		pFeatures->features.shaderStorageImageArrayDynamicIndexing = VK_TRUE;
+		pFeatures->features.shaderStorageImageExtendedFormats = VK_TRUE;
+		VkPhysicalDeviceDescriptorIndexingFeatures* indexing = FindOut<VkPhysicalDeviceDescriptorIndexingFeatures>(chain, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES);
+		if (indexing != nullptr) {
+			// Every boolean member follows sType and pNext
+			VkBool32* first = &indexing->shaderInputAttachmentArrayDynamicIndexing;
+			VkBool32* last = &indexing->runtimeDescriptorArray;
+			std::fill(first, last + 1, VK_TRUE);
+		}
+	}
+
+	// Every format supports every optimal tiling feature
+	VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceFormatProperties(VkPhysicalDevice, VkFormat, VkFormatProperties* pFormatProperties) {
+		pFormatProperties->linearTilingFeatures = 0;
+		pFormatProperties->optimalTilingFeatures = ~0u;
+		pFormatProperties->bufferFeatures = 0;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceQueueFamilyProperties(VkPhysicalDevice, uint32_t* pQueueFamilyPropertyCount, VkQueueFamilyProperties* pQueueFamilyProperties) {
+		if (pQueueFamilyProperties != nullptr && *pQueueFamilyPropertyCount > 0) {
+			VkQueueFamilyProperties family{};
+			family.queueFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
+			family.queueCount = 16;
+			family.timestampValidBits = 64;
+			family.minImageTransferGranularity = { 1, 1, 1 };
+			pQueueFamilyProperties[0] = family;
+		}
+		*pQueueFamilyPropertyCount = 1;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice, VkPhysicalDeviceMemoryProperties* pMemoryProperties) {
+		memset(pMemoryProperties, 0, sizeof(VkPhysicalDeviceMemoryProperties));
+		pMemoryProperties->memoryTypeCount = 1;
+		pMemoryProperties->memoryTypes[0].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		pMemoryProperties->memoryTypes[0].heapIndex = 0;
+		pMemoryProperties->memoryHeapCount = 1;
+		pMemoryProperties->memoryHeaps[0].size = 1ull << 36;
+		pMemoryProperties->memoryHeaps[0].flags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkEnumerateDeviceExtensionProperties(VkPhysicalDevice, const char*, uint32_t* pPropertyCount, VkExtensionProperties*) {
+		*pPropertyCount = 0;
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreateDevice(VkPhysicalDevice, const VkDeviceCreateInfo*, const VkAllocationCallbacks*, VkDevice* pDevice) {
+		*pDevice = Fresh<VkDevice>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroyDevice(VkDevice, const VkAllocationCallbacks*) { }
+
+	VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vkGetDeviceProcAddr(VkDevice, const char*) {
+		return nullptr;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkGetDeviceQueue(VkDevice, uint32_t, uint32_t queueIndex, VkQueue* pQueue) {
+		*pQueue = (VkQueue)(uintptr_t)(16 * (queueIndex + 1));
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkDeviceWaitIdle(VkDevice) {
+		long long latest = Latest.load();
+		if (latest > Now())
+			std::this_thread::sleep_for(std::chrono::nanoseconds(latest - Now()));
+		return VK_SUCCESS;
+	}
+
+#pragma endregion
+
+#pragma region Presentation
+
+	// There is no surface to present to, windowed presenters fail on creation.
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkGetPhysicalDeviceSurfaceSupportKHR(VkPhysicalDevice, uint32_t, VkSurfaceKHR, VkBool32* pSupported) {
+		*pSupported = VK_FALSE;
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroySurfaceKHR(VkInstance, VkSurfaceKHR, const VkAllocationCallbacks*) { }
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreateSwapchainKHR(VkDevice, const VkSwapchainCreateInfoKHR*, const VkAllocationCallbacks*, VkSwapchainKHR*) {
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroySwapchainKHR(VkDevice, VkSwapchainKHR, const VkAllocationCallbacks*) { }
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkGetSwapchainImagesKHR(VkDevice, VkSwapchainKHR, uint32_t* pSwapchainImageCount, VkImage*) {
+		*pSwapchainImageCount = 0;
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkAcquireNextImageKHR(VkDevice, VkSwapchainKHR, uint64_t, VkSemaphore, VkFence, uint32_t*) {
+		return VK_ERROR_SURFACE_LOST_KHR;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkQueuePresentKHR(VkQueue, const VkPresentInfoKHR*) {
+		return VK_ERROR_SURFACE_LOST_KHR;
+	}
+
+#pragma endregion
+
+#pragma region Memory and Resources
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkAllocateMemory(VkDevice, const VkMemoryAllocateInfo* pAllocateInfo, const VkAllocationCallbacks*, VkDeviceMemory* pMemory) {
+		Memory* memory = new Memory();
+		memory->Size = pAllocateInfo->allocationSize;
+		*pMemory = Handle<VkDeviceMemory>(memory);
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkFreeMemory(VkDevice, VkDeviceMemory memory, const VkAllocationCallbacks*) {
+		Memory* m = As<Memory>(memory);
+		if (m == nullptr)
+			return;
+		free(m->Data);
+		delete m;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkMapMemory(VkDevice, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize, VkMemoryMapFlags, void** ppData) {
+		Memory* m = As<Memory>(memory);
+		// Host storage is only backed once mapped, device-only allocations cost nothing
+		if (m->Data == nullptr)
+			m->Data = calloc(1, (size_t)std::max<VkDeviceSize>(m->Size, 1));
+		if (m->Data == nullptr)
+			return VK_ERROR_OUT_OF_HOST_MEMORY;
+		*ppData = (unsigned char*)m->Data + offset;
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkUnmapMemory(VkDevice, VkDeviceMemory) { }
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreateBuffer(VkDevice, const VkBufferCreateInfo* pCreateInfo, const VkAllocationCallbacks*, VkBuffer* pBuffer) {
+		*pBuffer = Handle<VkBuffer>(new Buffer{ pCreateInfo->size });
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroyBuffer(VkDevice, VkBuffer buffer, const VkAllocationCallbacks*) {
+		delete As<Buffer>(buffer);
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreateImage(VkDevice, const VkImageCreateInfo* pCreateInfo, const VkAllocationCallbacks*, VkImage* pImage) {
+		// Estimated with the widest texel, a third more for the mip chain
+		VkDeviceSize size = (VkDeviceSize)pCreateInfo->extent.width * pCreateInfo->extent.height * pCreateInfo->extent.depth * pCreateInfo->arrayLayers * 16;
+		if (pCreateInfo->mipLevels > 1)
+			size += size / 3;
+		*pImage = Handle<VkImage>(new Image{ size });
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroyImage(VkDevice, VkImage image, const VkAllocationCallbacks*) {
+		delete As<Image>(image);
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkGetBufferMemoryRequirements(VkDevice, VkBuffer buffer, VkMemoryRequirements* pMemoryRequirements) {
+		pMemoryRequirements->size = (As<Buffer>(buffer)->Size + 255) & ~(VkDeviceSize)255;
+		pMemoryRequirements->alignment = 256;
+		pMemoryRequirements->memoryTypeBits = 1;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkGetImageMemoryRequirements(VkDevice, VkImage image, VkMemoryRequirements* pMemoryRequirements) {
+		pMemoryRequirements->size = (As<Image>(image)->Size + 255) & ~(VkDeviceSize)255;
+		pMemoryRequirements->alignment = 256;
+		pMemoryRequirements->memoryTypeBits = 1;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkBindBufferMemory(VkDevice, VkBuffer, VkDeviceMemory, VkDeviceSize) {
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkDeviceAddress VKAPI_CALL vkGetBufferDeviceAddress(VkDevice, const VkBufferDeviceAddressInfo* pInfo) {
+		// The acceleration structure extensions are not exposed, buffer addresses are never dereferenced
+		return (VkDeviceAddress)(uintptr_t)pInfo->buffer;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkBindImageMemory(VkDevice, VkImage, VkDeviceMemory, VkDeviceSize) {
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreateImageView(VkDevice, const VkImageViewCreateInfo*, const VkAllocationCallbacks*, VkImageView* pView) {
+		*pView = Fresh<VkImageView>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroyImageView(VkDevice, VkImageView, const VkAllocationCallbacks*) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroyBufferView(VkDevice, VkBufferView, const VkAllocationCallbacks*) { }
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreateSampler(VkDevice, const VkSamplerCreateInfo*, const VkAllocationCallbacks*, VkSampler* pSampler) {
+		*pSampler = Fresh<VkSampler>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroySampler(VkDevice, VkSampler, const VkAllocationCallbacks*) { }
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreateFramebuffer(VkDevice, const VkFramebufferCreateInfo*, const VkAllocationCallbacks*, VkFramebuffer* pFramebuffer) {
+		*pFramebuffer = Fresh<VkFramebuffer>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroyFramebuffer(VkDevice, VkFramebuffer, const VkAllocationCallbacks*) { }
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreateRenderPass(VkDevice, const VkRenderPassCreateInfo*, const VkAllocationCallbacks*, VkRenderPass* pRenderPass) {
+		*pRenderPass = Fresh<VkRenderPass>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroyRenderPass(VkDevice, VkRenderPass, const VkAllocationCallbacks*) { }
+
+#pragma endregion
+
+#pragma region Descriptors and Pipelines
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreateDescriptorSetLayout(VkDevice, const VkDescriptorSetLayoutCreateInfo*, const VkAllocationCallbacks*, VkDescriptorSetLayout* pSetLayout) {
+		*pSetLayout = Fresh<VkDescriptorSetLayout>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroyDescriptorSetLayout(VkDevice, VkDescriptorSetLayout, const VkAllocationCallbacks*) { }
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreateDescriptorPool(VkDevice, const VkDescriptorPoolCreateInfo*, const VkAllocationCallbacks*, VkDescriptorPool* pDescriptorPool) {
+		*pDescriptorPool = Fresh<VkDescriptorPool>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroyDescriptorPool(VkDevice, VkDescriptorPool, const VkAllocationCallbacks*) { }
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkAllocateDescriptorSets(VkDevice, const VkDescriptorSetAllocateInfo* pAllocateInfo, VkDescriptorSet* pDescriptorSets) {
+		for (uint32_t i = 0; i < pAllocateInfo->descriptorSetCount; i++)
+			pDescriptorSets[i] = Fresh<VkDescriptorSet>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkUpdateDescriptorSets(VkDevice, uint32_t, const VkWriteDescriptorSet*, uint32_t, const VkCopyDescriptorSet*) { }
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreatePipelineLayout(VkDevice, const VkPipelineLayoutCreateInfo*, const VkAllocationCallbacks*, VkPipelineLayout* pPipelineLayout) {
+		*pPipelineLayout = Fresh<VkPipelineLayout>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroyPipelineLayout(VkDevice, VkPipelineLayout, const VkAllocationCallbacks*) { }
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreatePipelineCache(VkDevice, const VkPipelineCacheCreateInfo*, const VkAllocationCallbacks*, VkPipelineCache* pPipelineCache) {
+		*pPipelineCache = Fresh<VkPipelineCache>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroyPipelineCache(VkDevice, VkPipelineCache, const VkAllocationCallbacks*) { }
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkGetPipelineCacheData(VkDevice, VkPipelineCache, size_t* pDataSize, void*) {
+		*pDataSize = 0;
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreateShaderModule(VkDevice, const VkShaderModuleCreateInfo*, const VkAllocationCallbacks*, VkShaderModule* pShaderModule) {
+		*pShaderModule = Fresh<VkShaderModule>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroyShaderModule(VkDevice, VkShaderModule, const VkAllocationCallbacks*) { }
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreateComputePipelines(VkDevice, VkPipelineCache, uint32_t createInfoCount, const VkComputePipelineCreateInfo*, const VkAllocationCallbacks*, VkPipeline* pPipelines) {
+		for (uint32_t i = 0; i < createInfoCount; i++)
+			pPipelines[i] = Fresh<VkPipeline>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreateGraphicsPipelines(VkDevice, VkPipelineCache, uint32_t createInfoCount, const VkGraphicsPipelineCreateInfo*, const VkAllocationCallbacks*, VkPipeline* pPipelines) {
+		for (uint32_t i = 0; i < createInfoCount; i++)
+			pPipelines[i] = Fresh<VkPipeline>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroyPipeline(VkDevice, VkPipeline, const VkAllocationCallbacks*) { }
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreateQueryPool(VkDevice, const VkQueryPoolCreateInfo*, const VkAllocationCallbacks*, VkQueryPool* pQueryPool) {
+		*pQueryPool = Fresh<VkQueryPool>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroyQueryPool(VkDevice, VkQueryPool, const VkAllocationCallbacks*) { }
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkGetQueryPoolResults(VkDevice, VkQueryPool, uint32_t, uint32_t, size_t dataSize, void* pData, VkDeviceSize, VkQueryResultFlags) {
+		// Nothing executes, every timestamp and statistic reads zero
+		memset(pData, 0, dataSize);
+		return VK_SUCCESS;
+	}
+
+#pragma endregion
+
+#pragma region Command Recording and Submission
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreateCommandPool(VkDevice, const VkCommandPoolCreateInfo*, const VkAllocationCallbacks*, VkCommandPool* pCommandPool) {
+		*pCommandPool = Fresh<VkCommandPool>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroyCommandPool(VkDevice, VkCommandPool, const VkAllocationCallbacks*) { }
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkAllocateCommandBuffers(VkDevice, const VkCommandBufferAllocateInfo* pAllocateInfo, VkCommandBuffer* pCommandBuffers) {
+		for (uint32_t i = 0; i < pAllocateInfo->commandBufferCount; i++)
+			pCommandBuffers[i] = Fresh<VkCommandBuffer>();
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkBeginCommandBuffer(VkCommandBuffer, const VkCommandBufferBeginInfo*) {
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkEndCommandBuffer(VkCommandBuffer) {
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkResetCommandBuffer(VkCommandBuffer, VkCommandBufferResetFlags) {
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdPipelineBarrier(VkCommandBuffer, VkPipelineStageFlags, VkPipelineStageFlags, VkDependencyFlags, uint32_t, const VkMemoryBarrier*, uint32_t, const VkBufferMemoryBarrier*, uint32_t, const VkImageMemoryBarrier*) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdCopyBuffer(VkCommandBuffer, VkBuffer, VkBuffer, uint32_t, const VkBufferCopy*) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdFillBuffer(VkCommandBuffer, VkBuffer, VkDeviceSize, VkDeviceSize, uint32_t) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdCopyBufferToImage(VkCommandBuffer, VkBuffer, VkImage, VkImageLayout, uint32_t, const VkBufferImageCopy*) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdCopyImageToBuffer(VkCommandBuffer, VkImage, VkImageLayout, VkBuffer, uint32_t, const VkBufferImageCopy*) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdClearColorImage(VkCommandBuffer, VkImage, VkImageLayout, const VkClearColorValue*, uint32_t, const VkImageSubresourceRange*) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdBlitImage(VkCommandBuffer, VkImage, VkImageLayout, VkImage, VkImageLayout, uint32_t, const VkImageBlit*, VkFilter) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdBindPipeline(VkCommandBuffer, VkPipelineBindPoint, VkPipeline) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdDispatch(VkCommandBuffer, uint32_t, uint32_t, uint32_t) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdDispatchIndirect(VkCommandBuffer, VkBuffer, VkDeviceSize) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdBeginRenderPass(VkCommandBuffer, const VkRenderPassBeginInfo*, VkSubpassContents) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdEndRenderPass(VkCommandBuffer) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdSetViewport(VkCommandBuffer, uint32_t, uint32_t, const VkViewport*) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdSetScissor(VkCommandBuffer, uint32_t, uint32_t, const VkRect2D*) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdBindIndexBuffer(VkCommandBuffer, VkBuffer, VkDeviceSize, VkIndexType) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdDrawIndexedIndirect(VkCommandBuffer, VkBuffer, VkDeviceSize, uint32_t, uint32_t) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdBindDescriptorSets(VkCommandBuffer, VkPipelineBindPoint, VkPipelineLayout, uint32_t, uint32_t, const VkDescriptorSet*, uint32_t, const uint32_t*) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdPushConstants(VkCommandBuffer, VkPipelineLayout, VkShaderStageFlags, uint32_t, uint32_t, const void*) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdWriteTimestamp(VkCommandBuffer, VkPipelineStageFlagBits, VkQueryPool, uint32_t) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdResetQueryPool(VkCommandBuffer, VkQueryPool, uint32_t, uint32_t) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdBeginQuery(VkCommandBuffer, VkQueryPool, uint32_t, VkQueryControlFlags) { }
+
+	VKAPI_ATTR void VKAPI_CALL vkCmdEndQuery(VkCommandBuffer, VkQueryPool, uint32_t) { }
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreateSemaphore(VkDevice, const VkSemaphoreCreateInfo* pCreateInfo, const VkAllocationCallbacks*, VkSemaphore* pSemaphore) {
+		Semaphore* semaphore = new Semaphore();
+		const VkSemaphoreTypeCreateInfo* type = Find<VkSemaphoreTypeCreateInfo>(pCreateInfo->pNext, VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO);
+		if (type != nullptr)
+			semaphore->Value = type->initialValue;
+		*pSemaphore = Handle<VkSemaphore>(semaphore);
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroySemaphore(VkDevice, VkSemaphore semaphore, const VkAllocationCallbacks*) {
+		delete As<Semaphore>(semaphore);
+	}
+
+	/// <summary>
+	/// Each submission starts once its waited semaphores are ready and completes after the simulated latency.
+	/// Signaled semaphores take the timeline values when given, otherwise 1.
+	/// </summary>
+	VKAPI_ATTR VkResult VKAPI_CALL vkQueueSubmit(VkQueue, uint32_t submitCount, const VkSubmitInfo* pSubmits, VkFence) {
+		long long start = Now();
+		for (uint32_t s = 0; s < submitCount; s++) {
+			const VkSubmitInfo& submit = pSubmits[s];
+			const VkTimelineSemaphoreSubmitInfo* timeline = Find<VkTimelineSemaphoreSubmitInfo>(submit.pNext, VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO);
+
+			for (uint32_t i = 0; i < submit.waitSemaphoreCount; i++)
+				start = std::max(start, As<Semaphore>(submit.pWaitSemaphores[i])->ReadyAt.load());
+			long long completion = start + Latency();
+
+			for (uint32_t i = 0; i < submit.signalSemaphoreCount; i++) {
+				Semaphore* semaphore = As<Semaphore>(submit.pSignalSemaphores[i]);
+				uint64_t value = timeline != nullptr && i < timeline->signalSemaphoreValueCount ? timeline->pSignalSemaphoreValues[i] : 1;
+				Later(semaphore->ReadyAt, completion);
+				semaphore->Value.store(value, std::memory_order_release);
+			}
+			Later(Latest, completion);
+			start = completion; // submissions of a batch execute in order
+		}
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkGetSemaphoreCounterValue(VkDevice, VkSemaphore semaphore, uint64_t* pValue) {
+		// Values signaled by submissions still running are not visible yet. The previous value is not kept, task semaphores only go from 0 to 1
+		Semaphore* state = As<Semaphore>(semaphore);
+		uint64_t value = state->Value.load(std::memory_order_acquire);
+		*pValue = state->ReadyAt.load() <= Now() ? value : 0;
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkWaitSemaphores(VkDevice, const VkSemaphoreWaitInfo* pWaitInfo, uint64_t timeout) {
+		bool any = (pWaitInfo->flags & VK_SEMAPHORE_WAIT_ANY_BIT) != 0;
+		long long deadline = timeout >= (uint64_t)LLONG_MAX - Now() ? LLONG_MAX : Now() + (long long)timeout;
+
+		while (true) {
+			long long now = Now();
+			bool done = !any;
+			long long readyAt = any ? LLONG_MAX : 0;
+			bool pending = false; // some value is not signaled yet by any submission
+			for (uint32_t i = 0; i < pWaitInfo->semaphoreCount; i++) {
+				Semaphore* semaphore = As<Semaphore>(pWaitInfo->pSemaphores[i]);
+				bool signaled = Signaled(semaphore, pWaitInfo->pValues[i], now);
+				if (any && signaled)
+					return VK_SUCCESS;
+				if (!signaled) {
+					done = false;
+					if (semaphore->Value.load(std::memory_order_acquire) < pWaitInfo->pValues[i])
+						pending = true;
+					else
+						readyAt = any ? std::min(readyAt, semaphore->ReadyAt.load()) : std::max(readyAt, semaphore->ReadyAt.load());
+				}
+			}
+			if (done)
+				return VK_SUCCESS;
+			if (now >= deadline)
+				return VK_TIMEOUT;
+
+			if (pending || readyAt == LLONG_MAX)
+				std::this_thread::yield();
+			else
+				std::this_thread::sleep_for(std::chrono::nanoseconds(std::min(readyAt, deadline) - now));
+		}
+	}
+
+#pragma endregion
+
+}
+
+#endif
@@ -0,0 +1,347 @@
+#include "goofy.internal.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace goofy {
+
+#pragma region BVH Builder
+
+	/// <summary>
+	/// Axis aligned box, empty boxes have inverted infinite bounds.
+	/// </summary>
+	struct __Box {
+		float Min[3] = { std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity() };
+		float Max[3] = { -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity() };
+
+		inline void Grow(const float* point) {
+			for (int a = 0; a < 3; a++) {
+				Min[a] = std::min(Min[a], point[a]);
+				Max[a] = std::max(Max[a], point[a]);
+			}
+		}
+
+		inline void Grow(const __Box& box) {
+			for (int a = 0; a < 3; a++) {
+				Min[a] = std::min(Min[a], box.Min[a]);
+				Max[a] = std::max(Max[a], box.Max[a]);
+			}
+		}
+
+		/// <summary>
+		/// Half the surface area, the heuristic only compares ratios.
+		/// </summary>
+		inline float Area() const {
+			float x = Max[0] - Min[0], y = Max[1] - Min[1], z = Max[2] - Min[2];
+			return x < 0 ? 0 : x * y + y * z + z * x;
+		}
+	};
+
+	static __Box __TriangleBox(const MeshDescription& mesh, unsigned int stride, size_t triangle) {
+		__Box box;
+		for (int v = 0; v < 3; v++) {
+			size_t vertex = mesh.Indices == nullptr ? triangle * 3 + v : mesh.Indices[triangle * 3 + v];
+			box.Grow((const float*)((const char*)mesh.Positions + vertex * stride));
+		}
+		return box;
+	}
+
+	/// <summary>
+	/// Triangles of a node, and the node they are written to.
+	/// </summary>
+	struct __BVHRange {
+		unsigned int Begin;
+		unsigned int End;
+		unsigned int Node;
+	};
+
+	/// <summary>
+	/// Splits the ranges of a triangle list reordering it in place. Nodes are allocated in pairs so siblings are adjacent.
+	/// </summary>
+	class __BVHBuilder {
+		static const int Bins = 16;
+		static const unsigned int MaxLeaf = 4;
+		static const size_t ParallelGrain = 16384;
+
+		struct Binning {
+			__Box Boxes[3][Bins];
+			unsigned int Counts[3][Bins] = { };
+
+			void Merge(const Binning& other) {
+				for (int a = 0; a < 3; a++)
+					for (int b = 0; b < Bins; b++) {
+						Boxes[a][b].Grow(other.Boxes[a][b]);
+						Counts[a][b] += other.Counts[a][b];
+					}
+			}
+		};
+
+		struct Split {
+			int Axis = -1;
+			int Bin = 0;
+			float Cost = std::numeric_limits<float>::infinity();
+		};
+
+		const std::vector<__Box>& boxes;
+		const std::vector<float>& centroids;
+		std::vector<unsigned int>& triangles;
+
+		/// <summary>
+		/// Evaluates a function over the triangles of a range producing partial results that are merged, over the threads
+		/// of ParallelFor if requested.
+		/// </summary>
+		template<typename T, typename F, typename M>
+		T Reduce(__BVHRange range, bool parallel, F accumulate, M merge) {
+			if (!parallel) {
+				T result;
+				accumulate(result, range.Begin, range.End);
+				return result;
+			}
+			size_t count = range.End - range.Begin;
+			std::vector<T> partials((count + ParallelGrain - 1) / ParallelGrain);
+			ParallelFor(count, ParallelGrain, [&](size_t begin, size_t end) {
+				accumulate(partials[begin / ParallelGrain], range.Begin + (unsigned int)begin, range.Begin + (unsigned int)end);
+			});
+			for (size_t i = 1; i < partials.size(); i++)
+				merge(partials[0], partials[i]);
+			return partials[0];
+		}
+
+		inline int BinOf(unsigned int triangle, int axis, const __Box& centroidBounds, float scale) const {
+			int bin = (int)((centroids[triangle * 3 + axis] - centroidBounds.Min[axis]) * scale);
+			return std::min(Bins - 1, std::max(0, bin));
+		}
+
+		inline float Scale(const __Box& centroidBounds, int axis) const {
+			return Bins * 0.9999f / (centroidBounds.Max[axis] - centroidBounds.Min[axis]);
+		}
+
+		/// <summary>
+		/// Finds the cheapest split between bins of the centroid bounds in any axis. Axes where every centroid lies on a plane
+		/// are not evaluated.
+		/// </summary>
+		Split FindSplit(__BVHRange range, const __Box& bounds, const __Box& centroidBounds, bool parallel) {
+			float scales[3];
+			for (int a = 0; a < 3; a++)
+				scales[a] = centroidBounds.Max[a] > centroidBounds.Min[a] ? Scale(centroidBounds, a) : 0;
+			Binning binning = Reduce<Binning>(range, parallel, [&](Binning& result, unsigned int begin, unsigned int end) {
+				for (unsigned int i = begin; i < end; i++) {
+					unsigned int triangle = triangles[i];
+					for (int a = 0; a < 3; a++)
+						if (scales[a] > 0) {
+							int bin = BinOf(triangle, a, centroidBounds, scales[a]);
+							result.Boxes[a][bin].Grow(boxes[triangle]);
+							result.Counts[a][bin]++;
+						}
+				}
+			}, [](Binning& result, const Binning& other) { result.Merge(other); });
+
+			Split best;
+			float parentArea = std::max(bounds.Area(), std::numeric_limits<float>::min());
+			for (int a = 0; a < 3; a++) {
+				if (scales[a] == 0)
+					continue;
+				// Sweep from the right accumulating the cost of the right side of each plane, then from the left
+				float rightCost[Bins];
+				__Box right;
+				unsigned int rightCount = 0;
+				for (int b = Bins - 1; b > 0; b--) {
+					right.Grow(binning.Boxes[a][b]);
+					rightCount += binning.Counts[a][b];
+					rightCost[b] = rightCount == 0 ? -1 : right.Area() * rightCount;
+				}
+				__Box left;
+				unsigned int leftCount = 0;
+				for (int b = 0; b < Bins - 1; b++) {
+					left.Grow(binning.Boxes[a][b]);
+					leftCount += binning.Counts[a][b];
+					if (leftCount == 0 || rightCost[b + 1] < 0)
+						continue;
+					float cost = 1 + (left.Area() * leftCount + rightCost[b + 1]) / parentArea;
+					if (cost < best.Cost) {
+						best.Axis = a;
+						best.Bin = b + 1;
+						best.Cost = cost;
+					}
+				}
+			}
+			return best;
+		}
+
+	public:
+		__BVHBuilder(const std::vector<__Box>& boxes, const std::vector<float>& centroids, std::vector<unsigned int>& triangles)
+			: boxes(boxes), centroids(centroids), triangles(triangles) { }
+
+		/// <summary>
+		/// Builds the subtree of a range into its node. If deferred is specified then ranges of at most deferBelow triangles
+		/// are collected there instead of being split, and large ranges are measured and binned in parallel.
+		/// </summary>
+		void Subdivide(std::vector<BVHNode>& nodes, __BVHRange root, size_t deferBelow, std::vector<__BVHRange>* deferred) {
+			std::vector<__BVHRange> stack = { root };
+			while (!stack.empty()) {
+				__BVHRange range = stack.back();
+				stack.pop_back();
+				unsigned int count = range.End - range.Begin;
+				if (deferred != nullptr && count <= deferBelow) {
+					deferred->push_back(range);
+					continue;
+				}
+				bool parallel = deferred != nullptr && count > ParallelGrain;
+
+				typedef std::pair<__Box, __Box> Bounds;
+				Bounds bounds = Reduce<Bounds>(range, parallel, [&](Bounds& result, unsigned int begin, unsigned int end) {
+					for (unsigned int i = begin; i < end; i++) {
+						result.first.Grow(boxes[triangles[i]]);
+						result.second.Grow(&centroids[triangles[i] * 3]);
+					}
+				}, [](Bounds& result, const Bounds& other) {
+					result.first.Grow(other.first);
+					result.second.Grow(other.second);
+				});
+				BVHNode& node = nodes[range.Node];
+				for (int a = 0; a < 3; a++) {
+					node.Min[a] = bounds.first.Min[a];
+					node.Max[a] = bounds.first.Max[a];
+				}
+
+				Split split = count > 1 ? FindSplit(range, bounds.first, bounds.second, parallel) : Split();
+				if (count <= MaxLeaf && split.Cost >= (float)count) {
+					node.Count = count;
+					node.Index = range.Begin;
+					continue;
+				}
+				unsigned int middle = range.Begin + count / 2;
+				if (split.Axis >= 0) {
+					float scale = Scale(bounds.second, split.Axis);
+					middle = (unsigned int)(std::partition(triangles.begin() + range.Begin, triangles.begin() + range.End, [&](unsigned int triangle) {
+						return BinOf(triangle, split.Axis, bounds.second, scale) < split.Bin;
+					}) - triangles.begin());
+					// Rounding can move every centroid to one side, the range is halved instead
+					if (middle == range.Begin || middle == range.End)
+						middle = range.Begin + count / 2;
+				}
+				node.Count = 0;
+				node.Index = (unsigned int)nodes.size();
+				unsigned int child = node.Index;
+				nodes.resize(nodes.size() + 2);
+				stack.push_back({ middle, range.End, child + 1 });
+				stack.push_back({ range.Begin, middle, child });
+			}
+		}
+	};
+
+	BVH BuildBVH(const MeshDescription& mesh) {
+		// Ranges below this size are built as independent subtrees by a single thread
+		const size_t subtreeSize = 4096;
+
+		BVH bvh;
+		unsigned int count = mesh.TriangleCount;
+		if (count == 0)
+			return bvh;
+		if (mesh.Indices == nullptr ? (unsigned long long)count * 3 > mesh.VertexCount
+			: *std::max_element(mesh.Indices, mesh.Indices + (size_t)count * 3) >= mesh.VertexCount)
+			throw std::runtime_error("Mesh triangles reference vertices out of range");
+
+		unsigned int stride = mesh.VertexStride == 0 ? 12 : mesh.VertexStride;
+		std::vector<__Box> boxes(count);
+		std::vector<float> centroids((size_t)count * 3);
+		bvh.Triangles.resize(count);
+		ParallelFor(count, subtreeSize, [&](size_t begin, size_t end) {
+			for (size_t t = begin; t < end; t++) {
+				__Box box = __TriangleBox(mesh, stride, t);
+				boxes[t] = box;
+				for (int a = 0; a < 3; a++)
+					centroids[t * 3 + a] = (box.Min[a] + box.Max[a]) * 0.5f;
+				bvh.Triangles[t] = (unsigned int)t;
+			}
+		});
+
+		// The top of the tree is split by the calling thread, binning in parallel, until ranges are small enough to be
+		// handed to the threads as subtrees. Larger subtrees go first to balance the threads.
+		__BVHBuilder builder(boxes, centroids, bvh.Triangles);
+		std::vector<__BVHRange> subtrees;
+		bvh.Nodes.resize(1);
+		builder.Subdivide(bvh.Nodes, { 0, count, 0 }, subtreeSize, &subtrees);
+		std::sort(subtrees.begin(), subtrees.end(), [](const __BVHRange& a, const __BVHRange& b) {
+			return a.End - a.Begin > b.End - b.Begin;
+		});
+		std::vector<std::vector<BVHNode>> locals(subtrees.size());
+		ParallelFor(subtrees.size(), 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				locals[i].resize(1);
+				builder.Subdivide(locals[i], { subtrees[i].Begin, subtrees[i].End, 0 }, 0, nullptr);
+			}
+		});
+
+		// Local roots fill the nodes reserved for them, the rest are appended after the top of the tree
+		std::vector<size_t> bases(subtrees.size());
+		size_t total = bvh.Nodes.size();
+		for (size_t i = 0; i < subtrees.size(); i++) {
+			bases[i] = total;
+			total += locals[i].size() - 1;
+		}
+		bvh.Nodes.resize(total);
+		ParallelFor(subtrees.size(), 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+				for (size_t j = 0; j < locals[i].size(); j++) {
+					BVHNode node = locals[i][j];
+					if (node.Count == 0)
+						node.Index = (unsigned int)(bases[i] + node.Index - 1);
+					bvh.Nodes[j == 0 ? subtrees[i].Node : bases[i] + j - 1] = node;
+				}
+		});
+		return bvh;
+	}
+
+	float SAHCost(const BVH& bvh) {
+		if (bvh.Nodes.empty())
+			return 0;
+		auto area = [](const BVHNode& node) {
+			float x = node.Max[0] - node.Min[0], y = node.Max[1] - node.Min[1], z = node.Max[2] - node.Min[2];
+			return x * y + y * z + z * x;
+		};
+		// Same costs as the builder: 1 per node traversed and per triangle tested
+		double cost = 0;
+		for (const BVHNode& node : bvh.Nodes)
+			cost += area(node) * (node.Count == 0 ? 1.0 : (double)node.Count);
+		return (float)(cost / std::max(area(bvh.Nodes[0]), std::numeric_limits<float>::min()));
+	}
+
+	float RefitBVH(BVH& bvh, const MeshDescription& mesh) {
+		if (bvh.Triangles.size() != mesh.TriangleCount)
+			throw std::runtime_error("BVH was built for a different mesh");
+		if (bvh.Nodes.empty())
+			return 0;
+
+		// Leaves are independent. Children always follow their parent, so a reverse sweep finds them refitted.
+		unsigned int stride = mesh.VertexStride == 0 ? 12 : mesh.VertexStride;
+		ParallelFor(bvh.Nodes.size(), 2048, [&](size_t begin, size_t end) {
+			for (size_t n = begin; n < end; n++) {
+				BVHNode& node = bvh.Nodes[n];
+				if (node.Count == 0)
+					continue;
+				__Box box;
+				for (unsigned int i = 0; i < node.Count; i++)
+					box.Grow(__TriangleBox(mesh, stride, bvh.Triangles[node.Index + i]));
+				memcpy(node.Min, box.Min, sizeof(box.Min));
+				memcpy(node.Max, box.Max, sizeof(box.Max));
+			}
+		});
+		for (size_t n = bvh.Nodes.size(); n-- > 0;) {
+			BVHNode& node = bvh.Nodes[n];
+			if (node.Count != 0)
+				continue;
+			const BVHNode& left = bvh.Nodes[node.Index];
+			const BVHNode& right = bvh.Nodes[node.Index + 1];
+			for (int a = 0; a < 3; a++) {
+				node.Min[a] = std::min(left.Min[a], right.Min[a]);
+				node.Max[a] = std::max(left.Max[a], right.Max[a]);
+			}
+		}
+		return SAHCost(bvh);
+	}
+
+#pragma endregion
+
+}
@@ -14,6 +14,109 @@ namespace goofy {
 			return (VkImageUsageFlagBits)bits;
 		}
 
+		VkBufferUsageFlagBits __Convert(const BufferUsage& usage) {
+			int bits = 0;
+			if (usage.TransferSource) bits |= (int)VkBufferUsageFlagBits::VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+			if (usage.TransferDestination) bits |= (int)VkBufferUsageFlagBits::VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			if (usage.Uniform) bits |= (int)VkBufferUsageFlagBits::VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+			if (usage.Storage) bits |= (int)VkBufferUsageFlagBits::VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+			if (usage.Vertices) bits |= (int)VkBufferUsageFlagBits::VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+			if (usage.Indices) bits |= (int)VkBufferUsageFlagBits::VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+			if (usage.Indirect) bits |= (int)VkBufferUsageFlagBits::VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+			return (VkBufferUsageFlagBits)bits;
+		}
+
+		int __TexelSize(VkFormat format) {
+			switch (format) {
+			case VK_FORMAT_R8_UNORM:
+			case VK_FORMAT_R8_SNORM:
+			case VK_FORMAT_R8_UINT:
+				return 1;
+			case VK_FORMAT_R8G8_UNORM:
+			case VK_FORMAT_R16_SFLOAT:
+				return 2;
+			case VK_FORMAT_R8G8B8A8_UNORM:
+			case VK_FORMAT_R8G8B8A8_SNORM:
+			case VK_FORMAT_R8G8B8A8_USCALED:
+			case VK_FORMAT_R8G8B8A8_SSCALED:
+			case VK_FORMAT_R8G8B8A8_UINT:
+			case VK_FORMAT_R8G8B8A8_SINT:
+			case VK_FORMAT_R8G8B8A8_SRGB:
+			case VK_FORMAT_B8G8R8A8_UNORM:
+			case VK_FORMAT_B8G8R8A8_SRGB:
+			case VK_FORMAT_R16G16_SFLOAT:
+			case VK_FORMAT_R32_UINT:
+			case VK_FORMAT_R32_SINT:
+			case VK_FORMAT_R32_SFLOAT:
+			case VK_FORMAT_D32_SFLOAT:
+			case VK_FORMAT_D24_UNORM_S8_UINT:
+				return 4;
+			case VK_FORMAT_R16G16B16A16_SFLOAT:
+			case VK_FORMAT_R32G32_UINT:
+			case VK_FORMAT_R32G32_SINT:
+			case VK_FORMAT_R32G32_SFLOAT:
+			case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+			case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+			case VK_FORMAT_BC4_UNORM_BLOCK:
+				return 8;
+			case VK_FORMAT_R32G32B32_UINT:
+			case VK_FORMAT_R32G32B32_SINT:
+			case VK_FORMAT_R32G32B32_SFLOAT:
+				return 12;
+			case VK_FORMAT_R32G32B32A32_UINT:
+			case VK_FORMAT_R32G32B32A32_SINT:
+			case VK_FORMAT_R32G32B32A32_SFLOAT:
+			case VK_FORMAT_BC3_UNORM_BLOCK:
+			case VK_FORMAT_BC3_SRGB_BLOCK:
+			case VK_FORMAT_BC5_UNORM_BLOCK:
+			case VK_FORMAT_BC7_UNORM_BLOCK:
+			case VK_FORMAT_BC7_SRGB_BLOCK:
+				return 16;
+			default:
+				throw std::runtime_error("Unsupported format");
+			}
+		}
+
+		int __BlockExtent(VkFormat format) {
+			switch (format) {
+			case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+			case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+			case VK_FORMAT_BC3_UNORM_BLOCK:
+			case VK_FORMAT_BC3_SRGB_BLOCK:
+			case VK_FORMAT_BC4_UNORM_BLOCK:
+			case VK_FORMAT_BC5_UNORM_BLOCK:
+			case VK_FORMAT_BC7_UNORM_BLOCK:
+			case VK_FORMAT_BC7_SRGB_BLOCK:
+				return 4;
+			default:
+				return 1;
+			}
+		}
+
+		VkDeviceSize __ImageSize(const VkImageCreateInfo& description) {
+			VkDeviceSize block = __BlockExtent(description.format);
+			VkExtent3D extent = description.extent;
+			return (VkDeviceSize)__TexelSize(description.format) * ((extent.width + block - 1) / block) * ((extent.height + block - 1) / block) *
+				extent.depth * description.arrayLayers;
+		}
+
+		unsigned int __StorageImageFormat(VkFormat format) {
+			switch (format) {
+			case VK_FORMAT_R32G32B32A32_SFLOAT: return 1; // Rgba32f
+			case VK_FORMAT_R16G16B16A16_SFLOAT: return 2; // Rgba16f
+			case VK_FORMAT_R32_SFLOAT: return 3; // R32f
+			case VK_FORMAT_R8G8B8A8_UNORM: return 4; // Rgba8
+			case VK_FORMAT_R8G8B8A8_SNORM: return 5; // Rgba8Snorm
+			case VK_FORMAT_R32G32_SFLOAT: return 6; // Rg32f
+			case VK_FORMAT_R16G16_SFLOAT: return 7; // Rg16f
+			case VK_FORMAT_R16_SFLOAT: return 9; // R16f
+			case VK_FORMAT_R8G8_UNORM: return 13; // Rg8
+			case VK_FORMAT_R8_UNORM: return 15; // R8
+			case VK_FORMAT_R8_SNORM: return 20; // R8Snorm
+			default: return 0;
+			}
+		}
+
 		WorkPiece::WorkPiece() { }
 
 		void WorkPiece::PopulationCompleted() {
@@ -33,28 +136,38 @@ namespace goofy {
 
 		__ResourceData::~__ResourceData()
 		{
+			if (!IsBuffer && device->_Views != nullptr)
+				device->_Views->Invalidate(Image);
+			// The GPU might still be using the objects, they are destroyed when the current frame retires
 			if (Memory) { // Only owned resources should be destroyed.
 				if (IsBuffer)
-					vkDestroyBuffer(device->_Device, Buffer, nullptr);
+					device->__Defer(VK_OBJECT_TYPE_BUFFER, (uint64_t)Buffer);
 				else
-					vkDestroyImage(device->_Device, Image, nullptr);
+					device->__Defer(VK_OBJECT_TYPE_IMAGE, (uint64_t)Image);
+				device->__Defer(VK_OBJECT_TYPE_DEVICE_MEMORY, (uint64_t)Memory, HostMemory);
+				device->_ResourceMemory -= MemorySize;
 			}
 			if (UploadingStaging)
-				vkDestroyBuffer(device->_Device, UploadingStaging, nullptr);
+				device->__Defer(VK_OBJECT_TYPE_BUFFER, (uint64_t)UploadingStaging);
 			if (DownloadingStaging)
-				vkDestroyBuffer(device->_Device, DownloadingStaging, nullptr);
+				device->__Defer(VK_OBJECT_TYPE_BUFFER, (uint64_t)DownloadingStaging);
 		}
 
 		__Resource::~__Resource() {
+			if (CachedView) // View and indices belong to the cache
+				return;
+			device->__ReleaseFromHeap(this);
 			if (IsBuffer)
 			{
 				if (BufferView)
-					vkDestroyBufferView(device->_Device, BufferView, nullptr);
+					device->__Defer(VK_OBJECT_TYPE_BUFFER_VIEW, (uint64_t)BufferView);
 			}
 			else
 			{
-				if (ImageView)
-					vkDestroyImageView(device->_Device, ImageView, nullptr);
+				if (ImageView) {
+					device->__ReleaseFramebuffers(ImageView);
+					device->__Defer(VK_OBJECT_TYPE_IMAGE_VIEW, (uint64_t)ImageView);
+				}
 			}
 		}
 
@@ -73,6 +186,14 @@ namespace goofy {
 			if (finished)
 				return;
 
+			unsigned long long start = Tracer::Now();
+
+			if (Resolve) {
+				std::function<void()> resolve = Resolve;
+				Resolve = nullptr;
+				resolve();
+			}
+
 			if (GPUFinished != nullptr) {
 				VkSemaphoreWaitInfo info = {};
 				uint64_t value = 1;
@@ -87,14 +208,46 @@ namespace goofy {
 				t->Wait();
 
 			finished = true;
+
+			unsigned long long waited = Tracer::Now() - start;
+			ThreadCounters& counters = Metrics::Local(device);
+			ThreadCounters::Add(counters.GPUWaits[ThreadCounters::Bucket(waited)], 1);
+			ThreadCounters::Add(counters.GPUWaitNanoseconds, waited);
+		}
+
+		bool __GPUTask::Poll() {
+			if (finished)
+				return true;
+
+			if (Deferred.load(std::memory_order_acquire)) // deferred work not submitted yet
+				return false;
+
+			if (GPUFinished != nullptr) {
+				uint64_t value = 0;
+				if (vkGetSemaphoreCounterValue(device, GPUFinished, &value) != VK_SUCCESS || value < 1)
+					return false;
+			}
+
+			for (std::shared_ptr<__GPUTask> t : children)
+				if (!t->Poll())
+					return false;
+
+			finished = true;
+			return true;
 		}
 
 		std::shared_ptr<__GPUTask> __GPUTask::CreateSingle(VkDevice device, bool empty) {
 			std::shared_ptr<__GPUTask> task = std::shared_ptr<__GPUTask>(new __GPUTask());
 			task->device = device;
 			if (!empty) {
+				// Timeline semaphores signaled to 1 by the submission, so any number of submissions and host waits can wait them
+				VkSemaphoreTypeCreateInfo type = {};
+				type.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+				type.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+				type.initialValue = 0;
 				VkSemaphoreCreateInfo info = {};
 				info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+				info.pNext = &type;
 
 				vkCreateSemaphore(device, &info, nullptr, &task->GPUFinished);
 			}
@@ -116,6 +269,12 @@ namespace goofy {
 			if (finished)
 				return;
 
+			if (Resolve) {
+				std::function<void()> resolve = Resolve;
+				Resolve = nullptr;
+				resolve();
+			}
+
 			if (GPUFinished != nullptr)
 				semaphores.push_back(GPUFinished);
 
@@ -125,9 +284,91 @@ namespace goofy {
 		}
 
 		void __CPUTask::Wait() {
+			unsigned long long start = Tracer::Now();
 			workPiece->WaitForPopulation();
+			unsigned long long waited = Tracer::Now() - start;
+			ThreadCounters& counters = Metrics::Local(device);
+			ThreadCounters::Add(counters.CPUWaits[ThreadCounters::Bucket(waited)], 1);
+			ThreadCounters::Add(counters.CPUWaitNanoseconds, waited);
+		}
+
+#ifndef GOOFY_NO_PROFILING
+		__CommandListManager::~__CommandListManager() {
+			if (Timestamps != nullptr)
+				vkDestroyQueryPool(Profiler->device, Timestamps, nullptr);
+			if (Statistics != nullptr)
+				vkDestroyQueryPool(Profiler->device, Statistics, nullptr);
+		}
+
+		bool __CommandListManager::__BeginProfile(const char* name) {
+			if (Profiled.size() >= __Profiler::WorkPieces)
+				return false;
+			uint32_t query = (uint32_t)Profiled.size();
+			vkCmdWriteTimestamp(vkCmdList, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, Timestamps, 2 + 2 * query);
+			if (Statistics != nullptr)
+				vkCmdBeginQuery(vkCmdList, Statistics, query, 0);
+			Profiled.push_back(name);
+			return true;
+		}
+
+		void __CommandListManager::__EndProfile(bool begun) {
+			if (!begun)
+				return;
+			uint32_t query = (uint32_t)Profiled.size() - 1;
+			if (Statistics != nullptr)
+				vkCmdEndQuery(vkCmdList, Statistics, query);
+			vkCmdWriteTimestamp(vkCmdList, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, Timestamps, 3 + 2 * query);
+		}
+
+		Timing __TimingSeries::Resolve() const {
+			Timing timing{};
+			timing.Samples = Count;
+			if (Count == 0)
+				return timing;
+			double sorted[Capacity];
+			std::copy(Samples, Samples + Count, sorted);
+			std::sort(sorted, sorted + Count);
+			timing.Min = sorted[0];
+			timing.Average = std::accumulate(sorted, sorted + Count, 0.0) / Count;
+			timing.P99 = sorted[std::min(Count - 1, Count * 99 / 100)];
+			return timing;
 		}
 
+		void __Profiler::Record(EngineType supported, const uint64_t* timestamps, const std::vector<const char*>& names, const uint64_t* counters) {
+			std::lock_guard<std::mutex> lock(mutex);
+			engines[(int)supported].Add((timestamps[1] - timestamps[0]) * period / 1000000.0);
+			for (size_t i = 0; i < names.size(); i++) {
+				__TimingSeries& series = processes[names[i]];
+				series.Add((timestamps[3 + 2 * i] - timestamps[2 + 2 * i]) * period / 1000000.0);
+				if (counters != nullptr)
+					for (int c = 0; c < 4; c++)
+						series.Counters[c] = counters[4 * i + c];
+			}
+		}
+
+		ProfileReport __Profiler::Report() {
+			std::lock_guard<std::mutex> lock(mutex);
+			ProfileReport report;
+			for (auto& p : processes) {
+				ProcessProfile profile{};
+				profile.Process = p.first;
+				profile.GPU = p.second.Resolve();
+				profile.Vertices = p.second.Counters[0];
+				profile.VertexInvocations = p.second.Counters[1];
+				profile.FragmentInvocations = p.second.Counters[2];
+				profile.ComputeInvocations = p.second.Counters[3];
+				report.Processes.push_back(profile);
+			}
+			for (auto& e : engines) {
+				EngineProfile profile{};
+				profile.Engines = (EngineType)e.first;
+				profile.GPU = e.second.Resolve();
+				report.Engines.push_back(profile);
+			}
+			return report;
+		}
+#endif
+
 		void __CommandListManager::__Open() {
 			if (State == CommandListState::Recording)
 				return;
@@ -144,6 +385,38 @@ namespace goofy {
 				throw std::runtime_error("failed to begin recording command buffer!");
 			}
 
+#ifndef GOOFY_NO_PROFILING
+			if (Profiler != nullptr) {
+				if (Timestamps == nullptr) {
+					VkQueryPoolCreateInfo queryInfo{};
+					queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+					queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+					queryInfo.queryCount = 2 + 2 * __Profiler::WorkPieces;
+					vkCreateQueryPool(Profiler->device, &queryInfo, nullptr, &Timestamps);
+					if (Profiler->statistics && ((int)SupportedEngines & (int)EngineType::GRAPHICS)) {
+						queryInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+						queryInfo.queryCount = __Profiler::WorkPieces;
+						queryInfo.pipelineStatistics =
+							VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+							VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+							VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+							VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+						vkCreateQueryPool(Profiler->device, &queryInfo, nullptr, &Statistics);
+					}
+				}
+				vkCmdResetQueryPool(vkCmdList, Timestamps, 0, 2 + 2 * __Profiler::WorkPieces);
+				if (Statistics != nullptr)
+					vkCmdResetQueryPool(vkCmdList, Statistics, 0, __Profiler::WorkPieces);
+				Profiled.clear();
+				vkCmdWriteTimestamp(vkCmdList, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, Timestamps, 0);
+			}
+#endif
+
+			BoundHeap = 0;
+			BoundCompute = nullptr;
+			BoundGraphics = nullptr;
+			BoundIndices = nullptr;
+			RenderPass = nullptr;
 			State = CommandListState::Recording;
 		}
 
@@ -151,6 +424,11 @@ namespace goofy {
 			if (State != CommandListState::Recording)
 				throw std::runtime_error("Closing a command buffer has not been opened");
 
+#ifndef GOOFY_NO_PROFILING
+			if (Profiler != nullptr)
+				vkCmdWriteTimestamp(vkCmdList, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, Timestamps, 1);
+#endif
+
 			if (vkEndCommandBuffer(vkCmdList) != VK_SUCCESS) {
 				throw std::runtime_error("failed to record command buffer!");
 			}
@@ -158,18 +436,219 @@ namespace goofy {
 			State = CommandListState::Executable;
 		}
 
+		void __CommandListManager::__Push(EngineType engine, int count, const unsigned int* constants, bool captured) {
+			if (Heap == nullptr)
+				throw std::runtime_error("Device has no descriptor heap (descriptor indexing not supported)");
+
+			VkPipelineBindPoint bindPoint;
+			switch (engine) {
+			case EngineType::COMPUTE:
+				bindPoint = VK_PIPELINE_BIND_POINT_COMPUTE;
+				break;
+			case EngineType::GRAPHICS:
+				bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+				break;
+			case EngineType::RAYTRACING:
+				bindPoint = VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR;
+				break;
+			default:
+				throw std::runtime_error("Not supported binder type");
+			}
+
+			// The heap is the same set for every pipeline, binding it once per list is enough
+			if ((BoundHeap & (int)engine) == 0) {
+				vkCmdBindDescriptorSets(vkCmdList, bindPoint, Heap->PipelineLayout, 0, 1, &Heap->Set, 0, nullptr);
+				BoundHeap |= (int)engine;
+			}
+
+			if ((uint32_t)count * 4 > Heap->PushConstantsSize)
+				throw std::runtime_error("Binder constants exceed the push constants size");
+			if (Capture != nullptr && captured)
+				__Capture::Push(Captured, engine, count, constants);
+			if (count == 0)
+				return;
+
+			vkCmdPushConstants(vkCmdList, Heap->PipelineLayout, VK_SHADER_STAGE_ALL, 0, count * 4, constants);
+		}
+
+		void __CommandListManager::__Bind(const __Pipeline* pipeline, bool captured) {
+			bool graphics = pipeline->BindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS;
+			if (!graphics && pipeline->BindPoint != VK_PIPELINE_BIND_POINT_COMPUTE)
+				throw std::runtime_error("Binding a pipeline that is not a compute or graphics pipeline");
+			if (graphics && pipeline->RenderPass != RenderPass)
+				throw std::runtime_error("Graphics pipelines are bound while rendering to targets of their formats");
+			if (Capture != nullptr && captured)
+				Capture->Bind(Captured, pipeline);
+			const __Pipeline*& bound = graphics ? BoundGraphics : BoundCompute;
+			if (pipeline == bound)
+				return;
+			if (!pipeline->Ready.load(std::memory_order_acquire) || !pipeline->Error.empty())
+				const_cast<__Pipeline*>(pipeline)->Wait();
+			vkCmdBindPipeline(vkCmdList, pipeline->BindPoint, pipeline->Pipeline);
+			bound = pipeline;
+		}
+
+		void __CommandListManager::__OutsideRendering(const char* operation) const {
+			if (RenderPass != nullptr)
+				throw std::runtime_error(std::string(operation) + " while rendering, the rendering must end first");
+		}
+
+		void __CommandListManager::__Dispatch(uint32_t x, uint32_t y, uint32_t z) {
+			__OutsideRendering("Dispatching");
+			if (BoundCompute == nullptr)
+				throw std::runtime_error("Dispatching without a compute pipeline");
+			if (Capture != nullptr)
+				Capture->Compute(Captured, x, y, z);
+			vkCmdDispatch(vkCmdList, x, y, z);
+		}
+
+		void __CommandListManager::__DispatchIndirect(const __Resource* arguments, VkDeviceSize offset) {
+			__OutsideRendering("Dispatching");
+			if (BoundCompute == nullptr)
+				throw std::runtime_error("Dispatching without a compute pipeline");
+			if (!arguments->IsBuffer || (arguments->BufferDescription.usage & VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT) == 0)
+				throw std::runtime_error("Indirect arguments must be a buffer with indirect usage");
+			if (offset % 4 != 0 || offset + sizeof(VkDispatchIndirectCommand) > arguments->BufferDescription.size)
+				throw std::runtime_error("Indirect arguments out of the buffer or not 4-byte aligned");
+			if (Capture != nullptr)
+				Capture->ComputeIndirect(Captured, arguments, offset);
+			vkCmdDispatchIndirect(vkCmdList, arguments->_Data->Buffer, offset);
+		}
+
+		void __CommandListManager::__BeginRendering(const __Resource* target, const __Resource* depth) {
+			if (RenderPass != nullptr)
+				throw std::runtime_error("Rendering already begun, the rendering must end first");
+			if (!((int)SupportedEngines & (int)EngineType::GRAPHICS))
+				throw std::runtime_error("Rendering requires a graphics engine");
+			if (target->IsBuffer || (target->ImageDescription.usage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT) == 0 ||
+				target->ImageSlice.mip_count != 1 || target->ImageSlice.array_count != 1)
+				throw std::runtime_error("Render targets must be a single mip and layer of an image with RenderTarget usage");
+			VkExtent3D extent = __Device::__MipExtent(target->ImageDescription.extent, target->ImageSlice.mip_start);
+			if (depth != nullptr) {
+				if (depth->IsBuffer || (depth->ImageDescription.usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) == 0 ||
+					depth->ImageSlice.mip_count != 1 || depth->ImageSlice.array_count != 1)
+					throw std::runtime_error("Depth buffers must be a single mip and layer of an image with DepthStencil usage");
+				VkExtent3D depthExtent = __Device::__MipExtent(depth->ImageDescription.extent, depth->ImageSlice.mip_start);
+				if (depthExtent.width != extent.width || depthExtent.height != extent.height)
+					throw std::runtime_error("Depth buffer and render target sizes differ");
+			}
+			if (Capture != nullptr)
+				Capture->BeginRendering(Captured, target, depth);
+
+			__Device* device = target->device;
+			VkRenderPass renderPass = device->__RenderPass(target->ImageDescription.format, depth == nullptr ? VK_FORMAT_UNDEFINED : depth->ImageDescription.format);
+			VkFramebuffer framebuffer = device->__Framebuffer(renderPass, target->ImageView, depth == nullptr ? nullptr : depth->ImageView, extent);
+
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+				VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			vkCmdPipelineBarrier(vkCmdList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+				0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+			VkRenderPassBeginInfo beginInfo{};
+			beginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			beginInfo.renderPass = renderPass;
+			beginInfo.framebuffer = framebuffer;
+			beginInfo.renderArea.extent = { extent.width, extent.height };
+			vkCmdBeginRenderPass(vkCmdList, &beginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			VkViewport viewport{ 0, 0, (float)extent.width, (float)extent.height, 0, 1 };
+			vkCmdSetViewport(vkCmdList, 0, 1, &viewport);
+			vkCmdSetScissor(vkCmdList, 0, 1, &beginInfo.renderArea);
+			RenderPass = renderPass;
+			BoundGraphics = nullptr;
+		}
+
+		void __CommandListManager::__EndRendering() {
+			if (RenderPass == nullptr)
+				throw std::runtime_error("Ending a rendering has not begun");
+			if (Capture != nullptr)
+				__Capture::EndRendering(Captured);
+			vkCmdEndRenderPass(vkCmdList);
+			RenderPass = nullptr;
+
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+			vkCmdPipelineBarrier(vkCmdList, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+				VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+
+		void __CommandListManager::__SetIndices(const __Resource* indices) {
+			if (!indices->IsBuffer || (indices->BufferDescription.usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) == 0)
+				throw std::runtime_error("Indices must be a buffer with Indices usage");
+			if (Capture != nullptr)
+				Capture->Indices(Captured, indices);
+			if (indices == BoundIndices)
+				return;
+			vkCmdBindIndexBuffer(vkCmdList, indices->_Data->Buffer, 0, VK_INDEX_TYPE_UINT32);
+			BoundIndices = indices;
+		}
+
+		void __CommandListManager::__DrawIndirect(const __Resource* draws, uint32_t maxDraws) {
+			if (RenderPass == nullptr)
+				throw std::runtime_error("Drawing without rendering to a target");
+			if (BoundGraphics == nullptr || BoundIndices == nullptr)
+				throw std::runtime_error("Drawing without a graphics pipeline or indices");
+			if (!draws->IsBuffer || (draws->BufferDescription.usage & VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT) == 0)
+				throw std::runtime_error("Draws must be a buffer with Indirect usage");
+			VkDeviceSize stride = sizeof(VkDrawIndexedIndirectCommand);
+			if (16 + maxDraws * stride > draws->BufferDescription.size)
+				throw std::runtime_error("Draws out of the buffer");
+			__Device* device = draws->device;
+			if (!device->_SupportsIndirectFirstInstance)
+				throw std::runtime_error("Device does not support the first instance of indirect draws");
+			if (Capture != nullptr)
+				Capture->DrawIndirect(Captured, draws, maxDraws);
+			if (maxDraws == 0)
+				return;
+
+			VkBuffer buffer = draws->_Data->Buffer;
+			if (device->_vkCmdDrawIndexedIndirectCount != nullptr)
+				device->_vkCmdDrawIndexedIndirectCount(vkCmdList, buffer, 16, buffer, 0, maxDraws, (uint32_t)stride);
+			else if (device->_SupportsMultiDrawIndirect)
+				vkCmdDrawIndexedIndirect(vkCmdList, buffer, 16, maxDraws, (uint32_t)stride);
+			else // One command per draw, culled ones draw no instances
+				for (uint32_t i = 0; i < maxDraws; i++)
+					vkCmdDrawIndexedIndirect(vkCmdList, buffer, 16 + i * stride, 1, (uint32_t)stride);
+		}
+
 		void __CommandListManager::__Reset() {
 			if (State == CommandListState::OnGPU)
 				throw std::runtime_error("Reseting a command list has not finished on the gpu");
 
+#ifndef GOOFY_NO_PROFILING
+			// The list has retired, results are available without waiting
+			if (Profiler != nullptr && State == CommandListState::Executable) {
+				uint32_t count = 2 + 2 * (uint32_t)Profiled.size();
+				uint64_t timestamps[2 + 2 * __Profiler::WorkPieces];
+				if (vkGetQueryPoolResults(Profiler->device, Timestamps, 0, count, count * sizeof(uint64_t), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+					std::vector<uint64_t> counters;
+					if (Statistics != nullptr && !Profiled.empty()) {
+						counters.resize(4 * Profiled.size());
+						if (vkGetQueryPoolResults(Profiler->device, Statistics, 0, (uint32_t)Profiled.size(), counters.size() * sizeof(uint64_t), counters.data(), 4 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+							counters.clear();
+					}
+					Profiler->Record(SupportedEngines, timestamps, Profiled, counters.empty() ? nullptr : counters.data());
+				}
+				Profiled.clear();
+			}
+#endif
+
 			vkResetCommandBuffer(vkCmdList, VkCommandBufferResetFlagBits::VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
 
 			State = CommandListState::Initial;
 		}
 
-		__CommandQueueManager::__CommandQueueManager(VkDevice device, int familyIndex, EngineType supported, VkQueue queue, bool throwErrorIfAbandonedTasks) : 
+		__CommandQueueManager::__CommandQueueManager(VkDevice device, int familyIndex, EngineType supported, VkQueue queue, bool throwErrorIfAbandonedTasks, __BindlessHeap* heap, __ResourcePool* resources, __Profiler* profiler) : 
 			SupportedEngines(supported), 
 			device(device), 
+			heap(heap),
+			resources(resources),
+			profiler(profiler),
 			queue(queue),
 			throwErrorIfAbandonedTasks(throwErrorIfAbandonedTasks)
 		{
@@ -195,6 +674,11 @@ namespace goofy {
 			else {
 				result = std::shared_ptr<__CommandListManager>(new __CommandListManager());
 				result->SupportedEngines = SupportedEngines;
+				result->Heap = heap;
+				result->Pool = resources;
+#ifndef GOOFY_NO_PROFILING
+				result->Profiler = profiler;
+#endif
 
 				VkCommandBufferAllocateInfo info = { };
 				info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -203,6 +687,7 @@ namespace goofy {
 				info.commandBufferCount = 1;
 
 				vkAllocateCommandBuffers(device, &info, &result->vkCmdList);
+				allocatedBuffers++;
 			}
 
 			result->__Open();
@@ -215,13 +700,19 @@ namespace goofy {
 		/// </summary>
 		/// <returns></returns>
 		std::shared_ptr<__CommandListManager> __CommandQueueManager::Peek() {
-			if (recordingBuffer == nullptr)
+			if (recordingBuffer == nullptr) {
 				recordingBuffer = FetchNew();
+				// Created with the list so releases while it is recorded can wait for its submission
+				std::shared_ptr<__GPUTask> task = __GPUTask::CreateSingle(device, false);
+				std::lock_guard<std::mutex> lock(sync_task);
+				recordingTask = task;
+			}
 			assert(recordingBuffer != nullptr);
 			return recordingBuffer;
 		}
 
 		void __CommandQueueManager::WaitForPopulation() {
+			TraceScope trace("WaitForPopulation");
 			sync_populated.lock();
 			for (int i=0; i< populated.size(); i++)
 				populated[i]->WaitForPopulation();
@@ -232,6 +723,7 @@ namespace goofy {
 		/// Submit current recording command buffer to the gpu.
 		/// </summary>
 		std::shared_ptr<__GPUTask> __CommandQueueManager::SubmitCurrent(int count, std::shared_ptr<__GPUTask>* wait_for) {
+			TraceScope trace("SubmitCurrent");
 			sync_populated.lock();
 
 			if (recordingBuffer == nullptr)
@@ -240,7 +732,13 @@ namespace goofy {
 				return __GPUTask::CreateSingle(device, true);
 			}
 
-			std::shared_ptr<__GPUTask> task = __GPUTask::CreateSingle(device, false);
+			std::shared_ptr<__GPUTask> task;
+			{
+				// The submitted list stays visible to releases, another thread may bind them before this flush reports the task
+				std::lock_guard<std::mutex> lock(sync_task);
+				task.swap(recordingTask);
+				submittedTask = task;
+			}
 
 			recordingBuffer->__Close();
 
@@ -266,7 +764,19 @@ namespace goofy {
 
 			sinfo.signalSemaphoreCount = 1;
 			sinfo.pSignalSemaphores = &task->GPUFinished;
+
+			waitingValues.assign(waitingSemaphores.size(), 1);
+			uint64_t signaled = 1;
+			VkTimelineSemaphoreSubmitInfo timeline = {};
+			timeline.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+			timeline.waitSemaphoreValueCount = (uint32_t)waitingValues.size();
+			timeline.pWaitSemaphoreValues = waitingValues.data();
+			timeline.signalSemaphoreValueCount = 1;
+			timeline.pSignalSemaphoreValues = &signaled;
+			sinfo.pNext = &timeline;
 			vkQueueSubmit(queue, 1, &sinfo, nullptr);
+			inFlightBuffers++;
+			ThreadCounters::Add(Metrics::Local(device).Submits, 1);
 
 			submittedBuffers.push_back(recordingBuffer);
 			submittedTasks.push_back(task);
@@ -286,8 +796,9 @@ namespace goofy {
 		/// Wait for all submitted tasks. This method should be called before starting a frame using this command pool manager.
 		/// </summary>
 		void __CommandQueueManager::WaitForPendings() {
+			TraceScope trace("WaitForPendings");
 			waitingSemaphores.resize(submittedTasks.size());
-			waitingValues.resize(submittedTasks.size(), 1);
+			waitingValues.assign(submittedTasks.size(), 1);
 			int total = 0;
 			for (int i = 0; i < submittedTasks.size(); i++)
 				if (!submittedTasks[i]->finished)
@@ -304,6 +815,7 @@ namespace goofy {
 				submittedBuffers[i]->__Reset();
 				reusableCmdBuffers.push_back(submittedBuffers[i]);
 			}
+			inFlightBuffers -= (int)submittedBuffers.size();
 			submittedBuffers.clear();
 			submittedTasks.clear();
 		}
@@ -316,6 +828,7 @@ namespace goofy {
 				{
 					submittedBuffers[i]->__Reset();
 					reusableCmdBuffers.push_back(submittedBuffers[i]);
+					inFlightBuffers--;
 					submittedBuffers[i] = submittedBuffers.back();
 					submittedTasks[i] = submittedTasks.back();
 					submittedBuffers.pop_back();
@@ -345,7 +858,7 @@ namespace goofy {
 
 		__EngineManager::__EngineManager() { } // empty constructor for null initialization
 
-		__EngineManager::__EngineManager(VkDevice device, int familyIndex, EngineType supportedEngines, int frames, int frame_async_threads, int async_threads, int queues) :
+		__EngineManager::__EngineManager(VkDevice device, int familyIndex, EngineType supportedEngines, int frames, int frame_async_threads, int async_threads, int queues, __BindlessHeap* heap, __ResourcePool* pool, __Profiler* profiler) :
 			device(device),
 			frames(frames),
 			frame_async_threads(frame_async_threads),
@@ -360,7 +873,7 @@ namespace goofy {
 			for (int i = 0; i < Managers.size(); i++)
 			{
 				bool isAsynThread = i >= frames * (frame_async_threads + 1);
-				Managers[i] = std::shared_ptr<__CommandQueueManager>(new __CommandQueueManager(device, familyIndex, supportedEngines, Queues[i % queues], isAsynThread));
+				Managers[i] = std::shared_ptr<__CommandQueueManager>(new __CommandQueueManager(device, familyIndex, supportedEngines, Queues[i % queues], isAsynThread, heap, pool, profiler));
 			}
 			marked.resize(Managers.size());
 		}
@@ -371,25 +884,41 @@ namespace goofy {
 		void __EngineManager::Dispatch(std::shared_ptr<WorkPiece> workPiece) {
 			int cmdIdx = workPiece->ManagerIndex;
 			
+			TraceScope trace(workPiece->GraphicProcess->Name());
+			ThreadCounters::Add(Metrics::Local(device).Dispatches, 1);
+
 			std::shared_ptr<__CommandListManager> cmdList;
 			Managers[cmdIdx]->Populating(workPiece, cmdList);
 
 			if (cmdList == nullptr)
 			{
-				throw std::exception("Weird...");
+				throw std::runtime_error("Weird...");
 			}
 			goofy::CommandListManager wrapper(supportedEngines);
 			wrapper.__state = cmdList;
+#ifndef GOOFY_NO_PROFILING
+			bool profiled = cmdList->Profiler != nullptr && cmdList->__BeginProfile(workPiece->GraphicProcess->Name());
+#endif
+			cmdList->Capture = workPiece->Capture.get();
 			workPiece->GraphicProcess->Populate(wrapper);
+			if (cmdList->RenderPass != nullptr)
+				cmdList->__EndRendering();
+			if (cmdList->Capture != nullptr) {
+				cmdList->Capture->Populated(workPiece->CaptureId, cmdList->Captured);
+				cmdList->Capture = nullptr;
+			}
+#ifndef GOOFY_NO_PROFILING
+			cmdList->__EndProfile(profiled);
+#endif
 			workPiece->PopulationCompleted();
 		}
 
-		void __EngineManager::Flush(int frame) {
+		void __EngineManager::Flush(int frame, std::vector<std::shared_ptr<__GPUTask>>& tasks) {
 			for (int i = 0; i < frame_async_threads + 1; i++)
 				Managers[(frame_async_threads + 1) * frame + i]->WaitForPopulation();
 
 			for (int i = 0; i < frame_async_threads + 1; i++)
-				Managers[(frame_async_threads + 1) * frame + i]->SubmitCurrent(0, nullptr);
+				tasks.push_back(Managers[(frame_async_threads + 1) * frame + i]->SubmitCurrent(0, nullptr));
 		}
 
 		void __EngineManager::WaitForCompletition(int frame) {
@@ -421,5 +950,1635 @@ namespace goofy {
 					marked[i] = false;
 				}
 		}
+
+		void __UploadBatchProcess::Populate(goofy::CommandListManager manager) {
+			Uploader->Record(manager, this);
+		}
+
+		__StreamingUploader::__StreamingUploader(__Device* device, VkDeviceSize budget, int regions) :
+			device(device),
+			Budget(budget),
+			Regions(regions)
+		{
+			Staging = device->CreateBuffer(budget * regions, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			if (vkMapMemory(device->_Device, Staging->_Data->Memory, 0, budget * regions, 0, (void**)&StagingMapped) != VK_SUCCESS) {
+				throw std::runtime_error("failed to map staging memory!");
+			}
+			regionTasks.resize(regions);
+			regionRequests.resize(regions);
+		}
+
+		__StreamingUploader::~__StreamingUploader() {
+			if (StagingMapped)
+				vkUnmapMemory(device->_Device, Staging->_Data->Memory);
+		}
+
+		std::shared_ptr<__GPUTask> __StreamingUploader::Enqueue(std::shared_ptr<__Resource> destination, const void* data, VkDeviceSize size, VkDeviceSize offset,
+			std::shared_ptr<__Resource> source, VkDeviceSize sourceOffset, std::shared_ptr<void> owner,
+			std::function<void(VkDeviceSize, VkDeviceSize, unsigned char*)> produce) {
+			std::shared_ptr<__UploadRequest> request = std::shared_ptr<__UploadRequest>(new __UploadRequest());
+			request->Destination = destination;
+			request->Data = (const unsigned char*)data;
+			request->Size = size;
+			request->Offset = offset;
+			request->Source = source;
+			request->SourceOffset = sourceOffset;
+			request->Owner = owner;
+			request->Produce = produce;
+			request->RowPitch = 0;
+			request->Alignment = 4;
+			if (!destination->IsBuffer) {
+				int texelSize = __TexelSize(destination->ImageDescription.format);
+				int block = __BlockExtent(destination->ImageDescription.format);
+				request->RowPitch = (VkDeviceSize)texelSize * ((destination->ImageDescription.extent.width + block - 1) / block);
+				request->Alignment = std::lcm(texelSize, 4);
+				if (request->RowPitch + request->Alignment > Budget)
+					throw std::runtime_error("Upload budget is smaller than a single image row");
+			}
+
+			std::shared_ptr<__GPUTask> task = std::shared_ptr<__GPUTask>(new __GPUTask());
+			task->device = device->_Device;
+			task->finished = size == 0;
+			request->Task = task;
+			if (size == 0)
+				return task;
+
+			// Waiting for the upload forces remaining chunks to be submitted.
+			std::weak_ptr<__UploadRequest> weak = request;
+			task->Resolve = [this, weak]() { Drain(weak); };
+			task->Deferred.store(true, std::memory_order_relaxed);
+
+			std::lock_guard<std::recursive_mutex> lock(mutex);
+			pending.push_back(request);
+			return task;
+		}
+
+		void __StreamingUploader::Pump() {
+			std::lock_guard<std::recursive_mutex> lock(mutex);
+			__FlushBatch();
+			if (!pending.empty())
+				__ScheduleBatch();
+		}
+
+		void __StreamingUploader::Drain(std::weak_ptr<__UploadRequest> request) {
+			std::lock_guard<std::recursive_mutex> lock(mutex);
+			std::shared_ptr<__UploadRequest> r = request.lock();
+			if (r == nullptr) // already released after all its chunks were submitted
+				return;
+			while (r->Submitted < r->Size) {
+				if (dispatchedTask == nullptr)
+					__ScheduleBatch();
+				__FlushBatch();
+			}
+		}
+
+		void __StreamingUploader::Finish() {
+			std::lock_guard<std::recursive_mutex> lock(mutex);
+			__FlushBatch();
+			for (auto& tasks : regionTasks) {
+				for (auto t : tasks)
+					t->Wait();
+				tasks.clear();
+			}
+			for (auto& requests : regionRequests)
+				requests.clear();
+			pending.clear();
+			lastSubmitted = nullptr;
+		}
+
+		void __StreamingUploader::__ScheduleBatch() {
+			int region = CurrentRegion;
+			CurrentRegion = (CurrentRegion + 1) % Regions;
+
+			// The region was used frames-in-fly ago, its copies should be finished already.
+			for (auto t : regionTasks[region])
+				t->Wait();
+			regionTasks[region].clear();
+			regionRequests[region].clear();
+
+			std::shared_ptr<__UploadBatchProcess> batch = std::shared_ptr<__UploadBatchProcess>(new __UploadBatchProcess());
+			batch->Uploader = this;
+			batch->Region = region;
+
+			// Bytes copied in the batch (budget) and bytes placed in the staging region.
+			VkDeviceSize used = 0;
+			VkDeviceSize staged = 0;
+			while (!pending.empty()) {
+				std::shared_ptr<__UploadRequest> request = pending.front();
+				if (request->Source == nullptr)
+					staged = (staged + request->Alignment - 1) / request->Alignment * request->Alignment;
+				if (used >= Budget || staged >= Budget)
+					break;
+				VkDeviceSize available = Budget - std::max(used, request->Source == nullptr ? staged : 0);
+				VkDeviceSize chunkSize = std::min(request->Size - request->Scheduled, available);
+				if (request->RowPitch > 0) // Images are copied in whole rows
+					chunkSize -= chunkSize % request->RowPitch;
+				if (chunkSize == 0)
+					break;
+
+				__UploadChunk chunk;
+				chunk.Request = request;
+				chunk.SourceOffset = request->Scheduled;
+				chunk.StagingOffset = region * Budget + staged;
+				chunk.Size = chunkSize;
+				batch->Chunks.push_back(chunk);
+
+				request->Scheduled += chunkSize;
+				used += chunkSize;
+				if (request->Source == nullptr)
+					staged += chunkSize;
+				if (request->Scheduled == request->Size)
+					pending.pop_front();
+			}
+
+			if (batch->Chunks.size() == 0)
+				return;
+
+			dispatchedBatch = batch;
+			dispatchedTask = device->Dispatch(batch, DispatchMode::ASYNC);
+
+			// Without async threads the batch was populated in a frame command list. Submit it now instead of with the frame.
+			if (dispatchedTask->workPiece->Dispatch != DispatchMode::ASYNC)
+				__FlushBatch();
+		}
+
+		void __StreamingUploader::__FlushBatch() {
+			if (dispatchedTask == nullptr)
+				return;
+
+			// Task semaphores are timelines, the next batch and the tasks of the requests can all wait this submission
+			std::shared_ptr<__GPUTask> submitted = device->Flush(1, &dispatchedTask, lastSubmitted == nullptr ? 0 : 1, &lastSubmitted);
+
+			for (__UploadChunk& chunk : dispatchedBatch->Chunks) {
+				chunk.Request->Task->children.push_back(submitted);
+				chunk.Request->Submitted += chunk.Size;
+				if (chunk.Request->Submitted == chunk.Request->Size) // Polling completes without a wait resolving it
+					chunk.Request->Task->Deferred.store(false, std::memory_order_release);
+				regionRequests[dispatchedBatch->Region].push_back(chunk.Request);
+			}
+
+			regionTasks[dispatchedBatch->Region].push_back(submitted);
+			lastSubmitted = submitted;
+			dispatchedBatch = nullptr;
+			dispatchedTask = nullptr;
+		}
+
+		void __StreamingUploader::Record(goofy::CommandListManager manager, __UploadBatchProcess* batch) {
+			if (manager.__state->Capture != nullptr)
+				__Capture::Unsupported(manager.__state->Captured, "Upload");
+			VkCommandBuffer cmdList = manager.__state->vkCmdList;
+			VkBuffer staging = Staging->_Data->Buffer;
+
+			// Copy chunks to the staging region (in this populating thread) and transition images never used before.
+			std::vector<VkImageMemoryBarrier> barriers;
+			for (__UploadChunk& chunk : batch->Chunks) {
+				if (chunk.Request->Produce != nullptr)
+					chunk.Request->Produce(chunk.SourceOffset, chunk.Size, StagingMapped + chunk.StagingOffset);
+				else if (chunk.Request->Source == nullptr)
+					memcpy(StagingMapped + chunk.StagingOffset, chunk.Request->Data + chunk.SourceOffset, chunk.Size);
+
+				std::shared_ptr<__ResourceData> data = chunk.Request->Destination->_Data;
+				if (!data->IsBuffer && data->Layout == VK_IMAGE_LAYOUT_UNDEFINED) {
+					VkImageMemoryBarrier barrier{};
+					barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+					barrier.srcAccessMask = 0;
+					barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+					barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+					barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+					barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+					barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+					barrier.image = data->Image;
+					barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+					barrier.subresourceRange.baseMipLevel = 0;
+					barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+					barrier.subresourceRange.baseArrayLayer = 0;
+					barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+					barriers.push_back(barrier);
+					data->Layout = VK_IMAGE_LAYOUT_GENERAL;
+				}
+			}
+			if (barriers.size() > 0)
+				vkCmdPipelineBarrier(cmdList, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, barriers.size(), barriers.data());
+
+			std::vector<VkBufferImageCopy> regions;
+			for (__UploadChunk& chunk : batch->Chunks) {
+				__UploadRequest* request = chunk.Request.get();
+				std::shared_ptr<__Resource> destination = request->Destination;
+
+				// Imported sources are copied on the gpu straight from the host memory
+				VkBuffer source = request->Source == nullptr ? staging : request->Source->_Data->Buffer;
+				VkDeviceSize sourceOffset = request->Source == nullptr ? chunk.StagingOffset : request->SourceOffset + chunk.SourceOffset;
+
+				if (destination->IsBuffer) {
+					VkBufferCopy region;
+					region.srcOffset = sourceOffset;
+					region.dstOffset = request->Offset + chunk.SourceOffset;
+					region.size = chunk.Size;
+					vkCmdCopyBuffer(cmdList, source, destination->_Data->Buffer, 1, &region);
+					continue;
+				}
+
+				// Split the rows of the chunk in regions by depth and array slice. Rows of compressed formats are rows of blocks.
+				VkExtent3D extent = destination->ImageDescription.extent;
+				uint32_t block = (uint32_t)__BlockExtent(destination->ImageDescription.format);
+				uint32_t planeRows = (extent.height + block - 1) / block;
+				VkDeviceSize firstRow = chunk.SourceOffset / request->RowPitch;
+				VkDeviceSize row = firstRow;
+				VkDeviceSize rows = chunk.Size / request->RowPitch;
+				regions.clear();
+				while (rows > 0) {
+					uint32_t y = (uint32_t)(row % planeRows);
+					uint32_t plane = (uint32_t)(row / planeRows);
+					uint32_t count = (uint32_t)std::min<VkDeviceSize>(rows, planeRows - y);
+
+					VkBufferImageCopy region{};
+					region.bufferOffset = sourceOffset + (row - firstRow) * request->RowPitch;
+					region.bufferRowLength = 0;
+					region.bufferImageHeight = 0;
+					region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+					region.imageSubresource.mipLevel = 0;
+					region.imageSubresource.baseArrayLayer = plane / extent.depth;
+					region.imageSubresource.layerCount = 1;
+					region.imageOffset = { 0, (int32_t)(y * block), (int32_t)(plane % extent.depth) };
+					region.imageExtent = { extent.width, std::min(count * block, extent.height - y * block), 1 };
+					regions.push_back(region);
+
+					row += count;
+					rows -= count;
+				}
+				vkCmdCopyBufferToImage(cmdList, source, destination->_Data->Image, VK_IMAGE_LAYOUT_GENERAL, regions.size(), regions.data());
+			}
+		}
+
+		__Readback::~__Readback() {
+			if (Staging)
+				device->__ReleaseReadbackBuffer(Staging, Task);
+		}
+
+		bool __Readback::IsReady() {
+			return Submitted.load(std::memory_order_acquire) && Task->Poll();
+		}
+
+		void __Readback::Wait() {
+			if (!Submitted.load(std::memory_order_acquire))
+				throw std::runtime_error("Waiting for a readback whose frame has not ended");
+			Task->Wait();
+		}
+
+		void __Readback::Record(goofy::CommandListManager manager) {
+			if (manager.__state->Capture != nullptr)
+				__Capture::Unsupported(manager.__state->Captured, "Download");
+			VkCommandBuffer cmdList = manager.__state->vkCmdList;
+
+			// Previous commands in the frame must finish writing the resource before copying.
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			vkCmdPipelineBarrier(cmdList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+			VkBuffer staging = Staging->Buffer->_Data->Buffer;
+			if (Source->IsBuffer) {
+				VkBufferCopy region;
+				region.srcOffset = Offset;
+				region.dstOffset = 0;
+				region.size = Size;
+				vkCmdCopyBuffer(cmdList, Source->_Data->Buffer, staging, 1, &region);
+			}
+			else {
+				VkBufferImageCopy region{};
+				region.bufferOffset = 0;
+				region.bufferRowLength = 0;
+				region.bufferImageHeight = 0;
+				region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				region.imageSubresource.mipLevel = 0;
+				region.imageSubresource.baseArrayLayer = 0;
+				region.imageSubresource.layerCount = Source->ImageDescription.arrayLayers;
+				region.imageOffset = { 0, 0, 0 };
+				region.imageExtent = Source->ImageDescription.extent;
+				vkCmdCopyImageToBuffer(cmdList, Source->_Data->Image, VK_IMAGE_LAYOUT_GENERAL, staging, 1, &region);
+			}
+
+			// Make the copy visible to the host once the frame finished.
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(cmdList, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+
+		void __ReadbackProcess::Populate(goofy::CommandListManager manager) {
+			for (std::shared_ptr<__Readback> r : Readbacks)
+				r->Record(manager);
+		}
+
+		void __InitialLayoutProcess::Populate(goofy::CommandListManager manager) {
+			device->__RecordInitialLayouts(manager, Images);
+		}
+
+		void __AccelerationStructureProcess::Populate(goofy::CommandListManager manager) {
+			device->__RecordAccelerationStructures(manager, Build, Compacting);
+		}
+
+		__AccelerationStructure::~__AccelerationStructure() {
+			if (Structure != nullptr)
+				device->__Defer(VK_OBJECT_TYPE_ACCELERATION_STRUCTURE_KHR, (uint64_t)Structure);
+		}
+
+		static PixelLayout __OutputLayout(VkFormat format, bool& srgb) {
+			srgb = false;
+			switch (format) {
+			case VK_FORMAT_R8G8B8A8_SRGB:
+				srgb = true; // fall through
+			case VK_FORMAT_R8G8B8A8_UNORM:
+				return PixelLayout::RGBA8;
+			case VK_FORMAT_B8G8R8A8_SRGB:
+				srgb = true; // fall through
+			case VK_FORMAT_B8G8R8A8_UNORM:
+				return PixelLayout::BGRA8;
+			case VK_FORMAT_R32G32B32A32_SFLOAT:
+				return PixelLayout::RGBA32F;
+			default:
+				throw std::runtime_error("Unsupported render target format for frame output");
+			}
+		}
+
+		static int __EncoderThreads(const FrameOutputDescription& description) {
+			return std::max(1, description.encoder_threads > 0 ? description.encoder_threads : (int)std::thread::hardware_concurrency());
+		}
+
+		static int __QueuedFrames(const FrameOutputDescription& description, int framesInFly) {
+			return description.max_queued_frames > 0 ? description.max_queued_frames : framesInFly + 2 * __EncoderThreads(description);
+		}
+
+		__FrameWriter::__FrameWriter(const FrameOutputDescription& description, VkFormat format, VkExtent2D resolution, int framesInFly) :
+			Path(description.path),
+			Format(description.format),
+			Width(resolution.width),
+			Height(resolution.height),
+			slots(__QueuedFrames(description, framesInFly)),
+			jobs(__QueuedFrames(description, framesInFly))
+		{
+			Layout = __OutputLayout(format, SRGB);
+			FileExtension(Format); // validates the format before starting
+
+			int threads = __EncoderThreads(description);
+			for (int i = 0; i < threads; i++)
+				encoders.push_back(std::thread(__Encoding, this));
+			writer = std::thread(__Writing, this);
+		}
+
+		__FrameWriter::~__FrameWriter() {
+			Close();
+		}
+
+		void __FrameWriter::Push(std::shared_ptr<__Readback> readback) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (error.size() > 0)
+					throw std::runtime_error(error);
+			}
+			std::shared_ptr<__FrameJob> job = std::shared_ptr<__FrameJob>(new __FrameJob());
+			job->Frame = FrameCount++;
+			job->Readback = readback;
+			slots.Wait(); // back-pressure when encoders fall behind
+			jobs.Produce(job);
+		}
+
+		void __FrameWriter::Close() {
+			if (encoders.size() == 0)
+				return;
+			for (int i = 0; i < encoders.size(); i++)
+				jobs.Produce(nullptr);
+			for (std::thread& t : encoders)
+				t.join();
+			encoders.clear();
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				closing = true;
+			}
+			encoded.notify_all();
+			writer.join();
+		}
+
+		void __FrameWriter::__Encoding(__FrameWriter* _this) {
+			while (true) {
+				std::shared_ptr<__FrameJob> job = _this->jobs.Consume();
+				if (job == nullptr)
+					return;
+
+				try {
+					job->Readback->Wait();
+					EncodeImage(_this->Format, job->Readback->Staging->Mapped, _this->Width, _this->Height, _this->Layout, _this->SRGB, job->Encoded);
+				}
+				catch (std::exception& e) {
+					std::lock_guard<std::mutex> lock(_this->mutex);
+					_this->error = e.what();
+					job->Failed = true;
+				}
+				job->Readback = nullptr; // readback buffer can be reused
+
+				std::lock_guard<std::mutex> lock(_this->mutex);
+				_this->completed[job->Frame] = job;
+				_this->encoded.notify_all();
+			}
+		}
+
+		void __FrameWriter::__Writing(__FrameWriter* _this) {
+			while (true) {
+				std::shared_ptr<__FrameJob> job;
+				{
+					std::unique_lock<std::mutex> lock(_this->mutex);
+					while (_this->completed.empty() || _this->completed.begin()->first != _this->written) {
+						if (_this->closing && _this->completed.empty())
+							return;
+						_this->encoded.wait(lock);
+					}
+					job = _this->completed.begin()->second;
+					_this->completed.erase(_this->completed.begin());
+				}
+
+				char number[32];
+				snprintf(number, sizeof(number), "%06lld", job->Frame);
+				std::string path = _this->Path + number + FileExtension(_this->Format);
+				// Frames appear whole or not at all, a failed encoding or write leaves no file behind
+				if (!job->Failed && !WriteFileAtomically(path.data(), job->Encoded.data(), job->Encoded.size(), false)) {
+					std::lock_guard<std::mutex> lock(_this->mutex);
+					_this->error = "failed to write frame " + path;
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(_this->mutex);
+					_this->written++;
+				}
+				_this->slots.Signal();
+			}
+		}
+
+		__BindlessHeap::__BindlessHeap(VkDevice device, const VkPhysicalDeviceLimits& limits, const VkPhysicalDeviceDescriptorIndexingProperties& indexing, __DestructionQueue* destruction) :
+			device(device), Destruction(destruction) {
+			// Every binding is update-after-bind, so the set and every stage using it are bound by the update-after-bind limits
+			Capacity[(int)__HeapRange::SAMPLED_IMAGES] = std::min({ 16384u, indexing.maxDescriptorSetUpdateAfterBindSampledImages, indexing.maxPerStageDescriptorUpdateAfterBindSampledImages });
+			Capacity[(int)__HeapRange::STORAGE_IMAGES] = std::min({ 4096u, indexing.maxDescriptorSetUpdateAfterBindStorageImages, indexing.maxPerStageDescriptorUpdateAfterBindStorageImages });
+			Capacity[(int)__HeapRange::STORAGE_BUFFERS] = std::min({ 16384u, indexing.maxDescriptorSetUpdateAfterBindStorageBuffers, indexing.maxPerStageDescriptorUpdateAfterBindStorageBuffers });
+			Capacity[(int)__HeapRange::SAMPLERS] = std::min({ 1024u, indexing.maxDescriptorSetUpdateAfterBindSamplers, indexing.maxPerStageDescriptorUpdateAfterBindSamplers });
+
+			// Images and buffers share the per-stage resource limit, all ranges share the update-after-bind pool limit.
+			// Ranges are scaled down in proportion when a sum exceeds its limit.
+			auto fit = [this](int first, int last, uint32_t limit) {
+				uint64_t total = 0;
+				for (int i = first; i <= last; i++)
+					total += Capacity[i];
+				if (total > limit)
+					for (int i = first; i <= last; i++)
+						Capacity[i] = (uint32_t)((uint64_t)Capacity[i] * limit / total);
+			};
+			fit((int)__HeapRange::SAMPLED_IMAGES, (int)__HeapRange::STORAGE_BUFFERS, indexing.maxPerStageUpdateAfterBindResources);
+			fit(0, Ranges - 1, indexing.maxUpdateAfterBindDescriptorsInAllPools);
+			PushConstantsSize = std::min(MaxPushConstants, limits.maxPushConstantsSize);
+
+			VkDescriptorType types[Ranges] = {
+				VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+				VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_DESCRIPTOR_TYPE_SAMPLER
+			};
+
+			VkDescriptorSetLayoutBinding bindings[Ranges] = { };
+			VkDescriptorBindingFlags bindingFlags[Ranges] = { };
+			VkDescriptorPoolSize sizes[Ranges] = { };
+			for (int i = 0; i < Ranges; i++) {
+				bindings[i].binding = i;
+				bindings[i].descriptorType = types[i];
+				bindings[i].descriptorCount = Capacity[i];
+				bindings[i].stageFlags = VK_SHADER_STAGE_ALL;
+				// Every range, samplers included, takes new entries while lists using the heap are recorded or in flight.
+				// Entries are only rewritten once released and retired, so pending lists never read a changing one.
+				bindingFlags[i] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+					VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+				sizes[i].type = types[i];
+				sizes[i].descriptorCount = Capacity[i];
+			}
+
+			VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+			flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+			flagsInfo.bindingCount = Ranges;
+			flagsInfo.pBindingFlags = bindingFlags;
+
+			VkDescriptorSetLayoutCreateInfo layoutInfo{};
+			layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			layoutInfo.pNext = &flagsInfo;
+			layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+			layoutInfo.bindingCount = Ranges;
+			layoutInfo.pBindings = bindings;
+			if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &Layout) != VK_SUCCESS)
+				throw std::runtime_error("failed to create descriptor heap layout!");
+
+			VkDescriptorPoolCreateInfo poolInfo{};
+			poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+			poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+			poolInfo.maxSets = 1;
+			poolInfo.poolSizeCount = Ranges;
+			poolInfo.pPoolSizes = sizes;
+			if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &Pool) != VK_SUCCESS)
+				throw std::runtime_error("failed to create descriptor heap pool!");
+
+			VkDescriptorSetAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			allocInfo.descriptorPool = Pool;
+			allocInfo.descriptorSetCount = 1;
+			allocInfo.pSetLayouts = &Layout;
+			if (vkAllocateDescriptorSets(device, &allocInfo, &Set) != VK_SUCCESS)
+				throw std::runtime_error("failed to allocate descriptor heap!");
+
+			VkPushConstantRange pushConstants{};
+			pushConstants.stageFlags = VK_SHADER_STAGE_ALL;
+			pushConstants.offset = 0;
+			pushConstants.size = PushConstantsSize;
+
+			VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+			pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+			pipelineLayoutInfo.setLayoutCount = 1;
+			pipelineLayoutInfo.pSetLayouts = &Layout;
+			pipelineLayoutInfo.pushConstantRangeCount = 1;
+			pipelineLayoutInfo.pPushConstantRanges = &pushConstants;
+			if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &PipelineLayout) != VK_SUCCESS)
+				throw std::runtime_error("failed to create heap pipeline layout!");
+		}
+
+		__BindlessHeap::~__BindlessHeap() {
+			vkDestroyPipelineLayout(device, PipelineLayout, nullptr);
+			vkDestroyDescriptorPool(device, Pool, nullptr); // frees the set
+			vkDestroyDescriptorSetLayout(device, Layout, nullptr);
+		}
+
+		uint32_t __BindlessHeap::Allocate(__HeapRange range) {
+			int r = (int)range;
+			std::lock_guard<std::mutex> lock(mutex);
+			// Indices whose submissions finished can not be referenced by lists still on the GPU, flags are set in release order
+			while (!retired[r].empty() && retired[r].front().first->load(std::memory_order_acquire)) {
+				free[r].push_back(retired[r].front().second);
+				retired[r].pop_front();
+			}
+			if (!free[r].empty()) {
+				uint32_t index = free[r].back();
+				free[r].pop_back();
+				return index;
+			}
+			if (allocated[r] == Capacity[r])
+				throw std::runtime_error("Descriptor heap is full");
+			return allocated[r]++;
+		}
+
+		void __BindlessHeap::Release(__HeapRange range, uint32_t index) {
+			std::shared_ptr<std::atomic<bool>> retirement = Destruction->Track();
+			std::lock_guard<std::mutex> lock(mutex);
+			retired[(int)range].push_back(std::make_pair(retirement, index));
+		}
+
+		void __BindlessHeap::Write(__HeapRange range, uint32_t index, VkImageView view) {
+			VkDescriptorImageInfo info{};
+			info.imageView = view;
+			info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+			VkWriteDescriptorSet write{};
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = Set;
+			write.dstBinding = (uint32_t)range;
+			write.dstArrayElement = index;
+			write.descriptorCount = 1;
+			write.descriptorType = range == __HeapRange::SAMPLED_IMAGES ? VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			write.pImageInfo = &info;
+			vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+		}
+
+		void __BindlessHeap::Write(uint32_t index, VkBuffer buffer) {
+			VkDescriptorBufferInfo info{};
+			info.buffer = buffer;
+			info.offset = 0;
+			info.range = VK_WHOLE_SIZE;
+
+			VkWriteDescriptorSet write{};
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = Set;
+			write.dstBinding = (uint32_t)__HeapRange::STORAGE_BUFFERS;
+			write.dstArrayElement = index;
+			write.descriptorCount = 1;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			write.pBufferInfo = &info;
+			vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+		}
+
+		void __BindlessHeap::Write(uint32_t index, VkSampler sampler) {
+			VkDescriptorImageInfo info{};
+			info.sampler = sampler;
+
+			VkWriteDescriptorSet write{};
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = Set;
+			write.dstBinding = (uint32_t)__HeapRange::SAMPLERS;
+			write.dstArrayElement = index;
+			write.descriptorCount = 1;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+			write.pImageInfo = &info;
+			vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+		}
+
+		__ViewCache::~__ViewCache() {
+			for (auto& v : views)
+				vkDestroyImageView(device->_Device, v.second.View, nullptr);
+			for (auto& s : samplers)
+				vkDestroySampler(device->_Device, s.second.Sampler, nullptr);
+		}
+
+		__CachedView __ViewCache::FetchView(const __Resource* image, const ImageSliceDescription& slice) {
+			__ViewKey key{ image->_Data->Image, slice.ImageType, image->ImageDescription.format, slice.mip_start, slice.mip_count, slice.array_start, slice.array_count };
+
+			std::lock_guard<std::mutex> lock(mutex);
+			auto found = views.find(key);
+			if (found != views.end())
+				return found->second;
+
+			VkImageViewCreateInfo ivcreateInfo{};
+			ivcreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			ivcreateInfo.image = key.Image;
+			ivcreateInfo.viewType = key.Type;
+			ivcreateInfo.format = key.Format;
+			ivcreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+			ivcreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+			ivcreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+			ivcreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+			ivcreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			ivcreateInfo.subresourceRange.baseMipLevel = slice.mip_start;
+			ivcreateInfo.subresourceRange.levelCount = slice.mip_count;
+			ivcreateInfo.subresourceRange.baseArrayLayer = slice.array_start;
+			ivcreateInfo.subresourceRange.layerCount = slice.array_count;
+
+			__CachedView view{ nullptr, Resource::NoIndex, Resource::NoIndex };
+			if (vkCreateImageView(device->_Device, &ivcreateInfo, nullptr, &view.View) != VK_SUCCESS)
+				throw std::runtime_error("failed to create image views!");
+			CreatedViews++;
+
+			__BindlessHeap* heap = device->_Heap;
+			if (heap != nullptr) {
+				if (image->ImageDescription.usage & VK_IMAGE_USAGE_SAMPLED_BIT) {
+					view.SampledIndex = heap->Allocate(__HeapRange::SAMPLED_IMAGES);
+					heap->Write(__HeapRange::SAMPLED_IMAGES, view.SampledIndex, view.View);
+				}
+				if (image->ImageDescription.usage & VK_IMAGE_USAGE_STORAGE_BIT) {
+					view.StorageIndex = heap->Allocate(__HeapRange::STORAGE_IMAGES);
+					heap->Write(__HeapRange::STORAGE_IMAGES, view.StorageIndex, view.View);
+				}
+			}
+
+			views[key] = view;
+			return view;
+		}
+
+		__CachedSampler __ViewCache::FetchSampler(const __SamplerKey& key) {
+			std::lock_guard<std::mutex> lock(mutex);
+			auto found = samplers.find(key);
+			if (found != samplers.end())
+				return found->second;
+
+			VkSamplerCreateInfo createInfo{};
+			createInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+			createInfo.minFilter = key.MinFilter;
+			createInfo.magFilter = key.MagFilter;
+			createInfo.mipmapMode = key.MipFilter;
+			createInfo.addressModeU = key.AddressU;
+			createInfo.addressModeV = key.AddressV;
+			createInfo.addressModeW = key.AddressW;
+			createInfo.mipLodBias = key.MipLodBias;
+			createInfo.anisotropyEnable = SupportsAnisotropy && key.MaxAnisotropy > 1;
+			createInfo.maxAnisotropy = std::min(key.MaxAnisotropy, MaxAnisotropy);
+			createInfo.minLod = key.MinLod;
+			createInfo.maxLod = key.MaxLod == 0 ? VK_LOD_CLAMP_NONE : key.MaxLod;
+			createInfo.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+
+			__CachedSampler sampler{ nullptr, Resource::NoIndex };
+			if (vkCreateSampler(device->_Device, &createInfo, nullptr, &sampler.Sampler) != VK_SUCCESS)
+				throw std::runtime_error("failed to create sampler!");
+			CreatedSamplers++;
+
+			if (device->_Heap != nullptr) {
+				sampler.Index = device->_Heap->Allocate(__HeapRange::SAMPLERS);
+				device->_Heap->Write(sampler.Index, sampler.Sampler);
+			}
+
+			samplers[key] = sampler;
+			return sampler;
+		}
+
+		void __ViewCache::Invalidate(VkImage image) {
+			std::lock_guard<std::mutex> lock(mutex);
+			auto first = views.lower_bound(__ViewKey{ image, (VkImageViewType)0, (VkFormat)0, 0, 0, 0, 0 });
+			auto last = first;
+			while (last != views.end() && last->first.Image == image) {
+				device->__ReleaseFramebuffers(last->second.View);
+				device->__Defer(VK_OBJECT_TYPE_IMAGE_VIEW, (uint64_t)last->second.View);
+				if (device->_Heap != nullptr) {
+					if (last->second.SampledIndex != Resource::NoIndex)
+						device->_Heap->Release(__HeapRange::SAMPLED_IMAGES, last->second.SampledIndex);
+					if (last->second.StorageIndex != Resource::NoIndex)
+						device->_Heap->Release(__HeapRange::STORAGE_IMAGES, last->second.StorageIndex);
+				}
+				last++;
+			}
+			views.erase(first, last);
+		}
+
+		__ResourcePool::__ResourcePool(__DestructionQueue* destruction) :
+			Destruction(destruction),
+			Generations(Capacity),
+			Images(Capacity),
+			Buffers(Capacity),
+			Ranges(Capacity),
+			SampledIndices(Capacity),
+			StorageIndices(Capacity),
+			Owners(Capacity) {
+			for (uint32_t i = 0; i < Capacity; i++)
+				Generations[i].store(1, std::memory_order_relaxed);
+		}
+
+		uint32_t __ResourcePool::Register(std::shared_ptr<__Resource> resource) {
+			std::lock_guard<std::mutex> lock(mutex);
+			// Frame and async lists recording the slot were submitted and finished, flags are set in release order
+			while (!retired.empty() && retired.front().first->load(std::memory_order_acquire)) {
+				Owners[retired.front().second] = nullptr; // the resource can be destroyed now
+				free.push_back(retired.front().second);
+				retired.pop_front();
+			}
+			uint32_t slot;
+			if (!free.empty()) {
+				slot = free.back();
+				free.pop_back();
+			}
+			else {
+				if (allocated == Capacity)
+					throw std::runtime_error("Resource pool is full");
+				slot = allocated++;
+			}
+
+			Owners[slot] = resource;
+			SampledIndices[slot] = resource->SampledIndex;
+			StorageIndices[slot] = resource->StorageIndex;
+			if (resource->IsBuffer) {
+				Buffers[slot] = resource->_Data->Buffer;
+				Images[slot] = nullptr;
+			}
+			else {
+				Buffers[slot] = nullptr;
+				Images[slot] = resource->_Data->Image;
+				Ranges[slot].aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				Ranges[slot].baseMipLevel = resource->ImageSlice.mip_start;
+				Ranges[slot].levelCount = resource->ImageSlice.mip_count;
+				Ranges[slot].baseArrayLayer = resource->ImageSlice.array_start;
+				Ranges[slot].layerCount = resource->ImageSlice.array_count;
+			}
+			return ((uint32_t)Generations[slot].load(std::memory_order_relaxed) << 16) | slot;
+		}
+
+		void __ResourcePool::Release(uint32_t handle) {
+			std::shared_ptr<std::atomic<bool>> retirement = Destruction->Track();
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t slot = Slot(handle);
+			// Bump the generation so the handle is stale from now on. Generation 0 is skipped, null handles are never alive.
+			uint16_t generation = Generations[slot].load(std::memory_order_relaxed) + 1;
+			Generations[slot].store(generation == 0 ? 1 : generation, std::memory_order_relaxed);
+			retired.push_back(std::make_pair(retirement, slot));
+		}
+
+		__DestructionQueue::__DestructionQueue(VkDevice device, bool background) :
+			device(device), background(background) {
+			if (background)
+				worker = std::thread(__Work, this);
+		}
+
+		__DestructionQueue::~__DestructionQueue() {
+			if (worker.joinable()) {
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					stop = true;
+				}
+				batchReady.notify_one();
+				worker.join();
+			}
+		}
+
+		void __DestructionQueue::Enqueue(VkObjectType type, uint64_t handle, std::shared_ptr<void> owner) {
+			std::lock_guard<std::mutex> lock(mutex);
+			pending.push_back(Entry{ type, handle, owner, nullptr });
+			// Lists still recording may reference the object and are submitted later, by EndFrame or by an explicit flush
+			for (size_t i = 0; i < Managers.size(); i++) {
+				std::shared_ptr<__GPUTask> task = Managers[i]->RecordingTask();
+				if (task != nullptr && task.get() != captured[i]) {
+					captured[i] = task.get();
+					recording.push_back(task);
+				}
+			}
+		}
+
+		std::shared_ptr<std::atomic<bool>> __DestructionQueue::Track() {
+			std::shared_ptr<std::atomic<bool>> retirement = std::make_shared<std::atomic<bool>>(false);
+			Enqueue(VK_OBJECT_TYPE_UNKNOWN, 0, retirement);
+			return retirement;
+		}
+
+		void __DestructionQueue::Submitted(int count, const std::shared_ptr<__GPUTask>* tasks) {
+			std::lock_guard<std::mutex> lock(mutex);
+			inFlight.erase(std::remove_if(inFlight.begin(), inFlight.end(), [](const std::shared_ptr<__GPUTask>& t) { return t->Poll(); }), inFlight.end());
+			inFlight.insert(inFlight.end(), tasks, tasks + count);
+			if (bound == pending.size())
+				return;
+			// Any list in flight or recording at the release, from this frame, an older one or an async thread, might reference the released objects
+			std::shared_ptr<__GPUTask> task = std::shared_ptr<__GPUTask>(new __GPUTask());
+			task->device = device;
+			task->children = inFlight;
+			task->children.insert(task->children.end(), recording.begin(), recording.end());
+			recording.clear();
+			std::fill(captured.begin(), captured.end(), nullptr);
+			for (; bound < pending.size(); bound++)
+				pending[bound].Task = task;
+		}
+
+		void __DestructionQueue::Retire() {
+			std::vector<Entry> retired;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				while (bound > 0 && pending.front().Task->Poll()) {
+					retired.push_back(std::move(pending.front()));
+					pending.pop_front();
+					bound--;
+				}
+				if (retired.empty())
+					return;
+				if (background) {
+					batch.insert(batch.end(), std::make_move_iterator(retired.begin()), std::make_move_iterator(retired.end()));
+					batchReady.notify_one();
+					return;
+				}
+			}
+			for (const Entry& e : retired)
+				Destroy(e);
+		}
+
+		void __DestructionQueue::DestroyAll() {
+			std::vector<Entry> all;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				// Let the worker finish its batch
+				stop = true;
+				batchReady.notify_one();
+				lock.unlock();
+				if (worker.joinable())
+					worker.join();
+				lock.lock();
+				all.insert(all.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+				all.insert(all.end(), std::make_move_iterator(pending.begin()), std::make_move_iterator(pending.end()));
+				batch.clear();
+				pending.clear();
+				bound = 0;
+				inFlight.clear();
+				recording.clear();
+			}
+			for (const Entry& e : all)
+				Destroy(e);
+		}
+
+		void __DestructionQueue::Destroy(const Entry& entry) {
+			switch (entry.Type) {
+			case VK_OBJECT_TYPE_UNKNOWN: // Tracked release, nothing to destroy
+				((std::atomic<bool>*)entry.Owner.get())->store(true, std::memory_order_release);
+				return;
+			case VK_OBJECT_TYPE_BUFFER:
+				vkDestroyBuffer(device, (VkBuffer)entry.Handle, nullptr);
+				break;
+			case VK_OBJECT_TYPE_IMAGE:
+				vkDestroyImage(device, (VkImage)entry.Handle, nullptr);
+				break;
+			case VK_OBJECT_TYPE_BUFFER_VIEW:
+				vkDestroyBufferView(device, (VkBufferView)entry.Handle, nullptr);
+				break;
+			case VK_OBJECT_TYPE_IMAGE_VIEW:
+				vkDestroyImageView(device, (VkImageView)entry.Handle, nullptr);
+				break;
+			case VK_OBJECT_TYPE_DEVICE_MEMORY:
+				vkFreeMemory(device, (VkDeviceMemory)entry.Handle, nullptr);
+				break;
+			case VK_OBJECT_TYPE_SAMPLER:
+				vkDestroySampler(device, (VkSampler)entry.Handle, nullptr);
+				break;
+			case VK_OBJECT_TYPE_PIPELINE:
+				vkDestroyPipeline(device, (VkPipeline)entry.Handle, nullptr);
+				break;
+			case VK_OBJECT_TYPE_RENDER_PASS:
+				vkDestroyRenderPass(device, (VkRenderPass)entry.Handle, nullptr);
+				break;
+			case VK_OBJECT_TYPE_FRAMEBUFFER:
+				vkDestroyFramebuffer(device, (VkFramebuffer)entry.Handle, nullptr);
+				break;
+			case VK_OBJECT_TYPE_ACCELERATION_STRUCTURE_KHR:
+				DestroyAccelerationStructure(device, (VkAccelerationStructureKHR)entry.Handle, nullptr);
+				break;
+			default:
+				throw std::runtime_error("Not supported object type for deferred destruction");
+			}
+			Destroyed++;
+		}
+
+		void __DestructionQueue::__Work(__DestructionQueue* _this) {
+			std::unique_lock<std::mutex> lock(_this->mutex);
+			while (true) {
+				_this->batchReady.wait(lock, [_this] { return _this->stop || !_this->batch.empty(); });
+				if (_this->batch.empty())
+					return; // stopped
+				std::vector<Entry> current;
+				current.swap(_this->batch);
+				lock.unlock();
+				for (const Entry& e : current)
+					_this->Destroy(e);
+				lock.lock();
+			}
+		}
+
+		__Pipeline::~__Pipeline() {
+			if (Pipeline)
+				device->__Defer(VK_OBJECT_TYPE_PIPELINE, (uint64_t)Pipeline);
+		}
+
+		static bool __SameStage(const std::vector<unsigned int>& code, const std::string& entryPoint, const std::vector<unsigned char>& constants, const ShaderStageDescription& shader) {
+			return code.size() * 4 == shader.Size && memcmp(code.data(), shader.Code, shader.Size) == 0 &&
+				entryPoint == (shader.EntryPoint == nullptr ? "main" : shader.EntryPoint) &&
+				constants.size() == shader.ConstantsSize && (shader.ConstantsSize == 0 || memcmp(constants.data(), shader.Constants, shader.ConstantsSize) == 0);
+		}
+
+		bool __Pipeline::__Matches(const ComputePipelineDescription& description) const {
+			return BindPoint == VK_PIPELINE_BIND_POINT_COMPUTE && __SameStage(Code[0], EntryPoint[0], Constants[0], description.Shader);
+		}
+
+		bool __Pipeline::__Matches(const GraphicsPipelineDescription& description) const {
+			return BindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS &&
+				Graphics.Topology == description.Topology && Graphics.RenderTargetFormat == description.RenderTargetFormat &&
+				Graphics.DepthStencilFormat == description.DepthStencilFormat && Graphics.CullBackFaces == description.CullBackFaces &&
+				__SameStage(Code[0], EntryPoint[0], Constants[0], description.Vertex) &&
+				__SameStage(Code[1], EntryPoint[1], Constants[1], description.Fragment);
+		}
+
+		void __Pipeline::__Keep(int stage, const ShaderStageDescription& shader) {
+			Code[stage].assign(shader.Code, shader.Code + shader.Size / 4);
+			EntryPoint[stage] = shader.EntryPoint == nullptr ? "main" : shader.EntryPoint;
+			Constants[stage].assign((const unsigned char*)shader.Constants, (const unsigned char*)shader.Constants + shader.ConstantsSize);
+		}
+
+		__PipelineCache::__PipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, const char* path) :
+			device(device), Path(path == nullptr ? "" : path) {
+			VkPhysicalDeviceIDProperties idProperties{};
+			idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+			VkPhysicalDeviceProperties2 properties{};
+			properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+			properties.pNext = &idProperties;
+			vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+			memcpy(Identity.Magic, "GOOFYPC", 8);
+			Identity.Version = 1;
+			Identity.VendorID = properties.properties.vendorID;
+			Identity.DeviceID = properties.properties.deviceID;
+			Identity.DriverVersion = properties.properties.driverVersion;
+			memcpy(Identity.DriverUUID, idProperties.driverUUID, VK_UUID_SIZE);
+			memcpy(Identity.CacheUUID, properties.properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+			VkPipelineCacheCreateInfo createInfo{};
+			createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+			std::vector<unsigned char> content;
+			if (!Path.empty() && ReadFile(Path.c_str(), content) && content.size() >= sizeof(Header)) {
+				Header header;
+				memcpy(&header, content.data(), sizeof(Header));
+				const unsigned char* data = content.data() + sizeof(Header);
+				// Only data written by this same device and driver, and not truncated or corrupted, reaches the driver
+				bool valid = memcmp(header.Magic, Identity.Magic, 8) == 0 &&
+					header.Version == Identity.Version &&
+					header.VendorID == Identity.VendorID &&
+					header.DeviceID == Identity.DeviceID &&
+					header.DriverVersion == Identity.DriverVersion &&
+					memcmp(header.DriverUUID, Identity.DriverUUID, VK_UUID_SIZE) == 0 &&
+					memcmp(header.CacheUUID, Identity.CacheUUID, VK_UUID_SIZE) == 0 &&
+					header.DataSize == content.size() - sizeof(Header) &&
+					header.DataHash == Hash(data, header.DataSize);
+				if (valid) {
+					createInfo.initialDataSize = header.DataSize;
+					createInfo.pInitialData = data;
+				}
+			}
+
+			if (vkCreatePipelineCache(device, &createInfo, nullptr, &Cache) != VK_SUCCESS) {
+				// Driver rejected the data, start empty
+				createInfo.initialDataSize = 0;
+				createInfo.pInitialData = nullptr;
+				if (vkCreatePipelineCache(device, &createInfo, nullptr, &Cache) != VK_SUCCESS)
+					throw std::runtime_error("failed to create pipeline cache!");
+			}
+			Warm = createInfo.initialDataSize > 0;
+		}
+
+		__PipelineCache::~__PipelineCache() {
+			Save();
+			vkDestroyPipelineCache(device, Cache, nullptr);
+		}
+
+		void __PipelineCache::Save() {
+			if (Path.empty())
+				return;
+			size_t size = 0;
+			if (vkGetPipelineCacheData(device, Cache, &size, nullptr) != VK_SUCCESS || size == 0)
+				return;
+			std::vector<unsigned char> content(sizeof(Header) + size);
+			if (vkGetPipelineCacheData(device, Cache, &size, content.data() + sizeof(Header)) != VK_SUCCESS)
+				return;
+			content.resize(sizeof(Header) + size);
+
+			Header header = Identity;
+			header.DataSize = size;
+			header.DataHash = Hash(content.data() + sizeof(Header), size);
+			memcpy(content.data(), &header, sizeof(Header));
+			WriteFileAtomically(Path.c_str(), content.data(), content.size()); // A failed save only costs a cold start
+		}
+
+		void __Pipeline::Wait() {
+			if (!Ready.load()) {
+				std::unique_lock<std::mutex> lock(mutex);
+				compiled.wait(lock, [this] { return Ready.load(); });
+			}
+			if (!Error.empty())
+				throw std::runtime_error(Error);
+		}
+
+		void __Pipeline::__Compiled(const std::string& error) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				Error = error;
+				Ready.store(true);
+			}
+			compiled.notify_all();
+		}
+
+		void __PipelineJob::Own(ShaderStageDescription& stage, int index) {
+			Code[index].assign(stage.Code, stage.Code + stage.Size / 4);
+			EntryPoint[index] = stage.EntryPoint == nullptr ? "main" : stage.EntryPoint;
+			stage.Code = Code[index].data();
+			stage.EntryPoint = EntryPoint[index].c_str();
+			Constants[index].assign((const unsigned char*)stage.Constants, (const unsigned char*)stage.Constants + stage.ConstantsSize);
+			stage.Constants = Constants[index].data();
+		}
+
+		__PipelineCompiler::__PipelineCompiler(__Device* device, int threads) : device(device) {
+			for (int i = 0; i < threads; i++)
+				workers.push_back(std::thread(__Work, this));
+		}
+
+		__PipelineCompiler::~__PipelineCompiler() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stop = true;
+			}
+			available.notify_all();
+			for (std::thread& t : workers)
+				t.join();
+			for (std::shared_ptr<__PipelineJob> job : jobs)
+				job->Pipeline->__Compiled("Device destroyed before the pipeline was compiled");
+			jobs.clear();
+		}
+
+		void __PipelineCompiler::Enqueue(std::shared_ptr<__Pipeline> pipeline, const ComputePipelineDescription& description) {
+			std::shared_ptr<__PipelineJob> job = std::shared_ptr<__PipelineJob>(new __PipelineJob());
+			job->Pipeline = pipeline;
+			job->IsGraphics = false;
+			job->Compute = description;
+			job->Own(job->Compute.Shader, 0);
+			__Enqueue(job);
+		}
+
+		void __PipelineCompiler::Enqueue(std::shared_ptr<__Pipeline> pipeline, const GraphicsPipelineDescription& description) {
+			std::shared_ptr<__PipelineJob> job = std::shared_ptr<__PipelineJob>(new __PipelineJob());
+			job->Pipeline = pipeline;
+			job->IsGraphics = true;
+			job->Graphics = description;
+			job->Own(job->Graphics.Vertex, 0);
+			job->Own(job->Graphics.Fragment, 1);
+			__Enqueue(job);
+		}
+
+		void __PipelineCompiler::__Enqueue(std::shared_ptr<__PipelineJob> job) {
+			job->Pipeline->Ready.store(false);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				jobs.push_back(job);
+			}
+			available.notify_one();
+		}
+
+		void __PipelineCompiler::__Work(__PipelineCompiler* _this) {
+			Tracer::NameThread("Pipeline compiler");
+			while (true) {
+				std::shared_ptr<__PipelineJob> job;
+				{
+					std::unique_lock<std::mutex> lock(_this->mutex);
+					_this->available.wait(lock, [_this] { return _this->stop || !_this->jobs.empty(); });
+					if (_this->stop)
+						return;
+					job = _this->jobs.front();
+					_this->jobs.pop_front();
+				}
+				std::string error;
+				TraceScope trace("CompilePipeline");
+				try {
+					if (job->IsGraphics)
+						_this->device->__BuildGraphicsPipeline(job->Pipeline.get(), job->Graphics);
+					else
+						_this->device->__BuildComputePipeline(job->Pipeline.get(), job->Compute);
+				}
+				// Any failure is reported to the waiters, an escaping exception would terminate the worker and leave the pipeline pending
+				catch (std::exception& e) {
+					error = e.what();
+					if (error.empty())
+						error = "failed to compile pipeline!";
+				}
+				catch (...) {
+					error = "failed to compile pipeline!";
+				}
+				job->Pipeline->__Compiled(error);
+			}
+		}
+
+		std::atomic<uint32_t> __Capture::Sessions = { 0 };
+
+		__Capture::__Capture(FILE* file) : File(file), Session(++Sessions), Start(Tracer::Now()) {
+			std::unique_lock<std::mutex> lock(mutex);
+			Record.Write("GOOFYCAP", 8);
+			Record.Write(Version);
+			__Write();
+		}
+
+		__Capture::~__Capture() {
+			Close();
+		}
+
+		void __Capture::Close() {
+			std::unique_lock<std::mutex> lock(mutex);
+			if (File == nullptr)
+				return;
+			fclose(File);
+			File = nullptr;
+		}
+
+		// Appends the record being built to the file, called with the lock taken
+		void __Capture::__Write() {
+			if (File != nullptr)
+				fwrite(Record.Bytes.data(), 1, Record.Bytes.size(), File);
+			Record.Bytes.clear();
+		}
+
+		uint32_t __Capture::Resource(const __Resource* resource) {
+			__ResourceData* data = resource->_Data.get();
+			uint64_t key = data->CaptureKey.load(std::memory_order_acquire);
+			if ((key >> 32) == Session)
+				return (uint32_t)key;
+
+			std::unique_lock<std::mutex> lock(mutex);
+			key = data->CaptureKey.load(std::memory_order_relaxed);
+			if ((key >> 32) == Session) // written by another thread meanwhile
+				return (uint32_t)key;
+
+			uint32_t id = ++NextResource;
+			Record.Write(__CaptureOp::RESOURCE);
+			Record.Write(id);
+			Record.Write((uint8_t)resource->IsBuffer);
+			if (resource->IsBuffer) {
+				Record.Write((uint64_t)resource->BufferDescription.size);
+				Record.Write((uint32_t)resource->BufferDescription.usage);
+			}
+			else {
+				const VkImageCreateInfo& image = resource->ImageDescription;
+				uint32_t fields[8] = {
+					(uint32_t)image.imageType, (uint32_t)image.format,
+					image.extent.width, image.extent.height, image.extent.depth,
+					image.mipLevels, image.arrayLayers, (uint32_t)image.usage
+				};
+				Record.Write(fields);
+			}
+			__Write();
+			data->CaptureKey.store(((uint64_t)Session << 32) | id, std::memory_order_release);
+			return id;
+		}
+
+		uint32_t __Capture::Dispatch(Process* process, DispatchMode mode) {
+			const char* name = process->Name();
+			uint16_t length = (uint16_t)std::min<size_t>(strlen(name), 0xFFFF);
+			uint32_t engines = (uint32_t)process->RequiredEngines();
+
+			std::unique_lock<std::mutex> lock(mutex);
+			uint32_t id = ++NextProcess;
+			Record.Write(__CaptureOp::DISPATCH);
+			Record.Write((uint64_t)(Tracer::Now() - Start));
+			Record.Write(id);
+			Record.Write((uint8_t)mode);
+			Record.Write(engines);
+			Record.Write(length);
+			Record.Write(name, length);
+			__Write();
+			return id;
+		}
+
+		void __Capture::Populated(uint32_t id, __CaptureStream& commands) {
+			std::unique_lock<std::mutex> lock(mutex);
+			Record.Write(__CaptureOp::PROCESS);
+			Record.Write(id);
+			Record.Write((uint32_t)commands.Bytes.size());
+			Record.Write(commands.Bytes.data(), commands.Bytes.size());
+			__Write();
+			commands.Bytes.clear();
+		}
+
+		void __Capture::Flush(int count, std::shared_ptr<__CPUTask>* tasks, int waitingCount, std::shared_ptr<__GPUTask>* waitingGPU, std::shared_ptr<__GPUTask> result) {
+			std::unique_lock<std::mutex> lock(mutex);
+			uint32_t id = ++NextFlush;
+			Record.Write(__CaptureOp::FLUSH);
+			Record.Write((uint64_t)(Tracer::Now() - Start));
+			Record.Write(id);
+
+			// Processes dispatched before the capture started are not in the file
+			std::vector<uint32_t> ids;
+			for (int i = 0; i < count; i++)
+				if (tasks[i]->workPiece->Capture.get() == this)
+					ids.push_back(tasks[i]->workPiece->CaptureId);
+			Record.Write((uint32_t)ids.size());
+			Record.Write(ids.data(), ids.size() * sizeof(uint32_t));
+
+			ids.clear();
+			for (int i = 0; i < waitingCount; i++) {
+				auto flushed = Flushes.find(waitingGPU[i].get());
+				if (flushed != Flushes.end() && flushed->second.first.lock() == waitingGPU[i])
+					ids.push_back(flushed->second.second);
+			}
+			Record.Write((uint32_t)ids.size());
+			Record.Write(ids.data(), ids.size() * sizeof(uint32_t));
+			__Write();
+
+			if (Flushes.size() >= 1024) // forget tasks released by the application
+				for (auto f = Flushes.begin(); f != Flushes.end();)
+					f = f->second.first.expired() ? Flushes.erase(f) : std::next(f);
+			Flushes[result.get()] = { result, id };
+		}
+
+		void __Capture::Frame(__CaptureOp op) {
+			std::unique_lock<std::mutex> lock(mutex);
+			Record.Write(op);
+			Record.Write((uint64_t)(Tracer::Now() - Start));
+			__Write();
+		}
+
+		void __Capture::Clear(__CaptureStream& commands, const __Resource* resource, const VkImageSubresourceRange& range, const float color[4]) {
+			commands.Write(__CaptureOp::CLEAR);
+			commands.Write(Resource(resource));
+			uint32_t subresources[4] = { range.baseMipLevel, range.levelCount, range.baseArrayLayer, range.layerCount };
+			commands.Write(subresources);
+			commands.Write(color, 4 * sizeof(float));
+		}
+
+		void __Capture::Push(__CaptureStream& commands, EngineType engine, int count, const unsigned int* constants) {
+			commands.Write(__CaptureOp::PUSH);
+			commands.Write((uint8_t)engine);
+			commands.Write((uint8_t)count);
+			commands.Write(constants, count * sizeof(unsigned int));
+		}
+
+		void __Capture::GenerateMips(__CaptureStream& commands, const __Resource* resource, const VkImageSubresourceRange& range) {
+			commands.Write(__CaptureOp::GENERATE_MIPS);
+			commands.Write(Resource(resource));
+			uint32_t subresources[4] = { range.baseMipLevel, range.levelCount, range.baseArrayLayer, range.layerCount };
+			commands.Write(subresources);
+		}
+
+		void __Capture::Unsupported(__CaptureStream& commands, const char* command) {
+			uint16_t length = (uint16_t)std::min<size_t>(strlen(command), 0xFFFF);
+			commands.Write(__CaptureOp::UNSUPPORTED);
+			commands.Write(length);
+			commands.Write(command, length);
+		}
+
+		uint32_t __Capture::Pipeline(const __Pipeline* pipeline) {
+			uint64_t key = pipeline->CaptureKey.load(std::memory_order_acquire);
+			if ((key >> 32) == Session)
+				return (uint32_t)key;
+
+			std::unique_lock<std::mutex> lock(mutex);
+			key = pipeline->CaptureKey.load(std::memory_order_relaxed);
+			if ((key >> 32) == Session) // written by another thread meanwhile
+				return (uint32_t)key;
+
+			// Pipelines share the id sequence of resources
+			uint32_t id = ++NextResource;
+			bool graphics = pipeline->BindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS;
+			Record.Write(graphics ? __CaptureOp::GRAPHICS_PIPELINE : __CaptureOp::PIPELINE);
+			Record.Write(id);
+			if (graphics) {
+				const GraphicsPipelineDescription& state = pipeline->Graphics;
+				uint32_t fields[4] = { (uint32_t)state.Topology, (uint32_t)state.RenderTargetFormat, (uint32_t)state.DepthStencilFormat, state.CullBackFaces ? 1u : 0u };
+				Record.Write(fields);
+			}
+			for (int stage = 0; stage < (graphics ? 2 : 1); stage++) {
+				uint16_t length = (uint16_t)std::min<size_t>(pipeline->EntryPoint[stage].size(), 0xFFFF);
+				Record.Write(length);
+				Record.Write(pipeline->EntryPoint[stage].data(), length);
+				Record.Write((uint32_t)pipeline->Code[stage].size());
+				Record.Write(pipeline->Code[stage].data(), pipeline->Code[stage].size() * sizeof(unsigned int));
+				Record.Write((uint32_t)pipeline->Constants[stage].size());
+				Record.Write(pipeline->Constants[stage].data(), pipeline->Constants[stage].size());
+			}
+			__Write();
+			const_cast<__Pipeline*>(pipeline)->CaptureKey.store(((uint64_t)Session << 32) | id, std::memory_order_release);
+			return id;
+		}
+
+		void __Capture::Bind(__CaptureStream& commands, const __Pipeline* pipeline) {
+			commands.Write(__CaptureOp::BIND_PIPELINE);
+			commands.Write(Pipeline(pipeline));
+		}
+
+		void __Capture::Compute(__CaptureStream& commands, uint32_t x, uint32_t y, uint32_t z) {
+			commands.Write(__CaptureOp::COMPUTE);
+			uint32_t groups[3] = { x, y, z };
+			commands.Write(groups);
+		}
+
+		void __Capture::ComputeIndirect(__CaptureStream& commands, const __Resource* arguments, VkDeviceSize offset) {
+			commands.Write(__CaptureOp::COMPUTE_INDIRECT);
+			commands.Write(Resource(arguments));
+			commands.Write((uint64_t)offset);
+		}
+
+		void __Capture::BeginRendering(__CaptureStream& commands, const __Resource* target, const __Resource* depth) {
+			commands.Write(__CaptureOp::BEGIN_RENDERING);
+			commands.Write(Resource(target));
+			commands.Write(depth == nullptr ? 0u : Resource(depth));
+		}
+
+		void __Capture::EndRendering(__CaptureStream& commands) {
+			commands.Write(__CaptureOp::END_RENDERING);
+		}
+
+		void __Capture::Indices(__CaptureStream& commands, const __Resource* indices) {
+			commands.Write(__CaptureOp::INDICES);
+			commands.Write(Resource(indices));
+		}
+
+		void __Capture::Cull(__CaptureStream& commands, const __Resource* instances, uint32_t count, const float planes[24], const __Resource* draws) {
+			commands.Write(__CaptureOp::CULL);
+			commands.Write(Resource(instances));
+			commands.Write(count);
+			commands.Write(planes, 24 * sizeof(float));
+			commands.Write(Resource(draws));
+		}
+
+		void __Capture::DrawIndirect(__CaptureStream& commands, const __Resource* draws, uint32_t maxDraws) {
+			commands.Write(__CaptureOp::DRAW_INDIRECT);
+			commands.Write(Resource(draws));
+			commands.Write(maxDraws);
+		}
+
+		void __ReplayProcess::Populate(goofy::CommandListManager manager) {
+			__CommandListManager* list = manager.__state.get();
+			__CaptureReader reader(Commands, Size);
+			while (!reader.End()) {
+				switch (reader.Read<__CaptureOp>()) {
+				case __CaptureOp::CLEAR:
+				{
+					auto image = Replay->Resources.find(reader.Read<uint32_t>());
+					if (image == Replay->Resources.end() || image->second->IsBuffer)
+						throw std::runtime_error("Corrupted capture, cleared resource is not an image");
+					VkImageSubresourceRange range;
+					range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+					range.baseMipLevel = reader.Read<uint32_t>();
+					range.levelCount = reader.Read<uint32_t>();
+					range.baseArrayLayer = reader.Read<uint32_t>();
+					range.layerCount = reader.Read<uint32_t>();
+					VkClearColorValue color;
+					memcpy(color.float32, reader.Skip(4 * sizeof(float)), 4 * sizeof(float));
+					vkCmdClearColorImage(list->vkCmdList, image->second->_Data->Image, VK_IMAGE_LAYOUT_GENERAL, &color, 1, &range);
+					break;
+				}
+				case __CaptureOp::PUSH:
+				{
+					EngineType engine = (EngineType)reader.Read<uint8_t>();
+					int count = reader.Read<uint8_t>();
+					unsigned int constants[32];
+					if (count > 32)
+						throw std::runtime_error("Corrupted capture, too many constants");
+					memcpy(constants, reader.Skip(count * sizeof(unsigned int)), count * sizeof(unsigned int));
+					list->__Push(engine, count, constants);
+					break;
+				}
+				case __CaptureOp::GENERATE_MIPS:
+				{
+					auto image = Replay->Resources.find(reader.Read<uint32_t>());
+					if (image == Replay->Resources.end() || image->second->IsBuffer)
+						throw std::runtime_error("Corrupted capture, mips generated of a resource that is not an image");
+					int mipStart = reader.Read<uint32_t>();
+					int mipCount = reader.Read<uint32_t>();
+					int arrayStart = reader.Read<uint32_t>();
+					int arrayCount = reader.Read<uint32_t>();
+					image->second->device->GenerateMips(list, image->second.get(), mipStart, mipCount, arrayStart, arrayCount);
+					break;
+				}
+				case __CaptureOp::BIND_PIPELINE:
+				{
+					auto pipeline = Replay->Pipelines.find(reader.Read<uint32_t>());
+					if (pipeline == Replay->Pipelines.end())
+						throw std::runtime_error("Corrupted capture, bound pipeline not found");
+					list->__Bind(pipeline->second.get());
+					break;
+				}
+				case __CaptureOp::COMPUTE:
+				{
+					uint32_t groups[3];
+					memcpy(groups, reader.Skip(sizeof(groups)), sizeof(groups));
+					list->__Dispatch(groups[0], groups[1], groups[2]);
+					break;
+				}
+				case __CaptureOp::COMPUTE_INDIRECT:
+				{
+					auto arguments = Replay->Resources.find(reader.Read<uint32_t>());
+					if (arguments == Replay->Resources.end() || !arguments->second->IsBuffer)
+						throw std::runtime_error("Corrupted capture, indirect arguments are not a buffer");
+					list->__DispatchIndirect(arguments->second.get(), reader.Read<uint64_t>());
+					break;
+				}
+				case __CaptureOp::BEGIN_RENDERING:
+				{
+					auto target = Replay->Resources.find(reader.Read<uint32_t>());
+					uint32_t depthId = reader.Read<uint32_t>();
+					auto depth = Replay->Resources.find(depthId);
+					if (target == Replay->Resources.end() || target->second->IsBuffer || (depthId != 0 && (depth == Replay->Resources.end() || depth->second->IsBuffer)))
+						throw std::runtime_error("Corrupted capture, render targets are not images");
+					list->__BeginRendering(target->second.get(), depthId == 0 ? nullptr : depth->second.get());
+					break;
+				}
+				case __CaptureOp::END_RENDERING:
+					list->__EndRendering();
+					break;
+				case __CaptureOp::INDICES:
+				{
+					auto indices = Replay->Resources.find(reader.Read<uint32_t>());
+					if (indices == Replay->Resources.end() || !indices->second->IsBuffer)
+						throw std::runtime_error("Corrupted capture, indices are not a buffer");
+					list->__SetIndices(indices->second.get());
+					break;
+				}
+				case __CaptureOp::CULL:
+				{
+					auto instances = Replay->Resources.find(reader.Read<uint32_t>());
+					uint32_t count = reader.Read<uint32_t>();
+					float planes[24];
+					memcpy(planes, reader.Skip(sizeof(planes)), sizeof(planes));
+					auto draws = Replay->Resources.find(reader.Read<uint32_t>());
+					if (instances == Replay->Resources.end() || draws == Replay->Resources.end() || !instances->second->IsBuffer || !draws->second->IsBuffer)
+						throw std::runtime_error("Corrupted capture, culled instances or draws are not buffers");
+					draws->second->device->Cull(list, instances->second.get(), count, planes, draws->second.get());
+					break;
+				}
+				case __CaptureOp::DRAW_INDIRECT:
+				{
+					auto draws = Replay->Resources.find(reader.Read<uint32_t>());
+					if (draws == Replay->Resources.end() || !draws->second->IsBuffer)
+						throw std::runtime_error("Corrupted capture, draws are not a buffer");
+					list->__DrawIndirect(draws->second.get(), reader.Read<uint32_t>());
+					break;
+				}
+				case __CaptureOp::UNSUPPORTED:
+					reader.Skip(reader.Read<uint16_t>());
+					Replay->Unsupported++;
+					break;
+				default:
+					throw std::runtime_error("Corrupted capture, unknown command");
+				}
+			}
+		}
+
+		__Replay::__Replay(__Device* device, const char* path) {
+			if (!ReadFile(path, Content))
+				throw std::runtime_error("Failed to read the capture file");
+
+			__CaptureReader reader(Content.data(), Content.size());
+			if (Content.size() < 12 || memcmp(reader.Skip(8), "GOOFYCAP", 8) != 0 || reader.Read<uint32_t>() != __Capture::Version)
+				throw std::runtime_error("Not a capture file or unsupported version");
+
+			auto process = [&](uint32_t id) {
+				std::shared_ptr<__ReplayProcess>& p = Processes[id];
+				if (p == nullptr) {
+					p = std::shared_ptr<__ReplayProcess>(new __ReplayProcess());
+					p->Replay = this;
+				}
+				return p;
+			};
+
+			while (!reader.End()) {
+				__ReplayEvent e = {};
+				e.Op = reader.Read<__CaptureOp>();
+				switch (e.Op) {
+				case __CaptureOp::RESOURCE:
+				{
+					uint32_t id = reader.Read<uint32_t>();
+					if (reader.Read<uint8_t>() != 0) {
+						VkDeviceSize size = reader.Read<uint64_t>();
+						VkBufferUsageFlags usage = reader.Read<uint32_t>();
+						Resources[id] = device->CreateBuffer(size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+					}
+					else {
+						uint32_t f[8];
+						memcpy(f, reader.Skip(sizeof(f)), sizeof(f));
+						Resources[id] = device->CreateImage((VkImageType)f[0], (VkFormat)f[1], VkExtent3D{ f[2], f[3], f[4] }, f[5], f[6], f[7]);
+					}
+					continue;
+				}
+				case __CaptureOp::PIPELINE:
+				case __CaptureOp::GRAPHICS_PIPELINE:
+				{
+					uint32_t id = reader.Read<uint32_t>();
+					bool graphics = e.Op == __CaptureOp::GRAPHICS_PIPELINE;
+					uint32_t fields[4] = { };
+					if (graphics)
+						memcpy(fields, reader.Skip(sizeof(fields)), sizeof(fields));
+					ShaderStageDescription stages[2] = { };
+					std::string entryPoints[2];
+					std::vector<unsigned int> code[2];
+					for (int stage = 0; stage < (graphics ? 2 : 1); stage++) {
+						uint16_t length = reader.Read<uint16_t>();
+						entryPoints[stage] = std::string((const char*)reader.Skip(length), length);
+						stages[stage].EntryPoint = entryPoints[stage].c_str();
+						code[stage].resize(reader.Read<uint32_t>());
+						memcpy(code[stage].data(), reader.Skip(code[stage].size() * sizeof(unsigned int)), code[stage].size() * sizeof(unsigned int));
+						stages[stage].Code = code[stage].data();
+						stages[stage].Size = code[stage].size() * sizeof(unsigned int);
+						stages[stage].ConstantsSize = reader.Read<uint32_t>();
+						stages[stage].Constants = reader.Skip(stages[stage].ConstantsSize);
+					}
+					if (graphics) {
+						GraphicsPipelineDescription description = {};
+						description.Vertex = stages[0];
+						description.Fragment = stages[1];
+						description.Topology = (PrimitiveTopology)fields[0];
+						description.RenderTargetFormat = (FormatHandle)fields[1];
+						description.DepthStencilFormat = (FormatHandle)fields[2];
+						description.CullBackFaces = fields[3] != 0;
+						Pipelines[id] = device->CreateGraphicsPipeline(description);
+					}
+					else {
+						ComputePipelineDescription description = {};
+						description.Shader = stages[0];
+						Pipelines[id] = device->CreateComputePipeline(description);
+					}
+					continue;
+				}
+				case __CaptureOp::PROCESS:
+				{
+					std::shared_ptr<__ReplayProcess> p = process(reader.Read<uint32_t>());
+					p->Size = reader.Read<uint32_t>();
+					p->Commands = reader.Skip(p->Size);
+					continue;
+				}
+				case __CaptureOp::DISPATCH:
+				{
+					e.Time = reader.Read<uint64_t>();
+					e.Id = reader.Read<uint32_t>();
+					e.Mode = (DispatchMode)reader.Read<uint8_t>();
+					std::shared_ptr<__ReplayProcess> p = process(e.Id);
+					p->Engines = (EngineType)reader.Read<uint32_t>();
+					uint16_t length = reader.Read<uint16_t>();
+					std::string name((const char*)reader.Skip(length), length);
+					p->ProcessName = device->_ReplayNames.insert(name).first->c_str();
+					break;
+				}
+				case __CaptureOp::FLUSH:
+				{
+					e.Time = reader.Read<uint64_t>();
+					e.Id = reader.Read<uint32_t>();
+					e.Tasks.resize(reader.Read<uint32_t>());
+					for (uint32_t& t : e.Tasks)
+						t = reader.Read<uint32_t>();
+					e.Waits.resize(reader.Read<uint32_t>());
+					for (uint32_t& w : e.Waits)
+						w = reader.Read<uint32_t>();
+					break;
+				}
+				case __CaptureOp::BEGIN_FRAME:
+				case __CaptureOp::END_FRAME:
+					e.Time = reader.Read<uint64_t>();
+					break;
+				default:
+					throw std::runtime_error("Corrupted capture, unknown record");
+				}
+				Events.push_back(e);
+			}
+		}
 	}
 }
\ No newline at end of file
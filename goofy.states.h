@@ -3,11 +3,15 @@
 
 #pragma region Includes
 
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
+#endif
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#ifdef _WIN32
 #define GLFW_EXPOSE_NATIVE_WIN32
 #include <GLFW/glfw3native.h>
+#endif
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -25,6 +29,28 @@ namespace goofy {
 
 		VkImageUsageFlagBits __Convert(const ImageUsage& usage);
 
+		VkBufferUsageFlagBits __Convert(const BufferUsage& usage);
+
+		/// <summary>
+		/// Gets the size in bytes of a single texel of the format, or of a block for block compressed formats.
+		/// </summary>
+		int __TexelSize(VkFormat format);
+
+		/// <summary>
+		/// Gets the width and height in texels of the blocks of the format, 1 for uncompressed formats.
+		/// </summary>
+		int __BlockExtent(VkFormat format);
+
+		/// <summary>
+		/// Gets the size in bytes of the first mip level (all array slices) of an image, tightly packed.
+		/// </summary>
+		VkDeviceSize __ImageSize(const VkImageCreateInfo& description);
+
+		/// <summary>
+		/// Gets the SPIR-V image format shaders access storage images of the format with, 0 (Unknown) if the format is not supported.
+		/// </summary>
+		unsigned int __StorageImageFormat(VkFormat format);
+
 #pragma endregion
 
 		enum class WorkPieceState {
@@ -33,6 +59,10 @@ namespace goofy {
 			SUBMITTED
 		};
 
+		struct __Capture;
+		struct __Replay;
+		struct __DestructionQueue;
+
 		struct WorkPiece {
 			std::shared_ptr<Process> GraphicProcess = nullptr;
 			DispatchMode Dispatch = DispatchMode::MAIN_THREAD;
@@ -41,6 +71,9 @@ namespace goofy {
 			WorkPieceState State = WorkPieceState::DISPATCHED;
 			std::mutex mutex;
 			OneTimeSemaphore AfterPopulated;
+			// Capture the commands of the process are written to, null if the device is not capturing
+			std::shared_ptr<__Capture> Capture = nullptr;
+			uint32_t CaptureId = 0;
 
 			WorkPiece();
 
@@ -63,6 +96,14 @@ namespace goofy {
 			VkSemaphore GPUFinished = nullptr;
 			std::vector<std::shared_ptr<__GPUTask>> children;
 			bool finished = false;
+			/// <summary>
+			/// Optional action forcing the submission of deferred work (e.g. streamed uploads) before waiting on this task.
+			/// </summary>
+			std::function<void()> Resolve = nullptr;
+			/// <summary>
+			/// Set while the deferred work still has parts to submit, children are complete once it is cleared.
+			/// </summary>
+			std::atomic<bool> Deferred = { false };
 
 			__GPUTask();
 
@@ -70,6 +111,11 @@ namespace goofy {
 
 			void Wait();
 
+			/// <summary>
+			/// Checks without blocking if the task has finished on the gpu.
+			/// </summary>
+			bool Poll();
+
 			static std::shared_ptr<__GPUTask> CreateSingle(VkDevice device, bool empty);
 
 			static std::shared_ptr<__GPUTask> Union(int count, std::shared_ptr<__GPUTask>* tasks);
@@ -78,22 +124,334 @@ namespace goofy {
 		};
 
 		struct __CPUTask {
+			// Device the waits are counted for
+			VkDevice device = nullptr;
 			std::shared_ptr<WorkPiece> workPiece;
 			void Wait();
 		};
 
+		/// <summary>
+		/// Records of capture files. A capture starts with the magic "GOOFYCAP" and the version, followed by records of an opcode and its fields.
+		/// Frame records carry the time in nanoseconds since the capture started. Commands recorded by a process are written
+		/// as a whole in a PROCESS record once the process has been populated.
+		/// </summary>
+		enum class __CaptureOp : uint8_t {
+			// id, is buffer, buffer size and usage or image type, format, extent, mips, layers and usage
+			RESOURCE = 1,
+			// id, size in bytes, commands
+			PROCESS = 2,
+			// time, id, mode, engines, name
+			DISPATCH = 3,
+			// time, id, processes flushed, flushes waited
+			FLUSH = 4,
+			BEGIN_FRAME = 5,
+			END_FRAME = 6,
+			// id, entry point, code size in words, code, constants size in bytes, constants
+			PIPELINE = 7,
+			// id, topology, render target format, depth format, cull back faces, then the vertex and fragment shaders as above
+			GRAPHICS_PIPELINE = 8,
+
+			// Commands
+			// resource, mips and layers range, color
+			CLEAR = 16,
+			// engine, count, constants
+			PUSH = 17,
+			// resource, mips and layers range
+			GENERATE_MIPS = 18,
+			// pipeline
+			BIND_PIPELINE = 19,
+			// groups x, y and z
+			COMPUTE = 20,
+			// resource, offset
+			COMPUTE_INDIRECT = 21,
+			// render target, depth buffer or 0
+			BEGIN_RENDERING = 22,
+			END_RENDERING = 23,
+			// resource
+			INDICES = 24,
+			// instances, count, planes, draws
+			CULL = 25,
+			// draws, max draws
+			DRAW_INDIRECT = 26,
+			// command name. Recorded without capture support (e.g. uploads, readbacks), skipped and counted by replays
+			UNSUPPORTED = 27
+		};
+
+		/// <summary>
+		/// Plain values appended to a growing block of bytes.
+		/// </summary>
+		struct __CaptureStream {
+			std::vector<unsigned char> Bytes;
+
+			void Write(const void* data, size_t size) {
+				const unsigned char* bytes = (const unsigned char*)data;
+				Bytes.insert(Bytes.end(), bytes, bytes + size);
+			}
+
+			template<typename T>
+			void Write(const T& value) {
+				Write(&value, sizeof(T));
+			}
+		};
+
+		/// <summary>
+		/// Reads plain values from a block of bytes. Throws if reading past the end.
+		/// </summary>
+		struct __CaptureReader {
+			const unsigned char* Data;
+			size_t Size;
+			size_t Position = 0;
+
+			__CaptureReader(const unsigned char* data, size_t size) : Data(data), Size(size) { }
+
+			bool End() const {
+				return Position >= Size;
+			}
+
+			const unsigned char* Skip(size_t size) {
+				if (size > Size - Position)
+					throw std::runtime_error("Truncated capture");
+				const unsigned char* bytes = Data + Position;
+				Position += size;
+				return bytes;
+			}
+
+			template<typename T>
+			T Read() {
+				T value;
+				memcpy(&value, Skip(sizeof(T)), sizeof(T));
+				return value;
+			}
+		};
+
+		/// <summary>
+		/// Ranges (bindings) of the descriptor heap.
+		/// </summary>
+		enum class __HeapRange : int {
+			SAMPLED_IMAGES = 0,
+			STORAGE_IMAGES = 1,
+			STORAGE_BUFFERS = 2,
+			SAMPLERS = 3
+		};
+
+		/// <summary>
+		/// Descriptor set shared by all pipelines of the device. Resources take stable indices in its arrays when created
+		/// and processes pass those indices through push constants, so no descriptor set is allocated or updated per draw.
+		/// </summary>
+		struct __BindlessHeap {
+			static constexpr int Ranges = 4;
+			static constexpr uint32_t MaxPushConstants = 128;
+
+			VkDevice device;
+			VkDescriptorSetLayout Layout = nullptr;
+			VkDescriptorPool Pool = nullptr;
+			VkDescriptorSet Set = nullptr;
+			// Layout every pipeline is created with: the heap and the push constants block.
+			VkPipelineLayout PipelineLayout = nullptr;
+			uint32_t PushConstantsSize;
+			uint32_t Capacity[Ranges];
+			__DestructionQueue* Destruction;
+
+			std::mutex mutex;
+			uint32_t allocated[Ranges] = { };
+			std::vector<uint32_t> free[Ranges];
+			// Released indices with their retirement flag. Reused once the submissions that could reference them finished.
+			std::deque<std::pair<std::shared_ptr<std::atomic<bool>>, uint32_t>> retired[Ranges];
+
+			/// <summary>
+			/// Capacities are clamped to the update-after-bind limits, every range of the heap is updated after bind.
+			/// </summary>
+			__BindlessHeap(VkDevice device, const VkPhysicalDeviceLimits& limits, const VkPhysicalDeviceDescriptorIndexingProperties& indexing, __DestructionQueue* destruction);
+
+			~__BindlessHeap();
+
+			uint32_t Allocate(__HeapRange range);
+
+			void Release(__HeapRange range, uint32_t index);
+
+			void Write(__HeapRange range, uint32_t index, VkImageView view);
+
+			void Write(uint32_t index, VkBuffer buffer);
+
+			void Write(uint32_t index, VkSampler sampler);
+		};
+
+		/// <summary>
+		/// Registered resources stored as structure of arrays and addressed by generational handles.
+		/// Arrays have a fixed capacity so command lists read them without locks while other threads register.
+		/// </summary>
+		struct __ResourcePool {
+			static const uint32_t Capacity = 1 << 16;
+
+			__DestructionQueue* Destruction;
+
+			// Hot data, read when recording
+			std::vector<std::atomic<uint16_t>> Generations;
+			std::vector<VkImage> Images;
+			std::vector<VkBuffer> Buffers;
+			std::vector<VkImageSubresourceRange> Ranges;
+			std::vector<uint32_t> SampledIndices;
+			std::vector<uint32_t> StorageIndices;
+			// Cold data, keeps registered resources alive
+			std::vector<std::shared_ptr<__Resource>> Owners;
+
+			std::mutex mutex;
+			uint32_t allocated = 0;
+			std::vector<uint32_t> free;
+			// Released slots with their retirement flag. Reused once the submissions that could reference them finished.
+			std::deque<std::pair<std::shared_ptr<std::atomic<bool>>, uint32_t>> retired;
+
+			__ResourcePool(__DestructionQueue* destruction);
+
+			uint32_t Register(std::shared_ptr<__Resource> resource);
+
+			void Release(uint32_t handle);
+
+			bool IsAlive(uint32_t handle) const {
+				return handle != 0 && Generations[handle & 0xFFFF].load(std::memory_order_relaxed) == (handle >> 16);
+			}
+
+			/// <summary>
+			/// Gets the slot of a live handle.
+			/// </summary>
+			uint32_t Slot(uint32_t handle) const {
+				if (!IsAlive(handle))
+					throw std::runtime_error("Stale or null resource handle");
+				return handle & 0xFFFF;
+			}
+		};
+
+		struct __Profiler;
+
+#ifndef GOOFY_NO_PROFILING
+		/// <summary>
+		/// Rolling window of the last GPU times (in milliseconds) of a process or engine.
+		/// </summary>
+		struct __TimingSeries {
+			static constexpr int Capacity = 256;
+			double Samples[Capacity];
+			int Count = 0;
+			int Next = 0;
+			unsigned long long Counters[4] = { };
+
+			void Add(double ms) {
+				Samples[Next] = ms;
+				Next = (Next + 1) % Capacity;
+				Count = std::min(Count + 1, Capacity);
+			}
+
+			Timing Resolve() const;
+		};
+
+		/// <summary>
+		/// Collects the timestamps resolved from retired command lists. Command lists write a pair of timestamps around every work piece
+		/// and around the whole recording.
+		/// </summary>
+		struct __Profiler {
+			// Timestamps per command list: 2 for the whole list and 2 per work piece
+			static const uint32_t WorkPieces = 256;
+
+			VkDevice device;
+			// Nanoseconds per timestamp tick
+			double period;
+			bool statistics;
+
+			std::mutex mutex;
+			std::map<std::string, __TimingSeries> processes;
+			std::map<int, __TimingSeries> engines;
+
+			__Profiler(VkDevice device, double period, bool statistics) : device(device), period(period), statistics(statistics) { }
+
+			void Record(EngineType engines, const uint64_t* timestamps, const std::vector<const char*>& names, const uint64_t* counters);
+
+			ProfileReport Report();
+		};
+#endif
+
 		struct __CommandListManager {
 			VkCommandBuffer vkCmdList;
 			EngineType SupportedEngines;
 			CommandListState State;
+			__BindlessHeap* Heap = nullptr;
+			__ResourcePool* Pool = nullptr;
+			// Bind points (as bits) the heap has been bound to in the current recording.
+			int BoundHeap = 0;
+			// Pipelines bound in the current recording, binding them again is skipped
+			const __Pipeline* BoundCompute = nullptr;
+			const __Pipeline* BoundGraphics = nullptr;
+			const __Resource* BoundIndices = nullptr;
+			// Render pass begun by the current process, null while not rendering
+			VkRenderPass RenderPass = nullptr;
+			// Capture of the process being populated and the commands it recorded so far
+			__Capture* Capture = nullptr;
+			__CaptureStream Captured;
 
 			std::shared_ptr<WorkPiece> current_work = nullptr;
 
+#ifndef GOOFY_NO_PROFILING
+			__Profiler* Profiler = nullptr;
+			VkQueryPool Timestamps = nullptr;
+			VkQueryPool Statistics = nullptr;
+			// Names of the processes profiled in the current recording, by query pair
+			std::vector<const char*> Profiled;
+
+			~__CommandListManager();
+
+			/// <summary>
+			/// Opens the queries of a work piece. Returns false if the list has no queries left and nothing was recorded.
+			/// </summary>
+			bool __BeginProfile(const char* name);
+
+			/// <summary>
+			/// Closes the queries of the last work piece, only for pieces whose begin was recorded.
+			/// </summary>
+			void __EndProfile(bool begun);
+#endif
+
 			void __Open();
 
 			void __Close();
 
 			void __Reset();
+
+			/// <summary>
+			/// Binds the descriptor heap for the engine bind point once per recording and pushes the constants.
+			/// Constants of commands replayed from their own capture record are not captured.
+			/// </summary>
+			void __Push(EngineType engine, int count, const unsigned int* constants, bool captured = true);
+
+			/// <summary>
+			/// Binds a compute or graphics pipeline unless it is bound already. Pipelines compiled asynchronously are waited for.
+			/// Graphics pipelines are bound while rendering to targets of their formats.
+			/// </summary>
+			void __Bind(const __Pipeline* pipeline, bool captured = true);
+
+			/// <summary>
+			/// Throws if a rendering has begun. Transfer and compute commands are only valid outside render passes.
+			/// </summary>
+			void __OutsideRendering(const char* operation) const;
+
+			void __Dispatch(uint32_t x, uint32_t y, uint32_t z);
+
+			void __DispatchIndirect(const __Resource* arguments, VkDeviceSize offset);
+
+			/// <summary>
+			/// Begins a render pass on a color target and an optional depth buffer, with the framebuffer cached for their views.
+			/// Previous writes are visible to the attachments and viewport and scissor cover the target.
+			/// </summary>
+			void __BeginRendering(const __Resource* target, const __Resource* depth);
+
+			/// <summary>
+			/// Ends the render pass, making the attachments visible to later commands.
+			/// </summary>
+			void __EndRendering();
+
+			void __SetIndices(const __Resource* indices);
+
+			/// <summary>
+			/// Draws the indexed commands of a draws buffer written by a cull, with the count read by the gpu when supported.
+			/// </summary>
+			void __DrawIndirect(const __Resource* draws, uint32_t maxDraws);
 		};
 
 		struct __CommandQueueManager {
@@ -101,6 +459,12 @@ namespace goofy {
 			VkQueue queue;
 			VkDevice device;
 			EngineType SupportedEngines;
+			__BindlessHeap* heap;
+			__ResourcePool* resources;
+			__Profiler* profiler;
+			// Command buffers allocated and submitted not retired yet, read by the statistics
+			std::atomic<int> allocatedBuffers = { 0 };
+			std::atomic<int> inFlightBuffers = { 0 };
 			std::vector<std::shared_ptr<__CommandListManager>> reusableCmdBuffers;
 			std::shared_ptr<__CommandListManager> recordingBuffer;
 			std::vector<std::shared_ptr<__CommandListManager>> submittedBuffers;
@@ -111,8 +475,13 @@ namespace goofy {
 			bool throwErrorIfAbandonedTasks;
 			std::mutex sync_populated;
 			std::vector<std::shared_ptr<WorkPiece>> populated = {};
+			// Task of the list being recorded, created when the list opens, and of the last submitted list (weak, so abandoned
+			// async tasks are still detected). Read by the deferred destruction under its own lock, releases may happen while the list populates.
+			std::mutex sync_task;
+			std::shared_ptr<__GPUTask> recordingTask;
+			std::weak_ptr<__GPUTask> submittedTask;
 
-			__CommandQueueManager(VkDevice device, int familyIndex, EngineType supported, VkQueue queue, bool throwErrorIfAbandonedTasks);
+			__CommandQueueManager(VkDevice device, int familyIndex, EngineType supported, VkQueue queue, bool throwErrorIfAbandonedTasks, __BindlessHeap* heap, __ResourcePool* resources, __Profiler* profiler);
 
 			~__CommandQueueManager();
 
@@ -145,6 +514,14 @@ namespace goofy {
 			void Clean();
 
 			void Populating(std::shared_ptr<WorkPiece> task, std::shared_ptr<__CommandListManager> &cmdList);
+
+			/// <summary>
+			/// Gets the task of the list being recorded, or of the last submitted one. Null if no list was opened yet.
+			/// </summary>
+			std::shared_ptr<__GPUTask> RecordingTask() {
+				std::lock_guard<std::mutex> lock(sync_task);
+				return recordingTask != nullptr ? recordingTask : submittedTask.lock();
+			}
 		};
 
 		struct __EngineManager {
@@ -160,13 +537,13 @@ namespace goofy {
 
 			__EngineManager(); // empty constructor for null initialization
 
-			__EngineManager(VkDevice device, int familyIndex, EngineType supportedEngines, int frames, int frame_async_threads, int async_threads, int queues);
+			__EngineManager(VkDevice device, int familyIndex, EngineType supportedEngines, int frames, int frame_async_threads, int async_threads, int queues, __BindlessHeap* heap, __ResourcePool* pool, __Profiler* profiler);
 			
 			~__EngineManager();
 
 			void Dispatch(std::shared_ptr<WorkPiece> workPiece);
 
-			void Flush(int frame);
+			void Flush(int frame, std::vector<std::shared_ptr<__GPUTask>>& tasks);
 
 			void WaitForCompletition(int frame);
 			
@@ -180,6 +557,87 @@ namespace goofy {
 		struct __Window {
 			void* pWindow;
 			bool IsGLFW;
+			/// <summary>
+			/// OFFLINE presenters have no window, it never closes and has no events. Time counts from Created.
+			/// </summary>
+			bool IsHeadless = false;
+			unsigned long long Created = 0;
+		};
+
+		/// <summary>
+		/// Vulkan objects released by the application, destroyed once the submissions that could be using them on the GPU have finished.
+		/// Each release captures the lists being recorded at that moment (the frame lists and the async ones, submitted later by
+		/// EndFrame or a flush). Released objects are bound on the next submission to every task still in flight and to those
+		/// captured lists, and destroyed in batches when all of them are polled finished.
+		/// </summary>
+		struct __DestructionQueue {
+			struct Entry {
+				VkObjectType Type;
+				uint64_t Handle;
+				// Kept alive until the object is destroyed (e.g. host memory imported into device memory)
+				std::shared_ptr<void> Owner;
+				// Submissions in flight and lists recording at the release, null until the next submission
+				std::shared_ptr<__GPUTask> Task;
+			};
+
+			// Command queue managers of every engine, set once the engines are created
+			std::vector<__CommandQueueManager*> Managers;
+
+			VkDevice device;
+			// Loaded with the acceleration structure extension
+			PFN_vkDestroyAccelerationStructureKHR DestroyAccelerationStructure = nullptr;
+
+			std::mutex mutex;
+			// Bound entries first, in binding order, followed by the entries released since the last submission
+			std::deque<Entry> pending;
+			size_t bound = 0;
+			// Submitted tasks not known to be finished
+			std::vector<std::shared_ptr<__GPUTask>> inFlight;
+			// Tasks of the lists recording when the unbound entries were released, the last one captured per manager
+			std::vector<std::shared_ptr<__GPUTask>> recording;
+			std::vector<__GPUTask*> captured;
+
+			// Background destruction
+			bool background;
+			std::thread worker;
+			std::condition_variable batchReady;
+			std::vector<Entry> batch;
+			bool stop = false;
+
+			// Objects destroyed since the device creation, written by the background worker
+			std::atomic<unsigned long long> Destroyed = { 0 };
+
+			__DestructionQueue(VkDevice device, bool background);
+
+			~__DestructionQueue();
+
+			void Enqueue(VkObjectType type, uint64_t handle, std::shared_ptr<void> owner = nullptr);
+
+			/// <summary>
+			/// Enqueues a marker instead of an object. The returned flag is set once the submissions that could reference
+			/// something released now (e.g. a heap index or a pool slot) have finished, so it can be reused.
+			/// </summary>
+			std::shared_ptr<std::atomic<bool>> Track();
+
+			/// <summary>
+			/// Records submitted tasks and binds the objects released since the previous submission to every task in flight
+			/// and to the lists they were released while recording, even if those are still to be submitted.
+			/// </summary>
+			void Submitted(int count, const std::shared_ptr<__GPUTask>* tasks);
+
+			/// <summary>
+			/// Destroys the objects whose submissions have finished on the GPU. Never blocks.
+			/// </summary>
+			void Retire();
+
+			/// <summary>
+			/// Destroys all pending objects. The device must be idle.
+			/// </summary>
+			void DestroyAll();
+
+			void Destroy(const Entry& entry);
+
+			static void __Work(__DestructionQueue* _this);
 		};
 
 		struct __ResourceData {
@@ -193,9 +651,24 @@ namespace goofy {
 
 			VkDeviceMemory Memory = nullptr;
 
+			// Layout the image was left by the last transition recorded by the library.
+			VkImageLayout Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
 			VkBuffer UploadingStaging = nullptr;
 			VkBuffer DownloadingStaging = nullptr;
 
+			// Bytes of Memory, accounted in the device statistics
+			VkDeviceSize MemorySize = 0;
+
+			// Capture session (high bits) and id (low bits) the resource was written with
+			std::atomic<uint64_t> CaptureKey = { 0 };
+
+			// Owner of the host memory imported in Memory, must outlive it
+			std::shared_ptr<void> HostMemory = nullptr;
+
+			// Swapchain image, its layout belongs to the presentation engine
+			bool Swapchain = false;
+
 			__ResourceData(__Device* device, VkImage image, VkDeviceMemory memory) :device(device), IsBuffer(false), Image(image), Memory(memory) {}
 			__ResourceData(__Device* device, VkBuffer buffer, VkDeviceMemory memory) :device(device), IsBuffer(true), Buffer(buffer), Memory(memory) {}
 			~__ResourceData();
@@ -235,6 +708,17 @@ namespace goofy {
 				ImageSliceDescription ImageSlice;
 			};
 
+			// Indices in the descriptor heap
+			uint32_t SampledIndex = Resource::NoIndex;
+			uint32_t StorageIndex = Resource::NoIndex;
+
+			// Sampler of textures
+			VkSampler Sampler = nullptr;
+			uint32_t SamplerIndex = Resource::NoIndex;
+
+			// Views of slices and textures (and their heap indices) belong to the device view cache
+			bool CachedView = false;
+
 			__Resource(__Device* device, const VkImageCreateInfo& description, VkImage image, VkImageView view) :
 				device(device),
 				IsBuffer(false),
@@ -248,9 +732,171 @@ namespace goofy {
 				ImageSlice.mip_count = description.mipLevels;
 			}
 
+			__Resource(__Device* device, const VkImageCreateInfo& description, VkImage image, VkDeviceMemory memory, VkImageView view, VkImageViewType viewType) :
+				device(device),
+				IsBuffer(false),
+				ImageDescription(description),
+				_Data(std::shared_ptr<__ResourceData>(new __ResourceData(device, image, memory))),
+				ImageView(view)
+			{
+				ImageSlice.ImageType = viewType;
+				ImageSlice.array_start = 0;
+				ImageSlice.array_count = description.arrayLayers;
+				ImageSlice.mip_start = 0;
+				ImageSlice.mip_count = description.mipLevels;
+			}
+
+			__Resource(__Device* device, const VkBufferCreateInfo& description, VkBuffer buffer, VkDeviceMemory memory) :
+				device(device),
+				IsBuffer(true),
+				BufferDescription(description),
+				_Data(std::shared_ptr<__ResourceData>(new __ResourceData(device, buffer, memory))),
+				BufferView(nullptr)
+			{
+				BufferSlice.TexelFormat = VK_FORMAT_UNDEFINED;
+				BufferSlice.offset = 0;
+				BufferSlice.size = (int)description.size;
+			}
+
+			/// <summary>
+			/// Creates a slice or texture of an image sharing its data, with a view from the device cache.
+			/// </summary>
+			__Resource(const __Resource& source, const ImageSliceDescription& slice, VkImageView view, uint32_t sampledIndex, uint32_t storageIndex) :
+				device(source.device),
+				IsBuffer(false),
+				ImageDescription(source.ImageDescription),
+				_Data(source._Data),
+				ImageView(view),
+				SampledIndex(sampledIndex),
+				StorageIndex(storageIndex),
+				CachedView(true)
+			{
+				ImageSlice = slice;
+			}
+
 			~__Resource();
 		};
 
+		/// <summary>
+		/// State of a structure whose vertices move. Updates write the geometry of a frame to its slot of a host visible staging
+		/// buffer: positions of hardware structures, the whole structure (nodes and triangles) of software ones.
+		/// </summary>
+		struct __DynamicGeometry {
+			// Mesh the structure was built for, without positions. Indices point to the copy below.
+			MeshDescription Mesh;
+			std::vector<unsigned int> Indices;
+			float RebuildThreshold;
+			// SAH cost of the BVH when it was last built
+			float BuiltCost = 0;
+			unsigned int Rebuilds = 0;
+			unsigned long long UpdatedFrame = ~0ull;
+			std::shared_ptr<__Resource> Staging;
+			unsigned char* Mapped = nullptr;
+			VkDeviceSize SlotSize = 0;
+			// Hardware structures: indices after the slots and scratch memory for a full build
+			VkDeviceSize IndexOffset = 0;
+			std::shared_ptr<__Resource> Scratch;
+			// Software structures: nodes reserved in the storage, a rebuilt BVH can have more nodes than the first one
+			size_t NodeCapacity = 0;
+		};
+
+		/// <summary>
+		/// Bottom level acceleration structure, or a BVH built on the CPU when the device has no acceleration structures.
+		/// </summary>
+		struct __AccelerationStructure {
+			__Device* device;
+			bool Software = false;
+			VkAccelerationStructureKHR Structure = nullptr;
+			// Buffer the structure lives in, shared with the structures built in the same call
+			std::shared_ptr<__Resource> Storage;
+			// Bytes in the storage of hardware structures, index of the root node (32-byte nodes) of software ones
+			VkDeviceSize Offset = 0;
+			VkDeviceSize Size = 0;
+			VkDeviceAddress Address = 0;
+			// Hierarchy of software and dynamic structures, kept on the CPU
+			BVH Tree;
+			std::unique_ptr<__DynamicGeometry> Dynamic;
+
+			~__AccelerationStructure();
+		};
+
+		struct __ViewKey {
+			VkImage Image;
+			VkImageViewType Type;
+			VkFormat Format;
+			int mip_start;
+			int mip_count;
+			int array_start;
+			int array_count;
+
+			bool operator<(const __ViewKey& other) const {
+				return std::tie(Image, Type, Format, mip_start, mip_count, array_start, array_count) <
+					std::tie(other.Image, other.Type, other.Format, other.mip_start, other.mip_count, other.array_start, other.array_count);
+			}
+		};
+
+		struct __CachedView {
+			VkImageView View;
+			uint32_t SampledIndex;
+			uint32_t StorageIndex;
+		};
+
+		struct __SamplerKey {
+			VkFilter MinFilter;
+			VkFilter MagFilter;
+			VkSamplerMipmapMode MipFilter;
+			VkSamplerAddressMode AddressU;
+			VkSamplerAddressMode AddressV;
+			VkSamplerAddressMode AddressW;
+			float MipLodBias;
+			float MaxAnisotropy;
+			float MinLod;
+			float MaxLod;
+
+			bool operator<(const __SamplerKey& other) const {
+				return std::tie(MinFilter, MagFilter, MipFilter, AddressU, AddressV, AddressW, MipLodBias, MaxAnisotropy, MinLod, MaxLod) <
+					std::tie(other.MinFilter, other.MagFilter, other.MipFilter, other.AddressU, other.AddressV, other.AddressW, other.MipLodBias, other.MaxAnisotropy, other.MinLod, other.MaxLod);
+			}
+		};
+
+		struct __CachedSampler {
+			VkSampler Sampler;
+			uint32_t Index;
+		};
+
+		/// <summary>
+		/// Image views keyed by image and subresource range, and samplers keyed by state.
+		/// Views live until their image is destroyed and samplers until the device is.
+		/// </summary>
+		struct __ViewCache {
+			__Device* device;
+			bool SupportsAnisotropy;
+			float MaxAnisotropy;
+
+			std::mutex mutex;
+			// Ordered by image first, so all views of an image are contiguous
+			std::map<__ViewKey, __CachedView> views;
+			std::map<__SamplerKey, __CachedSampler> samplers;
+
+			// Objects created since the device creation
+			unsigned long long CreatedViews = 0;
+			unsigned long long CreatedSamplers = 0;
+
+			__ViewCache(__Device* device, bool supportsAnisotropy, float maxAnisotropy) :
+				device(device), SupportsAnisotropy(supportsAnisotropy), MaxAnisotropy(maxAnisotropy) { }
+
+			~__ViewCache();
+
+			__CachedView FetchView(const __Resource* image, const ImageSliceDescription& slice);
+
+			__CachedSampler FetchSampler(const __SamplerKey& key);
+
+			/// <summary>
+			/// Destroys the views of an image that is being destroyed.
+			/// </summary>
+			void Invalidate(VkImage image);
+		};
+
 		class CleaningProcess : public Process {
 
 		public:
@@ -263,63 +909,663 @@ namespace goofy {
 			}
 		};
 
-		struct __Pipeline {};
+		/// <summary>
+		/// Pending upload of user data to a resource. Chunks are taken from it every frame until all bytes are scheduled.
+		/// </summary>
+		struct __UploadRequest {
+			std::shared_ptr<__Resource> Destination;
+			const unsigned char* Data;
+			VkDeviceSize Size;
+			VkDeviceSize Offset; // Offset in the destination buffer
+			VkDeviceSize RowPitch; // Images are split in whole rows (of blocks for compressed formats). 0 for buffers.
+			VkDeviceSize Alignment; // Alignment of the chunks in the staging ring.
+			// Buffer the data is copied from directly (e.g. imported host memory) instead of the staging ring.
+			std::shared_ptr<__Resource> Source = nullptr;
+			VkDeviceSize SourceOffset = 0;
+			// Keeps the data alive (e.g. a mapped file) until the copies finished.
+			std::shared_ptr<void> Owner = nullptr;
+			// Writes the bytes [offset, offset + size) of the upload to the staging memory instead of copying Data
+			// (e.g. encoding blocks). Called by the thread populating the batch.
+			std::function<void(VkDeviceSize, VkDeviceSize, unsigned char*)> Produce = nullptr;
+			VkDeviceSize Scheduled = 0;
+			VkDeviceSize Submitted = 0;
+			std::shared_ptr<__GPUTask> Task;
+		};
 
-		struct __Device {
-			// Vulkan objects
-			VkInstance _Instance = nullptr;
-			VkSurfaceKHR _Surface = nullptr;
-			VkPhysicalDevice _PhysicalDevice = nullptr;
-			VkDevice _Device = nullptr;
-			VkSwapchainKHR _Swapchain = nullptr;
+		struct __UploadChunk {
+			std::shared_ptr<__UploadRequest> Request;
+			VkDeviceSize SourceOffset;
+			VkDeviceSize StagingOffset;
+			VkDeviceSize Size;
+		};
 
-			// Frames and async info
-			int _FrameIndex;
-			int _NumberOfFrames;
-			int _NumberOfAsyncThreadsInFrame;
-			int _NumberOfAsyncThreads;
+		/// <summary>
+		/// Process copying a batch of chunks to the staging region and recording the copies on the transfer engine.
+		/// </summary>
+		class __UploadBatchProcess : public Process {
+		public:
+			__StreamingUploader* Uploader;
+			int Region;
+			std::vector<__UploadChunk> Chunks;
 
-			// Swapchain state
-			unsigned int _ImageIndex;
-			VkExtent2D _RT_Resolution;
-			std::vector<Texture2D> _RenderTargets;
+			EngineType RequiredEngines() override {
+				return EngineType::TRANSFER;
+			}
 
-			// Window
-			std::shared_ptr<__Window> _Window = nullptr;
+			void Populate(goofy::CommandListManager manager) override;
+		};
 
-			VkFormat PresentationFormat;
-			std::vector<VkSemaphore> ImageReadyToRender;
-			std::vector<VkSemaphore> ImageReadyToPresent;
+		/// <summary>
+		/// Streams uploads through a persistently mapped staging ring with one region per frame-in-fly.
+		/// Every frame at most one region (the upload budget) is filled and dispatched asynchronously to the transfer engine.
+		/// </summary>
+		struct __StreamingUploader {
+			__Device* device;
+			std::shared_ptr<__Resource> Staging;
+			unsigned char* StagingMapped = nullptr;
+			VkDeviceSize Budget;
+			int Regions;
+			int CurrentRegion = 0;
+
+			std::recursive_mutex mutex;
+			std::deque<std::shared_ptr<__UploadRequest>> pending;
+			// Tasks using each region of the staging ring. Must be finished before the region is reused.
+			std::vector<std::vector<std::shared_ptr<__GPUTask>>> regionTasks;
+			// Requests submitted in each region, kept alive with their sources until the region is reused.
+			std::vector<std::vector<std::shared_ptr<__UploadRequest>>> regionRequests;
+			// Last batch dispatched but not flushed yet.
+			std::shared_ptr<__UploadBatchProcess> dispatchedBatch = nullptr;
+			std::shared_ptr<__CPUTask> dispatchedTask = nullptr;
+			// Last submitted batch. Batches are chained on the gpu to keep chunks of a resource in order.
+			std::shared_ptr<__GPUTask> lastSubmitted = nullptr;
+
+			__StreamingUploader(__Device* device, VkDeviceSize budget, int regions);
+
+			~__StreamingUploader();
 
-			std::vector<__EngineManager*> _Engines; // One engine for each Family Queue: Present, Transfer, Compute, Graphics
+			/// <summary>
+			/// Enqueues an upload and returns the task signaled when all its chunks are done on the gpu.
+			/// If a source buffer is given, chunks are copied from it on the gpu and data is not touched.
+			/// </summary>
+			std::shared_ptr<__GPUTask> Enqueue(std::shared_ptr<__Resource> destination, const void* data, VkDeviceSize size, VkDeviceSize offset,
+				std::shared_ptr<__Resource> source = nullptr, VkDeviceSize sourceOffset = 0, std::shared_ptr<void> owner = nullptr,
+				std::function<void(VkDeviceSize, VkDeviceSize, unsigned char*)> produce = nullptr);
 
-			std::vector<std::thread> _OompaLoompas;
-			bool _disposed = false;
+			/// <summary>
+			/// Submits previous batch and schedules a new one within the budget. Should be called once per frame.
+			/// </summary>
+			void Pump();
 
-			int _engine_mapping[16] = { -1, -1, -1, -1, -1, -1, -1, -1,-1, -1, -1, -1,-1, -1, -1, -1 };
+			/// <summary>
+			/// Submits all chunks of a request ignoring the budget. Used when the request is waited.
+			/// </summary>
+			void Drain(std::weak_ptr<__UploadRequest> request);
 
-			std::shared_ptr<ProducerConsumerQueue<std::shared_ptr<WorkPiece>>> _AsyncProcesses;
-			std::shared_ptr<ProducerConsumerQueue<std::shared_ptr<WorkPiece>>> _FrameAsyncProcesses;
+			/// <summary>
+			/// Waits for all scheduled work and releases the staging ring.
+			/// </summary>
+			void Finish();
 
-			int __MainRenderingEngineIndex;
-			int __PresentingEngineIndex;
+			void Record(goofy::CommandListManager manager, __UploadBatchProcess* batch);
 
-			inline int NumberOfFrames() {
-				return _NumberOfFrames;
-			}
+		private:
+			void __ScheduleBatch();
 
-			void __create_vk_instance(const PresenterDescription& description) {
-				// Create Window if necessary
-				switch (description.mode) {
-				case PresenterCreationMode::NEW_GLFW_WINDOW:
-				case PresenterCreationMode::EXISTING_GLFW_WINDOW:
-				{
-					GLFWwindow* window = nullptr;
-					if (description.mode == PresenterCreationMode::NEW_GLFW_WINDOW) {
-						glfwInit();
-						glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-						glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-						window = glfwCreateWindow(description.resolution.width, description.resolution.height, description.window_name.data(), nullptr, nullptr);
+			void __FlushBatch();
+		};
+
+		/// <summary>
+		/// Host visible buffer readbacks are copied to. Recycled by the device when its readback is released.
+		/// </summary>
+		struct __ReadbackBuffer {
+			std::shared_ptr<__Resource> Buffer;
+			const unsigned char* Mapped;
+			VkDeviceSize Capacity;
+			// Task of the last readback using the buffer. The buffer can be reused once it finished.
+			std::shared_ptr<__GPUTask> LastUse = nullptr;
+		};
+
+		struct __Readback {
+			__Device* device;
+			std::shared_ptr<__Resource> Source;
+			VkDeviceSize Offset;
+			VkDeviceSize Size;
+			std::shared_ptr<__ReadbackBuffer> Staging;
+			// Completes with the submission copying after the command lists of the frame.
+			std::shared_ptr<__GPUTask> Task;
+			std::atomic<bool> Submitted = { false };
+
+			~__Readback();
+
+			bool IsReady();
+
+			void Wait();
+
+			void Record(goofy::CommandListManager manager);
+		};
+
+		class __ReadbackProcess : public Process {
+		public:
+			std::vector<std::shared_ptr<__Readback>> Readbacks;
+
+			EngineType RequiredEngines() override {
+				return GraphicsManager::SupportedEngines;
+			}
+
+			void Populate(goofy::CommandListManager manager) override;
+		};
+
+		/// <summary>
+		/// Frame read back from the render target travelling through the output pipeline.
+		/// </summary>
+		struct __FrameJob {
+			long long Frame;
+			std::shared_ptr<__Readback> Readback;
+			std::vector<unsigned char> Encoded;
+			// Encoding failed, the frame is not written
+			bool Failed = false;
+		};
+
+		/// <summary>
+		/// Writes presented frames to disk. Readbacks are encoded by a pool of threads and a single writer thread saves them in frame order.
+		/// The number of frames in the pipeline is bounded, so the presenter only blocks when encoders fall behind.
+		/// </summary>
+		struct __FrameWriter {
+			std::string Path;
+			FrameOutputFormat Format;
+			PixelLayout Layout;
+			bool SRGB;
+			int Width;
+			int Height;
+			long long FrameCount = 0;
+
+			// Free places in the pipeline
+			Semaphore slots;
+			ProducerConsumerQueue<std::shared_ptr<__FrameJob>> jobs;
+			std::mutex mutex;
+			std::condition_variable encoded;
+			// Encoded frames waiting for previous frames to be written
+			std::map<long long, std::shared_ptr<__FrameJob>> completed;
+			long long written = 0;
+			bool closing = false;
+			std::string error;
+			std::vector<std::thread> encoders;
+			std::thread writer;
+
+			__FrameWriter(const FrameOutputDescription& description, VkFormat format, VkExtent2D resolution, int framesInFly);
+
+			~__FrameWriter();
+
+			/// <summary>
+			/// Enqueues a submitted readback of the next frame. Blocks if the pipeline is full.
+			/// </summary>
+			void Push(std::shared_ptr<__Readback> readback);
+
+			/// <summary>
+			/// Waits for all frames to be written and stops the threads.
+			/// </summary>
+			void Close();
+
+		private:
+			static void __Encoding(__FrameWriter* _this);
+
+			static void __Writing(__FrameWriter* _this);
+		};
+
+		/// <summary>
+		/// Writes the work of a device to a capture file. Frame records are written by the thread driving the device,
+		/// commands are buffered by each command list while populating, so capturing never serializes the workers.
+		/// Resources are written the first time a captured command references them.
+		/// </summary>
+		struct __Capture {
+			static constexpr uint32_t Version = 1;
+			// Distinguishes resources written by previous captures
+			static std::atomic<uint32_t> Sessions;
+
+			FILE* File;
+			uint32_t Session;
+			unsigned long long Start;
+
+			std::mutex mutex;
+			__CaptureStream Record;
+			uint32_t NextResource = 0;
+			uint32_t NextProcess = 0;
+			uint32_t NextFlush = 0;
+			// Ids of the tasks returned by captured flushes, to capture the gpu waits of later flushes
+			std::map<__GPUTask*, std::pair<std::weak_ptr<__GPUTask>, uint32_t>> Flushes;
+
+			__Capture(FILE* file);
+
+			~__Capture();
+
+			/// <summary>
+			/// Writes the pending records and closes the file. Later records are discarded.
+			/// </summary>
+			void Close();
+
+			/// <summary>
+			/// Gets the id of a resource, writing it if referenced for the first time.
+			/// </summary>
+			uint32_t Resource(const __Resource* resource);
+
+			/// <summary>
+			/// Writes a dispatch and gets the id its commands are captured with.
+			/// </summary>
+			uint32_t Dispatch(Process* process, DispatchMode mode);
+
+			/// <summary>
+			/// Writes the commands recorded by a populated process and clears them.
+			/// </summary>
+			void Populated(uint32_t id, __CaptureStream& commands);
+
+			void Flush(int count, std::shared_ptr<__CPUTask>* tasks, int waitingCount, std::shared_ptr<__GPUTask>* waitingGPU, std::shared_ptr<__GPUTask> result);
+
+			void Frame(__CaptureOp op);
+
+			void Clear(__CaptureStream& commands, const __Resource* resource, const VkImageSubresourceRange& range, const float color[4]);
+
+			static void Push(__CaptureStream& commands, EngineType engine, int count, const unsigned int* constants);
+
+			void GenerateMips(__CaptureStream& commands, const __Resource* resource, const VkImageSubresourceRange& range);
+
+			/// <summary>
+			/// Marks a command recorded without capture support, so replays report they are incomplete.
+			/// </summary>
+			static void Unsupported(__CaptureStream& commands, const char* command);
+
+			/// <summary>
+			/// Gets the id of a pipeline, writing its shaders and state if referenced for the first time.
+			/// </summary>
+			uint32_t Pipeline(const __Pipeline* pipeline);
+
+			void Bind(__CaptureStream& commands, const __Pipeline* pipeline);
+
+			void Compute(__CaptureStream& commands, uint32_t x, uint32_t y, uint32_t z);
+
+			void ComputeIndirect(__CaptureStream& commands, const __Resource* arguments, VkDeviceSize offset);
+
+			void BeginRendering(__CaptureStream& commands, const __Resource* target, const __Resource* depth);
+
+			static void EndRendering(__CaptureStream& commands);
+
+			void Indices(__CaptureStream& commands, const __Resource* indices);
+
+			void Cull(__CaptureStream& commands, const __Resource* instances, uint32_t count, const float planes[24], const __Resource* draws);
+
+			void DrawIndirect(__CaptureStream& commands, const __Resource* draws, uint32_t maxDraws);
+
+		private:
+			void __Write();
+		};
+
+		/// <summary>
+		/// Process recording again the commands captured from a process.
+		/// </summary>
+		class __ReplayProcess : public Process {
+		public:
+			__Replay* Replay;
+			EngineType Engines;
+			const char* ProcessName;
+			const unsigned char* Commands = nullptr;
+			size_t Size = 0;
+
+			EngineType RequiredEngines() override {
+				return Engines;
+			}
+
+			const char* Name() override {
+				return ProcessName;
+			}
+
+			void Populate(goofy::CommandListManager manager) override;
+		};
+
+		struct __ReplayEvent {
+			__CaptureOp Op;
+			unsigned long long Time;
+			uint32_t Id;
+			DispatchMode Mode;
+			std::vector<uint32_t> Tasks;
+			std::vector<uint32_t> Waits;
+		};
+
+		/// <summary>
+		/// Capture loaded to be replayed on a device. Captured resources are created again and every dispatched process
+		/// records its captured commands, so the replay costs the same work on the CPU and the GPU without the application.
+		/// </summary>
+		struct __Replay {
+			std::vector<unsigned char> Content;
+			std::vector<__ReplayEvent> Events;
+			std::map<uint32_t, std::shared_ptr<__ReplayProcess>> Processes;
+			std::map<uint32_t, std::shared_ptr<__Resource>> Resources;
+			std::map<uint32_t, std::shared_ptr<__Pipeline>> Pipelines;
+			// Commands without capture support skipped by the replayed processes
+			std::atomic<int> Unsupported = { 0 };
+
+			/// <summary>
+			/// Loads a capture and creates its resources. Throws if the file can not be read or is not a valid capture.
+			/// </summary>
+			__Replay(__Device* device, const char* path);
+		};
+
+		/// <summary>
+		/// Transitions images created by the library from the undefined layout to the general layout assumed by all commands.
+		/// </summary>
+		class __InitialLayoutProcess : public Process {
+		public:
+			__Device* device;
+			std::vector<std::shared_ptr<__Resource>> Images;
+
+			EngineType RequiredEngines() override {
+				return GraphicsManager::SupportedEngines;
+			}
+
+			void Populate(goofy::CommandListManager manager) override;
+		};
+
+		/// <summary>
+		/// Bottom level structures built in one call. Builds are split in batches whose scratch memory fits the scratch pool,
+		/// each batch is a single build command.
+		/// </summary>
+		struct __AccelerationStructureBuild {
+			std::vector<std::shared_ptr<__AccelerationStructure>> Structures;
+			std::vector<VkAccelerationStructureGeometryKHR> Geometries;
+			std::vector<VkAccelerationStructureBuildGeometryInfoKHR> Infos;
+			std::vector<VkAccelerationStructureBuildRangeInfoKHR> Ranges;
+			// First structure of each batch, the last entry is the number of structures
+			std::vector<int> Batches;
+			VkQueryPool CompactedSizes = nullptr;
+			std::vector<std::shared_ptr<__AccelerationStructure>> Compacted;
+		};
+
+		/// <summary>
+		/// Records the batched builds of bottom level structures followed by the query of their compacted sizes, or the copies compacting them.
+		/// </summary>
+		class __AccelerationStructureProcess : public Process {
+		public:
+			__Device* device;
+			__AccelerationStructureBuild* Build;
+			bool Compacting = false;
+
+			EngineType RequiredEngines() override {
+				return RaytracingManager::SupportedEngines;
+			}
+
+			void Populate(goofy::CommandListManager manager) override;
+		};
+
+		struct __Pipeline {
+			__Device* device;
+			VkPipeline Pipeline = nullptr;
+			VkPipelineBindPoint BindPoint;
+			// Render pass graphics pipelines are compatible with
+			VkRenderPass RenderPass = nullptr;
+
+			// Shaders (compute, or vertex and fragment) and fixed state of graphics pipelines, written to the captures that bind them
+			std::vector<unsigned int> Code[2];
+			std::string EntryPoint[2];
+			std::vector<unsigned char> Constants[2];
+			GraphicsPipelineDescription Graphics = {};
+			std::atomic<uint64_t> CaptureKey = { 0 };
+
+			// Compilation state of pipelines created asynchronously
+			std::atomic<bool> Ready = { true };
+			std::mutex mutex;
+			std::condition_variable compiled;
+			std::string Error;
+
+			__Pipeline(__Device* device, VkPipelineBindPoint bindPoint) : device(device), BindPoint(bindPoint) { }
+
+			~__Pipeline();
+
+			/// <summary>
+			/// Waits for the compilation to finish. Throws if the compilation failed.
+			/// </summary>
+			void Wait();
+
+			void __Compiled(const std::string& error);
+
+			/// <summary>
+			/// Whether the pipeline was created from the same code, entry points, constants and state.
+			/// </summary>
+			bool __Matches(const ComputePipelineDescription& description) const;
+
+			bool __Matches(const GraphicsPipelineDescription& description) const;
+
+			/// <summary>
+			/// Copies the shader of a stage to be captured.
+			/// </summary>
+			void __Keep(int stage, const ShaderStageDescription& shader);
+		};
+
+		/// <summary>
+		/// Pipeline compilation request. Shader code and entry points are copied so the description can be released by the caller.
+		/// </summary>
+		struct __PipelineJob {
+			std::shared_ptr<__Pipeline> Pipeline;
+			bool IsGraphics;
+			ComputePipelineDescription Compute;
+			GraphicsPipelineDescription Graphics;
+			std::vector<unsigned int> Code[2];
+			std::string EntryPoint[2];
+			std::vector<unsigned char> Constants[2];
+
+			void Own(ShaderStageDescription& stage, int index);
+		};
+
+		/// <summary>
+		/// Threads compiling pipelines in background. The number of threads bounds the concurrent compilations.
+		/// </summary>
+		struct __PipelineCompiler {
+			__Device* device;
+			std::vector<std::thread> workers;
+
+			std::mutex mutex;
+			std::condition_variable available;
+			std::deque<std::shared_ptr<__PipelineJob>> jobs;
+			bool stop = false;
+
+			__PipelineCompiler(__Device* device, int threads);
+
+			/// <summary>
+			/// Stops the threads. Pending compilations fail.
+			/// </summary>
+			~__PipelineCompiler();
+
+			void Enqueue(std::shared_ptr<__Pipeline> pipeline, const ComputePipelineDescription& description);
+
+			void Enqueue(std::shared_ptr<__Pipeline> pipeline, const GraphicsPipelineDescription& description);
+
+			void __Enqueue(std::shared_ptr<__PipelineJob> job);
+
+			static void __Work(__PipelineCompiler* _this);
+		};
+
+		/// <summary>
+		/// Device-wide VkPipelineCache persisted to a file. The file starts with a header identifying the device and the driver,
+		/// a cache written by another device or driver version is discarded instead of being given to the driver.
+		/// </summary>
+		struct __PipelineCache {
+			struct Header {
+				char Magic[8];
+				uint32_t Version;
+				uint32_t VendorID;
+				uint32_t DeviceID;
+				uint32_t DriverVersion;
+				uint8_t DriverUUID[VK_UUID_SIZE];
+				uint8_t CacheUUID[VK_UUID_SIZE];
+				uint64_t DataSize;
+				uint64_t DataHash;
+			};
+
+			VkDevice device;
+			VkPipelineCache Cache = nullptr;
+			std::string Path;
+			Header Identity = { };
+			// Data was loaded from the file
+			bool Warm = false;
+
+			__PipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, const char* path);
+
+			/// <summary>
+			/// Saves the cache if persistent and destroys it.
+			/// </summary>
+			~__PipelineCache();
+
+			void Save();
+		};
+
+		struct __Device {
+			// Vulkan objects
+			VkInstance _Instance = nullptr;
+			VkSurfaceKHR _Surface = nullptr;
+			VkPhysicalDevice _PhysicalDevice = nullptr;
+			VkDevice _Device = nullptr;
+			VkSwapchainKHR _Swapchain = nullptr;
+			VkPhysicalDeviceMemoryProperties _MemoryProperties;
+			std::vector<uint32_t> _FamilyIndices; // Families sharing created resources.
+
+			// Host memory import (VK_EXT_external_memory_host)
+			bool _SupportsHostImport = false;
+			VkDeviceSize _HostImportAlignment = 0;
+			PFN_vkGetMemoryHostPointerPropertiesEXT _vkGetMemoryHostPointerProperties = nullptr;
+
+			// Frames and async info
+			unsigned long long _FrameNumber = 0; // Frames ended since creation
+			int _FrameIndex;
+			int _NumberOfFrames;
+			int _NumberOfAsyncThreadsInFrame;
+			int _NumberOfAsyncThreads;
+
+			// Swapchain state
+			unsigned int _ImageIndex;
+			VkExtent2D _RT_Resolution;
+			std::vector<Texture2D> _RenderTargets;
+
+			// Window
+			std::shared_ptr<__Window> _Window = nullptr;
+
+			VkFormat PresentationFormat;
+			std::vector<VkSemaphore> ImageReadyToRender;
+			std::vector<VkSemaphore> ImageReadyToPresent;
+
+			std::vector<__EngineManager*> _Engines; // One engine for each Family Queue: Present, Transfer, Compute, Graphics
+
+			std::vector<std::thread> _OompaLoompas;
+
+			int _engine_mapping[16] = { -1, -1, -1, -1, -1, -1, -1, -1,-1, -1, -1, -1,-1, -1, -1, -1 };
+
+			std::shared_ptr<ProducerConsumerQueue<std::shared_ptr<WorkPiece>>> _AsyncProcesses;
+			std::shared_ptr<ProducerConsumerQueue<std::shared_ptr<WorkPiece>>> _FrameAsyncProcesses;
+			std::mutex _FramePiecesMutex;
+			std::vector<std::shared_ptr<WorkPiece>> _FramePieces; // Frame async pieces dispatched in the current frame
+
+			int __MainRenderingEngineIndex;
+			int __PresentingEngineIndex;
+
+			__StreamingUploader* _Uploader = nullptr;
+
+			__BindlessHeap* _Heap = nullptr;
+
+			__ViewCache* _Views = nullptr;
+
+			__ResourcePool* _Pool = nullptr;
+
+			__DestructionQueue* _Destruction = nullptr;
+
+			__PipelineCache* _PipelineCache = nullptr;
+
+			__PipelineCompiler* _PipelineCompiler = nullptr;
+
+			// GPU timings of processes and engines, null if profiling is disabled
+			__Profiler* _Profiler = nullptr;
+
+			// Bytes of memory owned by live resources
+			std::atomic<unsigned long long> _ResourceMemory = { 0 };
+
+			// Totals at the last statistics snapshot, to measure rates per frame. Statistics may be queried from any thread.
+			std::mutex _StatisticsMutex;
+			long long _StatisticsFrame = 0;
+			unsigned long long _StatisticsDispatches = 0;
+			unsigned long long _StatisticsSubmits = 0;
+
+			// Specialized pipelines by hash of their code, constants and state. Colliding hashes are told apart by the full description.
+			std::multimap<unsigned long long, std::weak_ptr<__Pipeline>> _Variants;
+			std::mutex _VariantsMutex;
+
+			// Mip generation pipelines by image format, dimension and levels per dispatch
+			std::map<unsigned int, std::shared_ptr<__Pipeline>> _Downsamplers;
+			std::mutex _DownsamplersMutex;
+			bool _SupportsStorageImageIndexing = false;
+			bool _SupportsExtendedStorageFormats = false;
+
+			// Render passes by color and depth formats, shared by the pipelines and framebuffers of those formats
+			std::map<uint64_t, VkRenderPass> _RenderPasses;
+			std::mutex _RenderPassesMutex;
+
+			// Framebuffers by render pass, color view and depth view, released with the views
+			std::map<std::tuple<VkRenderPass, VkImageView, VkImageView>, VkFramebuffer> _Framebuffers;
+			std::mutex _FramebuffersMutex;
+
+			// GPU-driven draws. Without VK_KHR_draw_indirect_count the culled draws are not compacted and all are drawn.
+			std::shared_ptr<__Pipeline> _Culler;
+			std::mutex _CullerMutex;
+			bool _SupportsStorageBufferIndexing = false;
+			bool _SupportsMultiDrawIndirect = false;
+			bool _SupportsIndirectFirstInstance = false;
+			PFN_vkCmdDrawIndexedIndirectCountKHR _vkCmdDrawIndexedIndirectCount = nullptr;
+
+			// Acceleration structures (VK_KHR_acceleration_structure). BVHs are built on the CPU when not supported.
+			bool _SupportsAccelerationStructures = false;
+			VkDeviceSize _ScratchAlignment = 256;
+			PFN_vkGetAccelerationStructureBuildSizesKHR _vkGetAccelerationStructureBuildSizes = nullptr;
+			PFN_vkCreateAccelerationStructureKHR _vkCreateAccelerationStructure = nullptr;
+			PFN_vkCmdBuildAccelerationStructuresKHR _vkCmdBuildAccelerationStructures = nullptr;
+			PFN_vkCmdWriteAccelerationStructuresPropertiesKHR _vkCmdWriteAccelerationStructuresProperties = nullptr;
+			PFN_vkCmdCopyAccelerationStructureKHR _vkCmdCopyAccelerationStructure = nullptr;
+			PFN_vkGetAccelerationStructureDeviceAddressKHR _vkGetAccelerationStructureDeviceAddress = nullptr;
+			// Scratch memory shared by all builds, grown to the largest single build when it exceeds the budget
+			static constexpr VkDeviceSize __ScratchBudget = 64 << 20;
+			std::shared_ptr<__Resource> _Scratch = nullptr;
+			std::mutex _ScratchMutex;
+
+			/// <summary>
+			/// Destroys an object once the submissions in flight that could reference it have finished.
+			/// </summary>
+			void __Defer(VkObjectType type, uint64_t handle, std::shared_ptr<void> owner = nullptr) {
+				// Objects are released before the queue is torn down, a late release would leak the object
+				assert(_Destruction != nullptr && "object released after its device was destroyed");
+				_Destruction->Enqueue(type, handle, owner);
+			}
+
+			// Readback buffers available for reuse and readbacks waiting for the frame to be submitted.
+			std::mutex _ReadbackMutex;
+			std::vector<std::shared_ptr<__ReadbackBuffer>> _ReadbackBuffers;
+			std::vector<std::shared_ptr<__Readback>> _PendingReadbacks;
+
+			__FrameWriter* _FrameWriter = nullptr;
+
+			// Capture the work is written to, null if not capturing
+			std::shared_ptr<__Capture> _Capture = nullptr;
+			// Names of replayed processes, must remain valid while the device lives
+			std::set<std::string> _ReplayNames;
+
+			inline int NumberOfFrames() {
+				return _NumberOfFrames;
+			}
+
+			void __create_vk_instance(const PresenterDescription& description) {
+				// Create Window if necessary
+				switch (description.mode) {
+				case PresenterCreationMode::NEW_GLFW_WINDOW:
+				case PresenterCreationMode::EXISTING_GLFW_WINDOW:
+				{
+					GLFWwindow* window = nullptr;
+					if (description.mode == PresenterCreationMode::NEW_GLFW_WINDOW) {
+						glfwInit();
+						glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+						glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+						window = glfwCreateWindow(description.resolution.width, description.resolution.height, description.window_name.data(), nullptr, nullptr);
 					}
 					else {
 						window = (GLFWwindow*)description.ExistingWindow;
@@ -334,6 +1580,15 @@ namespace goofy {
 					this->_Window->pWindow = window;
 					break;
 				}
+				case PresenterCreationMode::OFFLINE:
+					// Headless, render targets are plain images with the requested resolution.
+					_RT_Resolution = { description.resolution.width, description.resolution.height };
+					this->_Window = std::shared_ptr<__Window>(new __Window());
+					this->_Window->IsGLFW = false;
+					this->_Window->pWindow = nullptr;
+					this->_Window->IsHeadless = true;
+					this->_Window->Created = Tracer::Now();
+					break;
 				default:
 					throw std::runtime_error("Not supported surface creation mode");
 				}
@@ -345,7 +1600,7 @@ namespace goofy {
 				appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 				appInfo.pEngineName = nullptr;
 				appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-				appInfo.apiVersion = VK_API_VERSION_1_0;
+				appInfo.apiVersion = VK_API_VERSION_1_2;
 
 				uint32_t extensionCount = 0;                // Getting available extensions
 				const char** extensions = nullptr;
@@ -412,7 +1667,8 @@ namespace goofy {
 				int i = 0;
 				for (const auto& queueFamily : queueFamilies) {
 					VkBool32 presentSupport = false;
-					vkGetPhysicalDeviceSurfaceSupportKHR(_PhysicalDevice, i, _Surface, &presentSupport);
+					if (_Surface != nullptr)
+						vkGetPhysicalDeviceSurfaceSupportKHR(_PhysicalDevice, i, _Surface, &presentSupport);
 
 					if ((queueFamily.queueFlags & bits) == bits && (!require_present_support || presentSupport)) {
 						if (minFlag > (unsigned int)queueFamily.queueFlags)
@@ -438,16 +1694,26 @@ namespace goofy {
 				std::vector<VkPhysicalDevice> devices(deviceCount);
 				vkEnumeratePhysicalDevices(_Instance, &deviceCount, devices.data());
 
+				// Prefer discrete GPUs but fall back to any device, including software rasterizers (e.g. headless nodes)
+				int bestRank = -1;
 				for (const auto& device : devices) {
 					VkPhysicalDeviceProperties deviceProperties;
-					VkPhysicalDeviceFeatures deviceFeatures;
 					vkGetPhysicalDeviceProperties(device, &deviceProperties);
-					vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-					if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
+					int rank = 0;
+					switch (deviceProperties.deviceType) {
+					case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: rank = 4; break;
+					case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: rank = 3; break;
+					case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: rank = 2; break;
+					case VK_PHYSICAL_DEVICE_TYPE_CPU: rank = 1; break;
+					default: rank = 0; break;
+					}
+					if (rank > bestRank) {
 						_PhysicalDevice = device;
-						break;
+						bestRank = rank;
 					}
 				}
+
+				vkGetPhysicalDeviceMemoryProperties(_PhysicalDevice, &_MemoryProperties);
 			}
 
 			void ResolveEngineIndex(EngineType engines) {
@@ -471,7 +1737,56 @@ namespace goofy {
 				return (EngineType)type;
 			}
 
+			/// <summary>
+			/// Emulates the swapchain with one render target image per frame-in-fly. Frames rotate through them.
+			/// </summary>
+			void __create_offline_presenter(const PresenterDescription& description) {
+				PresentationFormat = (VkFormat)description.PresentationFormat;
+				_RenderTargets.resize(NumberOfFrames());
+				std::shared_ptr<__InitialLayoutProcess> transition = std::shared_ptr<__InitialLayoutProcess>(new __InitialLayoutProcess());
+				transition->device = this;
+				for (int i = 0; i < NumberOfFrames(); i++) {
+					_RenderTargets[i].__state = CreateImage(VK_IMAGE_TYPE_2D, PresentationFormat, VkExtent3D{ _RT_Resolution.width, _RT_Resolution.height, 1 }, 1, 1, __Convert(description.Usage));
+					transition->Images.push_back(_RenderTargets[i].__state);
+				}
+				_ImageIndex = 0;
+
+				// Recorded first in the main command list, submitted with the first frame.
+				Dispatch(transition, DispatchMode::MAIN_THREAD);
+			}
+
+			void __RecordInitialLayouts(goofy::CommandListManager manager, const std::vector<std::shared_ptr<__Resource>>& images) {
+				std::vector<VkImageMemoryBarrier> barriers;
+				for (std::shared_ptr<__Resource> image : images) {
+					if (image->_Data->Layout != VK_IMAGE_LAYOUT_UNDEFINED)
+						continue;
+					VkImageMemoryBarrier barrier{};
+					barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+					barrier.srcAccessMask = 0;
+					barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+					barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+					barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+					barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+					barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+					barrier.image = image->_Data->Image;
+					barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+					barrier.subresourceRange.baseMipLevel = 0;
+					barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+					barrier.subresourceRange.baseArrayLayer = 0;
+					barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+					barriers.push_back(barrier);
+					image->_Data->Layout = VK_IMAGE_LAYOUT_GENERAL;
+				}
+				if (barriers.size() > 0)
+					vkCmdPipelineBarrier(manager.__state->vkCmdList, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, barriers.size(), barriers.data());
+			}
+
 			void __create_presenter(const PresenterDescription& description) {
+				if (description.mode == PresenterCreationMode::OFFLINE) {
+					__create_offline_presenter(description);
+					return;
+				}
+
 				// Create swap chain
 				VkSwapchainCreateInfoKHR createInfo{};
 				createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -532,8 +1847,12 @@ namespace goofy {
 					creationInfo.format = PresentationFormat;
 					creationInfo.imageType = VK_IMAGE_TYPE_2D;
 					creationInfo.extent = VkExtent3D{ _RT_Resolution.width, _RT_Resolution.height, 1 };
+					creationInfo.usage = createInfo.imageUsage;
 
 					_RenderTargets[i].__state = std::shared_ptr<__Resource>(new __Resource(this, creationInfo, swapChainImages[i], swapChainImageViews[i]));
+					_RenderTargets[i].__state->ImageSlice.ImageType = VK_IMAGE_VIEW_TYPE_2D;
+					_RenderTargets[i].__state->_Data->Swapchain = true;
+					__RegisterInHeap(_RenderTargets[i].__state.get());
 				}
 
 				//// Create Render Pass
@@ -611,6 +1930,17 @@ namespace goofy {
 				}
 			}
 
+			bool __supports_extension(const char* name) {
+				uint32_t extensionCount = 0;
+				vkEnumerateDeviceExtensionProperties(_PhysicalDevice, nullptr, &extensionCount, nullptr);
+				std::vector<VkExtensionProperties> extensions(extensionCount);
+				vkEnumerateDeviceExtensionProperties(_PhysicalDevice, nullptr, &extensionCount, extensions.data());
+				for (const auto& extension : extensions)
+					if (strcmp(extension.extensionName, name) == 0)
+						return true;
+				return false;
+			}
+
 			void __create_vk_device(const PresenterDescription& description) {
 
 				int total_threads = 1 + description.frame_threads + description.async_threads;
@@ -643,12 +1973,112 @@ namespace goofy {
 				VkPhysicalDeviceFeatures deviceFeatures{
 				};
 
-				const std::vector<const char*> deviceExtensions = {
-					VK_KHR_SWAPCHAIN_EXTENSION_NAME
-				};
+				std::vector<const char*> deviceExtensions;
+				if (_Surface != nullptr)
+					deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+				// Assets are imported directly from mapped files when the device can use host memory
+				_SupportsHostImport = __supports_extension(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) && __supports_extension(VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME);
+				if (_SupportsHostImport) {
+					deviceExtensions.push_back(VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME);
+					deviceExtensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+
+					VkPhysicalDeviceExternalMemoryHostPropertiesEXT hostProperties{};
+					hostProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+					VkPhysicalDeviceProperties2 properties{};
+					properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+					properties.pNext = &hostProperties;
+					vkGetPhysicalDeviceProperties2(_PhysicalDevice, &properties);
+					_HostImportAlignment = hostProperties.minImportedHostPointerAlignment;
+				}
+
+				// Descriptor indexing for the bindless heap
+				VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures{};
+				indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+				VkPhysicalDeviceFeatures2 features{};
+				features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+				features.pNext = &indexingFeatures;
+				// Acceleration structures are built from inputs and scratch memory given by device addresses
+				VkPhysicalDeviceBufferDeviceAddressFeatures addressFeatures{};
+				addressFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
+				VkPhysicalDeviceAccelerationStructureFeaturesKHR accelerationFeatures{};
+				accelerationFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR;
+				bool accelerationExtensions = __supports_extension(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME) && __supports_extension(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
+				if (accelerationExtensions) {
+					indexingFeatures.pNext = &addressFeatures;
+					addressFeatures.pNext = &accelerationFeatures;
+				}
+				vkGetPhysicalDeviceFeatures2(_PhysicalDevice, &features);
+				_SupportsAccelerationStructures = accelerationExtensions && addressFeatures.bufferDeviceAddress && accelerationFeatures.accelerationStructure;
+				VkPhysicalDeviceBufferDeviceAddressFeatures enabledAddress{};
+				enabledAddress.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
+				VkPhysicalDeviceAccelerationStructureFeaturesKHR enabledAcceleration{};
+				enabledAcceleration.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR;
+				if (_SupportsAccelerationStructures) {
+					deviceExtensions.push_back(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
+					deviceExtensions.push_back(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
+					enabledAddress.bufferDeviceAddress = VK_TRUE;
+					enabledAddress.pNext = &enabledAcceleration;
+					enabledAcceleration.accelerationStructure = VK_TRUE;
+
+					VkPhysicalDeviceAccelerationStructurePropertiesKHR accelerationProperties{};
+					accelerationProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
+					VkPhysicalDeviceProperties2 properties{};
+					properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+					properties.pNext = &accelerationProperties;
+					vkGetPhysicalDeviceProperties2(_PhysicalDevice, &properties);
+					_ScratchAlignment = std::max<VkDeviceSize>(_ScratchAlignment, accelerationProperties.minAccelerationStructureScratchOffsetAlignment);
+				}
+				deviceFeatures.samplerAnisotropy = features.features.samplerAnisotropy;
+				// Storage images of the heap indexed from push constants, by mip generation among others
+				deviceFeatures.shaderStorageImageArrayDynamicIndexing = features.features.shaderStorageImageArrayDynamicIndexing;
+				deviceFeatures.shaderStorageImageExtendedFormats = features.features.shaderStorageImageExtendedFormats;
+				_SupportsStorageImageIndexing = features.features.shaderStorageImageArrayDynamicIndexing;
+				_SupportsExtendedStorageFormats = features.features.shaderStorageImageExtendedFormats;
+				// Storage buffers of the heap indexed from push constants and the indirect draws written by culling
+				deviceFeatures.shaderStorageBufferArrayDynamicIndexing = features.features.shaderStorageBufferArrayDynamicIndexing;
+				deviceFeatures.multiDrawIndirect = features.features.multiDrawIndirect;
+				deviceFeatures.drawIndirectFirstInstance = features.features.drawIndirectFirstInstance;
+				_SupportsStorageBufferIndexing = features.features.shaderStorageBufferArrayDynamicIndexing;
+				_SupportsMultiDrawIndirect = features.features.multiDrawIndirect;
+				_SupportsIndirectFirstInstance = features.features.drawIndirectFirstInstance;
+				bool drawIndirectCount = __supports_extension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+				if (drawIndirectCount)
+					deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+				deviceFeatures.pipelineStatisticsQuery = description.profiling && description.profile_pipeline_statistics && features.features.pipelineStatisticsQuery;
+				// Resources and samplers write the heap while lists using it are recorded or executing,
+				// so the heap needs every range updatable after bind and while pending
+				bool supportsHeap = indexingFeatures.descriptorBindingPartiallyBound && indexingFeatures.runtimeDescriptorArray &&
+					indexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+					indexingFeatures.descriptorBindingStorageImageUpdateAfterBind &&
+					indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind &&
+					indexingFeatures.descriptorBindingUpdateUnusedWhilePending;
+				VkPhysicalDeviceDescriptorIndexingFeatures enabledIndexing{};
+				enabledIndexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+				enabledIndexing.shaderSampledImageArrayNonUniformIndexing = indexingFeatures.shaderSampledImageArrayNonUniformIndexing;
+				enabledIndexing.shaderStorageImageArrayNonUniformIndexing = indexingFeatures.shaderStorageImageArrayNonUniformIndexing;
+				enabledIndexing.shaderStorageBufferArrayNonUniformIndexing = indexingFeatures.shaderStorageBufferArrayNonUniformIndexing;
+				enabledIndexing.descriptorBindingPartiallyBound = indexingFeatures.descriptorBindingPartiallyBound;
+				enabledIndexing.runtimeDescriptorArray = indexingFeatures.runtimeDescriptorArray;
+				enabledIndexing.descriptorBindingSampledImageUpdateAfterBind = indexingFeatures.descriptorBindingSampledImageUpdateAfterBind;
+				enabledIndexing.descriptorBindingStorageImageUpdateAfterBind = indexingFeatures.descriptorBindingStorageImageUpdateAfterBind;
+				enabledIndexing.descriptorBindingStorageBufferUpdateAfterBind = indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind;
+				enabledIndexing.descriptorBindingUpdateUnusedWhilePending = indexingFeatures.descriptorBindingUpdateUnusedWhilePending;
+
+				// GPU tasks signal timeline semaphores, core in Vulkan 1.2
+				VkPhysicalDeviceTimelineSemaphoreFeatures enabledTimeline{};
+				enabledTimeline.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+				enabledTimeline.timelineSemaphore = VK_TRUE;
+				enabledTimeline.pNext = _SupportsAccelerationStructures ? &enabledAddress : nullptr;
 
 				VkDeviceCreateInfo deviceCreateInfo{};
 				deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+				void* enabledChain = &enabledTimeline;
+				if (supportsHeap) {
+					enabledIndexing.pNext = enabledChain;
+					enabledChain = &enabledIndexing;
+				}
+				deviceCreateInfo.pNext = enabledChain;
 				deviceCreateInfo.pQueueCreateInfos = queueCreateInfos;
 				deviceCreateInfo.queueCreateInfoCount = queueFamilyCount;
 				deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
@@ -660,25 +2090,1549 @@ namespace goofy {
 					throw std::runtime_error("failed to create logical device!");
 				}
 
-				__create_presenter(description);
+				if (_SupportsHostImport)
+					_vkGetMemoryHostPointerProperties = (PFN_vkGetMemoryHostPointerPropertiesEXT)vkGetDeviceProcAddr(_Device, "vkGetMemoryHostPointerPropertiesEXT");
+				if (drawIndirectCount)
+					_vkCmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(_Device, "vkCmdDrawIndexedIndirectCountKHR");
+				PFN_vkDestroyAccelerationStructureKHR destroyAccelerationStructure = nullptr;
+				if (_SupportsAccelerationStructures) {
+					_vkGetAccelerationStructureBuildSizes = (PFN_vkGetAccelerationStructureBuildSizesKHR)vkGetDeviceProcAddr(_Device, "vkGetAccelerationStructureBuildSizesKHR");
+					_vkCreateAccelerationStructure = (PFN_vkCreateAccelerationStructureKHR)vkGetDeviceProcAddr(_Device, "vkCreateAccelerationStructureKHR");
+					destroyAccelerationStructure = (PFN_vkDestroyAccelerationStructureKHR)vkGetDeviceProcAddr(_Device, "vkDestroyAccelerationStructureKHR");
+					_vkCmdBuildAccelerationStructures = (PFN_vkCmdBuildAccelerationStructuresKHR)vkGetDeviceProcAddr(_Device, "vkCmdBuildAccelerationStructuresKHR");
+					_vkCmdWriteAccelerationStructuresProperties = (PFN_vkCmdWriteAccelerationStructuresPropertiesKHR)vkGetDeviceProcAddr(_Device, "vkCmdWriteAccelerationStructuresPropertiesKHR");
+					_vkCmdCopyAccelerationStructure = (PFN_vkCmdCopyAccelerationStructureKHR)vkGetDeviceProcAddr(_Device, "vkCmdCopyAccelerationStructureKHR");
+					_vkGetAccelerationStructureDeviceAddress = (PFN_vkGetAccelerationStructureDeviceAddressKHR)vkGetDeviceProcAddr(_Device, "vkGetAccelerationStructureDeviceAddressKHR");
+					_SupportsAccelerationStructures = _vkGetAccelerationStructureBuildSizes && _vkCreateAccelerationStructure && destroyAccelerationStructure &&
+						_vkCmdBuildAccelerationStructures && _vkCmdWriteAccelerationStructuresProperties && _vkCmdCopyAccelerationStructure && _vkGetAccelerationStructureDeviceAddress;
+				}
+
+				// Heap indices and pool slots retire through the deferred destruction
+				_Destruction = new __DestructionQueue(_Device, description.background_destruction);
+				_Destruction->DestroyAccelerationStructure = destroyAccelerationStructure;
+
+				VkPhysicalDeviceProperties properties;
+				vkGetPhysicalDeviceProperties(_PhysicalDevice, &properties);
+				if (supportsHeap) {
+					VkPhysicalDeviceDescriptorIndexingProperties indexingProperties{};
+					indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+					VkPhysicalDeviceProperties2 properties2{};
+					properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+					properties2.pNext = &indexingProperties;
+					vkGetPhysicalDeviceProperties2(_PhysicalDevice, &properties2);
+					_Heap = new __BindlessHeap(_Device, properties.limits, indexingProperties, _Destruction);
+				}
+				_Views = new __ViewCache(this, deviceFeatures.samplerAnisotropy, properties.limits.maxSamplerAnisotropy);
+				_Pool = new __ResourcePool(_Destruction);
+				_PipelineCache = new __PipelineCache(_Device, _PhysicalDevice, description.pipeline_cache);
+				_PipelineCompiler = new __PipelineCompiler(this, description.pipeline_compile_threads > 0 ? description.pipeline_compile_threads : std::max(1u, std::thread::hardware_concurrency() / 2));
+#ifndef GOOFY_NO_PROFILING
+				if (description.profiling)
+					_Profiler = new __Profiler(_Device, properties.limits.timestampPeriod, deviceFeatures.pipelineStatisticsQuery);
+#endif
 
 				_Engines.resize(queueFamilyCount);
+				_FamilyIndices.resize(queueFamilyCount);
 				for (int i = 0; i < queueFamilyCount; i++)
 				{
+					_FamilyIndices[i] = i;
 					auto supportedEngines = GetSupportedEngines((VkQueueFlagBits)queueFamilies[i].queueFlags);
-					_Engines[i] = new __EngineManager(_Device, i, supportedEngines, _NumberOfFrames, _NumberOfAsyncThreadsInFrame, _NumberOfAsyncThreads, std::min((int)queueFamilies[i].queueCount, total_threads));
+					_Engines[i] = new __EngineManager(_Device, i, supportedEngines, _NumberOfFrames, _NumberOfAsyncThreadsInFrame, _NumberOfAsyncThreads, std::min((int)queueFamilies[i].queueCount, total_threads), _Heap, _Pool,
+						queueFamilies[i].timestampValidBits > 0 ? _Profiler : nullptr);
 				}
 
 				for (int i = 0; i < 16; i++)
 					ResolveEngineIndex((EngineType)i);
 
+				for (__EngineManager* e : _Engines)
+					for (const std::shared_ptr<__CommandQueueManager>& m : e->Managers)
+						_Destruction->Managers.push_back(m.get());
+				_Destruction->captured.resize(_Destruction->Managers.size());
+
 				__MainRenderingEngineIndex = __minimal_queue_index_for(VkQueueFlagBits::VK_QUEUE_GRAPHICS_BIT, false);
-				__PresentingEngineIndex = __minimal_queue_index_for((VkQueueFlagBits)0, true);
+				__PresentingEngineIndex = _Surface != nullptr ? __minimal_queue_index_for((VkQueueFlagBits)0, true) : __MainRenderingEngineIndex;
+
+				// Render targets are created once families are known, emulated ones are shared among engines as any other resource
+				__create_presenter(description);
 
 				_FrameAsyncProcesses = std::shared_ptr<ProducerConsumerQueue<std::shared_ptr<WorkPiece>>>(new ProducerConsumerQueue<std::shared_ptr<WorkPiece>>(description.frame_threads * 2));
 				_AsyncProcesses = std::shared_ptr<ProducerConsumerQueue<std::shared_ptr<WorkPiece>>>(new ProducerConsumerQueue<std::shared_ptr<WorkPiece>>(description.async_threads * 2));
 
 				delete[] queueCreateInfos;
+
+				_Uploader = new __StreamingUploader(this, description.upload_budget == 0 ? 16 * 1024 * 1024 : description.upload_budget, _NumberOfFrames);
+			}
+
+			uint32_t __FindMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) {
+				for (uint32_t i = 0; i < _MemoryProperties.memoryTypeCount; i++)
+					if ((typeBits & (1 << i)) && (_MemoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+						return i;
+				throw std::runtime_error("failed to find suitable memory type!");
+			}
+
+			DeviceStatistics GetStatistics() {
+				DeviceStatistics statistics{};
+				statistics.Frames = _FrameNumber;
+				statistics.FrameQueueDepth = _FrameAsyncProcesses->getCount();
+				statistics.AsyncQueueDepth = _AsyncProcesses->getCount();
+				Metrics::ForEach(_Device, [&](const ThreadCounters& counters) {
+					statistics.Dispatches += counters.Dispatches.load(std::memory_order_relaxed);
+					statistics.Submits += counters.Submits.load(std::memory_order_relaxed);
+					for (int i = 0; i < ThreadCounters::Buckets; i++) {
+						statistics.CPUTaskWaits.Counts[i] += counters.CPUWaits[i].load(std::memory_order_relaxed);
+						statistics.GPUTaskWaits.Counts[i] += counters.GPUWaits[i].load(std::memory_order_relaxed);
+					}
+					statistics.CPUTaskWaits.TotalMilliseconds += counters.CPUWaitNanoseconds.load(std::memory_order_relaxed) / 1000000.0;
+					statistics.GPUTaskWaits.TotalMilliseconds += counters.GPUWaitNanoseconds.load(std::memory_order_relaxed) / 1000000.0;
+					int index = counters.Worker.load(std::memory_order_relaxed);
+					if (index >= 0) {
+						WorkerStatistics worker;
+						worker.Worker = index;
+						worker.InFrame = index <= _NumberOfAsyncThreadsInFrame;
+						worker.BusyMilliseconds = counters.BusyNanoseconds.load(std::memory_order_relaxed) / 1000000.0;
+						worker.IdleMilliseconds = counters.IdleNanoseconds.load(std::memory_order_relaxed) / 1000000.0;
+						statistics.Workers.push_back(worker);
+					}
+				});
+				for (int i = 0; i < ThreadCounters::Buckets; i++) {
+					statistics.CPUTaskWaits.Waits += statistics.CPUTaskWaits.Counts[i];
+					statistics.GPUTaskWaits.Waits += statistics.GPUTaskWaits.Counts[i];
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(_StatisticsMutex);
+					long long frames = statistics.Frames - _StatisticsFrame;
+					if (frames > 0) {
+						statistics.DispatchesPerFrame = (statistics.Dispatches - _StatisticsDispatches) / (double)frames;
+						statistics.SubmitsPerFrame = (statistics.Submits - _StatisticsSubmits) / (double)frames;
+						_StatisticsFrame = statistics.Frames;
+						_StatisticsDispatches = statistics.Dispatches;
+						_StatisticsSubmits = statistics.Submits;
+					}
+				}
+
+				for (__EngineManager* engine : _Engines)
+					for (std::shared_ptr<__CommandQueueManager> manager : engine->Managers) {
+						CommandQueueStatistics queue;
+						queue.Engines = manager->SupportedEngines;
+						queue.AllocatedBuffers = manager->allocatedBuffers.load(std::memory_order_relaxed);
+						queue.InFlightBuffers = manager->inFlightBuffers.load(std::memory_order_relaxed);
+						statistics.CommandQueues.push_back(queue);
+					}
+
+				statistics.ResourceMemory = _ResourceMemory.load(std::memory_order_relaxed);
+				return statistics;
+			}
+
+			void __AccountMemory(__Resource* resource, VkDeviceSize size) {
+				resource->_Data->MemorySize = size;
+				_ResourceMemory += size;
+			}
+
+			VkDeviceMemory __AllocateMemory(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, VkMemoryAllocateFlags flags = 0) {
+				VkMemoryAllocateFlagsInfo flagsInfo{};
+				flagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+				flagsInfo.flags = flags;
+				VkMemoryAllocateInfo allocInfo{};
+				allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+				allocInfo.pNext = flags != 0 ? &flagsInfo : nullptr;
+				allocInfo.allocationSize = requirements.size;
+				allocInfo.memoryTypeIndex = __FindMemoryType(requirements.memoryTypeBits, properties);
+
+				VkDeviceMemory memory;
+				if (vkAllocateMemory(_Device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+					throw std::runtime_error("failed to allocate resource memory!");
+				}
+				return memory;
+			}
+
+			std::shared_ptr<__Resource> CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) {
+				VkBufferCreateInfo createInfo{};
+				createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+				createInfo.size = size;
+				createInfo.usage = usage;
+				// Resources are shared among engines so they can be uploaded in the transfer engine and consumed in others.
+				createInfo.sharingMode = _FamilyIndices.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+				createInfo.queueFamilyIndexCount = _FamilyIndices.size() > 1 ? _FamilyIndices.size() : 0;
+				createInfo.pQueueFamilyIndices = _FamilyIndices.size() > 1 ? _FamilyIndices.data() : nullptr;
+
+				VkBuffer buffer;
+				if (vkCreateBuffer(_Device, &createInfo, nullptr, &buffer) != VK_SUCCESS) {
+					throw std::runtime_error("failed to create buffer!");
+				}
+
+				VkMemoryRequirements requirements;
+				vkGetBufferMemoryRequirements(_Device, buffer, &requirements);
+				VkDeviceMemory memory = __AllocateMemory(requirements, properties, (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT : 0);
+				vkBindBufferMemory(_Device, buffer, memory, 0);
+
+				std::shared_ptr<__Resource> resource = std::shared_ptr<__Resource>(new __Resource(this, createInfo, buffer, memory));
+				__AccountMemory(resource.get(), requirements.size);
+				__RegisterInHeap(resource.get());
+				return resource;
+			}
+
+			/// <summary>
+			/// Takes indices in the descriptor heap for the usages of the resource that are accessed from shaders.
+			/// </summary>
+			void __RegisterInHeap(__Resource* resource) {
+				if (_Heap == nullptr)
+					return;
+				if (resource->IsBuffer) {
+					if (resource->BufferDescription.usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) {
+						resource->StorageIndex = _Heap->Allocate(__HeapRange::STORAGE_BUFFERS);
+						_Heap->Write(resource->StorageIndex, resource->_Data->Buffer);
+					}
+					return;
+				}
+				if (resource->ImageView == nullptr)
+					return;
+				if (resource->ImageDescription.usage & VK_IMAGE_USAGE_SAMPLED_BIT) {
+					resource->SampledIndex = _Heap->Allocate(__HeapRange::SAMPLED_IMAGES);
+					_Heap->Write(__HeapRange::SAMPLED_IMAGES, resource->SampledIndex, resource->ImageView);
+				}
+				if (resource->ImageDescription.usage & VK_IMAGE_USAGE_STORAGE_BIT) {
+					resource->StorageIndex = _Heap->Allocate(__HeapRange::STORAGE_IMAGES);
+					_Heap->Write(__HeapRange::STORAGE_IMAGES, resource->StorageIndex, resource->ImageView);
+				}
+			}
+
+			/// <summary>
+			/// Returns the heap indices of a resource. They are reused only after the frames in flight finished.
+			/// </summary>
+			void __ReleaseFromHeap(__Resource* resource) {
+				if (_Heap == nullptr)
+					return;
+				if (resource->SampledIndex != Resource::NoIndex)
+					_Heap->Release(__HeapRange::SAMPLED_IMAGES, resource->SampledIndex);
+				if (resource->StorageIndex != Resource::NoIndex)
+					_Heap->Release(resource->IsBuffer ? __HeapRange::STORAGE_BUFFERS : __HeapRange::STORAGE_IMAGES, resource->StorageIndex);
+			}
+
+			/// <summary>
+			/// Gets a slice (and optionally a sampled texture) of an image using the cached view of the range.
+			/// </summary>
+			std::shared_ptr<__Resource> __CreateSlice(const __Resource* image, const ImageSliceDescription& slice, VkSampler sampler = nullptr, uint32_t samplerIndex = Resource::NoIndex) {
+				if (slice.mip_start < 0 || slice.mip_count <= 0 || slice.mip_start + slice.mip_count > (int)image->ImageDescription.mipLevels ||
+					slice.array_start < 0 || slice.array_count <= 0 || slice.array_start + slice.array_count > (int)image->ImageDescription.arrayLayers)
+					throw std::runtime_error("Image slice out of range");
+
+				// Always from the cache, even for the whole range: the view of the image dies with it, the cached one with the image data the slice shares
+				__CachedView view = _Views->FetchView(image, slice);
+
+				std::shared_ptr<__Resource> result = std::shared_ptr<__Resource>(new __Resource(*image, slice, view.View, view.SampledIndex, view.StorageIndex));
+				result->Sampler = sampler;
+				result->SamplerIndex = samplerIndex;
+				return result;
+			}
+
+			VkShaderModule __CreateShaderModule(const ShaderStageDescription& description) {
+				if (description.Code == nullptr || description.Size == 0 || description.Size % 4 != 0)
+					throw std::runtime_error("Shader code must be SPIR-V words");
+				VkShaderModuleCreateInfo createInfo{};
+				createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+				createInfo.codeSize = description.Size;
+				createInfo.pCode = description.Code;
+				VkShaderModule module;
+				if (vkCreateShaderModule(_Device, &createInfo, nullptr, &module) != VK_SUCCESS)
+					throw std::runtime_error("failed to create shader module!");
+				return module;
+			}
+
+			/// <summary>
+			/// Specialization constants of a stage. Each 4-byte word of the constants block is the constant with id equal to its index.
+			/// </summary>
+			struct __Specialization {
+				std::vector<VkSpecializationMapEntry> entries;
+				VkSpecializationInfo info;
+			};
+
+			static VkPipelineShaderStageCreateInfo __StageInfo(VkShaderStageFlagBits stage, VkShaderModule module, const ShaderStageDescription& description, __Specialization& specialization) {
+				VkPipelineShaderStageCreateInfo info{};
+				info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+				info.stage = stage;
+				info.module = module;
+				info.pName = description.EntryPoint == nullptr ? "main" : description.EntryPoint;
+				if (description.ConstantsSize > 0) {
+					for (unsigned int i = 0; i < description.ConstantsSize / 4; i++)
+						specialization.entries.push_back({ i, i * 4, 4 });
+					specialization.info.mapEntryCount = (uint32_t)specialization.entries.size();
+					specialization.info.pMapEntries = specialization.entries.data();
+					specialization.info.dataSize = description.ConstantsSize;
+					specialization.info.pData = description.Constants;
+					info.pSpecializationInfo = &specialization.info;
+				}
+				return info;
+			}
+
+			static unsigned long long __StageKey(const ShaderStageDescription& description, unsigned long long seed) {
+				const char* entryPoint = description.EntryPoint == nullptr ? "main" : description.EntryPoint;
+				seed = Hash(description.Code, description.Size, seed);
+				seed = Hash(entryPoint, strlen(entryPoint), seed);
+				return Hash(description.Constants, description.ConstantsSize, seed);
+			}
+
+			/// <summary>
+			/// Gets the alive pipeline created from the same description, otherwise creates it and keeps a weak reference.
+			/// Pipelines are matched by their full description on a key match. The new pipeline is published not ready and
+			/// compiled outside the lock, threads asking for it meanwhile wait for it and other variants are not blocked.
+			/// </summary>
+			template<typename D>
+			std::shared_ptr<__Pipeline> __Variant(unsigned long long key, const D& description,
+				std::shared_ptr<__Pipeline>(__Device::* create)(const D&), void(__Device::* build)(__Pipeline*, const D&)) {
+				std::shared_ptr<__Pipeline> pipeline;
+				bool building = false;
+				{
+					std::lock_guard<std::mutex> lock(_VariantsMutex);
+					auto range = _Variants.equal_range(key);
+					for (auto v = range.first; v != range.second && pipeline == nullptr;) {
+						std::shared_ptr<__Pipeline> existing = v->second.lock();
+						if (existing == nullptr)
+							v = _Variants.erase(v);
+						else {
+							if (existing->__Matches(description))
+								pipeline = existing;
+							v++;
+						}
+					}
+					if (pipeline == nullptr) {
+						pipeline = (this->*create)(description);
+						pipeline->Ready.store(false);
+						_Variants.emplace(key, pipeline);
+						building = true;
+					}
+				}
+				if (!building) {
+					pipeline->Wait(); // Throws if its build failed
+					return pipeline;
+				}
+				std::string error;
+				try {
+					(this->*build)(pipeline.get(), description);
+				}
+				catch (std::exception& e) {
+					error = e.what();
+					if (error.empty())
+						error = "failed to create pipeline variant!";
+				}
+				pipeline->__Compiled(error);
+				if (!error.empty()) // The failed pipeline expires with this reference, later requests retry
+					throw std::runtime_error(error);
+				return pipeline;
+			}
+
+			/// <summary>
+			/// Creates a specialized compute pipeline. Pipelines with the same code and constants are shared.
+			/// </summary>
+			std::shared_ptr<__Pipeline> CreateComputeVariant(const ComputePipelineDescription& description) {
+				return __Variant(__StageKey(description.Shader, VK_PIPELINE_BIND_POINT_COMPUTE), description, &__Device::__NewComputePipeline, &__Device::__BuildComputePipeline);
+			}
+
+			/// <summary>
+			/// Creates a specialized graphics pipeline. Pipelines with the same code, constants and fixed state are shared.
+			/// </summary>
+			std::shared_ptr<__Pipeline> CreateGraphicsVariant(const GraphicsPipelineDescription& description) {
+				unsigned long long key = __StageKey(description.Fragment, __StageKey(description.Vertex, VK_PIPELINE_BIND_POINT_GRAPHICS));
+				int state[] = { (int)description.Topology, (int)description.RenderTargetFormat, (int)description.DepthStencilFormat, description.CullBackFaces ? 1 : 0 };
+				return __Variant(Hash(state, sizeof(state), key), description, &__Device::__NewGraphicsPipeline, &__Device::__BuildGraphicsPipeline);
+			}
+
+			VkPipelineLayout __PipelineLayout() {
+				if (_Heap == nullptr)
+					throw std::runtime_error("Pipelines require descriptor indexing support");
+				return _Heap->PipelineLayout;
+			}
+
+			/// <summary>
+			/// Creates a compute pipeline. If async, the pipeline is compiled by the pipeline compiler threads and is returned not ready.
+			/// </summary>
+			std::shared_ptr<__Pipeline> CreateComputePipeline(const ComputePipelineDescription& description, bool async = false) {
+				std::shared_ptr<__Pipeline> pipeline = __NewComputePipeline(description);
+				if (async)
+					_PipelineCompiler->Enqueue(pipeline, description);
+				else
+					__BuildComputePipeline(pipeline.get(), description);
+				return pipeline;
+			}
+
+			/// <summary>
+			/// Pipeline object keeping the description, not built yet.
+			/// </summary>
+			std::shared_ptr<__Pipeline> __NewComputePipeline(const ComputePipelineDescription& description) {
+				std::shared_ptr<__Pipeline> pipeline = std::shared_ptr<__Pipeline>(new __Pipeline(this, VK_PIPELINE_BIND_POINT_COMPUTE));
+				pipeline->__Keep(0, description.Shader);
+				return pipeline;
+			}
+
+			void __BuildComputePipeline(__Pipeline* pipeline, const ComputePipelineDescription& description) {
+				// Fails before the module is created, nothing to release
+				VkPipelineLayout layout = __PipelineLayout();
+				VkShaderModule module = __CreateShaderModule(description.Shader);
+
+				VkComputePipelineCreateInfo createInfo{};
+				createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+				__Specialization specialization{};
+				createInfo.stage = __StageInfo(VK_SHADER_STAGE_COMPUTE_BIT, module, description.Shader, specialization);
+				createInfo.layout = layout;
+
+				VkResult result = vkCreateComputePipelines(_Device, _PipelineCache->Cache, 1, &createInfo, nullptr, &pipeline->Pipeline);
+				vkDestroyShaderModule(_Device, module, nullptr);
+				if (result != VK_SUCCESS)
+					throw std::runtime_error("failed to create compute pipeline!");
+			}
+
+			/// <summary>
+			/// Gets the pipeline generating a number of mip levels of images with a SPIR-V storage format. Built the first time it is used.
+			/// </summary>
+			std::shared_ptr<__Pipeline> __Downsampler(unsigned int format, bool volume, int levels) {
+				std::lock_guard<std::mutex> lock(_DownsamplersMutex);
+				std::shared_ptr<__Pipeline>& pipeline = _Downsamplers[(format << 8) | (volume ? 0x80 : 0) | levels];
+				if (pipeline == nullptr) {
+					std::vector<unsigned int> code = DownsampleShader(format, volume, levels);
+					ComputePipelineDescription description = {};
+					description.Shader.Code = code.data();
+					description.Shader.Size = code.size() * sizeof(unsigned int);
+					pipeline = CreateComputePipeline(description);
+				}
+				return pipeline;
+			}
+
+			static VkExtent3D __MipExtent(const VkExtent3D& extent, int level) {
+				return { std::max(1u, extent.width >> level), std::max(1u, extent.height >> level), std::max(1u, extent.depth >> level) };
+			}
+
+			/// <summary>
+			/// Records the generation of the levels [mipStart + 1, mipStart + mipCount) of the layers of an image from the level mipStart.
+			/// Formats that can be storage images are averaged by a compute shader several levels per dispatch, the others are blitted
+			/// level by level on graphics engines. Groups of levels are separated by a single barrier.
+			/// </summary>
+			void GenerateMips(__CommandListManager* list, const __Resource* image, int mipStart, int mipCount, int arrayStart, int arrayCount) {
+				list->__OutsideRendering("Generating mips");
+				if (image->IsBuffer)
+					throw std::runtime_error("Generating mips of a buffer");
+				if (mipCount <= 1)
+					return;
+
+				const VkImageCreateInfo& description = image->ImageDescription;
+				bool volume = description.imageType == VK_IMAGE_TYPE_3D;
+				VkFormatProperties properties;
+				vkGetPhysicalDeviceFormatProperties(_PhysicalDevice, description.format, &properties);
+				unsigned int storageFormat = __StorageImageFormat(description.format);
+				bool compute = _Heap != nullptr && _SupportsStorageImageIndexing && storageFormat != 0 &&
+					(storageFormat <= 5 || _SupportsExtendedStorageFormats) && // Formats past Rgba8Snorm are extended
+					(description.usage & VK_IMAGE_USAGE_STORAGE_BIT) && (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) &&
+					((int)list->SupportedEngines & (int)EngineType::COMPUTE);
+				if (!compute) {
+					VkImageUsageFlags transfers = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+					VkFormatFeatureFlags blits = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+					if ((description.usage & transfers) != transfers || (properties.optimalTilingFeatures & blits) != blits)
+						throw std::runtime_error("Generating mips requires Storage usage of a storage format, or TransferSource and TransferDestination usages");
+					if (!((int)list->SupportedEngines & (int)EngineType::GRAPHICS))
+						throw std::runtime_error("Mips of images that can not be storage images are blitted, it requires a graphics engine");
+				}
+
+				VkCommandBuffer cmdList = list->vkCmdList;
+				VkPipelineStageFlags stage = compute ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+				VkAccessFlags read = compute ? VK_ACCESS_SHADER_READ_BIT : VK_ACCESS_TRANSFER_READ_BIT;
+				VkAccessFlags write = compute ? VK_ACCESS_SHADER_WRITE_BIT : VK_ACCESS_TRANSFER_WRITE_BIT;
+
+				// Previous commands finish writing the source level (and using the others) before it is read.
+				VkMemoryBarrier barrier{};
+				barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+				barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+				barrier.dstAccessMask = read | write;
+				vkCmdPipelineBarrier(cmdList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, stage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+				int last = mipStart + mipCount - 1;
+				for (int source = mipStart; source < last;) {
+					if (compute) {
+						// Invocations read 8x8 texels of the source (4x4x4 for volumes) and write 3 levels (2 for volumes)
+						int levels = std::min(volume ? 2 : 3, last - source);
+						unsigned int constants[1 + 3 + 3 * 4];
+						for (int level = 0; level <= levels; level++) {
+							ImageSliceDescription slice{ volume ? VK_IMAGE_VIEW_TYPE_3D : VK_IMAGE_VIEW_TYPE_2D_ARRAY, source + level, 1, arrayStart, arrayCount };
+							constants[level] = _Views->FetchView(image, slice).StorageIndex;
+							VkExtent3D extent = __MipExtent(description.extent, source + level);
+							constants[1 + levels + 3 * level + 0] = extent.width - 1;
+							constants[1 + levels + 3 * level + 1] = extent.height - 1;
+							constants[1 + levels + 3 * level + 2] = extent.depth - 1;
+						}
+						list->__Push(EngineType::COMPUTE, 1 + levels + 3 * (levels + 1), constants, false);
+						list->__Bind(__Downsampler(storageFormat, volume, levels).get(), false);
+
+						// Each invocation covers 2^(levels - 1) texels of the first level written by axis
+						uint32_t span = 1u << (levels - 1);
+						VkExtent3D first = __MipExtent(description.extent, source + 1);
+						vkCmdDispatch(cmdList,
+							((first.width + span - 1) / span + 7) / 8,
+							((first.height + span - 1) / span + 7) / 8,
+							volume ? (first.depth + span - 1) / span : (uint32_t)arrayCount);
+						source += levels;
+					}
+					else {
+						// Blits of all layers of a level are a single region
+						VkExtent3D from = __MipExtent(description.extent, source);
+						VkExtent3D to = __MipExtent(description.extent, source + 1);
+						VkImageBlit region{};
+						region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, (uint32_t)source, (uint32_t)arrayStart, (uint32_t)arrayCount };
+						region.srcOffsets[1] = { (int32_t)from.width, (int32_t)from.height, (int32_t)from.depth };
+						region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, (uint32_t)source + 1, (uint32_t)arrayStart, (uint32_t)arrayCount };
+						region.dstOffsets[1] = { (int32_t)to.width, (int32_t)to.height, (int32_t)to.depth };
+						VkFilter filter = (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+						vkCmdBlitImage(cmdList, image->_Data->Image, VK_IMAGE_LAYOUT_GENERAL, image->_Data->Image, VK_IMAGE_LAYOUT_GENERAL, 1, &region, filter);
+						source++;
+					}
+
+					// Levels written are the source of the next group, the last barrier makes the chain visible to later commands
+					barrier.srcAccessMask = write;
+					barrier.dstAccessMask = source < last ? read : VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+					VkPipelineStageFlags next = source < last ? stage : (VkPipelineStageFlags)VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+					vkCmdPipelineBarrier(cmdList, stage, next, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+				}
+
+				// The downsampler replaced the pipeline of the process, its dispatches throw until one is set again
+				if (compute)
+					list->BoundCompute = nullptr;
+			}
+
+			/// <summary>
+			/// Gets the pipeline culling draw instances, compacting the draws when their count can be read by the gpu. Built the first time it is used.
+			/// </summary>
+			std::shared_ptr<__Pipeline> __Culler() {
+				std::lock_guard<std::mutex> lock(_CullerMutex);
+				if (_Culler == nullptr) {
+					std::vector<unsigned int> code = CullShader(_vkCmdDrawIndexedIndirectCount != nullptr);
+					ComputePipelineDescription description = {};
+					description.Shader.Code = code.data();
+					description.Shader.Size = code.size() * sizeof(unsigned int);
+					_Culler = CreateComputePipeline(description);
+				}
+				return _Culler;
+			}
+
+			/// <summary>
+			/// Records the culling of count instances of 32 bytes against 6 planes into a buffer of draws: the count of visible draws
+			/// followed by an indexed indirect command per instance. The count is reset by a fill, or the whole buffer when the draws
+			/// are not compacted, so stale commands draw no instances. The draws are visible to indirect draws afterwards.
+			/// </summary>
+			void Cull(__CommandListManager* list, const __Resource* instances, uint32_t count, const float planes[24], const __Resource* draws) {
+				list->__OutsideRendering("Culling");
+				if (_Heap == nullptr || !_SupportsStorageBufferIndexing || !((int)list->SupportedEngines & (int)EngineType::COMPUTE))
+					throw std::runtime_error("Culling requires a compute engine and storage buffers of the heap indexed from shaders");
+				if (!instances->IsBuffer || instances->StorageIndex == Resource::NoIndex || instances->BufferDescription.size < (VkDeviceSize)count * 32)
+					throw std::runtime_error("Instances must be a storage buffer of 32 bytes per instance");
+				VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+				if (!draws->IsBuffer || draws->StorageIndex == Resource::NoIndex || (draws->BufferDescription.usage & usage) != usage)
+					throw std::runtime_error("Draws must be a buffer with Storage, Indirect and TransferDestination usages");
+				if (draws->BufferDescription.size < 16 + (VkDeviceSize)count * sizeof(VkDrawIndexedIndirectCommand))
+					throw std::runtime_error("Draws buffer smaller than the draws of the instances");
+
+				bool compact = _vkCmdDrawIndexedIndirectCount != nullptr;
+				VkCommandBuffer cmdList = list->vkCmdList;
+
+				// Previous commands finish writing the instances and drawing the previous draws before they are written
+				VkMemoryBarrier barrier{};
+				barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+				barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
+				vkCmdPipelineBarrier(cmdList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+				vkCmdFillBuffer(cmdList, draws->_Data->Buffer, 0, compact ? 4 : VK_WHOLE_SIZE, 0);
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+				vkCmdPipelineBarrier(cmdList, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+				if (count > 0) {
+					unsigned int constants[3 + 24] = { instances->StorageIndex, draws->StorageIndex, count };
+					memcpy(constants + 3, planes, 24 * sizeof(float));
+					list->__Push(EngineType::COMPUTE, 3 + 24, constants, false);
+					list->__Bind(__Culler().get(), false);
+					vkCmdDispatch(cmdList, (count + 63) / 64, 1, 1);
+					// The culler replaced the pipeline of the process, its dispatches throw until one is set again
+					list->BoundCompute = nullptr;
+				}
+
+				barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_MEMORY_READ_BIT;
+				vkCmdPipelineBarrier(cmdList, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+			}
+
+			VkDeviceAddress __BufferAddress(const __Resource* buffer) {
+				VkBufferDeviceAddressInfo info{};
+				info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+				info.buffer = buffer->_Data->Buffer;
+				return vkGetBufferDeviceAddress(_Device, &info);
+			}
+
+			static VkDeviceSize __Align(VkDeviceSize value, VkDeviceSize alignment) {
+				return (value + alignment - 1) / alignment * alignment;
+			}
+
+			std::shared_ptr<__AccelerationStructure> __CreateAccelerationStructure(std::shared_ptr<__Resource> storage, VkDeviceSize offset, VkDeviceSize size) {
+				std::shared_ptr<__AccelerationStructure> structure = std::shared_ptr<__AccelerationStructure>(new __AccelerationStructure());
+				structure->device = this;
+				structure->Storage = storage;
+				structure->Offset = offset;
+				structure->Size = size;
+				VkAccelerationStructureCreateInfoKHR createInfo{};
+				createInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
+				createInfo.buffer = storage->_Data->Buffer;
+				createInfo.offset = offset;
+				createInfo.size = size;
+				createInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+				if (_vkCreateAccelerationStructure(_Device, &createInfo, nullptr, &structure->Structure) != VK_SUCCESS)
+					throw std::runtime_error("failed to create acceleration structure!");
+				return structure;
+			}
+
+			/// <summary>
+			/// Records the batched builds of a call and the query of their compacted sizes, or the copies compacting them.
+			/// </summary>
+			void __RecordAccelerationStructures(goofy::CommandListManager manager, __AccelerationStructureBuild* build, bool compacting) {
+				if (manager.__state->Capture != nullptr)
+					__Capture::Unsupported(manager.__state->Captured, "BuildAccelerationStructures");
+				VkCommandBuffer cmdList = manager.__state->vkCmdList;
+				VkMemoryBarrier barrier{};
+				barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+				barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+				barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+				int count = (int)build->Structures.size();
+
+				if (compacting) {
+					for (int i = 0; i < count; i++) {
+						VkCopyAccelerationStructureInfoKHR copy{};
+						copy.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR;
+						copy.src = build->Structures[i]->Structure;
+						copy.dst = build->Compacted[i]->Structure;
+						// Dynamic structures keep their built size, a rebuild in place may need all of it
+						bool dynamic = (build->Infos[i].flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR) != 0;
+						copy.mode = dynamic ? VK_COPY_ACCELERATION_STRUCTURE_MODE_CLONE_KHR : VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+						_vkCmdCopyAccelerationStructure(cmdList, &copy);
+					}
+					barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+					vkCmdPipelineBarrier(cmdList, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+					return;
+				}
+
+				// One build command per batch. The barrier after each one protects the scratch memory reused by the next batch
+				// and makes the structures visible to the compacted size query.
+				std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> ranges(count);
+				for (int i = 0; i < count; i++)
+					ranges[i] = &build->Ranges[i];
+				for (size_t b = 0; b + 1 < build->Batches.size(); b++) {
+					int first = build->Batches[b];
+					int size = build->Batches[b + 1] - first;
+					_vkCmdBuildAccelerationStructures(cmdList, size, &build->Infos[first], &ranges[first]);
+					vkCmdPipelineBarrier(cmdList, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+				}
+
+				std::vector<VkAccelerationStructureKHR> built(count);
+				for (int i = 0; i < count; i++)
+					built[i] = build->Structures[i]->Structure;
+				vkCmdResetQueryPool(cmdList, build->CompactedSizes, 0, count);
+				_vkCmdWriteAccelerationStructuresProperties(cmdList, count, built.data(), VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, build->CompactedSizes, 0);
+			}
+
+			/// <summary>
+			/// Records a process and waits for the gpu to execute it.
+			/// </summary>
+			void __RunAndWait(std::shared_ptr<Process> process) {
+				std::shared_ptr<__CPUTask> populating = Dispatch(process, DispatchMode::MAIN_THREAD);
+				Flush(1, &populating, 0, nullptr)->Wait();
+			}
+
+			/// <summary>
+			/// Builds the bottom level structures of a set of meshes and waits for them. Mesh data is packed in a host visible input buffer,
+			/// structures are built in batches sharing the scratch pool, their compacted sizes are queried and they are copied
+			/// to a single buffer of the compacted sizes. Devices without acceleration structures build software structures.
+			/// </summary>
+			void BuildAccelerationStructures(int count, const MeshDescription* meshes, std::shared_ptr<__AccelerationStructure>* structures) {
+				if (count <= 0)
+					return;
+				if (!_SupportsAccelerationStructures) {
+					__BuildSoftwareStructures(count, meshes, structures);
+					return;
+				}
+
+				// Positions packed as three floats and indices as 32 bits, copied in parallel
+				std::vector<VkDeviceSize> vertexOffsets(count), indexOffsets(count);
+				VkDeviceSize inputSize = 0;
+				for (int i = 0; i < count; i++) {
+					vertexOffsets[i] = inputSize;
+					inputSize += __Align((VkDeviceSize)meshes[i].VertexCount * 12, 16);
+					indexOffsets[i] = inputSize;
+					if (meshes[i].Indices != nullptr)
+						inputSize += __Align((VkDeviceSize)meshes[i].TriangleCount * 12, 16);
+				}
+				std::shared_ptr<__Resource> input = CreateBuffer(std::max<VkDeviceSize>(inputSize, 16),
+					VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+				unsigned char* mapped;
+				if (vkMapMemory(_Device, input->_Data->Memory, 0, VK_WHOLE_SIZE, 0, (void**)&mapped) != VK_SUCCESS)
+					throw std::runtime_error("failed to map acceleration structure inputs!");
+				ParallelFor(count, 1, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; i++) {
+						const MeshDescription& mesh = meshes[i];
+						unsigned int stride = mesh.VertexStride == 0 ? 12 : mesh.VertexStride;
+						float* positions = (float*)(mapped + vertexOffsets[i]);
+						for (unsigned int v = 0; v < mesh.VertexCount; v++)
+							memcpy(positions + v * 3, (const unsigned char*)mesh.Positions + (size_t)v * stride, 12);
+						if (mesh.Indices != nullptr)
+							memcpy(mapped + indexOffsets[i], mesh.Indices, (size_t)mesh.TriangleCount * 12);
+					}
+				});
+				vkUnmapMemory(_Device, input->_Data->Memory);
+				VkDeviceAddress inputAddress = __BufferAddress(input.get());
+
+				__AccelerationStructureBuild build;
+				build.Geometries.resize(count);
+				build.Infos.resize(count);
+				build.Ranges.resize(count);
+				std::vector<VkDeviceSize> storageOffsets(count), scratchSizes(count), updateScratchSizes(count);
+				VkDeviceSize storageSize = 0;
+				for (int i = 0; i < count; i++) {
+					VkAccelerationStructureGeometryKHR& geometry = build.Geometries[i];
+					geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+					geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+					geometry.flags = meshes[i].Opaque ? VK_GEOMETRY_OPAQUE_BIT_KHR : 0;
+					geometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
+					geometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
+					geometry.geometry.triangles.vertexData.deviceAddress = inputAddress + vertexOffsets[i];
+					geometry.geometry.triangles.vertexStride = 12;
+					geometry.geometry.triangles.maxVertex = std::max(1u, meshes[i].VertexCount) - 1;
+					geometry.geometry.triangles.indexType = meshes[i].Indices != nullptr ? VK_INDEX_TYPE_UINT32 : (VkIndexType)VK_INDEX_TYPE_NONE_KHR;
+					geometry.geometry.triangles.indexData.deviceAddress = meshes[i].Indices != nullptr ? inputAddress + indexOffsets[i] : 0;
+
+					VkAccelerationStructureBuildGeometryInfoKHR& info = build.Infos[i];
+					info.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+					info.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+					info.flags = __BuildFlags(meshes[i].Dynamic);
+					info.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+					info.geometryCount = 1;
+					info.pGeometries = &geometry;
+					build.Ranges[i] = { meshes[i].TriangleCount, 0, 0, 0 };
+
+					VkAccelerationStructureBuildSizesInfoKHR sizes{};
+					sizes.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+					_vkGetAccelerationStructureBuildSizes(_Device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &info, &meshes[i].TriangleCount, &sizes);
+					storageOffsets[i] = storageSize;
+					storageSize += __Align(sizes.accelerationStructureSize, 256); // Structures must be 256-byte aligned
+					scratchSizes[i] = __Align(sizes.buildScratchSize, _ScratchAlignment);
+					updateScratchSizes[i] = std::max(sizes.buildScratchSize, sizes.updateScratchSize);
+				}
+
+				// Structures are built in a temporary buffer released once they are compacted
+				std::shared_ptr<__Resource> storage = CreateBuffer(storageSize,
+					VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+				for (int i = 0; i < count; i++) {
+					VkDeviceSize size = (i + 1 < count ? storageOffsets[i + 1] : storageSize) - storageOffsets[i];
+					build.Structures.push_back(__CreateAccelerationStructure(storage, storageOffsets[i], size));
+					build.Infos[i].dstAccelerationStructure = build.Structures[i]->Structure;
+				}
+
+				VkQueryPoolCreateInfo queryInfo{};
+				queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+				queryInfo.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
+				queryInfo.queryCount = count;
+				if (vkCreateQueryPool(_Device, &queryInfo, nullptr, &build.CompactedSizes) != VK_SUCCESS)
+					throw std::runtime_error("failed to create the compacted sizes query pool!");
+
+				std::shared_ptr<__AccelerationStructureProcess> process = std::shared_ptr<__AccelerationStructureProcess>(new __AccelerationStructureProcess());
+				process->device = this;
+				process->Build = &build;
+				std::vector<VkDeviceSize> compactedSizes(count);
+				{
+					// Batches fill the scratch pool, grown to the largest single build if the budget can not hold it
+					std::lock_guard<std::mutex> lock(_ScratchMutex);
+					VkDeviceSize largest = *std::max_element(scratchSizes.begin(), scratchSizes.end());
+					VkDeviceSize capacity = std::max(__ScratchBudget, largest);
+					if (_Scratch == nullptr || _Scratch->BufferDescription.size < capacity)
+						_Scratch = CreateBuffer(capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+					capacity = _Scratch->BufferDescription.size;
+					VkDeviceAddress scratch = __BufferAddress(_Scratch.get());
+					VkDeviceSize used = 0;
+					for (int i = 0; i < count; i++) {
+						if (i == 0 || used + scratchSizes[i] > capacity) {
+							build.Batches.push_back(i);
+							used = 0;
+						}
+						build.Infos[i].scratchData.deviceAddress = scratch + used;
+						used += scratchSizes[i];
+					}
+					build.Batches.push_back(count);
+					__RunAndWait(process);
+				}
+				vkGetQueryPoolResults(_Device, build.CompactedSizes, 0, count, count * sizeof(VkDeviceSize), compactedSizes.data(), sizeof(VkDeviceSize), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+				vkDestroyQueryPool(_Device, build.CompactedSizes, nullptr);
+
+				// Compacted structures are packed in a single buffer, the built ones and their inputs are released with this scope
+				VkDeviceSize compactedSize = 0;
+				for (int i = 0; i < count; i++) {
+					if (meshes[i].Dynamic)
+						compactedSizes[i] = build.Structures[i]->Size;
+					storageOffsets[i] = compactedSize;
+					compactedSize += __Align(compactedSizes[i], 256);
+				}
+				std::shared_ptr<__Resource> compacted = CreateBuffer(compactedSize,
+					VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+				for (int i = 0; i < count; i++)
+					build.Compacted.push_back(__CreateAccelerationStructure(compacted, storageOffsets[i], compactedSizes[i]));
+				process->Compacting = true;
+				__RunAndWait(process);
+
+				for (int i = 0; i < count; i++) {
+					VkAccelerationStructureDeviceAddressInfoKHR addressInfo{};
+					addressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
+					addressInfo.accelerationStructure = build.Compacted[i]->Structure;
+					build.Compacted[i]->Address = _vkGetAccelerationStructureDeviceAddress(_Device, &addressInfo);
+					structures[i] = build.Compacted[i];
+				}
+
+				// Dynamic structures get their staging ring, with the indices after the slots, and scratch memory for updates
+				ParallelFor(count, 1, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; i++)
+						if (meshes[i].Dynamic)
+							__MakeDynamic(structures[i].get(), meshes[i]);
+				});
+				for (int i = 0; i < count; i++) {
+					__DynamicGeometry* dynamic = structures[i]->Dynamic.get();
+					if (dynamic == nullptr)
+						continue;
+					dynamic->SlotSize = __Align((VkDeviceSize)meshes[i].VertexCount * 12, 256);
+					dynamic->IndexOffset = dynamic->SlotSize * _NumberOfFrames;
+					__CreateStaging(dynamic, dynamic->IndexOffset + dynamic->Indices.size() * sizeof(unsigned int),
+						VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+					if (!dynamic->Indices.empty())
+						memcpy(dynamic->Mapped + dynamic->IndexOffset, dynamic->Indices.data(), dynamic->Indices.size() * sizeof(unsigned int));
+					dynamic->Scratch = CreateBuffer(updateScratchSizes[i] + _ScratchAlignment,
+						VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+				}
+			}
+
+			static VkBuildAccelerationStructureFlagsKHR __BuildFlags(bool dynamic) {
+				return VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR |
+					(dynamic ? VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR : 0);
+			}
+
+			/// <summary>
+			/// Keeps the CPU copy of the mesh topology and of its BVH a dynamic structure is refitted with.
+			/// </summary>
+			static void __MakeDynamic(__AccelerationStructure* structure, const MeshDescription& mesh) {
+				std::unique_ptr<__DynamicGeometry> dynamic = std::unique_ptr<__DynamicGeometry>(new __DynamicGeometry());
+				dynamic->Mesh = mesh;
+				dynamic->Mesh.Positions = nullptr;
+				if (mesh.Indices != nullptr) {
+					dynamic->Indices.assign(mesh.Indices, mesh.Indices + (size_t)mesh.TriangleCount * 3);
+					dynamic->Mesh.Indices = dynamic->Indices.data();
+				}
+				dynamic->RebuildThreshold = mesh.RebuildThreshold > 0 ? mesh.RebuildThreshold : 1.5f;
+				if (structure->Tree.Nodes.empty() && mesh.TriangleCount > 0)
+					structure->Tree = BuildBVH(mesh);
+				dynamic->BuiltCost = SAHCost(structure->Tree);
+				structure->Dynamic = std::move(dynamic);
+			}
+
+			/// <summary>
+			/// Creates the host visible staging ring of a dynamic structure, mapped for its lifetime.
+			/// </summary>
+			void __CreateStaging(__DynamicGeometry* dynamic, VkDeviceSize size, VkBufferUsageFlags usage) {
+				dynamic->Staging = CreateBuffer(std::max<VkDeviceSize>(size, 16), usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+				if (vkMapMemory(_Device, dynamic->Staging->_Data->Memory, 0, VK_WHOLE_SIZE, 0, (void**)&dynamic->Mapped) != VK_SUCCESS)
+					throw std::runtime_error("failed to map acceleration structure staging!");
+			}
+
+			/// <summary>
+			/// Writes a software structure at a word of the storage buffer: its nodes, with room for a node capacity, followed by
+			/// its triangles. Child indices of inner nodes are rebased to the buffer and leaves index the word of their first triangle.
+			/// </summary>
+			static void __WriteSoftwareStructure(const BVH& tree, unsigned int* words, size_t first, size_t nodeCapacity) {
+				unsigned int root = (unsigned int)(first / 8);
+				unsigned int triangles = (unsigned int)(first + nodeCapacity * 8);
+				BVHNode* nodes = (BVHNode*)words;
+				for (size_t n = 0; n < tree.Nodes.size(); n++) {
+					nodes[n] = tree.Nodes[n];
+					nodes[n].Index += nodes[n].Count > 0 ? triangles : root;
+				}
+				if (!tree.Triangles.empty())
+					memcpy(words + nodeCapacity * 8, tree.Triangles.data(), tree.Triangles.size() * sizeof(unsigned int));
+			}
+
+			/// <summary>
+			/// Builds BVHs of the meshes on the CPU, one mesh per thread, and uploads them to a single storage buffer.
+			/// Dynamic structures reserve the nodes of the largest BVH of their mesh so they can be rebuilt in place.
+			/// </summary>
+			void __BuildSoftwareStructures(int count, const MeshDescription* meshes, std::shared_ptr<__AccelerationStructure>* structures) {
+				std::vector<BVH> trees(count);
+				ParallelFor(count, 1, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; i++)
+						trees[i] = BuildBVH(meshes[i]);
+				});
+
+				// Each structure is its nodes (8 words) followed by its triangles, padded to a whole node
+				std::vector<size_t> offsets(count + 1, 0), capacities(count);
+				for (int i = 0; i < count; i++) {
+					capacities[i] = meshes[i].Dynamic ? std::max<size_t>(1, (size_t)meshes[i].TriangleCount * 2) - 1 : trees[i].Nodes.size();
+					offsets[i + 1] = offsets[i] + capacities[i] * 8 + __Align(trees[i].Triangles.size(), 8);
+				}
+				std::vector<unsigned int> words(std::max<size_t>(offsets[count], 8));
+				ParallelFor(count, 1, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; i++)
+						__WriteSoftwareStructure(trees[i], &words[offsets[i]], offsets[i], capacities[i]);
+				});
+
+				std::shared_ptr<__Resource> storage = CreateBuffer(words.size() * sizeof(unsigned int),
+					VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+				Upload(storage, words.data(), words.size() * sizeof(unsigned int), 0)->Wait();
+
+				for (int i = 0; i < count; i++) {
+					std::shared_ptr<__AccelerationStructure> structure = std::shared_ptr<__AccelerationStructure>(new __AccelerationStructure());
+					structure->device = this;
+					structure->Software = true;
+					structure->Storage = storage;
+					structure->Offset = offsets[i] / 8;
+					structure->Size = (offsets[i + 1] - offsets[i]) * sizeof(unsigned int);
+					structure->Tree = std::move(trees[i]);
+					if (meshes[i].Dynamic) {
+						__MakeDynamic(structure.get(), meshes[i]);
+						structure->Dynamic->NodeCapacity = capacities[i];
+						structure->Dynamic->SlotSize = structure->Size;
+						__CreateStaging(structure->Dynamic.get(), structure->Size * _NumberOfFrames, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+					}
+					structures[i] = structure;
+				}
+			}
+
+			/// <summary>
+			/// Records the update of a dynamic structure to new positions. The CPU BVH is refitted, or rebuilt when its SAH cost
+			/// exceeds the threshold. Hardware structures are built in update mode (or rebuilt) from the positions copied to the
+			/// staging slot of the frame, software structures are copied from their slot to the storage buffer.
+			/// </summary>
+			void UpdateAccelerationStructure(__CommandListManager* list, __AccelerationStructure* structure, const float* positions) {
+				list->__OutsideRendering("Updating an acceleration structure");
+				__DynamicGeometry* dynamic = structure->Dynamic.get();
+				if (dynamic == nullptr)
+					throw std::runtime_error("Acceleration structure is not dynamic");
+				if (dynamic->UpdatedFrame == _FrameNumber)
+					throw std::runtime_error("Acceleration structure updated twice in a frame");
+				if (list->Capture != nullptr)
+					__Capture::Unsupported(list->Captured, "UpdateAccelerationStructure");
+				dynamic->UpdatedFrame = _FrameNumber;
+
+				MeshDescription mesh = dynamic->Mesh;
+				mesh.Positions = positions;
+				bool rebuild = RefitBVH(structure->Tree, mesh) > dynamic->BuiltCost * dynamic->RebuildThreshold;
+				if (rebuild) {
+					structure->Tree = BuildBVH(mesh);
+					dynamic->BuiltCost = SAHCost(structure->Tree);
+					dynamic->Rebuilds++;
+				}
+
+				VkCommandBuffer cmdList = list->vkCmdList;
+				VkDeviceSize slot = (_FrameNumber % _NumberOfFrames) * dynamic->SlotSize;
+				VkMemoryBarrier barrier{};
+				barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+				if (structure->Software) {
+					__WriteSoftwareStructure(structure->Tree, (unsigned int*)(dynamic->Mapped + slot), structure->Offset * 8, dynamic->NodeCapacity);
+					VkBufferCopy region{ slot, structure->Offset * sizeof(BVHNode), structure->Size };
+					// Traversals of the previous nodes finish before they are overwritten
+					barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+					barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+					vkCmdPipelineBarrier(cmdList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+					vkCmdCopyBuffer(cmdList, dynamic->Staging->_Data->Buffer, structure->Storage->_Data->Buffer, 1, &region);
+					barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+					barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+					vkCmdPipelineBarrier(cmdList, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+					return;
+				}
+
+				unsigned int stride = mesh.VertexStride == 0 ? 12 : mesh.VertexStride;
+				float* packed = (float*)(dynamic->Mapped + slot);
+				for (unsigned int v = 0; v < mesh.VertexCount; v++)
+					memcpy(packed + v * 3, (const unsigned char*)positions + (size_t)v * stride, 12);
+				VkDeviceAddress staging = __BufferAddress(dynamic->Staging.get());
+
+				VkAccelerationStructureGeometryKHR geometry{};
+				geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+				geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+				geometry.flags = mesh.Opaque ? VK_GEOMETRY_OPAQUE_BIT_KHR : 0;
+				geometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
+				geometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
+				geometry.geometry.triangles.vertexData.deviceAddress = staging + slot;
+				geometry.geometry.triangles.vertexStride = 12;
+				geometry.geometry.triangles.maxVertex = std::max(1u, mesh.VertexCount) - 1;
+				geometry.geometry.triangles.indexType = mesh.Indices != nullptr ? VK_INDEX_TYPE_UINT32 : (VkIndexType)VK_INDEX_TYPE_NONE_KHR;
+				geometry.geometry.triangles.indexData.deviceAddress = mesh.Indices != nullptr ? staging + dynamic->IndexOffset : 0;
+
+				VkAccelerationStructureBuildGeometryInfoKHR info{};
+				info.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+				info.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+				info.flags = __BuildFlags(true);
+				info.mode = rebuild ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
+				info.srcAccelerationStructure = rebuild ? nullptr : structure->Structure;
+				info.dstAccelerationStructure = structure->Structure;
+				info.geometryCount = 1;
+				info.pGeometries = &geometry;
+				info.scratchData.deviceAddress = __Align(__BufferAddress(dynamic->Scratch.get()), _ScratchAlignment);
+				VkAccelerationStructureBuildRangeInfoKHR range = { mesh.TriangleCount, 0, 0, 0 };
+				const VkAccelerationStructureBuildRangeInfoKHR* ranges = &range;
+
+				// Traversals and the previous build (structure and scratch) finish before the structure is written
+				barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR | VK_ACCESS_SHADER_READ_BIT;
+				barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+				vkCmdPipelineBarrier(cmdList, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+				_vkCmdBuildAccelerationStructures(cmdList, 1, &info, &ranges);
+				barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+				barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+				vkCmdPipelineBarrier(cmdList, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+			}
+
+			/// <summary>
+			/// Creates a render pass with one color attachment and an optional depth attachment. Images are kept in general layout.
+			/// </summary>
+			VkRenderPass __CreateRenderPass(VkFormat colorFormat, VkFormat depthFormat) {
+				VkAttachmentDescription attachments[2] = { };
+				for (int i = 0; i < 2; i++) {
+					attachments[i].samples = VK_SAMPLE_COUNT_1_BIT;
+					attachments[i].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+					attachments[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+					attachments[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+					attachments[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
+					attachments[i].initialLayout = VK_IMAGE_LAYOUT_GENERAL;
+					attachments[i].finalLayout = VK_IMAGE_LAYOUT_GENERAL;
+				}
+				attachments[0].format = colorFormat;
+				attachments[1].format = depthFormat;
+
+				VkAttachmentReference colorReference{ 0, VK_IMAGE_LAYOUT_GENERAL };
+				VkAttachmentReference depthReference{ 1, VK_IMAGE_LAYOUT_GENERAL };
+
+				VkSubpassDescription subpass{};
+				subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+				subpass.colorAttachmentCount = 1;
+				subpass.pColorAttachments = &colorReference;
+				subpass.pDepthStencilAttachment = depthFormat == VK_FORMAT_UNDEFINED ? nullptr : &depthReference;
+
+				VkRenderPassCreateInfo createInfo{};
+				createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+				createInfo.attachmentCount = depthFormat == VK_FORMAT_UNDEFINED ? 1 : 2;
+				createInfo.pAttachments = attachments;
+				createInfo.subpassCount = 1;
+				createInfo.pSubpasses = &subpass;
+
+				VkRenderPass renderPass;
+				if (vkCreateRenderPass(_Device, &createInfo, nullptr, &renderPass) != VK_SUCCESS)
+					throw std::runtime_error("failed to create render pass!");
+				return renderPass;
+			}
+
+			/// <summary>
+			/// Gets the render pass of a color format and a depth format (undefined without depth), created the first time it is used.
+			/// </summary>
+			VkRenderPass __RenderPass(VkFormat colorFormat, VkFormat depthFormat) {
+				std::lock_guard<std::mutex> lock(_RenderPassesMutex);
+				VkRenderPass& renderPass = _RenderPasses[((uint64_t)colorFormat << 32) | (uint32_t)depthFormat];
+				if (renderPass == nullptr)
+					renderPass = __CreateRenderPass(colorFormat, depthFormat);
+				return renderPass;
+			}
+
+			/// <summary>
+			/// Gets the framebuffer of a render pass on a color view and an optional depth view, created the first time it is used.
+			/// It lives as long as the views, so command lists recorded or in flight in any frame or thread can use it.
+			/// </summary>
+			VkFramebuffer __Framebuffer(VkRenderPass renderPass, VkImageView color, VkImageView depth, VkExtent3D extent) {
+				std::lock_guard<std::mutex> lock(_FramebuffersMutex);
+				auto key = std::make_tuple(renderPass, color, depth);
+				auto found = _Framebuffers.find(key);
+				if (found != _Framebuffers.end())
+					return found->second;
+				VkImageView attachments[2] = { color, depth };
+				VkFramebufferCreateInfo framebufferInfo{};
+				framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+				framebufferInfo.renderPass = renderPass;
+				framebufferInfo.attachmentCount = depth == nullptr ? 1 : 2;
+				framebufferInfo.pAttachments = attachments;
+				framebufferInfo.width = extent.width;
+				framebufferInfo.height = extent.height;
+				framebufferInfo.layers = 1;
+				VkFramebuffer framebuffer;
+				if (vkCreateFramebuffer(_Device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS)
+					throw std::runtime_error("failed to create framebuffer!");
+				_Framebuffers[key] = framebuffer;
+				return framebuffer;
+			}
+
+			/// <summary>
+			/// Releases the framebuffers using a view. Called when the view is released, they are destroyed with it.
+			/// </summary>
+			void __ReleaseFramebuffers(VkImageView view) {
+				std::lock_guard<std::mutex> lock(_FramebuffersMutex);
+				for (auto f = _Framebuffers.begin(); f != _Framebuffers.end();) {
+					if (std::get<1>(f->first) == view || std::get<2>(f->first) == view) {
+						__Defer(VK_OBJECT_TYPE_FRAMEBUFFER, (uint64_t)f->second);
+						f = _Framebuffers.erase(f);
+					}
+					else
+						f++;
+				}
+			}
+
+			/// <summary>
+			/// Creates a graphics pipeline. If async, the pipeline is compiled by the pipeline compiler threads and is returned not ready.
+			/// </summary>
+			std::shared_ptr<__Pipeline> CreateGraphicsPipeline(const GraphicsPipelineDescription& description, bool async = false) {
+				std::shared_ptr<__Pipeline> pipeline = __NewGraphicsPipeline(description);
+				if (async)
+					_PipelineCompiler->Enqueue(pipeline, description);
+				else
+					__BuildGraphicsPipeline(pipeline.get(), description);
+				return pipeline;
+			}
+
+			/// <summary>
+			/// Pipeline object keeping the description and its render pass, not built yet.
+			/// </summary>
+			std::shared_ptr<__Pipeline> __NewGraphicsPipeline(const GraphicsPipelineDescription& description) {
+				std::shared_ptr<__Pipeline> pipeline = std::shared_ptr<__Pipeline>(new __Pipeline(this, VK_PIPELINE_BIND_POINT_GRAPHICS));
+				pipeline->RenderPass = __RenderPass((VkFormat)description.RenderTargetFormat, (VkFormat)description.DepthStencilFormat);
+				pipeline->__Keep(0, description.Vertex);
+				pipeline->__Keep(1, description.Fragment);
+				pipeline->Graphics = description;
+				pipeline->Graphics.Vertex = {};
+				pipeline->Graphics.Fragment = {};
+				return pipeline;
+			}
+
+			void __BuildGraphicsPipeline(__Pipeline* pipeline, const GraphicsPipelineDescription& description) {
+				// Fails before the modules are created, nothing to release
+				VkPipelineLayout layout = __PipelineLayout();
+				VkShaderModule vertex = __CreateShaderModule(description.Vertex);
+				VkShaderModule fragment;
+				try {
+					fragment = __CreateShaderModule(description.Fragment);
+				}
+				catch (...) {
+					vkDestroyShaderModule(_Device, vertex, nullptr);
+					throw;
+				}
+				__Specialization specializations[2] = { };
+				VkPipelineShaderStageCreateInfo stages[] = {
+					__StageInfo(VK_SHADER_STAGE_VERTEX_BIT, vertex, description.Vertex, specializations[0]),
+					__StageInfo(VK_SHADER_STAGE_FRAGMENT_BIT, fragment, description.Fragment, specializations[1])
+				};
+
+				VkPipelineVertexInputStateCreateInfo vertexInput{};
+				vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+				VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+				inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+				switch (description.Topology) {
+				case PrimitiveTopology::TRIANGLE_STRIP: inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP; break;
+				case PrimitiveTopology::LINE_LIST: inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST; break;
+				case PrimitiveTopology::POINT_LIST: inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST; break;
+				default: inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST; break;
+				}
+
+				// Viewport and scissor are set when recording
+				VkPipelineViewportStateCreateInfo viewport{};
+				viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+				viewport.viewportCount = 1;
+				viewport.scissorCount = 1;
+				VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+				VkPipelineDynamicStateCreateInfo dynamic{};
+				dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+				dynamic.dynamicStateCount = 2;
+				dynamic.pDynamicStates = dynamicStates;
+
+				VkPipelineRasterizationStateCreateInfo rasterization{};
+				rasterization.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+				rasterization.polygonMode = VK_POLYGON_MODE_FILL;
+				rasterization.cullMode = description.CullBackFaces ? VK_CULL_MODE_BACK_BIT : VK_CULL_MODE_NONE;
+				rasterization.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+				rasterization.lineWidth = 1.0f;
+
+				VkPipelineMultisampleStateCreateInfo multisample{};
+				multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+				multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+				VkPipelineDepthStencilStateCreateInfo depthStencil{};
+				depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+				depthStencil.depthTestEnable = description.DepthStencilFormat != 0;
+				depthStencil.depthWriteEnable = description.DepthStencilFormat != 0;
+				depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+				VkPipelineColorBlendAttachmentState blendAttachment{};
+				blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+				VkPipelineColorBlendStateCreateInfo blend{};
+				blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+				blend.attachmentCount = 1;
+				blend.pAttachments = &blendAttachment;
+
+				VkGraphicsPipelineCreateInfo createInfo{};
+				createInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+				createInfo.stageCount = 2;
+				createInfo.pStages = stages;
+				createInfo.pVertexInputState = &vertexInput;
+				createInfo.pInputAssemblyState = &inputAssembly;
+				createInfo.pViewportState = &viewport;
+				createInfo.pRasterizationState = &rasterization;
+				createInfo.pMultisampleState = &multisample;
+				createInfo.pDepthStencilState = &depthStencil;
+				createInfo.pColorBlendState = &blend;
+				createInfo.pDynamicState = &dynamic;
+				createInfo.layout = layout;
+				createInfo.renderPass = pipeline->RenderPass;
+				createInfo.subpass = 0;
+
+				VkResult result = vkCreateGraphicsPipelines(_Device, _PipelineCache->Cache, 1, &createInfo, nullptr, &pipeline->Pipeline);
+				vkDestroyShaderModule(_Device, vertex, nullptr);
+				vkDestroyShaderModule(_Device, fragment, nullptr);
+				if (result != VK_SUCCESS)
+					throw std::runtime_error("failed to create graphics pipeline!");
+			}
+
+			std::shared_ptr<__Resource> CreateImage(VkImageType type, VkFormat format, VkExtent3D extent, int mips, int arrays, VkImageUsageFlags usage) {
+				VkImageCreateInfo createInfo{};
+				createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+				createInfo.imageType = type;
+				createInfo.format = format;
+				createInfo.extent = extent;
+				createInfo.mipLevels = std::max(1, mips);
+				createInfo.arrayLayers = std::max(1, arrays);
+				createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+				createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+				createInfo.usage = usage;
+				createInfo.sharingMode = _FamilyIndices.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+				createInfo.queueFamilyIndexCount = _FamilyIndices.size() > 1 ? _FamilyIndices.size() : 0;
+				createInfo.pQueueFamilyIndices = _FamilyIndices.size() > 1 ? _FamilyIndices.data() : nullptr;
+				createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+				VkImage image;
+				if (vkCreateImage(_Device, &createInfo, nullptr, &image) != VK_SUCCESS) {
+					throw std::runtime_error("failed to create image!");
+				}
+
+				VkMemoryRequirements requirements;
+				vkGetImageMemoryRequirements(_Device, image, &requirements);
+				VkDeviceMemory memory = __AllocateMemory(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+				vkBindImageMemory(_Device, image, memory, 0);
+
+				VkImageViewType viewType =
+					type == VK_IMAGE_TYPE_1D ? (createInfo.arrayLayers > 1 ? VK_IMAGE_VIEW_TYPE_1D_ARRAY : VK_IMAGE_VIEW_TYPE_1D) :
+					type == VK_IMAGE_TYPE_2D ? (createInfo.arrayLayers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D) :
+					VK_IMAGE_VIEW_TYPE_3D;
+
+				// Only images accessed from shaders or framebuffers require a view
+				VkImageView view = nullptr;
+				if (usage & (VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT))
+				{
+					VkImageViewCreateInfo ivcreateInfo{};
+					ivcreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+					ivcreateInfo.image = image;
+					ivcreateInfo.viewType = viewType;
+					ivcreateInfo.format = format;
+					ivcreateInfo.subresourceRange.aspectMask = (usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+					ivcreateInfo.subresourceRange.baseMipLevel = 0;
+					ivcreateInfo.subresourceRange.levelCount = createInfo.mipLevels;
+					ivcreateInfo.subresourceRange.baseArrayLayer = 0;
+					ivcreateInfo.subresourceRange.layerCount = createInfo.arrayLayers;
+					if (vkCreateImageView(_Device, &ivcreateInfo, nullptr, &view) != VK_SUCCESS) {
+						throw std::runtime_error("failed to create image views!");
+					}
+				}
+
+				std::shared_ptr<__Resource> resource = std::shared_ptr<__Resource>(new __Resource(this, createInfo, image, memory, view, viewType));
+				__AccountMemory(resource.get(), requirements.size);
+				__RegisterInHeap(resource.get());
+				return resource;
+			}
+
+			/// <summary>
+			/// Validates an upload to the resource and gets the number of bytes to upload (whole first mip level for images).
+			/// </summary>
+			VkDeviceSize __UploadSize(std::shared_ptr<__Resource> resource, VkDeviceSize size, VkDeviceSize offset) {
+				if (resource->IsBuffer) {
+					if (!(resource->BufferDescription.usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT))
+						throw std::runtime_error("Uploading to a buffer without TransferDestination usage");
+					if (offset + size > resource->BufferDescription.size)
+						throw std::runtime_error("Uploading out of the buffer bounds");
+					return size;
+				}
+				if (!(resource->ImageDescription.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
+					throw std::runtime_error("Uploading to an image without TransferDestination usage");
+				return __ImageSize(resource->ImageDescription);
+			}
+
+			std::shared_ptr<__GPUTask> Upload(std::shared_ptr<__Resource> resource, const void* data, VkDeviceSize size, VkDeviceSize offset) {
+				size = __UploadSize(resource, size, offset);
+				return _Uploader->Enqueue(resource, data, size, resource->IsBuffer ? offset : 0);
+			}
+
+			/// <summary>
+			/// Uploads RGBA8 texels to an image of a block compressed format. Each chunk is encoded straight into the staging
+			/// memory by the async worker populating its batch, so the calling thread never encodes.
+			/// </summary>
+			std::shared_ptr<__GPUTask> UploadCompressed(std::shared_ptr<__Resource> resource, const unsigned char* pixels, Formats::CompressionPreset preset) {
+				if (resource->IsBuffer || __BlockExtent(resource->ImageDescription.format) == 1)
+					throw std::runtime_error("Compressed uploads need an image of a block compressed format");
+				VkDeviceSize size = __UploadSize(resource, 0, 0);
+
+				VkFormat format = resource->ImageDescription.format;
+				unsigned int width = resource->ImageDescription.extent.width;
+				unsigned int height = resource->ImageDescription.extent.height;
+				unsigned int blockRows = (height + 3) / 4;
+				VkDeviceSize rowPitch = (VkDeviceSize)__TexelSize(format) * ((width + 3) / 4);
+				VkDeviceSize slicePixels = (VkDeviceSize)width * height * 4;
+				auto produce = [=](VkDeviceSize offset, VkDeviceSize size, unsigned char* staging) {
+					// Chunks are whole block rows, possibly spanning several array slices
+					VkDeviceSize row = offset / rowPitch;
+					VkDeviceSize rows = size / rowPitch;
+					while (rows > 0) {
+						unsigned int y = (unsigned int)(row % blockRows);
+						unsigned int count = (unsigned int)std::min<VkDeviceSize>(rows, blockRows - y);
+						CompressBlockRows((FormatHandle)format, pixels + row / blockRows * slicePixels, width, height, y, count, preset, staging);
+						staging += count * rowPitch;
+						row += count;
+						rows -= count;
+					}
+				};
+				return _Uploader->Enqueue(resource, pixels, size, 0, nullptr, 0, nullptr, produce);
+			}
+
+			/// <summary>
+			/// Creates a transfer source buffer aliasing host memory. Returns null if the memory can not be imported.
+			/// </summary>
+			std::shared_ptr<__Resource> __ImportHostMemory(const void* pointer, VkDeviceSize size) {
+				if (!_SupportsHostImport || _vkGetMemoryHostPointerProperties == nullptr ||
+					(size_t)pointer % _HostImportAlignment != 0 || size % _HostImportAlignment != 0)
+					return nullptr;
+
+				VkMemoryHostPointerPropertiesEXT pointerProperties{};
+				pointerProperties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+				if (_vkGetMemoryHostPointerProperties(_Device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, pointer, &pointerProperties) != VK_SUCCESS)
+					return nullptr;
+
+				VkExternalMemoryBufferCreateInfo externalInfo{};
+				externalInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+				externalInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+				VkBufferCreateInfo createInfo{};
+				createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+				createInfo.pNext = &externalInfo;
+				createInfo.size = size;
+				createInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+				createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+				VkBuffer buffer;
+				if (vkCreateBuffer(_Device, &createInfo, nullptr, &buffer) != VK_SUCCESS)
+					return nullptr;
+
+				VkMemoryRequirements requirements;
+				vkGetBufferMemoryRequirements(_Device, buffer, &requirements);
+				uint32_t typeBits = requirements.memoryTypeBits & pointerProperties.memoryTypeBits;
+
+				VkImportMemoryHostPointerInfoEXT importInfo{};
+				importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+				importInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+				importInfo.pHostPointer = (void*)pointer;
+
+				VkMemoryAllocateInfo allocInfo{};
+				allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+				allocInfo.pNext = &importInfo;
+				allocInfo.allocationSize = size;
+
+				VkDeviceMemory memory = nullptr;
+				bool found = false;
+				for (uint32_t i = 0; i < _MemoryProperties.memoryTypeCount && !found; i++)
+					if (typeBits & (1 << i)) {
+						allocInfo.memoryTypeIndex = i;
+						found = true;
+					}
+				if (!found || vkAllocateMemory(_Device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+					vkDestroyBuffer(_Device, buffer, nullptr);
+					return nullptr;
+				}
+				vkBindBufferMemory(_Device, buffer, memory, 0);
+
+				std::shared_ptr<__Resource> resource = std::shared_ptr<__Resource>(new __Resource(this, createInfo, buffer, memory));
+				__AccountMemory(resource.get(), size);
+				return resource;
+			}
+
+			/// <summary>
+			/// Uploads the content of a file (starting at fileOffset) to the resource.
+			/// The file is mapped and its pages are imported as a transfer source when supported; otherwise
+			/// the mapped pages are streamed to the staging ring without intermediate copies.
+			/// </summary>
+			std::shared_ptr<__GPUTask> UploadFile(std::shared_ptr<__Resource> resource, const char* path, VkDeviceSize fileOffset, VkDeviceSize offset) {
+				std::shared_ptr<MappedFile> file = std::shared_ptr<MappedFile>(new MappedFile(path));
+				if (fileOffset > file->Size())
+					throw std::runtime_error("Uploading from out of the file bounds");
+				VkDeviceSize size = __UploadSize(resource, file->Size() - fileOffset, offset);
+				if (fileOffset + size > file->Size())
+					throw std::runtime_error("File is smaller than the resource to upload");
+
+				// Copy regions to images must be aligned to the texel size
+				VkDeviceSize alignment = resource->IsBuffer ? 1 : std::lcm(__TexelSize(resource->ImageDescription.format), 4);
+				std::shared_ptr<__Resource> source = nullptr;
+				if (size > 0 && fileOffset % alignment == 0)
+					source = __ImportHostMemory(file->Data(), file->MappedSize());
+				if (source != nullptr)
+					source->_Data->HostMemory = file; // The mapping must outlive the imported memory
+
+				return _Uploader->Enqueue(resource, file->Data() + fileOffset, size, resource->IsBuffer ? offset : 0, source, fileOffset, file);
+			}
+
+			/// <summary>
+			/// Gets a free readback buffer of at least the size given, or creates a new one.
+			/// </summary>
+			std::shared_ptr<__ReadbackBuffer> __AcquireReadbackBuffer(VkDeviceSize size) {
+				std::lock_guard<std::mutex> lock(_ReadbackMutex);
+				int best = -1;
+				for (int i = 0; i < (int)_ReadbackBuffers.size(); i++) {
+					std::shared_ptr<__ReadbackBuffer> b = _ReadbackBuffers[i];
+					if (b->Capacity >= size && (b->LastUse == nullptr || b->LastUse->Poll()) &&
+						(best == -1 || b->Capacity < _ReadbackBuffers[best]->Capacity))
+						best = i;
+				}
+				if (best >= 0) {
+					std::shared_ptr<__ReadbackBuffer> result = _ReadbackBuffers[best];
+					_ReadbackBuffers[best] = _ReadbackBuffers.back();
+					_ReadbackBuffers.pop_back();
+					result->LastUse = nullptr;
+					return result;
+				}
+
+				// Capacities are rounded to powers of two so buffers can be reused by readbacks of similar sizes
+				VkDeviceSize capacity = 64 * 1024;
+				while (capacity < size)
+					capacity *= 2;
+
+				VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+				for (uint32_t i = 0; i < _MemoryProperties.memoryTypeCount; i++)
+					if ((_MemoryProperties.memoryTypes[i].propertyFlags & (properties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT)) == (properties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT)) {
+						properties |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT; // cpu reads are much faster from cached memory
+						break;
+					}
+
+				std::shared_ptr<__ReadbackBuffer> result = std::shared_ptr<__ReadbackBuffer>(new __ReadbackBuffer());
+				result->Buffer = CreateBuffer(capacity, VK_BUFFER_USAGE_TRANSFER_DST_BIT, properties);
+				result->Capacity = capacity;
+				if (vkMapMemory(_Device, result->Buffer->_Data->Memory, 0, capacity, 0, (void**)&result->Mapped) != VK_SUCCESS) {
+					throw std::runtime_error("failed to map readback memory!");
+				}
+				return result;
+			}
+
+			void __ReleaseReadbackBuffer(std::shared_ptr<__ReadbackBuffer> buffer, std::shared_ptr<__GPUTask> lastUse) {
+				std::lock_guard<std::mutex> lock(_ReadbackMutex);
+				buffer->LastUse = lastUse;
+				_ReadbackBuffers.push_back(buffer);
+			}
+
+			std::shared_ptr<__Readback> __CreateReadback(std::shared_ptr<__Resource> resource, VkDeviceSize size, VkDeviceSize offset) {
+				if (resource->IsBuffer) {
+					if (!(resource->BufferDescription.usage & VK_BUFFER_USAGE_TRANSFER_SRC_BIT))
+						throw std::runtime_error("Downloading from a buffer without TransferSource usage");
+					if (offset > resource->BufferDescription.size)
+						throw std::runtime_error("Downloading out of the buffer bounds");
+					if (size == 0)
+						size = resource->BufferDescription.size - offset;
+					if (offset + size > resource->BufferDescription.size)
+						throw std::runtime_error("Downloading out of the buffer bounds");
+				}
+				else {
+					if (resource->_Data->Swapchain)
+						throw std::runtime_error("Downloading a swapchain image, presented images are not in a layout the copy can read");
+					if (!(resource->ImageDescription.usage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT))
+						throw std::runtime_error("Downloading from an image without TransferSource usage");
+					size = __ImageSize(resource->ImageDescription);
+					offset = 0;
+				}
+
+				std::shared_ptr<__Readback> readback = std::shared_ptr<__Readback>(new __Readback());
+				readback->device = this;
+				readback->Source = resource;
+				readback->Offset = offset;
+				readback->Size = size;
+				readback->Staging = __AcquireReadbackBuffer(std::max<VkDeviceSize>(size, 1));
+				readback->Task = std::shared_ptr<__GPUTask>(new __GPUTask());
+				readback->Task->device = _Device;
+				return readback;
+			}
+
+			/// <summary>
+			/// Enqueues the copy of a resource to a readback buffer, recorded when the frame ends. Any thread can download.
+			/// </summary>
+			std::shared_ptr<__Readback> Download(std::shared_ptr<__Resource> resource, VkDeviceSize size, VkDeviceSize offset) {
+				std::shared_ptr<__Readback> readback = __CreateReadback(resource, size, offset);
+
+				std::lock_guard<std::mutex> lock(_ReadbackMutex);
+				_PendingReadbacks.push_back(readback);
+				return readback;
+			}
+
+			/// <summary>
+			/// Waits the population of every frame async piece dispatched in the frame, also the ones no worker has taken yet.
+			/// </summary>
+			void __WaitFramePopulation() {
+				std::vector<std::shared_ptr<WorkPiece>> pieces;
+				{
+					std::lock_guard<std::mutex> lock(_FramePiecesMutex);
+					pieces.swap(_FramePieces);
+				}
+				for (std::shared_ptr<WorkPiece> w : pieces)
+					w->AfterPopulated.Wait();
+			}
+
+			/// <summary>
+			/// Records the readbacks requested in the frame in a command list of the main thread, submitted after the command lists of the frame.
+			/// </summary>
+			void __FrameSubmitted(std::vector<std::shared_ptr<__GPUTask>>& tasks) {
+				std::shared_ptr<__ReadbackProcess> process = std::shared_ptr<__ReadbackProcess>(new __ReadbackProcess());
+				{
+					std::lock_guard<std::mutex> lock(_ReadbackMutex);
+					process->Readbacks.swap(_PendingReadbacks);
+				}
+				if (process->Readbacks.empty())
+					return;
+
+				std::shared_ptr<__CPUTask> populating = Dispatch(process, DispatchMode::MAIN_THREAD);
+				std::shared_ptr<__GPUTask> copied = Flush(1, &populating, tasks.size(), tasks.data());
+				for (std::shared_ptr<__Readback> r : process->Readbacks) {
+					r->Task->children.push_back(copied);
+					r->Submitted.store(true, std::memory_order_release);
+				}
+			}
+
+			void AttachOutput(const FrameOutputDescription& description) {
+				if (_Swapchain != nullptr)
+					throw std::runtime_error("Frame output requires an OFFLINE presenter, swapchain images are not read back");
+				DetachOutput();
+				_FrameWriter = new __FrameWriter(description, PresentationFormat, _RT_Resolution, _NumberOfFrames);
+			}
+
+			void DetachOutput() {
+				if (_FrameWriter == nullptr)
+					return;
+				_FrameWriter->Close();
+				delete _FrameWriter;
+				_FrameWriter = nullptr;
+			}
+
+			/// <summary>
+			/// Reads back the current render target after all command lists of the frame and sends it to the frame writer.
+			/// </summary>
+			void __OutputFrame(std::vector<std::shared_ptr<__GPUTask>>& frameTasks) {
+				std::shared_ptr<__Readback> readback = __CreateReadback(_RenderTargets[_ImageIndex].__state, 0, 0);
+				std::shared_ptr<__ReadbackProcess> process = std::shared_ptr<__ReadbackProcess>(new __ReadbackProcess());
+				process->Readbacks.push_back(readback);
+
+				// Submitted on its own, waiting for the frame command lists of every engine.
+				std::shared_ptr<__CPUTask> populating = Dispatch(process, DispatchMode::MAIN_THREAD);
+				readback->Task = Flush(1, &populating, frameTasks.size(), frameTasks.data());
+				readback->Submitted.store(true, std::memory_order_release);
+
+				_FrameWriter->Push(readback);
 			}
 
 			std::shared_ptr<WorkPiece> __CreateWorkPiece(std::shared_ptr<Process> process, DispatchMode mode) {
@@ -716,10 +3670,20 @@ namespace goofy {
 
 			static void __OompaLoompaWork(__Device* _this, int idx) {
 				std::cout << "Created worker " << idx << std::endl;
-				while (!_this->_disposed) {
+				Tracer::NameThread((idx <= _this->_NumberOfAsyncThreadsInFrame ? "Frame worker " : "Async worker ") + std::to_string(idx));
+				ThreadCounters& counters = Metrics::Local(_this->_Device);
+				counters.Worker.store(idx, std::memory_order_relaxed);
+				while (true) {
 					// Do work here...
+					unsigned long long idle = Tracer::Now();
 					std::shared_ptr<WorkPiece> workPiece = idx <= _this->_NumberOfAsyncThreadsInFrame ? _this->_FrameAsyncProcesses->Consume() : _this->_AsyncProcesses->Consume();
+					unsigned long long busy = Tracer::Now();
+					ThreadCounters::Add(counters.IdleNanoseconds, busy - idle);
 					_this->__PerformPopulation(workPiece, idx);
+					ThreadCounters::Add(counters.BusyNanoseconds, Tracer::Now() - busy);
+					// Each worker leaves on the cleaning piece it takes, work still being populated at disposal is not abandoned
+					if (dynamic_cast<CleaningProcess*>(workPiece->GraphicProcess.get()) != nullptr)
+						break;
 				}
 				std::cout << "Finished worker " << idx << std::endl;
 			}
@@ -730,6 +3694,7 @@ namespace goofy {
 			}
 
 			__Device(const PresenterDescription& description) {
+				Tracer::NameThread("Main");
 				__create_vk_instance(description);
 				__create_vk_surface(description);
 				__create_vk_physical_device();
@@ -738,7 +3703,9 @@ namespace goofy {
 			}
 
 			~__Device() {
-				_disposed = true;
+				DetachOutput(); // Queued frames are written
+				if (_Uploader)
+					_Uploader->Finish(); // Pending uploads are discarded
 				std::shared_ptr<Process> cleaning = std::shared_ptr<Process>(new CleaningProcess());
 				for (int i = 0; i < _NumberOfAsyncThreads; i++)
 				{
@@ -753,10 +3720,44 @@ namespace goofy {
 				for (int i = 0; i < _OompaLoompas.size(); i++)
 					_OompaLoompas[i].join();
 				_OompaLoompas.clear(); // join all threads
+				delete _PipelineCompiler;
+				_PipelineCompiler = nullptr;
+				vkDeviceWaitIdle(_Device); // Nothing can be in use by the GPU from now on
+				delete _Uploader;
+				_PendingReadbacks.clear();
+				for (std::shared_ptr<__ReadbackBuffer> b : _ReadbackBuffers)
+					vkUnmapMemory(_Device, b->Buffer->_Data->Memory);
+				_ReadbackBuffers.clear();
 				_RenderTargets.clear(); // Destroy all RTs objects
+				_Destruction->Managers.clear(); // The device is idle, no list references later releases
 				for (int i = 0; i < _Engines.size(); i++)
 					delete _Engines[i];
+#ifndef GOOFY_NO_PROFILING
+				delete _Profiler;
+				_Profiler = nullptr;
+#endif
+				_Downsamplers.clear();
+				_Culler = nullptr;
+				for (auto& framebuffer : _Framebuffers)
+					vkDestroyFramebuffer(_Device, framebuffer.second, nullptr);
+				_Framebuffers.clear();
+				for (auto& renderPass : _RenderPasses)
+					vkDestroyRenderPass(_Device, renderPass.second, nullptr);
+				_RenderPasses.clear();
+				_Scratch = nullptr;
+				delete _PipelineCache; // Saved to disk
+				_PipelineCache = nullptr;
+				delete _Pool; // Registered resources release their views and heap indices
+				_Pool = nullptr;
+				delete _Views;
+				_Views = nullptr;
+				delete _Heap;
+				_Heap = nullptr;
+				_Destruction->DestroyAll();
+				delete _Destruction;
+				_Destruction = nullptr;
 				if (_Swapchain) vkDestroySwapchainKHR(_Device, _Swapchain, nullptr);
+				Metrics::Release(_Device);
 				if (_Device) vkDestroyDevice(_Device, nullptr);
 				if (_Surface) vkDestroySurfaceKHR(_Instance, _Surface, nullptr);
 				if (_Instance) vkDestroyInstance(_Instance, nullptr);
@@ -784,7 +3785,12 @@ namespace goofy {
 				}
 
 				auto workPiece = __CreateWorkPiece(process, mode);
+				if (_Capture != nullptr) {
+					workPiece->Capture = _Capture;
+					workPiece->CaptureId = _Capture->Dispatch(process.get(), mode);
+				}
 				std::shared_ptr<__CPUTask> task = std::shared_ptr<states::__CPUTask>(new states::__CPUTask());
+				task->device = _Device;
 				task->workPiece = workPiece;
 
 				switch (mode)
@@ -796,6 +3802,10 @@ namespace goofy {
 				}
 				case goofy::DispatchMode::ASYNC_FRAME:
 				{
+					{
+						std::lock_guard<std::mutex> lock(_FramePiecesMutex);
+						_FramePieces.push_back(workPiece);
+					}
 					_FrameAsyncProcesses->Produce(workPiece);
 					break;
 				}
@@ -818,11 +3828,17 @@ namespace goofy {
 				}
 
 				__GPUTask* result = new __GPUTask();
-				
+				result->device = _Device;
+
 				for (auto e : _Engines)
 					e->FlushMarked(waitingCount, waitingGPU, result->children);
-				
-				return std::shared_ptr<__GPUTask>(result);
+
+				std::shared_ptr<__GPUTask> flushed = std::shared_ptr<__GPUTask>(result);
+				_Destruction->Submitted(result->children.size(), result->children.data());
+				_Destruction->Retire();
+				if (_Capture != nullptr)
+					_Capture->Flush(count, tasks, waitingCount, waitingGPU, flushed);
+				return flushed;
 			}
 		};
 
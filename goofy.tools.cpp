@@ -1,5 +1,22 @@
 #include "goofy.internal.h"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <map>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace goofy {
 
 	template<typename S>
@@ -42,8 +59,1129 @@ namespace goofy {
 		s.SignalAll();
 	}
 
+#pragma endregion
+
+#pragma region Mapped Files
+
+#ifdef _WIN32
+
+	MappedFile::MappedFile(const char* path) {
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("failed to open file!");
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize)) {
+			CloseHandle(file);
+			throw std::runtime_error("failed to get file size!");
+		}
+		size = fileSize.QuadPart;
+		if (size == 0)
+			return;
+
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		mappedSize = (size + info.dwPageSize - 1) / info.dwPageSize * info.dwPageSize;
+
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr || (data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) == nullptr) {
+			if (mapping) CloseHandle(mapping);
+			CloseHandle(file);
+			throw std::runtime_error("failed to map file!");
+		}
+	}
+
+	MappedFile::~MappedFile() {
+		if (data) UnmapViewOfFile(data);
+		if (mapping) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	}
+
+#else
+
+	MappedFile::MappedFile(const char* path) {
+		file = open(path, O_RDONLY);
+		if (file < 0)
+			throw std::runtime_error("failed to open file!");
+
+		struct stat fileStat;
+		if (fstat(file, &fileStat) != 0) {
+			close(file);
+			throw std::runtime_error("failed to get file size!");
+		}
+		size = fileStat.st_size;
+		if (size == 0)
+			return;
+
+		long pageSize = sysconf(_SC_PAGESIZE);
+		mappedSize = (size + pageSize - 1) / pageSize * pageSize;
+
+		data = mmap(nullptr, mappedSize, PROT_READ, MAP_SHARED, file, 0);
+		if (data == MAP_FAILED) {
+			data = nullptr;
+			close(file);
+			throw std::runtime_error("failed to map file!");
+		}
+		// Assets are consumed front to back, let the OS read ahead.
+		madvise(data, mappedSize, MADV_SEQUENTIAL);
+	}
+
+	MappedFile::~MappedFile() {
+		if (data) munmap(data, mappedSize);
+		if (file >= 0) close(file);
+	}
+
+#endif
+
 	
 
+#pragma endregion
+
+#pragma region Files
+
+	unsigned long long Hash(const void* data, size_t size, unsigned long long seed) {
+		const unsigned char* bytes = (const unsigned char*)data;
+		unsigned long long hash = seed;
+		for (size_t i = 0; i < size; i++) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	bool ReadFile(const char* path, std::vector<unsigned char>& content) {
+		FILE* file = fopen(path, "rb");
+		if (file == nullptr)
+			return false;
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		content.resize(size < 0 ? 0 : size);
+		bool read = size >= 0 && fread(content.data(), 1, content.size(), file) == content.size();
+		fclose(file);
+		return read;
+	}
+
+	bool WriteFileAtomically(const char* path, const void* data, size_t size, bool durable) {
+		// Unique per process and call, concurrent writers of the same path never share a temporary file
+		static std::atomic<unsigned int> temporaries = { 0 };
+#ifdef _WIN32
+		unsigned long process = GetCurrentProcessId();
+#else
+		unsigned long process = (unsigned long)getpid();
+#endif
+		std::string temporary = std::string(path) + "." + std::to_string(process) + "." + std::to_string(temporaries.fetch_add(1, std::memory_order_relaxed)) + ".tmp";
+		FILE* file = fopen(temporary.c_str(), "wb");
+		if (file == nullptr)
+			return false;
+		bool written = fwrite(data, 1, size, file) == size;
+		written &= fflush(file) == 0;
+		if (durable) {
+#ifdef _WIN32
+			written &= FlushFileBuffers((HANDLE)_get_osfhandle(_fileno(file))) != 0;
+#else
+			written &= fsync(fileno(file)) == 0;
+#endif
+		}
+		written &= fclose(file) == 0;
+		if (!written) {
+			remove(temporary.c_str());
+			return false;
+		}
+#ifdef _WIN32
+		if (!MoveFileExA(temporary.c_str(), path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+#else
+		if (rename(temporary.c_str(), path) != 0) {
+#endif
+			remove(temporary.c_str());
+			return false;
+		}
+		return true;
+	}
+
+#pragma endregion
+
+#pragma region Tracing
+
+	std::atomic<bool> Tracer::Enabled = { false };
+	std::atomic<long long> Tracer::Frame = { 0 };
+	std::atomic<unsigned int> Tracer::Session = { 0 };
+
+	static std::mutex __traceMutex;
+	static std::vector<std::unique_ptr<TraceBuffer>> __traceBuffers;
+	// Capacity of the first trace, every buffer is allocated with it
+	static unsigned int __traceCapacity = 0;
+	static unsigned long long __traceStart = 0;
+
+	/// <summary>
+	/// Allocates the events of a buffer without them. Called under the trace mutex, the capacity publishes the events.
+	/// </summary>
+	static void __AllocateTrace(TraceBuffer* buffer) {
+		if (__traceCapacity == 0 || buffer->Capacity.load(std::memory_order_relaxed) != 0)
+			return;
+		buffer->Events.reset(new TraceEvent[__traceCapacity]);
+		buffer->Capacity.store(__traceCapacity, std::memory_order_release);
+	}
+
+	TraceBuffer* Tracer::__Buffer() {
+		// Buffers are registered once per thread and live until the process ends
+		thread_local TraceBuffer* buffer = nullptr;
+		if (buffer == nullptr) {
+			std::lock_guard<std::mutex> lock(__traceMutex);
+			__traceBuffers.push_back(std::unique_ptr<TraceBuffer>(new TraceBuffer()));
+			buffer = __traceBuffers.back().get();
+			buffer->Thread = (int)__traceBuffers.size() - 1;
+			buffer->Name = "Thread " + std::to_string(buffer->Thread);
+			// Threads started during a trace join it, the allocation is paid once per thread and not per event
+			__AllocateTrace(buffer);
+			buffer->Session.store(Session.load());
+		}
+		return buffer;
+	}
+
+	void Tracer::Start(unsigned int eventsPerThread) {
+		Enabled.store(false);
+		{
+			std::lock_guard<std::mutex> lock(__traceMutex);
+			if (__traceCapacity == 0)
+				__traceCapacity = eventsPerThread;
+			// Scopes still open from the previous trace drop their events, buffers are not reallocated under them
+			unsigned int session = ++Session;
+			for (std::unique_ptr<TraceBuffer>& buffer : __traceBuffers) {
+				__AllocateTrace(buffer.get());
+				buffer->Count.store(0);
+				buffer->Session.store(session);
+			}
+			__traceStart = Now();
+		}
+		Enabled.store(true);
+	}
+
+	void Tracer::Stop() {
+		Enabled.store(false);
+	}
+
+	void Tracer::NameThread(const std::string& name) {
+		TraceBuffer* buffer = __Buffer();
+		std::lock_guard<std::mutex> lock(__traceMutex);
+		buffer->Name = name;
+	}
+
+	unsigned long long Tracer::Now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void Tracer::Record(const char* name, unsigned long long begin, long long frame, unsigned int session) {
+		if (session != Session.load(std::memory_order_relaxed))
+			return; // Started in an older trace
+		unsigned long long end = Now();
+		TraceBuffer* buffer = __Buffer();
+		unsigned int count = buffer->Count.load(std::memory_order_relaxed);
+		if (count >= buffer->Capacity.load(std::memory_order_acquire))
+			return;
+		buffer->Events[count] = { name, begin, end, frame };
+		buffer->Count.store(count + 1, std::memory_order_release);
+	}
+
+	static void __WriteEscaped(std::string& json, const char* text) {
+		for (const char* c = text; *c != 0; c++) {
+			if (*c == '"' || *c == '\\')
+				json += '\\';
+			json += *c;
+		}
+	}
+
+	bool Tracer::Write(const char* path) {
+		std::string json = "{\"traceEvents\":[\n";
+		char line[256];
+		bool first = true;
+		std::lock_guard<std::mutex> lock(__traceMutex);
+		unsigned int session = Session.load();
+		for (std::unique_ptr<TraceBuffer>& buffer : __traceBuffers) {
+			if (buffer->Session.load() != session || buffer->Count.load(std::memory_order_acquire) == 0)
+				continue; // Recorded nothing in this trace
+			json += first ? "" : ",\n";
+			first = false;
+			snprintf(line, sizeof(line), "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"", buffer->Thread);
+			json += line;
+			__WriteEscaped(json, buffer->Name.c_str());
+			json += "\"}}";
+			unsigned int count = buffer->Count.load(std::memory_order_acquire);
+			for (unsigned int i = 0; i < count; i++) {
+				const TraceEvent& e = buffer->Events[i];
+				json += ",\n{\"ph\":\"X\",\"name\":\"";
+				__WriteEscaped(json, e.Name);
+				snprintf(line, sizeof(line), "\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%lld}}",
+					buffer->Thread, (e.Begin - __traceStart) / 1000.0, (e.End - e.Begin) / 1000.0, e.Frame);
+				json += line;
+			}
+		}
+		json += "\n]}\n";
+		return WriteFileAtomically(path, json.data(), json.size());
+	}
+
+#pragma endregion
+
+#pragma region Metrics
+
+	static std::mutex __metricsMutex;
+	// Counters of the live threads and totals of the exited ones, by the device they count for
+	static std::multimap<const void*, ThreadCounters*> __metricsCounters;
+	static std::map<const void*, std::unique_ptr<ThreadCounters>> __metricsExited;
+
+	/// <summary>
+	/// Counters of a thread for every device it counted for. They are unregistered when the thread exits, so readers never
+	/// visit the counters of a finished thread.
+	/// </summary>
+	struct __ThreadMetrics {
+		std::vector<std::unique_ptr<ThreadCounters>> Counters;
+
+		~__ThreadMetrics() {
+			std::lock_guard<std::mutex> lock(__metricsMutex);
+			for (std::unique_ptr<ThreadCounters>& counters : Counters) {
+				if (!counters->Registered.load())
+					continue; // Device released
+				auto range = __metricsCounters.equal_range(counters->Owner);
+				for (auto c = range.first; c != range.second; c++)
+					if (c->second == counters.get()) {
+						__metricsCounters.erase(c);
+						break;
+					}
+				std::unique_ptr<ThreadCounters>& exited = __metricsExited[counters->Owner];
+				if (exited == nullptr)
+					exited = std::unique_ptr<ThreadCounters>(new ThreadCounters());
+				exited->Accumulate(*counters);
+			}
+		}
+	};
+
+	int ThreadCounters::Bucket(unsigned long long nanoseconds) {
+		unsigned long long microseconds = nanoseconds / 1000;
+		int bucket = 0;
+		while (bucket < Buckets - 1 && microseconds >= (1ull << bucket))
+			bucket++;
+		return bucket;
+	}
+
+	void ThreadCounters::Accumulate(const ThreadCounters& other) {
+		Add(Dispatches, other.Dispatches.load(std::memory_order_relaxed));
+		Add(Submits, other.Submits.load(std::memory_order_relaxed));
+		Add(BusyNanoseconds, other.BusyNanoseconds.load(std::memory_order_relaxed));
+		Add(IdleNanoseconds, other.IdleNanoseconds.load(std::memory_order_relaxed));
+		for (int i = 0; i < Buckets; i++) {
+			Add(CPUWaits[i], other.CPUWaits[i].load(std::memory_order_relaxed));
+			Add(GPUWaits[i], other.GPUWaits[i].load(std::memory_order_relaxed));
+		}
+		Add(CPUWaitNanoseconds, other.CPUWaitNanoseconds.load(std::memory_order_relaxed));
+		Add(GPUWaitNanoseconds, other.GPUWaitNanoseconds.load(std::memory_order_relaxed));
+	}
+
+	ThreadCounters& Metrics::Local(const void* owner) {
+		thread_local __ThreadMetrics local;
+		// Threads count for a single device almost always
+		thread_local ThreadCounters* last = nullptr;
+		if (last != nullptr && last->Owner == owner && last->Registered.load(std::memory_order_relaxed))
+			return *last;
+		for (std::unique_ptr<ThreadCounters>& counters : local.Counters)
+			if (counters->Owner == owner && counters->Registered.load(std::memory_order_relaxed))
+				return *(last = counters.get());
+
+		std::lock_guard<std::mutex> lock(__metricsMutex);
+		// Counters of released devices are not listed anymore
+		local.Counters.erase(std::remove_if(local.Counters.begin(), local.Counters.end(),
+			[](const std::unique_ptr<ThreadCounters>& c) { return !c->Registered.load(); }), local.Counters.end());
+		last = nullptr;
+		ThreadCounters* counters = new ThreadCounters();
+		counters->Owner = owner;
+		counters->Registered.store(true);
+		local.Counters.push_back(std::unique_ptr<ThreadCounters>(counters));
+		__metricsCounters.emplace(owner, counters);
+		return *(last = counters);
+	}
+
+	void Metrics::ForEach(const void* owner, const std::function<void(const ThreadCounters&)>& visit) {
+		std::lock_guard<std::mutex> lock(__metricsMutex);
+		auto range = __metricsCounters.equal_range(owner);
+		for (auto c = range.first; c != range.second; c++)
+			visit(*c->second);
+		auto exited = __metricsExited.find(owner);
+		if (exited != __metricsExited.end())
+			visit(*exited->second);
+	}
+
+	void Metrics::Release(const void* owner) {
+		std::lock_guard<std::mutex> lock(__metricsMutex);
+		auto range = __metricsCounters.equal_range(owner);
+		for (auto c = range.first; c != range.second; c++)
+			c->second->Registered.store(false);
+		__metricsCounters.erase(range.first, range.second);
+		__metricsExited.erase(owner);
+	}
+
+#pragma endregion
+
+#pragma region Parallel
+
+	struct __ParallelJob {
+		const std::function<void(size_t, size_t)>* Body;
+		size_t Count;
+		size_t Grain;
+		std::atomic<size_t> Next = { 0 };
+
+		void Run() {
+			size_t begin;
+			while ((begin = Next.fetch_add(Grain)) < Count)
+				(*Body)(begin, std::min(Count, begin + Grain));
+		}
+	};
+
+	/// <summary>
+	/// Threads running the ranges of one job at a time. Workers register while running a job so the submitter knows when
+	/// the job (living in its stack) is no longer referenced.
+	/// </summary>
+	class __ParallelPool {
+		std::vector<std::thread> threads;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::condition_variable finished;
+		__ParallelJob* job = nullptr;
+		unsigned long long generation = 0;
+		int active = 0;
+		bool stop = false;
+		std::mutex submit;
+
+		void Work() {
+			unsigned long long seen = 0;
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true) {
+				wake.wait(lock, [&] { return stop || (job != nullptr && generation != seen); });
+				if (stop)
+					return;
+				seen = generation;
+				__ParallelJob* current = job;
+				active++;
+				lock.unlock();
+				current->Run();
+				lock.lock();
+				if (--active == 0)
+					finished.notify_all();
+			}
+		}
+
+	public:
+		__ParallelPool() {
+			unsigned int count = std::thread::hardware_concurrency();
+			for (unsigned int i = 1; i < count; i++)
+				threads.push_back(std::thread([this] { Work(); }));
+		}
+
+		~__ParallelPool() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stop = true;
+			}
+			wake.notify_all();
+			for (std::thread& thread : threads)
+				thread.join();
+		}
+
+		void Run(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+			__ParallelJob local;
+			local.Body = &body;
+			local.Count = count;
+			local.Grain = grain;
+			// Nested and concurrent jobs run on the calling thread instead of waiting for the pool
+			std::unique_lock<std::mutex> submitting(submit, std::try_to_lock);
+			if (threads.empty() || count <= grain || !submitting.owns_lock()) {
+				local.Run();
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				job = &local;
+				generation++;
+			}
+			wake.notify_all();
+			local.Run();
+			std::unique_lock<std::mutex> lock(mutex);
+			job = nullptr;
+			finished.wait(lock, [&] { return active == 0; });
+		}
+	};
+
+	void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+		static __ParallelPool pool;
+		pool.Run(count, std::max<size_t>(1, grain), body);
+	}
+
+#pragma endregion
+
+#pragma region Shaders
+
+	/// <summary>
+	/// Appends an instruction to a section of a SPIR-V module. The word count is taken from the operands.
+	/// </summary>
+	static void __Op(std::vector<unsigned int>& section, unsigned int opcode, const std::vector<unsigned int>& operands) {
+		section.push_back(((unsigned int)operands.size() + 1) << 16 | opcode);
+		section.insert(section.end(), operands.begin(), operands.end());
+	}
+
+	/// <summary>
+	/// Words of a literal string, nul terminated and padded to a whole word.
+	/// </summary>
+	static std::vector<unsigned int> __Literal(const char* text) {
+		std::vector<unsigned int> words(strlen(text) / 4 + 1, 0);
+		memcpy(words.data(), text, strlen(text));
+		return words;
+	}
+
+	std::vector<unsigned int> DownsampleShader(unsigned int format, bool volume, int levels) {
+		// Opcodes
+		enum : unsigned int {
+			Extension = 10, MemoryModel = 14, EntryPoint = 15, ExecutionMode = 16, Capability = 17,
+			TypeVoid = 19, TypeBool = 20, TypeInt = 21, TypeFloat = 22, TypeVector = 23, TypeImage = 25, TypeArray = 28,
+			TypeRuntimeArray = 29, TypeStruct = 30, TypePointer = 32, TypeFunction = 33, Constant = 43,
+			Function = 54, FunctionEnd = 56, Variable = 59, Load = 61, AccessChain = 65, Decorate = 71, MemberDecorate = 72,
+			CompositeConstruct = 80, CompositeExtract = 81, ImageRead = 98, ImageWrite = 99, Bitcast = 124,
+			IAdd = 128, FAdd = 129, VectorTimesScalar = 142, LogicalAnd = 167, Select = 169, UGreaterThan = 172,
+			ULessThan = 176, ULessThanEqual = 178, ShiftLeftLogical = 196, SelectionMerge = 247, Label = 248,
+			Branch = 249, BranchConditional = 250, Return = 253
+		};
+		// Storage classes
+		enum : unsigned int { UniformConstant = 0, Input = 1, PushConstant = 9 };
+
+		std::vector<unsigned int> preamble, annotations, types, code;
+		unsigned int bound = 1;
+		auto id = [&] { return bound++; };
+		int axes = volume ? 3 : 2;
+
+		__Op(preamble, Capability, { 1 }); // Shader
+		__Op(preamble, Capability, { 31 }); // StorageImageArrayDynamicIndexing
+		__Op(preamble, Capability, { 5302 }); // RuntimeDescriptorArray
+		if (format >= 6) // Formats past Rgba8Snorm
+			__Op(preamble, Capability, { 49 }); // StorageImageExtendedFormats
+		std::vector<unsigned int> extension = __Literal("SPV_EXT_descriptor_indexing");
+		__Op(preamble, Extension, extension);
+		__Op(preamble, MemoryModel, { 0, 1 }); // Logical GLSL450
+
+		unsigned int tVoid = id(), tFunction = id(), tBool = id(), tUint = id(), tInt = id(), tFloat = id();
+		unsigned int tUvec3 = id(), tIvec3 = id(), tVec4 = id();
+		__Op(types, TypeVoid, { tVoid });
+		__Op(types, TypeFunction, { tFunction, tVoid });
+		__Op(types, TypeBool, { tBool });
+		__Op(types, TypeInt, { tUint, 32, 0 });
+		__Op(types, TypeInt, { tInt, 32, 1 });
+		__Op(types, TypeFloat, { tFloat, 32 });
+		__Op(types, TypeVector, { tUvec3, tUint, 3 });
+		__Op(types, TypeVector, { tIvec3, tInt, 3 });
+		__Op(types, TypeVector, { tVec4, tFloat, 4 });
+
+		std::map<unsigned int, unsigned int> constants;
+		auto uintConstant = [&](unsigned int value) {
+			unsigned int& constant = constants[value];
+			if (constant == 0) {
+				constant = id();
+				__Op(types, Constant, { tUint, constant, value });
+			}
+			return constant;
+		};
+		float weight = volume ? 0.125f : 0.25f;
+		unsigned int cWeight = id(), weightBits;
+		memcpy(&weightBits, &weight, 4);
+		__Op(types, Constant, { tFloat, cWeight, weightBits });
+
+		// Storage images of the descriptor heap: set 0, binding 1. 2D images are accessed as arrays, the layer is the z coordinate.
+		unsigned int tImage = id(), tImages = id(), tImagesPointer = id(), tImagePointer = id(), vImages = id();
+		__Op(types, TypeImage, { tImage, tFloat, volume ? 2u : 1u, 0, volume ? 0u : 1u, 0, 2, format });
+		__Op(types, TypeRuntimeArray, { tImages, tImage });
+		__Op(types, TypePointer, { tImagesPointer, UniformConstant, tImages });
+		__Op(types, TypePointer, { tImagePointer, UniformConstant, tImage });
+		__Op(types, Variable, { tImagesPointer, vImages, UniformConstant });
+		__Op(annotations, Decorate, { vImages, 34, 0 }); // DescriptorSet
+		__Op(annotations, Decorate, { vImages, 33, 1 }); // Binding
+
+		// Push constants: source index, destination indices, then the last texel coordinate of every level
+		unsigned int words = 1 + levels + 3 * (levels + 1);
+		unsigned int tArray = id(), tBlock = id(), tBlockPointer = id(), tWordPointer = id(), vConstants = id();
+		__Op(types, TypeArray, { tArray, tUint, uintConstant(words) });
+		__Op(types, TypeStruct, { tBlock, tArray });
+		__Op(types, TypePointer, { tBlockPointer, PushConstant, tBlock });
+		__Op(types, TypePointer, { tWordPointer, PushConstant, tUint });
+		__Op(types, Variable, { tBlockPointer, vConstants, PushConstant });
+		__Op(annotations, Decorate, { tArray, 6, 4 }); // ArrayStride
+		__Op(annotations, MemberDecorate, { tBlock, 0, 35, 0 }); // Offset
+		__Op(annotations, Decorate, { tBlock, 2 }); // Block
+
+		unsigned int tInputPointer = id(), vInvocation = id();
+		__Op(types, TypePointer, { tInputPointer, Input, tUvec3 });
+		__Op(types, Variable, { tInputPointer, vInvocation, Input });
+		__Op(annotations, Decorate, { vInvocation, 11, 28 }); // BuiltIn GlobalInvocationId
+
+		unsigned int fMain = id();
+		std::vector<unsigned int> entryPoint = { 5, fMain }; // GLCompute
+		std::vector<unsigned int> name = __Literal("main");
+		entryPoint.insert(entryPoint.end(), name.begin(), name.end());
+		entryPoint.push_back(vInvocation);
+		__Op(preamble, EntryPoint, entryPoint);
+		__Op(preamble, ExecutionMode, { fMain, 17, 8, 8, 1 }); // LocalSize
+
+		__Op(code, Function, { tVoid, fMain, 0, tFunction });
+		__Op(code, Label, { id() });
+
+		auto word = [&](unsigned int index) {
+			unsigned int pointer = id(), value = id();
+			__Op(code, AccessChain, { tWordPointer, pointer, vConstants, uintConstant(0), uintConstant(index) });
+			__Op(code, Load, { tUint, value, pointer });
+			return value;
+		};
+		auto image = [&](unsigned int index) {
+			unsigned int pointer = id(), value = id();
+			__Op(code, AccessChain, { tImagePointer, pointer, vImages, word(index) });
+			__Op(code, Load, { tImage, value, pointer });
+			return value;
+		};
+		std::vector<unsigned int> images;
+		for (int level = 0; level <= levels; level++)
+			images.push_back(image(level));
+		std::vector<std::array<unsigned int, 3>> last(levels + 1), step(levels);
+		for (int level = 0; level <= levels; level++)
+			for (int a = 0; a < axes; a++)
+				last[level][a] = word(1 + levels + 3 * level + a);
+		// Axes already down to one texel are not halved, every child is the same texel
+		for (int level = 0; level < levels; level++)
+			for (int a = 0; a < axes; a++) {
+				unsigned int halved = id();
+				step[level][a] = id();
+				__Op(code, UGreaterThan, { tBool, halved, last[level][a], uintConstant(0) });
+				__Op(code, Select, { tUint, step[level][a], halved, uintConstant(1), uintConstant(0) });
+			}
+
+		unsigned int invocation = id();
+		std::array<unsigned int, 3> group;
+		__Op(code, Load, { tUvec3, invocation, vInvocation });
+		for (int a = 0; a < 3; a++) {
+			group[a] = id();
+			__Op(code, CompositeExtract, { tUint, group[a], invocation, (unsigned int)a });
+		}
+
+		auto coordinate = [&](const std::array<unsigned int, 3>& position) {
+			unsigned int unsignedCoordinate = id(), signedCoordinate = id();
+			__Op(code, CompositeConstruct, { tUvec3, unsignedCoordinate, position[0], position[1], position[2] });
+			__Op(code, Bitcast, { tIvec3, signedCoordinate, unsignedCoordinate });
+			return signedCoordinate;
+		};
+
+		// Each invocation owns a texel of the last level and the texels it covers in the levels above, unrolled.
+		// Texels are averages of their children. Texels past the level edge are computed but never written.
+		std::function<unsigned int(int, std::array<unsigned int, 3>)> texel = [&](int level, std::array<unsigned int, 3> position) {
+			if (level == 0) {
+				std::array<unsigned int, 3> clamped = position;
+				for (int a = 0; a < axes; a++) {
+					unsigned int inside = id();
+					clamped[a] = id();
+					__Op(code, ULessThan, { tBool, inside, position[a], last[0][a] });
+					__Op(code, Select, { tUint, clamped[a], inside, position[a], last[0][a] });
+				}
+				unsigned int value = id();
+				__Op(code, ImageRead, { tVec4, value, images[0], coordinate(clamped) });
+				return value;
+			}
+
+			std::array<unsigned int, 3> doubled = position;
+			for (int a = 0; a < axes; a++) {
+				doubled[a] = id();
+				__Op(code, ShiftLeftLogical, { tUint, doubled[a], position[a], uintConstant(1) });
+			}
+			unsigned int sum = 0;
+			for (int child = 0; child < (1 << axes); child++) {
+				std::array<unsigned int, 3> childPosition = doubled;
+				for (int a = 0; a < axes; a++)
+					if (child & (1 << a)) {
+						childPosition[a] = id();
+						__Op(code, IAdd, { tUint, childPosition[a], doubled[a], step[level - 1][a] });
+					}
+				unsigned int value = texel(level - 1, childPosition);
+				if (sum == 0)
+					sum = value;
+				else {
+					unsigned int added = id();
+					__Op(code, FAdd, { tVec4, added, sum, value });
+					sum = added;
+				}
+			}
+			unsigned int average = id();
+			__Op(code, VectorTimesScalar, { tVec4, average, sum, cWeight });
+
+			unsigned int inside = 0;
+			for (int a = 0; a < axes; a++) {
+				unsigned int axisInside = id();
+				__Op(code, ULessThanEqual, { tBool, axisInside, position[a], last[level][a] });
+				if (inside == 0)
+					inside = axisInside;
+				else {
+					unsigned int both = id();
+					__Op(code, LogicalAnd, { tBool, both, inside, axisInside });
+					inside = both;
+				}
+			}
+			unsigned int write = id(), merge = id();
+			__Op(code, SelectionMerge, { merge, 0 });
+			__Op(code, BranchConditional, { inside, write, merge });
+			__Op(code, Label, { write });
+			__Op(code, ImageWrite, { images[level], coordinate(position), average });
+			__Op(code, Branch, { merge });
+			__Op(code, Label, { merge });
+			return average;
+		};
+		texel(levels, group);
+
+		__Op(code, Return, { });
+		__Op(code, FunctionEnd, { });
+
+		std::vector<unsigned int> module = { 0x07230203, 0x00010000, 0, bound, 0 };
+		for (const std::vector<unsigned int>* section : { &preamble, &annotations, &types, &code })
+			module.insert(module.end(), section->begin(), section->end());
+		return module;
+	}
+
+	std::vector<unsigned int> CullShader(bool compact) {
+		// Opcodes
+		enum : unsigned int {
+			Extension = 10, MemoryModel = 14, EntryPoint = 15, ExecutionMode = 16, Capability = 17,
+			TypeVoid = 19, TypeBool = 20, TypeInt = 21, TypeFloat = 22, TypeVector = 23, TypeArray = 28,
+			TypeRuntimeArray = 29, TypeStruct = 30, TypePointer = 32, TypeFunction = 33, Constant = 43,
+			Function = 54, FunctionEnd = 56, Variable = 59, Load = 61, Store = 62, AccessChain = 65, Decorate = 71,
+			MemberDecorate = 72, CompositeExtract = 81, Bitcast = 124, FNegate = 127, IAdd = 128, FAdd = 129, IMul = 132,
+			FMul = 133, LogicalAnd = 167, ULessThan = 176, FOrdGreaterThanEqual = 190, AtomicIAdd = 234,
+			SelectionMerge = 247, Label = 248, Branch = 249, BranchConditional = 250, Return = 253
+		};
+		// Storage classes
+		enum : unsigned int { Input = 1, Uniform = 2, PushConstant = 9 };
+
+		std::vector<unsigned int> preamble, annotations, types, code;
+		unsigned int bound = 1;
+		auto id = [&] { return bound++; };
+
+		__Op(preamble, Capability, { 1 }); // Shader
+		__Op(preamble, Capability, { 30 }); // StorageBufferArrayDynamicIndexing
+		__Op(preamble, Capability, { 5302 }); // RuntimeDescriptorArray
+		std::vector<unsigned int> extension = __Literal("SPV_EXT_descriptor_indexing");
+		__Op(preamble, Extension, extension);
+		__Op(preamble, MemoryModel, { 0, 1 }); // Logical GLSL450
+
+		unsigned int tVoid = id(), tFunction = id(), tBool = id(), tUint = id(), tFloat = id(), tUvec3 = id();
+		__Op(types, TypeVoid, { tVoid });
+		__Op(types, TypeFunction, { tFunction, tVoid });
+		__Op(types, TypeBool, { tBool });
+		__Op(types, TypeInt, { tUint, 32, 0 });
+		__Op(types, TypeFloat, { tFloat, 32 });
+		__Op(types, TypeVector, { tUvec3, tUint, 3 });
+
+		std::map<unsigned int, unsigned int> constants;
+		auto uintConstant = [&](unsigned int value) {
+			unsigned int& constant = constants[value];
+			if (constant == 0) {
+				constant = id();
+				__Op(types, Constant, { tUint, constant, value });
+			}
+			return constant;
+		};
+
+		// Storage buffers of the descriptor heap: set 0, binding 2, each one a block of words
+		unsigned int tWords = id(), tBuffer = id(), tBuffers = id(), tBuffersPointer = id(), tBufferWordPointer = id(), vBuffers = id();
+		__Op(types, TypeRuntimeArray, { tWords, tUint });
+		__Op(types, TypeStruct, { tBuffer, tWords });
+		__Op(types, TypeRuntimeArray, { tBuffers, tBuffer });
+		__Op(types, TypePointer, { tBuffersPointer, Uniform, tBuffers });
+		__Op(types, TypePointer, { tBufferWordPointer, Uniform, tUint });
+		__Op(types, Variable, { tBuffersPointer, vBuffers, Uniform });
+		__Op(annotations, Decorate, { tWords, 6, 4 }); // ArrayStride
+		__Op(annotations, MemberDecorate, { tBuffer, 0, 35, 0 }); // Offset
+		__Op(annotations, Decorate, { tBuffer, 3 }); // BufferBlock
+		__Op(annotations, Decorate, { vBuffers, 34, 0 }); // DescriptorSet
+		__Op(annotations, Decorate, { vBuffers, 33, 2 }); // Binding
+
+		// Push constants: instances index, draws index, instance count and the planes
+		unsigned int tArray = id(), tBlock = id(), tBlockPointer = id(), tWordPointer = id(), vConstants = id();
+		__Op(types, TypeArray, { tArray, tUint, uintConstant(3 + 6 * 4) });
+		__Op(types, TypeStruct, { tBlock, tArray });
+		__Op(types, TypePointer, { tBlockPointer, PushConstant, tBlock });
+		__Op(types, TypePointer, { tWordPointer, PushConstant, tUint });
+		__Op(types, Variable, { tBlockPointer, vConstants, PushConstant });
+		__Op(annotations, Decorate, { tArray, 6, 4 }); // ArrayStride
+		__Op(annotations, MemberDecorate, { tBlock, 0, 35, 0 }); // Offset
+		__Op(annotations, Decorate, { tBlock, 2 }); // Block
+
+		unsigned int tInputPointer = id(), vInvocation = id();
+		__Op(types, TypePointer, { tInputPointer, Input, tUvec3 });
+		__Op(types, Variable, { tInputPointer, vInvocation, Input });
+		__Op(annotations, Decorate, { vInvocation, 11, 28 }); // BuiltIn GlobalInvocationId
+
+		unsigned int fMain = id();
+		std::vector<unsigned int> entryPoint = { 5, fMain }; // GLCompute
+		std::vector<unsigned int> name = __Literal("main");
+		entryPoint.insert(entryPoint.end(), name.begin(), name.end());
+		entryPoint.push_back(vInvocation);
+		__Op(preamble, EntryPoint, entryPoint);
+		__Op(preamble, ExecutionMode, { fMain, 17, 64, 1, 1 }); // LocalSize
+
+		__Op(code, Function, { tVoid, fMain, 0, tFunction });
+		__Op(code, Label, { id() });
+
+		auto word = [&](unsigned int index) {
+			unsigned int pointer = id(), value = id();
+			__Op(code, AccessChain, { tWordPointer, pointer, vConstants, uintConstant(0), uintConstant(index) });
+			__Op(code, Load, { tUint, value, pointer });
+			return value;
+		};
+		auto bufferWord = [&](unsigned int buffer, unsigned int index) {
+			unsigned int pointer = id();
+			__Op(code, AccessChain, { tBufferWordPointer, pointer, vBuffers, buffer, uintConstant(0), index });
+			return pointer;
+		};
+		auto asFloat = [&](unsigned int value) {
+			unsigned int result = id();
+			__Op(code, Bitcast, { tFloat, result, value });
+			return result;
+		};
+		auto binary = [&](unsigned int opcode, unsigned int type, unsigned int a, unsigned int b) {
+			unsigned int result = id();
+			__Op(code, opcode, { type, result, a, b });
+			return result;
+		};
+
+		unsigned int invocation = id(), instance = id();
+		__Op(code, Load, { tUvec3, invocation, vInvocation });
+		__Op(code, CompositeExtract, { tUint, instance, invocation, 0 });
+		unsigned int instances = word(0), draws = word(1), count = word(2);
+
+		// Invocations past the last instance do nothing
+		unsigned int inside = binary(ULessThan, tBool, instance, count);
+		unsigned int body = id(), end = id();
+		__Op(code, SelectionMerge, { end, 0 });
+		__Op(code, BranchConditional, { inside, body, end });
+		__Op(code, Label, { body });
+
+		unsigned int first = binary(IMul, tUint, instance, uintConstant(8));
+		unsigned int fields[8];
+		for (unsigned int i = 0; i < 8; i++) {
+			fields[i] = id();
+			__Op(code, Load, { tUint, fields[i], bufferWord(instances, binary(IAdd, tUint, first, uintConstant(i))) });
+		}
+		unsigned int center[3] = { asFloat(fields[0]), asFloat(fields[1]), asFloat(fields[2]) };
+		unsigned int negativeRadius = id();
+		__Op(code, FNegate, { tFloat, negativeRadius, asFloat(fields[3]) });
+
+		// The sphere is visible unless it is entirely behind a plane
+		unsigned int visible = 0;
+		for (unsigned int plane = 0; plane < 6; plane++) {
+			unsigned int distance = asFloat(word(3 + 4 * plane + 3));
+			for (unsigned int a = 0; a < 3; a++)
+				distance = binary(FAdd, tFloat, distance, binary(FMul, tFloat, asFloat(word(3 + 4 * plane + a)), center[a]));
+			unsigned int front = binary(FOrdGreaterThanEqual, tBool, distance, negativeRadius);
+			visible = visible == 0 ? front : binary(LogicalAnd, tBool, visible, front);
+		}
+
+		unsigned int write = id(), written = id();
+		__Op(code, SelectionMerge, { written, 0 });
+		__Op(code, BranchConditional, { visible, write, written });
+		__Op(code, Label, { write });
+		unsigned int slot = instance;
+		if (compact) {
+			slot = id();
+			__Op(code, AtomicIAdd, { tUint, slot, bufferWord(draws, uintConstant(0)), uintConstant(1), uintConstant(0), uintConstant(1) }); // Device scope, relaxed
+		}
+		unsigned int command = binary(IAdd, tUint, binary(IMul, tUint, slot, uintConstant(5)), uintConstant(4));
+		unsigned int values[5] = { fields[4], uintConstant(1), fields[5], fields[6], fields[7] };
+		for (unsigned int i = 0; i < 5; i++)
+			__Op(code, Store, { bufferWord(draws, i == 0 ? command : binary(IAdd, tUint, command, uintConstant(i))), values[i] });
+		__Op(code, Branch, { written });
+		__Op(code, Label, { written });
+		__Op(code, Branch, { end });
+		__Op(code, Label, { end });
+
+		__Op(code, Return, { });
+		__Op(code, FunctionEnd, { });
+
+		std::vector<unsigned int> module = { 0x07230203, 0x00010000, 0, bound, 0 };
+		for (const std::vector<unsigned int>* section : { &preamble, &annotations, &types, &code })
+			module.insert(module.end(), section->begin(), section->end());
+		return module;
+	}
+
+#pragma endregion
+
+#pragma region Image Encoding
+
+	const char* FileExtension(FrameOutputFormat format) {
+		switch (format) {
+		case FrameOutputFormat::RAW: return ".raw";
+		case FrameOutputFormat::PPM: return ".ppm";
+		case FrameOutputFormat::PNG: return ".png";
+		case FrameOutputFormat::EXR: return ".exr";
+		default:
+			throw std::runtime_error("Unsupported output format");
+		}
+	}
+
+	static inline int __PixelSize(PixelLayout layout) {
+		return layout == PixelLayout::RGBA32F ? 16 : 4;
+	}
+
+	/// <summary>
+	/// Gets all pixels as 8 bits RGBA or BGRA values. Float pixels are sRGB encoded to RGBA by the conversion kernels
+	/// into converted, and layout changes accordingly.
+	/// </summary>
+	static const unsigned char* __As8Bits(const unsigned char* pixels, size_t count, PixelLayout& layout, std::vector<unsigned char>& converted) {
+		if (layout != PixelLayout::RGBA32F)
+			return pixels;
+		converted.resize(count * 4);
+		Formats::FloatToSRGB((const Formats::R32G32B32A32_SFLOAT*)pixels, (Formats::R8G8B8A8*)converted.data(), count);
+		layout = PixelLayout::RGBA8;
+		return converted.data();
+	}
+
+	/// <summary>
+	/// Gets all pixels as linear float RGBA values. 8 bits pixels are decoded by the conversion kernels into converted.
+	/// </summary>
+	static const float* __AsRGBA32F(const unsigned char* pixels, size_t count, PixelLayout layout, bool srgb, std::vector<float>& converted) {
+		if (layout == PixelLayout::RGBA32F)
+			return (const float*)pixels;
+		converted.resize(count * 4);
+		Formats::R32G32B32A32_SFLOAT* destination = (Formats::R32G32B32A32_SFLOAT*)converted.data();
+		if (srgb)
+			Formats::SRGBToFloat((const Formats::R8G8B8A8*)pixels, destination, count);
+		else
+			Formats::UnormToFloat((const Formats::R8G8B8A8*)pixels, destination, count);
+		if (layout == PixelLayout::BGRA8)
+			for (size_t i = 0; i < count; i++)
+				std::swap(destination[i].R, destination[i].B);
+		return converted.data();
+	}
+
+	/// <summary>
+	/// Gets a 8 bits pixel as RGBA values.
+	/// </summary>
+	static inline void __ReadRGBA8(const unsigned char* pixel, PixelLayout layout, unsigned char* rgba) {
+		if (layout == PixelLayout::BGRA8) {
+			rgba[0] = pixel[2];
+			rgba[1] = pixel[1];
+			rgba[2] = pixel[0];
+			rgba[3] = pixel[3];
+		}
+		else
+			memcpy(rgba, pixel, 4);
+	}
+
+	static void __Append(std::vector<unsigned char>& output, const void* data, size_t size) {
+		output.insert(output.end(), (const unsigned char*)data, (const unsigned char*)data + size);
+	}
+
+	static void __AppendBE32(std::vector<unsigned char>& output, unsigned int value) {
+		unsigned char bytes[4] = { (unsigned char)(value >> 24), (unsigned char)(value >> 16), (unsigned char)(value >> 8), (unsigned char)value };
+		__Append(output, bytes, 4);
+	}
+
+	static unsigned int __Crc32(const unsigned char* data, size_t size, unsigned int crc) {
+		static const std::array<unsigned int, 256> table = [] {
+			std::array<unsigned int, 256> entries;
+			for (unsigned int i = 0; i < 256; i++) {
+				unsigned int c = i;
+				for (int k = 0; k < 8; k++)
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				entries[i] = c;
+			}
+			return entries;
+		}();
+
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++)
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	static void __AppendPNGChunk(std::vector<unsigned char>& output, const char* type, const std::vector<unsigned char>& data) {
+		__AppendBE32(output, (unsigned int)data.size());
+		size_t start = output.size();
+		__Append(output, type, 4);
+		__Append(output, data.data(), data.size());
+		__AppendBE32(output, __Crc32(output.data() + start, output.size() - start, 0));
+	}
+
+	static void __EncodePNG(const unsigned char* pixels, int width, int height, PixelLayout layout, std::vector<unsigned char>& output) {
+		static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		__Append(output, signature, 8);
+
+		std::vector<unsigned char> header;
+		__AppendBE32(header, width);
+		__AppendBE32(header, height);
+		unsigned char format[5] = { 8, 6, 0, 0, 0 }; // 8 bits RGBA, no interlace
+		__Append(header, format, 5);
+		__AppendPNGChunk(output, "IHDR", header);
+
+		// Scanlines without filtering
+		std::vector<unsigned char> converted;
+		pixels = __As8Bits(pixels, (size_t)width * height, layout, converted);
+		size_t rowSize = 1 + (size_t)width * 4;
+		std::vector<unsigned char> scanlines(rowSize * height);
+		for (int y = 0; y < height; y++) {
+			unsigned char* row = scanlines.data() + y * rowSize;
+			row[0] = 0;
+			const unsigned char* pixel = pixels + (size_t)y * width * 4;
+			if (layout == PixelLayout::RGBA8)
+				memcpy(row + 1, pixel, (size_t)width * 4);
+			else
+				for (int x = 0; x < width; x++, pixel += 4)
+					__ReadRGBA8(pixel, layout, row + 1 + x * 4);
+		}
+
+		// zlib stream with stored deflate blocks. Encoding speed matters more than size here.
+		std::vector<unsigned char> stream;
+		stream.reserve(scanlines.size() + scanlines.size() / 65535 * 5 + 16);
+		stream.push_back(0x78);
+		stream.push_back(0x01);
+		size_t offset = 0;
+		do {
+			unsigned int blockSize = (unsigned int)std::min<size_t>(65535, scanlines.size() - offset);
+			unsigned char block[5] = {
+				(unsigned char)(offset + blockSize == scanlines.size() ? 1 : 0),
+				(unsigned char)blockSize, (unsigned char)(blockSize >> 8),
+				(unsigned char)~blockSize, (unsigned char)(~blockSize >> 8) };
+			__Append(stream, block, 5);
+			__Append(stream, scanlines.data() + offset, blockSize);
+			offset += blockSize;
+		} while (offset < scanlines.size());
+
+		unsigned int a = 1, b = 0;
+		offset = 0;
+		while (offset < scanlines.size()) {
+			size_t end = std::min<size_t>(scanlines.size(), offset + 5552); // largest run without overflow
+			for (; offset < end; offset++) {
+				a += scanlines[offset];
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+		}
+		__AppendBE32(stream, (b << 16) | a);
+		__AppendPNGChunk(output, "IDAT", stream);
+
+		__AppendPNGChunk(output, "IEND", std::vector<unsigned char>());
+	}
+
+	static void __EncodePPM(const unsigned char* pixels, int width, int height, PixelLayout layout, std::vector<unsigned char>& output) {
+		std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+		__Append(output, header.data(), header.size());
+		size_t start = output.size();
+		output.resize(start + (size_t)width * height * 3);
+		unsigned char* rgb = output.data() + start;
+		unsigned char rgba[4];
+		std::vector<unsigned char> converted;
+		pixels = __As8Bits(pixels, (size_t)width * height, layout, converted);
+		for (size_t i = 0; i < (size_t)width * height; i++, pixels += 4) {
+			__ReadRGBA8(pixels, layout, rgba);
+			*rgb++ = rgba[0];
+			*rgb++ = rgba[1];
+			*rgb++ = rgba[2];
+		}
+	}
+
+	template<typename T>
+	static void __AppendLE(std::vector<unsigned char>& output, T value) {
+		__Append(output, &value, sizeof(T)); // little endian hosts
+	}
+
+	static void __AppendEXRAttribute(std::vector<unsigned char>& output, const char* name, const char* type, const std::vector<unsigned char>& value) {
+		__Append(output, name, strlen(name) + 1);
+		__Append(output, type, strlen(type) + 1);
+		__AppendLE<int>(output, (int)value.size());
+		__Append(output, value.data(), value.size());
+	}
+
+	static void __EncodeEXR(const unsigned char* pixels, int width, int height, PixelLayout layout, bool srgb, std::vector<unsigned char>& output) {
+		const unsigned char magic[4] = { 0x76, 0x2F, 0x31, 0x01 };
+		__Append(output, magic, 4);
+		__AppendLE<int>(output, 2); // single part scanline file
+
+		// Channels must be sorted by name
+		const char* channels[4] = { "A", "B", "G", "R" };
+		const int components[4] = { 3, 2, 1, 0 };
+		std::vector<unsigned char> value;
+		for (int c = 0; c < 4; c++) {
+			__Append(value, channels[c], 2);
+			__AppendLE<int>(value, 2); // FLOAT
+			__AppendLE<int>(value, 0); // pLinear and reserved
+			__AppendLE<int>(value, 1);
+			__AppendLE<int>(value, 1);
+		}
+		value.push_back(0);
+		__AppendEXRAttribute(output, "channels", "chlist", value);
+
+		value = { 0 }; // NO_COMPRESSION
+		__AppendEXRAttribute(output, "compression", "compression", value);
+
+		value.clear();
+		__AppendLE<int>(value, 0);
+		__AppendLE<int>(value, 0);
+		__AppendLE<int>(value, width - 1);
+		__AppendLE<int>(value, height - 1);
+		__AppendEXRAttribute(output, "dataWindow", "box2i", value);
+		__AppendEXRAttribute(output, "displayWindow", "box2i", value);
+
+		value = { 0 }; // INCREASING_Y
+		__AppendEXRAttribute(output, "lineOrder", "lineOrder", value);
+
+		value.clear();
+		__AppendLE<float>(value, 1.0f);
+		__AppendEXRAttribute(output, "pixelAspectRatio", "float", value);
+		__AppendEXRAttribute(output, "screenWindowWidth", "float", value);
+
+		value.clear();
+		__AppendLE<float>(value, 0.0f);
+		__AppendLE<float>(value, 0.0f);
+		__AppendEXRAttribute(output, "screenWindowCenter", "v2f", value);
+
+		output.push_back(0); // end of header
+
+		// Offset table followed by one scanline per block
+		int lineSize = width * 4 * sizeof(float);
+		unsigned long long offset = output.size() + (size_t)height * sizeof(unsigned long long);
+		for (int y = 0; y < height; y++, offset += 8 + lineSize)
+			__AppendLE<unsigned long long>(output, offset);
+
+		std::vector<float> converted;
+		const float* rgba = __AsRGBA32F(pixels, (size_t)width * height, layout, srgb, converted);
+		std::vector<float> line(width * 4);
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++, rgba += 4)
+				for (int c = 0; c < 4; c++)
+					line[c * width + x] = rgba[components[c]];
+			__AppendLE<int>(output, y);
+			__AppendLE<int>(output, lineSize);
+			__Append(output, line.data(), lineSize);
+		}
+	}
+
+	void EncodeImage(FrameOutputFormat format, const unsigned char* pixels, int width, int height, PixelLayout layout, bool srgb, std::vector<unsigned char>& output) {
+		output.clear();
+		switch (format) {
+		case FrameOutputFormat::RAW:
+			__Append(output, pixels, (size_t)width * height * __PixelSize(layout));
+			break;
+		case FrameOutputFormat::PPM:
+			__EncodePPM(pixels, width, height, layout, output);
+			break;
+		case FrameOutputFormat::PNG:
+			__EncodePNG(pixels, width, height, layout, output);
+			break;
+		case FrameOutputFormat::EXR:
+			__EncodeEXR(pixels, width, height, layout, srgb, output);
+			break;
+		default:
+			throw std::runtime_error("Unsupported output format");
+		}
+	}
+
 #pragma endregion
 
 }
\ No newline at end of file